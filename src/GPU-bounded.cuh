@@ -0,0 +1,210 @@
+#ifndef __GPU_BOUNDED_CUH_H3VX8M2E
+#define __GPU_BOUNDED_CUH_H3VX8M2E
+
+// Kernels of the memory bounded search (--memory-limit), shared by the
+// pathway and the puzzle solvers.
+//
+// When the node arena or a heap is full, about half of the open list is
+// dropped, the entries with the largest fValue first: the fValue range of
+// the open list is split into PRUNE_BINS bins, see pruneCut(), and the bins
+// past the median go.  The nodes that neither an open list entry nor the
+// best solution leads back to are then compacted away, and the domain
+// indexes the arena again.  g_pruned keeps the smallest fValue dropped, a
+// lower bound of the optimal distance.
+//
+// The kernels run one thread per heap, or per node for the arena.  They are
+// included after the kernels of a domain, which provide for their `Heap'
+// and `Node'
+//
+//     uint32_t pruneKey(const Heap &), an order preserving key of the fValue
+//     uint32_t nodePrev(const Node &), the address of the parent
+//     void relinkNode(Node *, uint32_t prev)
+
+#include "utils.hpp"
+
+const int PRUNE_BINS = 1024;
+
+inline __device__ int pruneBin(float fValue, float low, float scale)
+{
+    return min((int)((fValue - low) * scale), PRUNE_BINS - 1);
+}
+
+// Restore the heap property of heap[1, heapSize]
+template<class Heap>
+inline __device__ void heapify(Heap heap[], int heapSize)
+{
+    for (int i = heapSize / 2; i >= 1; --i) {
+        Heap value = heap[i];
+        int now = i;
+        int next;
+        while ((next = now*2) <= heapSize) {
+            if (next+1 <= heapSize && heap[next+1] < heap[next])
+                ++next;
+            if (!(heap[next] < value))
+                break;
+            heap[now] = heap[next];
+            now = next;
+        }
+        heap[now] = value;
+    }
+}
+
+template<class Heap, int NT>
+__global__ void kHeapHistogram(
+    const Heap g_openList[],
+    const int g_heapSize[],
+    int heapCapacity,
+    int numHeap,
+    float low,
+    float scale,
+    int g_histogram[PRUNE_BINS]
+)
+{
+    __shared__ int s_histogram[PRUNE_BINS];
+    for (int i = THREAD_ID; i < PRUNE_BINS; i += NT)
+        s_histogram[i] = 0;
+    __syncthreads();
+
+    int gid = GLOBAL_ID;
+    if (gid < numHeap) {
+        const Heap *heap = g_openList + (size_t)heapCapacity * gid;
+        for (int i = 0; i < g_heapSize[gid]; ++i)
+            atomicAdd(&s_histogram[pruneBin(heap[i].fValue, low, scale)], 1);
+    }
+    __syncthreads();
+
+    for (int i = THREAD_ID; i < PRUNE_BINS; i += NT)
+        if (s_histogram[i])
+            atomicAdd(&g_histogram[i], s_histogram[i]);
+}
+
+// Drop the items out of the first `cut' bins
+template<class Heap, int NT>
+__global__ void kPruneHeaps(
+    Heap g_openList[],
+    int g_heapSize[],
+    int heapCapacity,
+    int numHeap,
+    float low,
+    float scale,
+    int cut,
+    uint32_t *g_pruned
+)
+{
+    int gid = GLOBAL_ID;
+    if (gid >= numHeap)
+        return;
+
+    Heap *heap = g_openList + (size_t)heapCapacity * gid - 1;
+    int heapSize = g_heapSize[gid];
+    int size = 0;
+    uint32_t pruned = UINT32_MAX;
+    for (int i = 1; i <= heapSize; ++i) {
+        if (pruneBin(heap[i].fValue, low, scale) < cut)
+            heap[++size] = heap[i];
+        else
+            pruned = min(pruned, pruneKey(heap[i]));
+    }
+    heapify(heap, size);
+    g_heapSize[gid] = size;
+    if (pruned != UINT32_MAX)
+        atomicMin(g_pruned, pruned);
+}
+
+// Set g_mark of the nodes on the path to every heap item and to the best
+// solution, and count them
+template<class Node, class Heap, int NT>
+__global__ void kMarkLive(
+    const Node g_nodes[],
+    const Heap g_openList[],
+    const int g_heapSize[],
+    int heapCapacity,
+    int numHeap,
+    const unsigned long long *g_solution,
+    uint32_t g_mark[],
+    int *g_liveSize
+)
+{
+    int gid = GLOBAL_ID;
+    if (gid >= numHeap)
+        return;
+
+    int count = 0;
+    if (gid == 0 && *g_solution != ULLONG_MAX) {
+        uint32_t addr = *g_solution & UINT32_MAX;
+        while (addr != UINT32_MAX && atomicExch(&g_mark[addr], 1) == 0) {
+            ++count;
+            addr = nodePrev(g_nodes[addr]);
+        }
+    }
+
+    const Heap *heap = g_openList + (size_t)heapCapacity * gid;
+    for (int i = 0; i < g_heapSize[gid]; ++i) {
+        // stops at the first node marked already, its path is marked too
+        uint32_t addr = heap[i].addr;
+        while (addr != UINT32_MAX && atomicExch(&g_mark[addr], 1) == 0) {
+            ++count;
+            addr = nodePrev(g_nodes[addr]);
+        }
+    }
+    atomicAdd(g_liveSize, count);
+}
+
+// Turn g_mark into the new address of the marked nodes, UINT32_MAX for the
+// dropped ones
+template<int NT>
+__global__ void kAssignLive(
+    uint32_t g_mark[],
+    int nodeSize,
+    int *g_liveSize
+)
+{
+    int gid = GLOBAL_ID;
+    if (gid < nodeSize)
+        g_mark[gid] = g_mark[gid] ? atomicAdd(g_liveSize, 1) : UINT32_MAX;
+}
+
+template<class Node, int NT>
+__global__ void kCompactNodes(
+    const Node g_nodes[],
+    int nodeSize,
+    const uint32_t g_mark[],
+    Node g_compacted[]
+)
+{
+    int gid = GLOBAL_ID;
+    if (gid >= nodeSize || g_mark[gid] == UINT32_MAX)
+        return;
+
+    Node node = g_nodes[gid];
+    uint32_t prev = nodePrev(node);
+    if (prev != UINT32_MAX)
+        relinkNode(&node, g_mark[prev]);
+    g_compacted[g_mark[gid]] = node;
+}
+
+template<class Heap, int NT>
+__global__ void kRemapHeaps(
+    Heap g_openList[],
+    const int g_heapSize[],
+    int heapCapacity,
+    int numHeap,
+    const uint32_t g_mark[],
+    unsigned long long *g_solution
+)
+{
+    int gid = GLOBAL_ID;
+    if (gid >= numHeap)
+        return;
+
+    if (gid == 0 && *g_solution != ULLONG_MAX) {
+        unsigned long long solution = *g_solution;
+        *g_solution = solution >> 32 << 32 | g_mark[solution & UINT32_MAX];
+    }
+
+    Heap *heap = g_openList + (size_t)heapCapacity * gid;
+    for (int i = 0; i < g_heapSize[gid]; ++i)
+        heap[i].addr = g_mark[heap[i].addr];
+}
+
+#endif /* end of include guard: __GPU_BOUNDED_CUH_H3VX8M2E */
@@ -0,0 +1,259 @@
+#ifndef __GPU_MEMORY_CUH_W7D2KQ4N
+#define __GPU_MEMORY_CUH_W7D2KQ4N
+
+// Runtime sizing of the device buffers shared by the GPU solvers.
+
+#include <cstring>
+#include <cuda_runtime.h>
+#include <moderngpu.cuh>
+
+#include "utils.hpp"
+
+// Share of the free device memory the node arena and the open list may take,
+// the rest is left to the sort buffers of moderngpu and to the driver.
+const double DEVICE_MEMORY_FRACTION = 0.9;
+// Share of that an unbounded search starts them with.  A buffer grows
+// through a copy into one twice as large, so the other two thirds are kept
+// for the buffers to double at least once.
+const double DEVICE_MEMORY_START = 1.0 / 3;
+
+inline size_t freeDeviceMemory()
+{
+    size_t freeMemory, totalMemory;
+    cudaMemGetInfo(&freeMemory, &totalMemory);
+    return freeMemory;
+}
+
+// --memory-limit in bytes, 0 when the search may take all the free memory
+inline size_t memoryLimit()
+{
+    return (size_t)vm_options["memory-limit"].as<int>() << 20;
+}
+
+// Bytes the node arena and the open list start with.  A `bounded' search
+// never grows them, it takes its whole share of the free memory at once but
+// no more than --memory-limit once the `used' bytes of the fixed size
+// buffers are taken out.  Any other search leaves room to grow.
+inline size_t deviceMemoryBudget(size_t used, bool bounded)
+{
+    size_t budget = freeDeviceMemory() * DEVICE_MEMORY_FRACTION;
+    if (!bounded)
+        return budget * DEVICE_MEMORY_START;
+    size_t limit = memoryLimit();
+    if (limit) {
+        if (used >= limit) {
+            cout << "--memory-limit is too small, the fixed size buffers "
+                 << "already take " << (used >> 20) << " MB" << endl;
+            exit(1);
+        }
+        budget = min(budget, limit - used);
+    }
+    return budget;
+}
+
+// Number of elements requested by the option `name', or `automatic' when the
+// option is left at 0.  Abort when the buffer cannot fit in `budget' bytes.
+inline size_t bufferSize(
+    const char *name, size_t automatic, size_t elementSize, size_t budget)
+{
+    size_t size = vm_options[name].as<int>();
+    if (size == 0)
+        size = automatic;
+    if (size * elementSize > budget) {
+        cout << "Not enough GPU memory for --" << name << "=" << size
+             << " (" << budget / elementSize << " at most)" << endl;
+        exit(1);
+    }
+    return size;
+}
+
+inline void outOfDeviceMemory(const char *what, size_t size)
+{
+    cout << "GPU out of memory: " << what << " cannot grow beyond "
+         << size << " elements" << endl;
+    exit(1);
+}
+
+// bytes of one staging buffer of uploadBuffer()
+const size_t UPLOAD_CHUNK = 32 << 20;
+
+// Copy `count' elements of `data' to a new device buffer.  A large buffer
+// goes through two pinned staging buffers in turn, so the host copy of a
+// chunk overlaps the transfer of the previous one instead of waiting for the
+// driver to stage all of the pageable memory.
+template<typename T>
+MGPU_MEM(T) uploadBuffer(CudaContext &context, const T *data, size_t count)
+{
+    size_t bytes = sizeof(T) * count;
+    if (bytes <= UPLOAD_CHUNK)
+        return context.Malloc<T>(data, count);
+
+    MGPU_MEM(T) buffer = context.Malloc<T>(count);
+    uint8_t *staging[2] = { NULL, NULL };
+    if (cudaHostAlloc((void **)&staging[0], UPLOAD_CHUNK,
+                      cudaHostAllocDefault) != cudaSuccess ||
+        cudaHostAlloc((void **)&staging[1], UPLOAD_CHUNK,
+                      cudaHostAllocDefault) != cudaSuccess) {
+        // no pinned memory left, let the driver stage it
+        cudaGetLastError();
+        cudaFreeHost(staging[0]);
+        cudaMemcpy(buffer->get(), data, bytes, cudaMemcpyHostToDevice);
+        return buffer;
+    }
+
+    cudaStream_t stream;
+    cudaEvent_t copied[2];
+    cudaStreamCreate(&stream);
+    cudaEventCreate(&copied[0]);
+    cudaEventCreate(&copied[1]);
+
+    const uint8_t *source = (const uint8_t *)data;
+    uint8_t *target = (uint8_t *)buffer->get();
+    for (size_t offset = 0, k = 0; offset < bytes;
+         offset += UPLOAD_CHUNK, ++k) {
+        int i = k % 2;
+        size_t size = min(UPLOAD_CHUNK, bytes - offset);
+        // the transfer out of this staging buffer two chunks ago is done
+        cudaEventSynchronize(copied[i]);
+        memcpy(staging[i], source + offset, size);
+        cudaMemcpyAsync(target + offset, staging[i], size,
+                        cudaMemcpyHostToDevice, stream);
+        cudaEventRecord(copied[i], stream);
+    }
+    cudaStreamSynchronize(stream);
+
+    cudaEventDestroy(copied[0]);
+    cudaEventDestroy(copied[1]);
+    cudaStreamDestroy(stream);
+    cudaFreeHost(staging[0]);
+    cudaFreeHost(staging[1]);
+    return buffer;
+}
+
+// Words of the device read back without stalling it.  issue() queues a copy
+// of a few device words into pinned memory on a stream of its own, taken once
+// the work queued so far on the default stream is done.  The host goes on
+// queuing rounds and picks the copy up later with wait(), the last two copies
+// are kept.
+class StatusPoll {
+public:
+    static const int MAX_WORD = 4;
+
+    StatusPoll() : m_words(NULL), m_numIssued(0) {}
+    ~StatusPoll() { release(); }
+
+    // Create the stream on the current device
+    void create() {
+        release();
+        cudaHostAlloc((void **)&m_words, sizeof(int) * 2 * MAX_WORD,
+                      cudaHostAllocDefault);
+        cudaStreamCreateWithFlags(&m_stream, cudaStreamNonBlocking);
+        for (int i = 0; i < 2; ++i) {
+            cudaEventCreateWithFlags(&m_queued[i], cudaEventDisableTiming);
+            cudaEventCreateWithFlags(&m_copied[i], cudaEventDisableTiming);
+        }
+        m_numIssued = 0;
+    }
+
+    // Free everything, before the device is reset
+    void release() {
+        if (!m_words)
+            return;
+        cudaStreamSynchronize(m_stream);
+        for (int i = 0; i < 2; ++i) {
+            cudaEventDestroy(m_queued[i]);
+            cudaEventDestroy(m_copied[i]);
+        }
+        cudaStreamDestroy(m_stream);
+        cudaFreeHost(m_words);
+        m_words = NULL;
+    }
+
+    // Forget the copies of a previous search
+    void reset() {
+        cudaStreamSynchronize(m_stream);
+        m_numIssued = 0;
+    }
+
+    // Queue a copy of the `count' device words `words'
+    void issue(int *const words[], int count) {
+        int i = m_numIssued++ % 2;
+        cudaEventRecord(m_queued[i], 0);
+        cudaStreamWaitEvent(m_stream, m_queued[i], 0);
+        for (int k = 0; k < count; ++k)
+            cudaMemcpyAsync(m_words + i * MAX_WORD + k, words[k], sizeof(int),
+                            cudaMemcpyDeviceToHost, m_stream);
+        cudaEventRecord(m_copied[i], m_stream);
+    }
+
+    // Wait for the copy issued `age' copies ago (0 for the last one, at most
+    // 1) and return its words, NULL if there is no such copy
+    const int *wait(int age) {
+        if (age >= m_numIssued)
+            return NULL;
+        int i = (m_numIssued - 1 - age) % 2;
+        cudaEventSynchronize(m_copied[i]);
+        return m_words + i * MAX_WORD;
+    }
+
+private:
+    int *m_words;
+    int m_numIssued;
+    cudaStream_t m_stream;
+    cudaEvent_t m_queued[2];
+    cudaEvent_t m_copied[2];
+};
+
+// Grow a buffer of `capacity' elements to `newCapacity', keeping the first
+// `size'.  Return false if the device has no room for the copy.
+template<typename T>
+bool growBuffer(
+    CudaContext &context, MGPU_MEM(T) &buffer,
+    size_t size, size_t newCapacity)
+{
+    if (sizeof(T) * newCapacity > freeDeviceMemory())
+        return false;
+    MGPU_MEM(T) grown = context.Malloc<T>(newCapacity);
+    cudaMemcpy(grown->get(), buffer->get(), sizeof(T) * size,
+               cudaMemcpyDeviceToDevice);
+    buffer = grown;
+    return true;
+}
+
+// Grow `numHeap' heaps of `capacity' elements, stored one after another, to
+// `newCapacity' elements each.  Return false if the device has no room.
+template<typename T>
+bool growHeaps(
+    CudaContext &context, MGPU_MEM(T) &heaps,
+    int numHeap, int capacity, int newCapacity)
+{
+    if (sizeof(T) * numHeap * newCapacity > freeDeviceMemory())
+        return false;
+    MGPU_MEM(T) grown = context.Malloc<T>((size_t)numHeap * newCapacity);
+    cudaMemcpy2D(grown->get(), sizeof(T) * newCapacity,
+                 heaps->get(), sizeof(T) * capacity,
+                 sizeof(T) * capacity, numHeap,
+                 cudaMemcpyDeviceToDevice);
+    heaps = grown;
+    return true;
+}
+
+// Number of leading bins of `histogram' that a pruning pass of the memory
+// bounded search keeps: about half of the items, and at least the first bin
+// that is not empty.  `dropped' is set to the number of items left out.
+inline int pruneCut(const vector<int> &histogram, int64_t *dropped)
+{
+    int64_t total = 0;
+    for (int i = 0; i < (int)histogram.size(); ++i)
+        total += histogram[i];
+
+    int64_t kept = 0;
+    int cut = 0;
+    while (cut < (int)histogram.size() &&
+           (kept == 0 || kept + histogram[cut] <= total / 2))
+        kept += histogram[cut++];
+    *dropped = total - kept;
+    return cut;
+}
+
+#endif /* end of include guard: __GPU_MEMORY_CUH_W7D2KQ4N */
@@ -0,0 +1,174 @@
+#ifndef __GPU_METRICS_CUH_K2P7WQ9D
+#define __GPU_METRICS_CUH_K2P7WQ9D
+
+// The round records of --metrics for the GPU solvers (see metrics.hpp).  The
+// kernels of a round are timed with events, the sizes are read back from the
+// device: a measured search waits for the device at every round.
+
+#include <map>
+#include <cuda_runtime.h>
+#include <moderngpu.cuh>
+
+#include "metrics.hpp"
+
+// Allocator of a context that counts the bytes of its live buffers, and keeps
+// their high water mark.  The buffers come from the allocator it replaced.
+class CountingAlloc : public mgpu::CudaAlloc {
+public:
+    CountingAlloc(mgpu::CudaAlloc *alloc)
+        : mgpu::CudaAlloc(alloc->Device()), m_alloc(alloc), m_used(0),
+          m_peak(0) { }
+
+    virtual cudaError_t Malloc(size_t size, void **p) {
+        cudaError_t error = m_alloc->Malloc(size, p);
+        if (error == cudaSuccess) {
+            m_size[*p] = size;
+            m_used += size;
+            m_peak = max(m_peak, m_used);
+        }
+        return error;
+    }
+
+    virtual bool Free(void *p) {
+        std::map<void *, size_t>::iterator it = m_size.find(p);
+        if (it != m_size.end()) {
+            m_used -= it->second;
+            m_size.erase(it);
+        }
+        return m_alloc->Free(p);
+    }
+
+    virtual void Clear() {
+        m_alloc->Clear();
+    }
+
+    size_t peak() const {
+        return m_peak;
+    }
+
+private:
+    mgpu::intrusive_ptr<mgpu::CudaAlloc> m_alloc;
+    std::map<void *, size_t> m_size;
+    size_t m_used;
+    size_t m_peak;
+};
+
+// Count the buffers allocated through `context' from now on, for --metrics.
+// Called on a new context, before its first buffer.
+inline void countDeviceMemory(mgpu::CudaContext &context)
+{
+    if (metrics.enabled())
+        context.SetAllocator(new CountingAlloc(context.GetAllocator()));
+}
+
+// Record the most device memory the buffers of `context' took at once: the
+// node arena, the open lists, the hash tables and the sort buffers.
+inline void recordDeviceMemory(const char *solver, mgpu::CudaContext &context)
+{
+    CountingAlloc *alloc =
+        dynamic_cast<CountingAlloc *>(context.GetAllocator());
+    if (!metrics.enabled() || !alloc)
+        return;
+    metrics.peak(solver, "device_memory_mb", alloc->peak() / 1048576.0);
+}
+
+class RoundProbe {
+public:
+    // the events of a round, in this order
+    enum { MARK_BEGIN, MARK_EXTRACT, MARK_DEDUP, MARK_INSERT, NUM_MARK };
+
+    RoundProbe(const char *solver) : m_active(metrics.enabled()) {
+        if (!m_active)
+            return;
+        m_round.solver = solver;
+        m_round.search = metrics.beginSearch();
+        for (int i = 0; i < NUM_MARK; ++i)
+            cudaEventCreate(&m_event[i]);
+    }
+
+    ~RoundProbe() {
+        if (!m_active)
+            return;
+        for (int i = 0; i < NUM_MARK; ++i)
+            cudaEventDestroy(m_event[i]);
+    }
+
+    bool active() const {
+        return m_active;
+    }
+
+    // Start the round `round': the fill of the `numHeap' heaps of
+    // `heapCapacity', each of them giving up to `popsPerHeap' nodes
+    void begin(int round, const int *g_heapSize, int numHeap,
+               int heapCapacity, int popsPerHeap) {
+        if (!m_active)
+            return;
+        int search = m_round.search;
+        string solver = m_round.solver;
+        m_round = round_metrics_t();
+        m_round.solver = solver;
+        m_round.search = search;
+        m_round.round = round;
+        for (int i = 0; i < NUM_MARK; ++i)
+            m_marked[i] = false;
+
+        vector<int> heapSize(numHeap);
+        cudaMemcpy(&heapSize[0], g_heapSize, sizeof(int) * numHeap,
+                   cudaMemcpyDeviceToHost);
+        int64_t total = 0;
+        m_round.pops = 0;
+        m_round.heapMin = INT_MAX;
+        m_round.heapMax = 0;
+        for (int i = 0; i < numHeap; ++i) {
+            m_round.pops += min(heapSize[i], popsPerHeap);
+            m_round.heapMin = min(m_round.heapMin, heapSize[i]);
+            m_round.heapMax = max(m_round.heapMax, heapSize[i]);
+            total += heapSize[i];
+        }
+        m_round.heapAvg = (double)total / numHeap;
+        m_round.heapCapacity = heapCapacity;
+        mark(MARK_BEGIN);
+    }
+
+    void mark(int k) {
+        if (!m_active)
+            return;
+        cudaEventRecord(m_event[k]);
+        m_marked[k] = true;
+    }
+
+    // the counters of the round, filled in by the solver
+    round_metrics_t &counters() {
+        return m_round;
+    }
+
+    // Finish the round, with `nodeSize' nodes in an arena of `nodeCapacity'
+    void end(int64_t nodeSize, int64_t nodeCapacity) {
+        if (!m_active)
+            return;
+        m_round.nodeSize = nodeSize;
+        m_round.nodeCapacity = nodeCapacity;
+        m_round.extractMs = elapsed(MARK_BEGIN, MARK_EXTRACT);
+        m_round.dedupMs = elapsed(MARK_EXTRACT, MARK_DEDUP);
+        m_round.insertMs = elapsed(m_marked[MARK_DEDUP] ? MARK_DEDUP
+                                   : MARK_EXTRACT, MARK_INSERT);
+        metrics.round(m_round);
+    }
+
+private:
+    float elapsed(int from, int to) {
+        if (!m_marked[from] || !m_marked[to])
+            return -1;
+        float ms;
+        cudaEventSynchronize(m_event[to]);
+        cudaEventElapsedTime(&ms, m_event[from], m_event[to]);
+        return ms;
+    }
+
+    bool m_active;
+    cudaEvent_t m_event[NUM_MARK];
+    bool m_marked[NUM_MARK];
+    round_metrics_t m_round;
+};
+
+#endif /* end of include guard: __GPU_METRICS_CUH_K2P7WQ9D */
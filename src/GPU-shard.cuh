@@ -0,0 +1,105 @@
+#ifndef __GPU_SHARD_CUH_Q5T0HW2B
+#define __GPU_SHARD_CUH_Q5T0HW2B
+
+// A single search spread over the devices of --devices.  Every device (a
+// shard) owns a part of the states: the pathway solver partitions the rows of
+// the grid, the puzzle solver the hash values of the states.  A round is
+//
+//     every shard extracts from its own heaps, expands, and buckets the
+//     successors by their owner into one outbox per shard,
+//     the host reads the minimum fValue extracted, the best solution and the
+//     outbox sizes of all the shards, and decides whether the search is over,
+//     the outboxes are copied peer-to-peer to their owners,
+//     every owner deduplicates what it received and pushes it into its heaps.
+//
+// A node refers to its parent through shardRef(), so a path can hop between
+// the devices.
+
+#include <sstream>
+#include <cuda_runtime.h>
+
+#include "utils.hpp"
+
+// the top bits of a parent reference select the shard
+const int SHARD_SHIFT = 28;
+const int MAX_SHARD = 1 << (32 - SHARD_SHIFT);
+const uint32_t SHARD_ADDR_MASK = (1u << SHARD_SHIFT) - 1;
+
+// A parent reference of the shard 0 is the bare address, so the solvers on a
+// single device never see the difference.  UINT32_MAX (no parent) is kept.
+inline __host__ __device__ uint32_t shardRef(int shard, uint32_t addr)
+{
+    return (uint32_t)shard << SHARD_SHIFT | addr;
+}
+
+inline __host__ __device__ int refShard(uint32_t ref)
+{
+    return ref >> SHARD_SHIFT;
+}
+
+inline __host__ __device__ uint32_t refAddr(uint32_t ref)
+{
+    return ref & SHARD_ADDR_MASK;
+}
+
+// The CUDA ordinals of --devices, or just --ordinal
+inline vector<int> deviceOrdinals()
+{
+    vector<int> ordinals;
+    if (!vm_options.count("devices")) {
+        ordinals.push_back(vm_options["ordinal"].as<int>());
+        return ordinals;
+    }
+
+    std::istringstream in(vm_options["devices"].as<string>());
+    string token;
+    while (getline(in, token, ',')) {
+        char *end;
+        long ordinal = strtol(token.c_str(), &end, 10);
+        if (token.empty() || *end || ordinal < 0 ||
+            std::find(ordinals.begin(), ordinals.end(), ordinal) !=
+            ordinals.end()) {
+            ordinals.clear();
+            break;
+        }
+        ordinals.push_back((int)ordinal);
+    }
+    if (ordinals.empty() || (int)ordinals.size() > MAX_SHARD) {
+        cout << "Please set your devices parameter (up to " << MAX_SHARD
+             << " distinct ordinals)." << endl
+             << "============================================================"
+             << endl
+             << endl;
+        help();
+    }
+    return ordinals;
+}
+
+// Let every device read the memory of the others where the hardware can,
+// cudaMemcpyPeer() goes through the host otherwise.
+inline void enablePeerAccess(const vector<int> &ordinals)
+{
+    for (int i = 0; i < (int)ordinals.size(); ++i) {
+        cudaSetDevice(ordinals[i]);
+        for (int j = 0; j < (int)ordinals.size(); ++j) {
+            int canAccess = 0;
+            if (i != j)
+                cudaDeviceCanAccessPeer(&canAccess, ordinals[i], ordinals[j]);
+            if (canAccess)
+                cudaDeviceEnablePeerAccess(ordinals[j], 0);
+        }
+    }
+    // clear cudaErrorPeerAccessAlreadyEnabled
+    cudaGetLastError();
+}
+
+// Copy `count' elements between the buffers of two devices
+template<typename T>
+void peerCopy(T *dst, int dstOrdinal, const T *src, int srcOrdinal,
+              size_t count)
+{
+    if (count)
+        cudaMemcpyPeer(dst, dstOrdinal, src, srcOrdinal, sizeof(T) * count);
+}
+
+#endif /* end of include guard: __GPU_SHARD_CUH_Q5T0HW2B */
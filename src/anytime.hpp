@@ -0,0 +1,230 @@
+#ifndef __ANYTIME_HPP_C3N8RV5E
+#define __ANYTIME_HPP_C3N8RV5E
+
+// Weighted A* (--weight) and the anytime schedule of --anytime.
+//
+// Every solver orders its open list by g + weight * h, and stops as soon as
+// the best solution found is not worse than the open list.  The heuristics
+// are admissible and consistent, so that solution costs at most `weight'
+// times the optimum, and cost / weight is a lower bound of the optimum.
+//
+// Under --anytime, the search is started over after every solution with
+// the weight halfway to 1 (restarting weighted A*), and the interim
+// solutions are printed, until a search with weight 1 or until the best
+// solution meets the best lower bound.
+//
+// weightedSolve() runs that schedule for the solvers of both problems, the
+// pathway distances are float and the puzzle steps int.
+
+#include <cctype>
+#include <cstdio>
+
+#include "utils.hpp"
+#include "metrics.hpp"
+
+// below this distance to 1, the next weight is 1
+const float ANYTIME_MIN_STEP = 0.05f;
+
+inline float searchWeight()
+{
+    float weight = vm_options["weight"].as<float>();
+    if (!(weight >= 1)) {
+        cout << "Please set your weight parameter to 1 or more." << endl
+             << "==============================================" << endl
+             << endl;
+        help();
+    }
+    return weight;
+}
+
+class AnytimeSchedule {
+public:
+    // `integral' when the costs are integers, which rounds up the bounds
+    explicit AnytimeSchedule(bool integral)
+        : m_weight(searchWeight()), m_anytime(vm_options.count("anytime")),
+          m_integral(integral), m_found(false), m_best(0), m_lower(0),
+          m_improved(false) { }
+
+    // weight of the next search
+    float weight() const { return m_weight; }
+
+    // Record the result of the search with weight(), return whether another
+    // search should follow.  `pruned' is a lower bound of the optimum when
+    // the search may have dropped a better solution (see --memory-limit),
+    // negative otherwise.  improved() tells whether the search found the
+    // best solution so far.
+    bool next(bool found, double cost, double pruned = -1) {
+        m_improved = found && (!m_found || cost < m_best);
+        if (!found)
+            return false;
+
+        double lower = cost / m_weight;
+        if (m_integral)
+            lower = ceil(lower - 1e-6);
+        if (pruned >= 0)
+            lower = min(lower, pruned);
+        if (m_improved)
+            m_best = cost;
+        m_lower = max(m_lower, lower);
+        m_found = true;
+
+        if (!m_anytime || m_weight == 1 || proven()) {
+            metrics.solved(m_best, m_lower);
+            return false;
+        }
+        m_weight = 1 + (m_weight - 1) / 2;
+        if (m_weight - 1 < ANYTIME_MIN_STEP)
+            m_weight = 1;
+        return true;
+    }
+
+    bool improved() const { return m_improved; }
+    // whether the best solution is known to be optimal
+    bool proven() const { return m_best <= m_lower * (1 + 1e-6); }
+    // the optimum is at least this
+    double lowerBound() const { return m_lower; }
+
+private:
+    float m_weight;
+    bool m_anytime;
+    bool m_integral;
+    bool m_found;
+    double m_best;
+    double m_lower;
+    bool m_improved;
+};
+
+// Best solution of the searches of weightedSolve()
+template<typename Cost>
+struct anytime_solution_t {
+    bool successful;
+    Cost optimal;
+    vector<int> pathList;
+    // `optimal' may not be optimal (--weight, --memory-limit), the optimum
+    // is at least `lowerBound'.  Set without a solution when the memory
+    // bounded search gave up.
+    bool bounded;
+    Cost lowerBound;
+
+    anytime_solution_t()
+        : successful(false), optimal(0), bounded(false), lowerBound(0) { }
+};
+
+inline const char *costName(float) { return "distance"; }
+inline const char *costName(int) { return "steps"; }
+
+inline string formatCost(float cost)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.3f", cost);
+    return buffer;
+}
+
+inline string formatCost(int cost)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%d", cost);
+    return buffer;
+}
+
+inline bool costAtMost(float a, float b)
+{
+    return a < b || float_equal(a, b);
+}
+
+inline bool costAtMost(int a, int b)
+{
+    return a <= b;
+}
+
+// Solve at --weight, and under --anytime again with the smaller weights,
+// keeping the best solution.  `restart' starts the search over, NULL when
+// solve() always does; it is skipped on the first pass when the solver is
+// `started' at --weight already (by its initialize()).  `lowerBound' (if
+// any) tells whether a memory bounded search pruned.
+template<class Solver, typename Cost>
+void weightedSolve(
+    Solver *solver, void (Solver::*restart)(),
+    bool (Solver::*lowerBound)(Cost *), bool started, const char *name,
+    anytime_solution_t<Cost> *s)
+{
+    AnytimeSchedule schedule(numeric_limits<Cost>::is_integer);
+    for (bool first = true; ; first = false) {
+        float weight = schedule.weight();
+        solver->setWeight(weight);
+        if (restart && !(first && started))
+            (solver->*restart)();
+
+        Cost optimal = 0;
+        vector<int> pathList;
+        bool found = solver->solve();
+        if (found)
+            solver->getSolution(&optimal, &pathList);
+        Cost pruned = -1;
+        if (lowerBound && !(solver->*lowerBound)(&pruned))
+            pruned = -1;
+        // the memory bounded search gave up
+        if (!found && pruned >= 0)
+            s->bounded = true;
+
+        bool more = schedule.next(found, optimal, pruned);
+        if (schedule.improved()) {
+            s->successful = true;
+            s->optimal = optimal;
+            s->pathList.swap(pathList);
+        }
+        if (!more)
+            break;
+        printf("\t\t %s %s with weight %.3f: %s\n", name, costName(optimal),
+               weight, formatCost(optimal).c_str());
+    }
+    if (s->successful) {
+        s->bounded = !schedule.proven();
+        s->lowerBound = (Cost)schedule.lowerBound();
+    }
+}
+
+// Same, for a solver that never prunes
+template<class Solver, typename Cost>
+void weightedSolve(
+    Solver *solver, void (Solver::*restart)(), bool started,
+    const char *name, anytime_solution_t<Cost> *s)
+{
+    bool (Solver::*lowerBound)(Cost *) = NULL;
+    weightedSolve(solver, restart, lowerBound, started, name, s);
+}
+
+// " > Optimal distance from CPU: 12.000" and the like
+template<typename Cost>
+void printCost(const anytime_solution_t<Cost> &s, const char *name)
+{
+    string what = costName(s.optimal);
+    if (s.bounded) {
+        what[0] = toupper(what[0]);
+        printf(" > %s from %s: %s, the optimal is at least %s\n",
+               what.c_str(), name, formatCost(s.optimal).c_str(),
+               formatCost(s.lowerBound).c_str());
+    } else {
+        printf(" > Optimal %s from %s: %s\n", what.c_str(), name,
+               formatCost(s.optimal).c_str());
+    }
+}
+
+// Exact solutions agree when they are equal, and a bounded one when its
+// range [lowerBound, optimal] meets the range of the other one.  A memory
+// bounded search that gave up agrees with anything.
+template<typename Cost>
+bool matches(const anytime_solution_t<Cost> &a,
+             const anytime_solution_t<Cost> &b)
+{
+    if (!a.successful || !b.successful) {
+        if ((!a.successful && a.bounded) || (!b.successful && b.bounded))
+            return true;
+        return a.successful == b.successful;
+    }
+    Cost aLower = a.bounded ? a.lowerBound : a.optimal;
+    Cost bLower = b.bounded ? b.lowerBound : b.optimal;
+    return costAtMost(aLower, b.optimal) && costAtMost(bLower, a.optimal);
+}
+
+#endif /* end of include guard: __ANYTIME_HPP_C3N8RV5E */
@@ -0,0 +1,334 @@
+#ifndef __HDA_STAR_HPP_K2P9WX4M
+#define __HDA_STAR_HPP_K2P9WX4M
+
+// Hash distributed A* (HDA*) on CPU threads, the --threads backend.
+//
+// Every state is owned by one thread, picked by the hash of the state, and
+// only its owner keeps its node and its open list entry.  A thread expands the
+// best nodes of its own open list and sends each successor to the owner
+// through a lock-free MPSC inbox, so the search state is never locked.
+//
+// Termination mirrors the optimalDistance check of the GPU solvers: the best
+// solution found is optimal once no open list holds a node with a smaller
+// fValue and no successor is in flight.  m_work counts the busy threads plus
+// the successors in flight, so it drops to 0 exactly when that happens.
+//
+// Domain provides
+//     state_t, cost_t, openlist_t (see open-list.hpp)
+//     uint64_t hash(const state_t &) const
+//     cost_t heuristic(const state_t &) const
+//     bool isGoal(const state_t &) const
+//     void expand(const state_t &, Visitor visit) const, which calls
+//         visit(const state_t &next, cost_t edgeCost) for every successor
+// and its methods are called from all the threads at once.
+//
+// This header needs C++11, keep it out of the nvcc translation units.
+
+#include "utils.hpp"
+#include "open-list.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// number of nodes expanded between two checks of the inbox
+const int HDA_EXPAND_BATCH = 64;
+// number of successors buffered for a thread before they are sent
+const int HDA_MESSAGE_BATCH = 64;
+// An idle thread yields, and sleeps once it has found nothing to do that many
+// times in a row, so it does not steal the core of a busy one.
+const int HDA_IDLE_SPIN = 64;
+const int HDA_IDLE_SLEEP_US = 50;
+
+// The domain hashes are not well mixed (a cell ID, the packed tiles), spread
+// them before picking the owner.
+inline uint64_t hdaMix(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+template<class Domain>
+class HDAStar {
+public:
+    typedef typename Domain::state_t state_t;
+    typedef typename Domain::cost_t cost_t;
+
+    HDAStar(const Domain &domain, int numThread)
+        : m_domain(domain), m_numThread(numThread) { }
+    ~HDAStar();
+
+    // Return whether the goal can be reached from `start'
+    bool solve(const state_t &start);
+    cost_t optimal() const { return m_incumbent; }
+    // states from the start to the goal
+    void getPath(vector<state_t> *path) const;
+    size_t numExpanded() const;
+
+private:
+    // a node is addressed by its owner and its index in the owner's pool,
+    // and a successor is sent to its owner as a node too
+    struct node_t {
+        state_t state;
+        cost_t gValue;
+        int prevOwner;
+        int prevIndex;
+    };
+
+    struct batch_t {
+        batch_t *next;
+        vector<node_t> nodes;
+    };
+
+    struct hasher_t {
+        const Domain *domain;
+        size_t operator()(const state_t &state) const {
+            return domain->hash(state);
+        }
+    };
+
+    struct worker_t {
+        explicit worker_t(const hasher_t &hasher)
+            : index(16, hasher), inbox(nullptr), numExpanded(0) { }
+
+        vector<node_t> nodes;
+        std::unordered_map<state_t, int, hasher_t> index;
+        typename Domain::openlist_t openList;
+        // Producers push whole batches on a stack and the owner takes all of
+        // them at once, so the queue is lock-free and has no ABA problem.
+        std::atomic<batch_t *> inbox;
+        // successors not sent yet, one batch per owner
+        vector<batch_t *> outbox;
+        size_t numExpanded;
+    };
+
+    int owner(const state_t &state) const {
+        return hdaMix(m_domain.hash(state)) % m_numThread;
+    }
+
+    void run(int tid);
+    void expand(int tid);
+    void receive(int tid, const node_t &node);
+    void send(int tid, int dest, const node_t &node);
+    void flush(int tid, int dest);
+    void post(int dest, batch_t *batch);
+
+    const Domain &m_domain;
+    int m_numThread;
+    vector< std::unique_ptr<worker_t> > m_workers;
+
+    std::atomic<long long> m_work;
+    std::atomic<cost_t> m_incumbent;
+    std::mutex m_goalMutex;
+    int m_goalOwner;
+    int m_goalIndex;
+};
+
+template<class Domain>
+HDAStar<Domain>::~HDAStar()
+{
+    for (auto &worker : m_workers) {
+        batch_t *batch = worker->inbox.load();
+        while (batch) {
+            batch_t *next = batch->next;
+            delete batch;
+            batch = next;
+        }
+        for (batch_t *batch : worker->outbox)
+            delete batch;
+    }
+}
+
+template<class Domain>
+bool HDAStar<Domain>::solve(const state_t &start)
+{
+    m_workers.clear();
+    for (int i = 0; i < m_numThread; ++i) {
+        m_workers.emplace_back(new worker_t(hasher_t{&m_domain}));
+        m_workers.back()->outbox.resize(m_numThread, nullptr);
+    }
+    m_incumbent = numeric_limits<cost_t>::max();
+    m_goalOwner = -1;
+    m_goalIndex = -1;
+
+    batch_t *batch = new batch_t;
+    batch->nodes.push_back(node_t{start, 0, -1, -1});
+    m_work = 1;
+    post(owner(start), batch);
+
+    vector<std::thread> threads;
+    for (int i = 0; i < m_numThread; ++i)
+        threads.emplace_back(&HDAStar::run, this, i);
+    for (auto &thread : threads)
+        thread.join();
+
+    return m_goalOwner != -1;
+}
+
+template<class Domain>
+void HDAStar<Domain>::run(int tid)
+{
+    worker_t &w = *m_workers[tid];
+    bool busy = false;
+    int idle = 0;
+
+    for (;;) {
+        batch_t *batch = w.inbox.exchange(nullptr);
+        if (batch && !busy) {
+            ++m_work;
+            busy = true;
+        }
+        while (batch) {
+            for (const node_t &node : batch->nodes)
+                receive(tid, node);
+            m_work -= batch->nodes.size();
+
+            batch_t *next = batch->next;
+            delete batch;
+            batch = next;
+        }
+
+        for (int k = 0; k < HDA_EXPAND_BATCH; ++k) {
+            if (w.openList.empty() || !(w.openList.topKey() < m_incumbent))
+                break;
+            expand(tid);
+        }
+        for (int i = 0; i < m_numThread; ++i)
+            flush(tid, i);
+
+        // nodes not better than the incumbent are never expanded
+        if (busy &&
+            (w.openList.empty() || !(w.openList.topKey() < m_incumbent))) {
+            --m_work;
+            busy = false;
+        }
+        if (busy) {
+            idle = 0;
+        } else {
+            if (m_work == 0)
+                return;
+            if (++idle < HDA_IDLE_SPIN) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(
+                    std::chrono::microseconds(HDA_IDLE_SLEEP_US));
+            }
+        }
+    }
+}
+
+template<class Domain>
+void HDAStar<Domain>::expand(int tid)
+{
+    worker_t &w = *m_workers[tid];
+    int handle = w.openList.pop();
+    // copied, the pool may move while the successors are added
+    node_t node = w.nodes[handle];
+    ++w.numExpanded;
+
+    if (m_domain.isGoal(node.state)) {
+        std::lock_guard<std::mutex> lock(m_goalMutex);
+        if (node.gValue < m_incumbent) {
+            m_incumbent = node.gValue;
+            m_goalOwner = tid;
+            m_goalIndex = handle;
+        }
+        return;
+    }
+
+    m_domain.expand(node.state, [&](const state_t &next, cost_t cost) {
+        node_t succ{next, node.gValue + cost, tid, handle};
+        int dest = owner(next);
+        if (dest == tid)
+            receive(tid, succ);
+        else
+            send(tid, dest, succ);
+    });
+}
+
+template<class Domain>
+void HDAStar<Domain>::receive(int tid, const node_t &node)
+{
+    worker_t &w = *m_workers[tid];
+    int handle;
+
+    auto it = w.index.find(node.state);
+    if (it == w.index.end()) {
+        handle = w.nodes.size();
+        w.nodes.push_back(node);
+        w.index.emplace(node.state, handle);
+    } else {
+        handle = it->second;
+        if (!(node.gValue < w.nodes[handle].gValue))
+            return;
+        // lowers the key, or reopens a closed node
+        w.nodes[handle] = node;
+    }
+
+    cost_t fValue = node.gValue + m_domain.heuristic(node.state);
+    if (fValue < m_incumbent)
+        w.openList.update(handle, fValue);
+}
+
+template<class Domain>
+void HDAStar<Domain>::send(int tid, int dest, const node_t &node)
+{
+    batch_t *&batch = m_workers[tid]->outbox[dest];
+    if (!batch)
+        batch = new batch_t;
+    batch->nodes.push_back(node);
+    if ((int)batch->nodes.size() >= HDA_MESSAGE_BATCH)
+        flush(tid, dest);
+}
+
+template<class Domain>
+void HDAStar<Domain>::flush(int tid, int dest)
+{
+    batch_t *&batch = m_workers[tid]->outbox[dest];
+    if (!batch)
+        return;
+    // counted before it can be received
+    m_work += batch->nodes.size();
+    post(dest, batch);
+    batch = nullptr;
+}
+
+template<class Domain>
+void HDAStar<Domain>::post(int dest, batch_t *batch)
+{
+    std::atomic<batch_t *> &inbox = m_workers[dest]->inbox;
+    batch->next = inbox.load();
+    while (!inbox.compare_exchange_weak(batch->next, batch)) { }
+}
+
+template<class Domain>
+void HDAStar<Domain>::getPath(vector<state_t> *path) const
+{
+    path->clear();
+    int owner = m_goalOwner;
+    int index = m_goalIndex;
+    while (owner != -1) {
+        const node_t &node = m_workers[owner]->nodes[index];
+        path->push_back(node.state);
+        owner = node.prevOwner;
+        index = node.prevIndex;
+    }
+    std::reverse(path->begin(), path->end());
+}
+
+template<class Domain>
+size_t HDAStar<Domain>::numExpanded() const
+{
+    size_t count = 0;
+    for (auto &worker : m_workers)
+        count += worker->numExpanded;
+    return count;
+}
+
+#endif /* end of include guard: __HDA_STAR_HPP_K2P9WX4M */
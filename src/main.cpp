@@ -3,6 +3,7 @@
 #include <boost/program_options.hpp>
 
 #include "utils.hpp"
+#include "metrics.hpp"
 #include "pathway/pathway.hpp"
 #include "puzzle/puzzle.cuh"
 #include "problem.hpp"
@@ -28,6 +29,10 @@ uAstar can solves two kinds of problems.
      EXAMPLE (random generated graph with 50% paths blocked):
          ./uastar --pathway -H 5 -W 5 --input-module random  --block-rate 50
 
+     EXAMPLE (graph read from a PGM or PBM image, white cells are open):
+         ./uastar --pathway --input-module map --map-file map.pgm \
+                  --endpoints 0,0,511,511
+
 (2)  Solve the tile puzzle (or sliding puzzle) problem.  The
      ``Disjoint pattern database'' is used to accelerate the solving
      process.  For really large puzzle problem that tradition A* cannot
@@ -42,6 +47,7 @@ static po::options_description desc("uAstar Options");
 po::variables_map vm_options;
 boost::mt19937 random_engine;
 bool debug;
+Metrics metrics;
 
 void help()
 {
@@ -57,56 +63,86 @@ static string time_pass(std::chrono::steady_clock::time_point start_time)
     return "[" + time + "]";
 }
 
+// Run a phase of solve_problem() and record its time in the metrics
+template<typename Phase>
+static void run_phase(const char *name, Phase phase)
+{
+    metrics.beginPhase(name);
+    phase();
+    metrics.endPhase();
+}
+
 static void solve_problem(Problem &problem)
 {
     auto start_time = std::chrono::steady_clock::now();
     bool use_cpu = !vm_options.count("no-cpu");
     bool use_gpu = !vm_options.count("no-gpu");
+    int threads = vm_options["threads"].as<int>();
+    bool use_parallel = threads > 0;
 
     cout << time_pass(start_time)
          << " Generating input data ......"
          << endl;
-    problem.prepare();
+    run_phase("prepare", [&] { problem.prepare(); });
 
     if (use_cpu) {
         cout << time_pass(start_time)
             << " Initializing CPU data structure ......"
             << endl;
-        problem.cpuInitialize();
+        run_phase("cpu_initialize", [&] { problem.cpuInitialize(); });
     }
 
     if (use_gpu) {
         cout << time_pass(start_time)
              << " Initializing GPU data structure ......"
              << endl;
-        problem.gpuInitialize();
+        run_phase("gpu_initialize", [&] { problem.gpuInitialize(); });
+    }
+
+    if (use_parallel) {
+        cout << time_pass(start_time)
+             << " Initializing multi-threaded CPU data structure ......"
+             << endl;
+        run_phase("parallel_initialize",
+                  [&] { problem.parallelInitialize(); });
     }
 
     if (use_cpu) {
         cout << time_pass(start_time)
              << " Solving the problem on a pure CPU platform ......"
              << endl;
-        problem.cpuSolve();
+        run_phase("cpu_solve", [&] { problem.cpuSolve(); });
     }
 
     if (use_gpu) {
         cout << time_pass(start_time)
              << " Solving the problem with GPU acceleration ......"
              << endl;
-        problem.gpuSolve();
+        run_phase("gpu_solve", [&] { problem.gpuSolve(); });
     }
 
-    if (use_cpu || use_gpu) {
+    if (use_parallel) {
+        cout << time_pass(start_time)
+             << " Solving the problem on " << threads << " CPU threads ......"
+             << endl;
+        run_phase("parallel_solve", [&] { problem.parallelSolve(); });
+    }
+
+    if (use_cpu || use_gpu || use_parallel) {
         cout << time_pass(start_time)
              << " Checking the result ......"
              << endl;
-        if (!problem.output()) {
+        bool consistent;
+        run_phase("output", [&] { consistent = problem.output(); });
+        if (!consistent) {
+            metrics.write();
             cout << time_pass(start_time)
-                 << " ERROR: Output of the CPU and GPU is not consistent!"
+                 << " ERROR: Output of the solvers is not consistent!"
                  << endl;
             exit(1);
         }
     }
+    metrics.write();
 }
 
 int main(int argc, char *argv[])
@@ -126,20 +162,147 @@ int main(int argc, char *argv[])
          "    custom    -- Fetch the graph from system IO\n"
          "    zigzag    -- A kind of graph such that the optimal\n"
          "                 solution is a zig-zag path\n"
-         "    random    -- Random generated graph with 50\%\n"
-         "                 paths blocked"
+         "    random    -- Random generated graph with --block-rate\n"
+         "                 percent of the cells blocked\n"
+         "    map       -- Read the graph from the PGM (P5) or PBM\n"
+         "                 (P4) image --map-file, white is open"
          "\n"
          "For tile puzzle:\n"
          "    custom -- Fetch the problem from system IO\n"
          )
+        ("map-file", po::value<string>(),
+         "Image read by the map input module, its size is the size of the "
+         "graph")
+        ("endpoints", po::value<string>(),
+         "\"sx,sy,ex,ey\" of the first query of the map and random input "
+         "modules, by default the opposite corners and random cells")
+        ("query-file,q", po::value<string>(),
+         "Answer the extra queries listed in the file on the same graph, "
+         "one \"sx sy ex ey\" per line (only for --pathway)")
+        ("concurrent", po::value<int>()->default_value(1),
+         "Number of pathway queries solved concurrently on the GPU (not "
+         "with --bidirectional, --jump-pruning, --f-band, --memory-limit "
+         "or --poll-interval)")
+        ("poll-interval", po::value<int>()->default_value(1),
+         "Number of GPU search rounds queued before the host checks for "
+         "termination again.  The status is copied on a second stream and "
+         "checked one poll later, so the device is never left idle.  The "
+         "pathway search then deduplicates with --dedup hash")
+        ("dedup", po::value<string>()->default_value("sort"),
+         "How the GPU pathway solver merges duplicated successors:\n"
+         "    sort   -- Sort all the successors by their node ID\n"
+         "    hash   -- atomicMin into a scratch table keyed by node ID")
+        ("graph-layout", po::value<string>()->default_value("bytes"),
+         "How the pathway graph is stored:\n"
+         "    bytes   -- One byte of direction bits per cell\n"
+         "    bitmap  -- One bit per cell in 32x32 tiles")
+        ("node-layout", po::value<string>()->default_value("arena"),
+         "How the GPU pathway solver stores the nodes:\n"
+         "    arena    -- 16-byte nodes found through a hash table\n"
+         "    compact  -- 8 bytes per cell, no hash table and no sort")
+        ("bidirectional",
+         "Search the single pathway query on the GPU from both ends at "
+         "once, half of the heaps growing backward from the target "
+         "(arena node layout only)")
+        ("launch", po::value<string>()->default_value("default"),
+         "Launch geometry of the GPU pathway solver:\n"
+         "    default  -- 192 threads per block, 3 blocks per SM\n"
+         "    tune     -- Pick the fastest geometry for this device and\n"
+         "                problem size once, and cache it\n"
+         "    NB,NT,VT -- NB blocks of NT threads, VT values per thread")
+        ("launch-cache",
+         po::value<string>()->default_value("uastar-launch.cache"),
+         "File caching the result of --launch=tune")
+        ("open-list", po::value<string>()->default_value("heaps"),
+         "How the GPU puzzle solver keeps the open list:\n"
+         "    heaps    -- A binary heap per thread\n"
+         "    buckets  -- A bucket per fValue, the best entries of all the\n"
+         "                buckets are expanded every round (no --weight)")
+        ("gpu-engine", po::value<string>()->default_value("astar"),
+         "How the GPU puzzle solver searches:\n"
+         "    astar  -- A* over the open lists of all the threads\n"
+         "    ida    -- Batched IDA*, subtrees of a breadth first frontier\n"
+         "              per thread in a fixed device memory (not with\n"
+         "              --devices, --memory-limit, --open-list or --f-band)")
+        ("node-list-size", po::value<int>()->default_value(0),
+         "Number of nodes allocated on the GPU up front, 0 to size the node "
+         "list from the free device memory")
+        ("open-list-size", po::value<int>()->default_value(0),
+         "Number of open list entries allocated on the GPU up front, 0 to "
+         "size it automatically; the heaps grow when they fill up")
+        ("memory-limit", po::value<int>()->default_value(0),
+         "Device memory in MB the single query GPU search may use, 0 for "
+         "all of it.  Once the limit is reached the worst half of the open "
+         "list is pruned and the search goes on, reporting a lower bound of "
+         "the optimal solution when it may have pruned a better one")
+        ("jump-pruning",
+         "Prune the symmetric moves of the pathway search as Jump Point "
+         "Search does: a cell skips the neighbours its parent reaches "
+         "more cheaply on its own, usually 5 of 8 in the open areas.  The "
+         "solutions stay optimal (CPU and single query GPU searches, not "
+         "--bidirectional or --devices)")
+        ("hierarchy", po::value<int>()->default_value(0),
+         "Answer the CPU pathway queries with HPA*: cut the graph into "
+         "clusters of this side, link the entrances between them once, and "
+         "search that abstract graph before the cells.  The solutions may "
+         "cost a little more than the optimal ones, 0 to search the cells")
+        ("hierarchy-file", po::value<string>(),
+         "File caching the --hierarchy index, by default the --map-file "
+         "with the .hpa extension (none for the other input modules)")
+        ("weight", po::value<float>()->default_value(1.0f),
+         "Order the open lists by g + weight * h, so that the solutions cost "
+         "at most weight times the optimal one, 1 for optimal solutions")
+        ("f-band", po::value<float>()->default_value(-1.0f),
+         "Only extract the GPU heaps whose best fValue is within this band "
+         "of the smallest one of all the heaps, so that the threads do not "
+         "expand nodes much worse than the frontier; negative to extract "
+         "every heap (not for --concurrent pathway queries)")
+        ("anytime",
+         "After every solution, search again with the weight halfway to 1 "
+         "and print the interim solutions, until the best one is proven "
+         "optimal")
+        ("pdb-format", po::value<string>()->default_value("bytes"),
+         "How the puzzle pattern databases are stored on disk and on the "
+         "GPU:\n"
+         "    bytes    -- One byte per state\n"
+         "    nibbles  -- 4 bits per state, relative to the manhattan\n"
+         "                distance")
+        ("pdb-partition", po::value<string>()->default_value(""),
+         "Patterns of the puzzle heuristic, e.g. \"1,2,3/4,5,6,7,8\": tiles "
+         "separated by ',', patterns by '/' and partitions by ';'.  The "
+         "heuristic is the maximum over the partitions of the sum of their "
+         "patterns.  Empty for the default partition")
+        ("pdb-mirror", "Also take the maximum over the reflection of the "
+         "state about the diagonal, with the same pattern databases")
+        ("solution-format", po::value<string>()->default_value("text"),
+         "How the pathway solutions are written to solutionCPU/GPU:\n"
+         "    text    -- The cells of the path as text (.txt)\n"
+         "    binary  -- int32 height, width, length and cell IDs (.bin)")
         ("plot,p", po::value<string>(),
          "Plot the path to a BMP image (only for --pathway)")
         ("block-rate,b", po::value<int>(),
          "Set the block rate (1-99) (only for random module)")
         ("no-cpu,G", "Do not run sequential CPU-based A* search")
         ("no-gpu,C", "Do not run GPU-accelerated A* search")
+        ("threads", po::value<int>()->default_value(0),
+         "Also run hash distributed A* on this many CPU threads and check it "
+         "against the sequential CPU search, 0 to skip")
         ("ordinal,o", po::value<int>()->default_value(0), "Specify CUDA Ordinal")
+        ("devices", po::value<string>(),
+         "Spread the GPU search over these CUDA ordinals, e.g. \"0,1\".  The "
+         "devices own a band of the rows of the pathway graph or a range of "
+         "the hash values of the puzzle states, and exchange the successors "
+         "every round")
         ("seed,s", po::value<int>(), "Random seed of this run")
+        ("metrics", po::value<string>(),
+         "Write the time of every phase, counters of the solvers and one "
+         "record per GPU search round (pops, successors, duplicates, heap "
+         "fill, node arena and kernel times) to this file.  The GPU search "
+         "waits for the device at every round while it is measured")
+        ("metrics-format", po::value<string>()->default_value("json"),
+         "Format of --metrics:\n"
+         "    json  -- One object with the phases, counters and rounds\n"
+         "    csv   -- One table, a row per phase, counter or round")
         ;
 
     try {
@@ -163,6 +326,13 @@ int main(int argc, char *argv[])
     }
     if (vm_options.count("seed"))
         random_engine.seed(vm_options["seed"].as<int>());
+    string metrics_format = vm_options["metrics-format"].as<string>();
+    if (metrics_format != "json" && metrics_format != "csv") {
+        cout << "Please set your metrics-format parameter correctly." << endl
+             << "==================================================" << endl
+             << endl;
+        help();
+    }
 
     if (vm_options.count("pathway")) {
         Pathway pathway;
@@ -0,0 +1,268 @@
+#ifndef __METRICS_HPP_R4V8NX1C
+#define __METRICS_HPP_R4V8NX1C
+
+// Opt-in instrumentation of --metrics: the time of every phase of
+// solve_problem(), counters of the solvers and one record per round of the
+// GPU searches, written once the run is over as JSON or as one CSV table.
+// The heap fill of the rounds shows the load imbalance across the heaps, the
+// kernel times and the successors show where the throughput collapses.
+
+#include <cstdio>
+#include <time.h>
+
+#include "utils.hpp"
+
+// A round of a GPU search, a negative value is not measured by its solver
+struct round_metrics_t {
+    string solver;
+    int search;
+    int round;
+    // nodes extracted, successors generated, successors merged into another
+    // one of the round and entries pushed into the heaps
+    int pops;
+    int successors;
+    int duplicates;
+    int inserted;
+    // fill of the heaps before the round
+    int heapMin;
+    int heapMax;
+    double heapAvg;
+    int heapCapacity;
+    // node arena after the round
+    int64_t nodeSize;
+    int64_t nodeCapacity;
+    // kernel times in milliseconds
+    float extractMs;
+    float dedupMs;
+    float insertMs;
+
+    round_metrics_t()
+        : search(0), round(0), pops(-1), successors(-1), duplicates(-1),
+          inserted(-1), heapMin(-1), heapMax(-1), heapAvg(-1),
+          heapCapacity(-1), nodeSize(-1), nodeCapacity(-1),
+          extractMs(-1), dedupMs(-1), insertMs(-1) {}
+};
+
+class Metrics {
+public:
+    Metrics() : m_numSearch(0), m_phaseBegin(0), m_solved(false) {}
+
+    bool enabled() const {
+        return vm_options.count("metrics") != 0;
+    }
+
+    // A phase of solve_problem() starts, and ends with its time
+    void beginPhase(const string &name) {
+        m_phase = name;
+        m_phaseBegin = now();
+        m_solved = false;
+    }
+
+    void endPhase() {
+        m_phases.push_back(make_pair(m_phase, now() - m_phaseBegin));
+        m_phase.clear();
+    }
+
+    // The solver of the current `_solve' phase finished the schedule of a
+    // query with the solution `cost' and the lower bound `lower'.  The time
+    // to the first solution of the phase is kept.
+    void solved(double cost, double lower) {
+        string solver = phaseSolver();
+        if (solver.empty())
+            return;
+        if (!m_solved)
+            counter(solver, "first_solution_ms", now() - m_phaseBegin);
+        m_solved = true;
+        counter(solver, "solved", 1);
+        counter(solver, "cost", cost);
+        counter(solver, "lower_bound", lower);
+    }
+
+    // Raise the counter `name' of `solver' to `value'
+    void peak(const string &solver, const string &name, double value) {
+        for (size_t i = 0; i < m_counters.size(); ++i) {
+            if (m_counters[i].solver == solver && m_counters[i].name == name) {
+                m_counters[i].value = max(m_counters[i].value, value);
+                return;
+            }
+        }
+        counter(solver, name, value);
+    }
+
+    // Add `value' to the counter `name' of `solver'
+    void counter(const string &solver, const string &name, double value) {
+        for (size_t i = 0; i < m_counters.size(); ++i) {
+            if (m_counters[i].solver == solver && m_counters[i].name == name) {
+                m_counters[i].value += value;
+                return;
+            }
+        }
+        counter_t c = { solver, name, value };
+        m_counters.push_back(c);
+    }
+
+    // Number a new search, its rounds are numbered from 0
+    int beginSearch() {
+        return m_numSearch++;
+    }
+
+    void round(const round_metrics_t &r) {
+        m_rounds.push_back(r);
+    }
+
+    // Write everything to the file of --metrics.  The expansion rate of a
+    // solver is its `expanded' counter over the time of its `_solve' phase.
+    void write() const {
+        if (!enabled())
+            return;
+        string filename = vm_options["metrics"].as<string>();
+        FILE *fout = fopen(filename.c_str(), "w");
+        if (!fout) {
+            printf("ERROR: %s cannot be open for writting.", filename.c_str());
+            return;
+        }
+
+        vector<counter_t> counters = m_counters;
+        for (size_t i = 0; i < m_counters.size(); ++i) {
+            if (m_counters[i].name != "expanded")
+                continue;
+            for (size_t k = 0; k < m_phases.size(); ++k) {
+                if (m_phases[k].first == m_counters[i].solver + "_solve" &&
+                    m_phases[k].second > 0) {
+                    counter_t rate = { m_counters[i].solver, "expand_rate",
+                        m_counters[i].value * 1000 / m_phases[k].second };
+                    counters.push_back(rate);
+                }
+            }
+        }
+
+        if (vm_options["metrics-format"].as<string>() == "csv")
+            writeCSV(fout, counters);
+        else
+            writeJSON(fout, counters);
+        fclose(fout);
+    }
+
+private:
+    // in milliseconds
+    static double now() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+    }
+
+    // `cpu' in the phase `cpu_solve'
+    string phaseSolver() const {
+        const string suffix = "_solve";
+        if (m_phase.size() <= suffix.size() ||
+            m_phase.compare(m_phase.size() - suffix.size(), suffix.size(),
+                            suffix) != 0)
+            return string();
+        return m_phase.substr(0, m_phase.size() - suffix.size());
+    }
+
+    struct counter_t {
+        string solver;
+        string name;
+        double value;
+    };
+
+    static void writeValue(FILE *fout, double value, bool json) {
+        if (value >= 0)
+            fprintf(fout, "%.10g", value);
+        else if (json)
+            fprintf(fout, "null");
+    }
+
+    void writeRound(FILE *fout, const round_metrics_t &r, bool json) const {
+        const char *sep = json ? ", " : ",";
+        double values[] = {
+            (double)r.pops, (double)r.successors, (double)r.duplicates,
+            (double)r.inserted, (double)r.heapMin, (double)r.heapMax,
+            r.heapAvg, (double)r.heapCapacity, (double)r.nodeSize,
+            (double)r.nodeCapacity, r.extractMs, r.dedupMs, r.insertMs
+        };
+        for (int i = 0; i < ROUND_FIELDS; ++i) {
+            fprintf(fout, "%s", sep);
+            if (json)
+                fprintf(fout, "\"%s\": ", roundField(i));
+            writeValue(fout, values[i], json);
+        }
+    }
+
+    void writeJSON(FILE *fout, const vector<counter_t> &counters) const {
+        fprintf(fout, "{\n  \"phases\": [");
+        for (size_t i = 0; i < m_phases.size(); ++i) {
+            fprintf(fout, "%s\n    {\"name\": \"%s\", \"ms\": %.3f}",
+                    i ? "," : "", m_phases[i].first.c_str(),
+                    m_phases[i].second);
+        }
+        fprintf(fout, "\n  ],\n  \"counters\": [");
+        for (size_t i = 0; i < counters.size(); ++i) {
+            fprintf(fout, "%s\n    {\"solver\": \"%s\", \"name\": \"%s\", "
+                    "\"value\": %.10g}", i ? "," : "",
+                    counters[i].solver.c_str(), counters[i].name.c_str(),
+                    counters[i].value);
+        }
+        fprintf(fout, "\n  ],\n  \"rounds\": [");
+        for (size_t i = 0; i < m_rounds.size(); ++i) {
+            const round_metrics_t &r = m_rounds[i];
+            fprintf(fout, "%s\n    {\"solver\": \"%s\", \"search\": %d, "
+                    "\"round\": %d", i ? "," : "", r.solver.c_str(),
+                    r.search, r.round);
+            writeRound(fout, r, true);
+            fprintf(fout, "}");
+        }
+        fprintf(fout, "\n  ]\n}\n");
+    }
+
+    // One table: the phases and the counters fill `name' and `value', the
+    // rounds the other columns
+    void writeCSV(FILE *fout, const vector<counter_t> &counters) const {
+        fprintf(fout, "record,solver,name,value,search,round");
+        for (int i = 0; i < ROUND_FIELDS; ++i)
+            fprintf(fout, ",%s", roundField(i));
+        fprintf(fout, "\n");
+
+        string empty(ROUND_FIELDS, ',');
+        for (size_t i = 0; i < m_phases.size(); ++i) {
+            fprintf(fout, "phase,,%s,%.3f,,%s\n", m_phases[i].first.c_str(),
+                    m_phases[i].second, empty.c_str());
+        }
+        for (size_t i = 0; i < counters.size(); ++i) {
+            fprintf(fout, "counter,%s,%s,%.10g,,%s\n",
+                    counters[i].solver.c_str(), counters[i].name.c_str(),
+                    counters[i].value, empty.c_str());
+        }
+        for (size_t i = 0; i < m_rounds.size(); ++i) {
+            const round_metrics_t &r = m_rounds[i];
+            fprintf(fout, "round,%s,,,%d,%d", r.solver.c_str(),
+                    r.search, r.round);
+            writeRound(fout, r, false);
+            fprintf(fout, "\n");
+        }
+    }
+
+    // the columns of writeRound()
+    static const int ROUND_FIELDS = 13;
+    static const char *roundField(int i) {
+        static const char *const names[ROUND_FIELDS] = {
+            "pops", "successors", "duplicates", "inserted", "heap_min",
+            "heap_max", "heap_avg", "heap_capacity", "node_size",
+            "node_capacity", "extract_ms", "dedup_ms", "insert_ms"
+        };
+        return names[i];
+    }
+
+    int m_numSearch;
+    string m_phase;
+    double m_phaseBegin;
+    bool m_solved;
+    vector< pair<string, double> > m_phases;
+    vector<counter_t> m_counters;
+    vector<round_metrics_t> m_rounds;
+};
+
+extern Metrics metrics;
+
+#endif /* end of include guard: __METRICS_HPP_R4V8NX1C */
@@ -0,0 +1,193 @@
+#ifndef __OPEN_LIST_HPP_R4V8NJ2T
+#define __OPEN_LIST_HPP_R4V8NJ2T
+
+// Open lists of the CPU solvers.
+//
+// Items are dense integer handles (0, 1, 2, ...) given out by the solver, so
+// the position of every item is kept in a flat array and its key is lowered
+// in place instead of pushing a duplicate.  Both lists share the interface
+//
+//     update(handle, key)   insert the handle, or lower its key
+//     top(), topKey()       handle with the smallest key
+//     pop()                 remove and return that handle
+//
+// and a solver picks one through a template parameter.
+
+#include "utils.hpp"
+
+// Bucket queue for small non negative integer keys, e.g. the fValue of the
+// puzzles.  Ties are broken LIFO, which favors the deepest node of a layer.
+template<typename Key = int>
+class BucketQueue {
+public:
+    BucketQueue() : m_size(0), m_cursor(0) { }
+
+    void clear() {
+        for (size_t i = 0; i < m_buckets.size(); ++i)
+            m_buckets[i].clear();
+        m_position.clear();
+        m_key.clear();
+        m_size = 0;
+        m_cursor = 0;
+    }
+
+    bool empty() const { return m_size == 0; }
+    int size() const { return m_size; }
+
+    void update(int handle, Key key) {
+        assert(key >= 0);
+        if (handle >= (int)m_position.size()) {
+            m_position.resize(handle + 1, -1);
+            m_key.resize(handle + 1);
+        }
+        if (m_position[handle] != -1) {
+            if (key >= m_key[handle])
+                return;
+            remove(handle);
+        }
+
+        if (key >= (Key)m_buckets.size())
+            m_buckets.resize(key + 1);
+        vector<int> &bucket = m_buckets[key];
+        m_position[handle] = bucket.size();
+        m_key[handle] = key;
+        bucket.push_back(handle);
+        if (key < m_cursor)
+            m_cursor = key;
+        ++m_size;
+    }
+
+    int top() {
+        seek();
+        return m_buckets[m_cursor].back();
+    }
+
+    Key topKey() {
+        seek();
+        return m_cursor;
+    }
+
+    int pop() {
+        int handle = top();
+        remove(handle);
+        return handle;
+    }
+
+private:
+    void seek() {
+        while (m_buckets[m_cursor].empty())
+            ++m_cursor;
+    }
+
+    void remove(int handle) {
+        vector<int> &bucket = m_buckets[m_key[handle]];
+        int last = bucket.back();
+        bucket[m_position[handle]] = last;
+        m_position[last] = m_position[handle];
+        bucket.pop_back();
+        m_position[handle] = -1;
+        --m_size;
+    }
+
+    vector< vector<int> > m_buckets;
+    // index of a handle in its bucket, -1 when it is not in the list
+    vector<int> m_position;
+    vector<Key> m_key;
+    int m_size;
+    // no bucket below the cursor holds an item
+    Key m_cursor;
+};
+
+// D-ary min heap for any ordered key, e.g. the float fValue of the pathway.
+// A wider heap is shallower and the D children of a node share cache lines.
+template<typename Key, int D = 4>
+class DaryHeap {
+public:
+    void clear() {
+        m_heap.clear();
+        m_position.clear();
+    }
+
+    bool empty() const { return m_heap.empty(); }
+    int size() const { return m_heap.size(); }
+
+    void update(int handle, Key key) {
+        if (handle >= (int)m_position.size())
+            m_position.resize(handle + 1, -1);
+
+        int now = m_position[handle];
+        if (now == -1) {
+            item_t item;
+            item.key = key;
+            item.handle = handle;
+            now = m_heap.size();
+            m_heap.push_back(item);
+        } else if (key < m_heap[now].key) {
+            m_heap[now].key = key;
+        } else
+            return;
+        siftUp(now);
+    }
+
+    int top() const { return m_heap[0].handle; }
+    Key topKey() const { return m_heap[0].key; }
+
+    int pop() {
+        int handle = m_heap[0].handle;
+        m_position[handle] = -1;
+
+        item_t last = m_heap.back();
+        m_heap.pop_back();
+        if (!m_heap.empty()) {
+            m_heap[0] = last;
+            siftDown(0);
+        }
+        return handle;
+    }
+
+private:
+    struct item_t {
+        Key key;
+        int handle;
+    };
+
+    void place(int index, const item_t &item) {
+        m_heap[index] = item;
+        m_position[item.handle] = index;
+    }
+
+    void siftUp(int now) {
+        item_t item = m_heap[now];
+        while (now > 0) {
+            int next = (now - 1) / D;
+            if (!(item.key < m_heap[next].key))
+                break;
+            place(now, m_heap[next]);
+            now = next;
+        }
+        place(now, item);
+    }
+
+    void siftDown(int now) {
+        item_t item = m_heap[now];
+        int size = m_heap.size();
+        int next;
+        while ((next = now * D + 1) < size) {
+            int end = min(next + D, size);
+            for (int i = next + 1; i < end; ++i)
+                if (m_heap[i].key < m_heap[next].key)
+                    next = i;
+            if (!(m_heap[next].key < item.key))
+                break;
+            place(now, m_heap[next]);
+            now = next;
+        }
+        place(now, item);
+    }
+
+    vector<item_t> m_heap;
+    // index of a handle in the heap, -1 when it is not in the list
+    vector<int> m_position;
+};
+
+#endif /* end of include guard: __OPEN_LIST_HPP_R4V8NJ2T */
@@ -1,87 +1,107 @@
 #include "pathway/CPU-solver.hpp"
+#include "pathway/pruning.hpp"
+#include "metrics.hpp"
 
-#include <queue>
-#include <unordered_set>
-#include <unordered_map>
-
-struct node_t {
-    int id;
-    float dist;
-    node_t *prev;
-    node_t() = default;
-    node_t(int id, float dist, node_t *prev)
-        : id(id), dist(dist), prev(prev) { }
+// number of cells in a chunk, as a power of two
+const int CHUNK_BITS = 16;
+const int CHUNK_SIZE = 1 << CHUNK_BITS;
+
+// The moves of the graph for pruneMoves()
+struct PathwayGraph {
+    const Pathway *p;
+
+    bool canMove(int x, int y, int dx, int dy) const {
+        if (!p->inrange(x + dx, y + dy))
+            return false;
+        uint8_t mask = p->edgeMask(p->toID(x, y));
+        for (int i = 0; i < 8; ++i)
+            if (DX[i] == dx && DY[i] == dy)
+                return mask & 1 << i;
+        return false;
+    }
 };
 
 CPUPathwaySolver::CPUPathwaySolver(Pathway *pathway)
-    : p(pathway)
+    : p(pathway), m_weight(1),
+      m_jumpPruning(vm_options.count("jump-pruning"))
 {
     // pass
 }
 
 CPUPathwaySolver::~CPUPathwaySolver()
 {
-    for (auto &pair : globalList)
-        delete pair.second;
-    globalList.clear();
+    // pass
 }
 
 void CPUPathwaySolver::initialize()
 {
-    for (auto &pair : globalList)
-        delete pair.second;
-    globalList.clear();
+    int numChunk = (p->size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    m_chunks.resize(numChunk);
+    m_dirty.resize(numChunk, false);
+    for (int chunk : m_touchedChunks)
+        m_dirty[chunk] = false;
+    m_touchedChunks.clear();
 
-    openList = decltype(openList)();
-    closeList.clear();
+    openList.clear();
+    m_handleCell.clear();
 
     targetID = p->toID(p->ex(), p->ey());
+    optimalID = -1;
 
     int startID = p->toID(p->sx(), p->sy());
-    node_t *startNode = new node_t(startID, 0, nullptr);
-    openList.push(make_pair(computeFValue(startNode), startNode));
-    globalList[startNode->id] = startNode;
+    cell_t &start = cell(startID);
+    start.dist = 0;
+    start.handle = 0;
+    m_handleCell.push_back(startID);
+    openList.update(start.handle, computeFValue(startID, 0));
+}
+
+void CPUPathwaySolver::setWeight(float weight)
+{
+    m_weight = weight;
 }
 
 bool CPUPathwaySolver::solve()
 {
     while (!openList.empty()) {
-        node_t *node;
-        do {
-            node = openList.top().second;
-            openList.pop();
-        } while (closeList.count(node->id));
-        closeList.insert(node->id);
-
-        if (node->id == targetID) {
-            optimalNode = node;
+        int id = m_handleCell[openList.pop()];
+        cell_t &now = cell(id);
+        now.closed = true;
+
+        if (id == targetID) {
+            optimalID = id;
             return true;
         }
 
         int x, y;
-        p->toXY(node->id, &x, &y);
+        p->toXY(id, &x, &y);
         dout << "(" << x << ", " << y << ")" << endl;
+        uint8_t mask = p->edgeMask(id);
+        if (m_jumpPruning && now.prev != -1) {
+            int px, py;
+            p->toXY(now.prev, &px, &py);
+            PathwayGraph graph = { p };
+            mask = pruneMoves(graph, x, y, px, py, mask, DX, DY);
+        }
         for (int i = 0; i < 8; ++i) {
-            if (~p->graph()[node->id] & 1 << i)
+            if (~mask & 1 << i)
                 continue;
             int nx = x + DX[i];
             int ny = y + DY[i];
             if (p->inrange(nx, ny)) {
                 int nid = p->toID(nx, ny);
-                float dist = node->dist + COST[i];
-                if (globalList.count(nid) == 0) {
-                    node_t *nnode = new node_t(nid, dist, node);
-                    globalList[nid] = nnode;
-                    openList.push(make_pair(computeFValue(nnode), nnode));
-                    dout << "\t(" << nx << ", " << ny << ") n " << computeFValue(nnode) << endl;
-                } else {
-                    node_t *onode = globalList[nid];
-                    if (dist < onode->dist) {
-                        onode->dist = dist;
-                        onode->prev = node;
-                        openList.push(make_pair(computeFValue(onode), onode));
-                        dout << '\t' << nx << " " << ny << " u " << computeFValue(onode) << endl;
+                float dist = now.dist + COST[i];
+                cell_t &next = cell(nid);
+                if (!next.closed && dist < next.dist) {
+                    if (next.handle == -1) {
+                        next.handle = m_handleCell.size();
+                        m_handleCell.push_back(nid);
                     }
+                    next.dist = dist;
+                    next.prev = id;
+                    float fValue = computeFValue(nid, dist);
+                    openList.update(next.handle, fValue);
+                    dout << "\t(" << nx << ", " << ny << ") " << fValue << endl;
                 }
             }
         }
@@ -91,22 +111,35 @@ bool CPUPathwaySolver::solve()
 
 void CPUPathwaySolver::getSolution(float *optimal, vector<int> *pathList)
 {
-    printf("\t\t\tNumber of nodes expanded: %d\n", (int)globalList.size());
-    node_t *node = optimalNode;
-    *optimal = node->dist;
+    printf("\t\t\tNumber of nodes expanded: %d\n", (int)m_handleCell.size());
+    metrics.counter("cpu", "expanded", m_handleCell.size());
+    *optimal = cell(optimalID).dist;
     pathList->clear();
-    while (node) {
-        pathList->push_back(node->id);
-        node = node->prev;
-    }
+    for (int id = optimalID; id != -1; id = cell(id).prev)
+        pathList->push_back(id);
     std::reverse(pathList->begin(), pathList->end());
 }
 
-float CPUPathwaySolver::computeFValue(node_t *node)
+CPUPathwaySolver::cell_t &CPUPathwaySolver::cell(int id)
+{
+    int chunk = id >> CHUNK_BITS;
+    if (!m_dirty[chunk]) {
+        if (!m_chunks[chunk])
+            m_chunks[chunk].reset(new cell_t[CHUNK_SIZE]);
+        cell_t *cells = m_chunks[chunk].get();
+        std::fill(cells, cells + CHUNK_SIZE,
+                  cell_t{numeric_limits<float>::infinity(), -1, -1, false});
+        m_dirty[chunk] = true;
+        m_touchedChunks.push_back(chunk);
+    }
+    return m_chunks[chunk][id & (CHUNK_SIZE - 1)];
+}
+
+float CPUPathwaySolver::computeFValue(int id, float dist)
 {
     int x, y;
-    p->toXY(node->id, &x, &y);
+    p->toXY(id, &x, &y);
     int dx = abs(x - p->ex());
     int dy = abs(y - p->ey());
-    return node->dist + min(dx, dy)*SQRT2 + abs(dx-dy);
+    return dist + m_weight * (min(dx, dy)*SQRT2 + abs(dx-dy));
 }
@@ -2,33 +2,52 @@
 #define __CPU_SOLVER_HPP_FXKHT6GB
 
 #include "pathway/pathway.hpp"
-#include <queue>
-#include <unordered_set>
-#include <unordered_map>
+#include "open-list.hpp"
 
-class node_t;
 class CPUPathwaySolver {
 public:
     CPUPathwaySolver(Pathway *pathway);
     ~CPUPathwaySolver();
     void initialize();
+    // Order the open list by g + weight * h from the next initialize() on,
+    // see anytime.hpp
+    void setWeight(float weight);
     bool solve();
     void getSolution(float *optimal, vector<int> *pathList);
 
 private:
-    float computeFValue(node_t *node);
+    // search state of a cell, indexed by the dense cell ID
+    struct cell_t {
+        float dist;
+        int prev;
+        // handle in the open list, -1 until the cell is reached
+        int handle;
+        bool closed;
+    };
+
+    // costs are sums of 1 and SQRT2, so a heap rather than buckets
+    typedef DaryHeap<float> openlist_t;
+
+    cell_t &cell(int id);
+    float computeFValue(int id, float dist);
 
     Pathway *p;
-    std::priority_queue<
-        pair<float, node_t *>,
-        vector<pair<float, node_t *>>,
-        std::greater<pair<float, node_t *>>> openList;
-    std::unordered_set<int> closeList;
-    std::unordered_map<int, node_t *> globalList;
+    openlist_t openList;
+    // cell of every handle, in the order the cells are reached
+    vector<int> m_handleCell;
+
+    // The cells are allocated in chunks on first touch, so a short search on
+    // a large map stays small.  Only the touched chunks are reset for the
+    // next query.
+    vector<std::unique_ptr<cell_t[]>> m_chunks;
+    vector<bool> m_dirty;
+    vector<int> m_touchedChunks;
 
     int targetID;
-    node_t *optimalNode;
+    int optimalID;
+    float m_weight;
+    // --jump-pruning, see pruning.hpp
+    bool m_jumpPruning;
 };
 
 #endif /* end of include guard: __CPU_SOLVER_HPP_FXKHT6GB */
-
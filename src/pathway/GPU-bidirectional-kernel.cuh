@@ -0,0 +1,397 @@
+#ifndef __GPU_BIDIRECTIONAL_KERNEL_CUH_W5K9TD2Q
+#define __GPU_BIDIRECTIONAL_KERNEL_CUH_W5K9TD2Q
+
+// Kernels of the bidirectional search (--bidirectional).
+//
+// The first half of the heaps searches forward from the start, the second
+// half backward from the target through the reversed edges.  Both directions
+// share the node arena, the sort and the hash table: the backward node of a
+// cell has the ID of the cell plus the number of cells.  Whenever a node gets
+// a shorter gValue, the deduplication looks up the node of the same cell in
+// the opposite direction, and g_solution keeps the shortest meeting as
+// flipFloat(distance) << 32 | cell.
+//
+// Every heap only pops nodes of its own direction, so the smallest fValue
+// extracted in a round is known for each direction, and the best meeting is
+// the answer once it is not worse than the larger of the two.
+
+#include "pathway/GPU-kernel.cuh"
+
+__constant__ int d_startX;
+__constant__ int d_startY;
+
+inline cudaError_t initializeBidirectional(int startX, int startY)
+{
+    cudaError_t ret = cudaSuccess;
+    ret = cudaMemcpyToSymbol(d_startX, &startX, sizeof(int));
+    ret = cudaMemcpyToSymbol(d_startY, &startY, sizeof(int));
+    return ret;
+}
+
+inline __device__ uint32_t numCell()
+{
+    return d_height * d_width;
+}
+
+// heuristic of a node toward the end its direction is heading for
+inline __device__ float bidirectionalHValue(uint32_t nodeID)
+{
+    uint32_t cells = numCell();
+    if (nodeID < cells)
+        return computeHValue(nodeID);
+
+    int x, y;
+    idToXY(nodeID - cells, &x, &y);
+    int dx = abs(d_startX - x);
+    int dy = abs(d_startY - y);
+    return d_heuristicWeight * (min(dx, dy)*SQRT2 + abs(dx-dy));
+}
+
+__global__ void kBidirectionalInitialize(
+    node_t g_nodes[],
+    uint32_t g_hash[],
+    heap_t g_openList[],
+    int g_heapSize[],
+    int heapCapacity,
+    int numHeap,
+    int startX,
+    int startY,
+    int targetX,
+    int targetY,
+    unsigned long long *g_solution
+)
+{
+    uint32_t startID = xyToID(startX, startY);
+    uint32_t targetID = xyToID(targetX, targetY);
+    int half = numHeap / 2;
+
+    node_t node;
+    node.gValue = 0;
+    node.prev = UINT32_MAX;
+
+    heap_t heap;
+    for (int dir = 0; dir < 2; ++dir) {
+        node.nodeID = dir ? targetID + numCell() : startID;
+        node.fValue = bidirectionalHValue(node.nodeID);
+        heap.fValue = node.fValue;
+        heap.addr = dir;
+
+        g_nodes[dir] = node;
+        g_hash[node.nodeID] = dir;
+        g_openList[(size_t)heapCapacity * half * dir] = heap;
+        g_heapSize[half * dir] = 1;
+    }
+
+    if (startID == targetID)
+        *g_solution = (unsigned long long)flipFloat(0) << 32 | startID;
+}
+
+// kExtractExpand of both directions.  `g_optimalDistance', `g_heapBeginIndex'
+// and `g_heapInsertSize' have one entry per direction, and g_solution is only
+// there to share the signature of kExtractExpand: the meetings are found by
+// kBidirectionalDeduplicate.  The grid has an even number of blocks, so every
+// block works on a single direction.
+// NT: number of CUDA thread per CUDA block
+// VT: value handled per thread
+template<int NT, int VT>
+__global__ void kBidirectionalExtractExpand(
+    // global nodes
+    node_t g_nodes[],
+
+    uint8_t g_graph[],
+
+    // open list
+    heap_t g_openList[],
+    int g_heapSize[],
+    int heapCapacity,
+
+    // solution
+    uint32_t g_optimalDistance[],
+    unsigned long long *g_solution,
+    const int *g_status,
+
+    // output buffer
+    sort_t g_sortList[],
+    uint32_t g_prevList[],
+    int *g_sortListSize,
+
+    // cleanup
+    int g_heapBeginIndex[],
+    int g_heapInsertSize[]
+)
+{
+    __shared__ uint32_t s_optimalDistance;
+    __shared__ int s_sortListSize;
+    __shared__ int s_sortListBase;
+
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
+    int gid = GLOBAL_ID;
+    int tid = THREAD_ID;
+    int half = gridDim.x * NT / 2;
+    int dir = gid >= half;
+    uint32_t cells = numCell();
+    if (tid == 0) {
+        s_optimalDistance = UINT32_MAX;
+        s_sortListSize = 0;
+        s_sortListBase = 0;
+    }
+
+    __syncthreads();
+
+    heap_t *heap = g_openList + (size_t)heapCapacity * gid - 1;
+
+    heap_t extracted[VT];
+    int popCount = 0;
+    int heapSize = g_heapSize[gid];
+
+#pragma unroll
+    for (int k = 0; k < VT; ++k) {
+        if (heapSize == 0 || heap[1].fValue > d_bandLimit[dir])
+            break;
+
+        extracted[k] = heap[1];
+        popCount++;
+
+        heap_t nowValue = heap[heapSize--];
+
+        int now = 1;
+        int next;
+        while ((next = now*2) <= heapSize) {
+            heap_t nextValue = heap[next];
+            heap_t nextValue2 = heap[next+1];
+            bool inc = (next+1 <= heapSize) && (nextValue2 < nextValue);
+            if (inc) {
+                ++next;
+                nextValue = nextValue2;
+            }
+
+            if (nextValue < nowValue) {
+                heap[now] = nextValue;
+                now = next;
+            } else
+                break;
+        }
+        heap[now] = nowValue;
+
+    }
+    g_heapSize[gid] = heapSize;
+
+    int sortListCount = 0;
+    sort_t sortList[VT*8];
+    int prevList[VT*8];
+    bool valid[VT*8];
+
+    const int DX[8] = { 1,  1, -1, -1,  1, -1,  0,  0 };
+    const int DY[8] = { 1, -1,  1, -1,  0,  0,  1, -1 };
+    const float COST[8] = { SQRT2, SQRT2, SQRT2, SQRT2, 1, 1, 1, 1 };
+
+#pragma unroll
+    for (int k = 0; k < VT; ++k) {
+#pragma unroll
+        for (int i = 0; i < 8; ++i)
+            valid[k*8 + i] = false;
+
+        if (k >= popCount)
+            continue;
+        atomicMin(&s_optimalDistance, flipFloat(extracted[k].fValue));
+        node_t node = g_nodes[extracted[k].addr];
+        if (extracted[k].fValue != node.fValue)
+            continue;
+
+        int x, y;
+        idToXY(dir ? node.nodeID - cells : node.nodeID, &x, &y);
+        uint8_t mask = dir ? 0 : edgeMask(g_graph, node.nodeID, x, y);
+#pragma unroll
+        for (int i = 0; i < 8; ++i) {
+            // a backward successor is a cell with an edge to this one
+            int nx = dir ? x - DX[i] : x + DX[i];
+            int ny = dir ? y - DY[i] : y + DY[i];
+            if (!inrange(nx, ny))
+                continue;
+            uint32_t nodeID = xyToID(nx, ny);
+            if (dir)
+                mask = edgeMask(g_graph, nodeID, nx, ny);
+            if (~mask & (1 << i))
+                continue;
+
+            int index = k*8 + i;
+            sortList[index].nodeID = dir ? nodeID + cells : nodeID;
+            sortList[index].gValue = node.gValue + COST[i];
+            prevList[index] = extracted[k].addr;
+            valid[index] = true;
+            ++sortListCount;
+        }
+    }
+
+    int sortListIndex = atomicAdd(&s_sortListSize, sortListCount);
+    __syncthreads();
+    if (tid == 0) {
+        s_sortListBase = atomicAdd(g_sortListSize, s_sortListSize);
+    }
+    __syncthreads();
+    sortListIndex += s_sortListBase;
+
+#pragma unroll
+    for (int k = 0; k < VT*8; ++k)
+        if (valid[k]) {
+            g_sortList[sortListIndex] = sortList[k];
+            g_prevList[sortListIndex] = prevList[k];
+            sortListIndex++;
+        }
+    if (tid == 0)
+        atomicMin(&g_optimalDistance[dir], s_optimalDistance);
+    if (gid == 0) {
+        for (int i = 0; i < 2; ++i) {
+            int newHeapBeginIndex = g_heapBeginIndex[i] + g_heapInsertSize[i];
+
+            g_heapBeginIndex[i] = newHeapBeginIndex % half;
+            g_heapInsertSize[i] = 0;
+        }
+    }
+}
+
+// The best meeting is optimal once no direction extracted a node with a
+// smaller fValue in this round, and the search fails once a direction
+// cannot extract anything without having met the other one.
+__global__ void kBidirectionalCheckTermination(
+    unsigned long long *g_solution,
+    uint32_t g_optimalDistance[],
+    int *g_status
+)
+{
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
+    unsigned long long solution = *g_solution;
+    uint32_t forward = g_optimalDistance[0];
+    uint32_t backward = g_optimalDistance[1];
+    if (solution != ULLONG_MAX &&
+        (uint32_t)(solution >> 32) <= max(forward, backward))
+        *g_status = SEARCH_SOLVED;
+    else if (forward == UINT32_MAX || backward == UINT32_MAX)
+        *g_status = SEARCH_FAILED;
+    g_optimalDistance[0] = UINT32_MAX;
+    g_optimalDistance[1] = UINT32_MAX;
+}
+
+// kDeduplicate of both directions, the items of a direction go to its half
+// of g_heapInsertList, which starts `insertListHalf' items further for the
+// backward direction.
+template<int NT>
+__global__ void kBidirectionalDeduplicate(
+    // global nodes
+    node_t g_nodes[],
+    int *g_nodeSize,
+
+    // hash table
+    uint32_t g_hash[],
+
+    sort_t g_sortList[],
+    uint32_t g_prevList[],
+    const int *g_sortListSize,
+
+    heap_t g_heapInsertList[],
+    int insertListHalf,
+    int g_heapInsertSize[],
+
+    unsigned long long *g_solution,
+    const int *g_status
+)
+{
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
+    int tid = THREAD_ID;
+    int gid = GLOBAL_ID;
+    bool working = gid < *g_sortListSize;
+    uint32_t cells = numCell();
+
+    __shared__ int s_nodeInsertCount;
+    __shared__ int s_nodeInsertBase;
+
+    __shared__ int s_heapInsertCount[2];
+    __shared__ int s_heapInsertBase[2];
+
+    if (tid == 0) {
+        s_nodeInsertCount = 0;
+        s_heapInsertCount[0] = 0;
+        s_heapInsertCount[1] = 0;
+    }
+    __syncthreads();
+
+    node_t node;
+    int dir = 0;
+    bool insert = true;
+    bool found = true;
+    uint32_t nodeIndex;
+    uint32_t heapIndex;
+    uint32_t addr;
+
+    if (working) {
+        node.nodeID = g_sortList[gid].nodeID;
+        node.gValue = g_sortList[gid].gValue;
+        node.prev   = g_prevList[gid];
+        node.fValue = node.gValue + bidirectionalHValue(node.nodeID);
+        dir = node.nodeID >= cells;
+
+        addr = g_hash[node.nodeID];
+        found = (addr != UINT32_MAX);
+
+        if (found) {
+            if (node.fValue < g_nodes[addr].fValue) {
+                g_nodes[addr] = node;
+            } else {
+                insert = false;
+            }
+        }
+
+        if (!found) {
+            nodeIndex = atomicAdd(&s_nodeInsertCount, 1);
+        }
+        if (insert) {
+            heapIndex = atomicAdd(&s_heapInsertCount[dir], 1);
+        }
+    }
+
+    __syncthreads();
+    if (tid == 0) {
+        s_nodeInsertBase = atomicAdd(g_nodeSize, s_nodeInsertCount);
+        for (int i = 0; i < 2; ++i)
+            s_heapInsertBase[i] = atomicAdd(&g_heapInsertSize[i],
+                                            s_heapInsertCount[i]);
+    }
+    __syncthreads();
+
+    if (working && !found) {
+        addr = s_nodeInsertBase + nodeIndex;
+        // the opposite direction may look the node up right away
+        g_nodes[addr] = node;
+        __threadfence();
+        g_hash[node.nodeID] = addr;
+    }
+    if (working && insert) {
+        uint32_t index = s_heapInsertBase[dir] + heapIndex;
+        heap_t *list = g_heapInsertList + insertListHalf * dir;
+        list[index].fValue = node.fValue;
+        list[index].addr = addr;
+
+        // Both nodes of a cell may improve in the same launch.  Each thread
+        // publishes its node before it reads the other one, so at least one
+        // of the two sees both gValues.
+        __threadfence();
+        uint32_t cell = dir ? node.nodeID - cells : node.nodeID;
+        uint32_t opposite = dir ? cell : cell + cells;
+        volatile uint32_t *hash = g_hash;
+        volatile node_t *nodes = g_nodes;
+        uint32_t oppositeAddr = hash[opposite];
+        if (oppositeAddr != UINT32_MAX) {
+            float distance = node.gValue + nodes[oppositeAddr].gValue;
+            atomicMin(g_solution,
+                      (unsigned long long)flipFloat(distance) << 32 | cell);
+        }
+    }
+}
+
+#endif /* end of include guard: __GPU_BIDIRECTIONAL_KERNEL_CUH_W5K9TD2Q */
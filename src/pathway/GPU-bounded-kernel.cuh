@@ -0,0 +1,69 @@
+#ifndef __GPU_BOUNDED_KERNEL_CUH_Q8TZ4WLN
+#define __GPU_BOUNDED_KERNEL_CUH_Q8TZ4WLN
+
+// The pathway side of the memory bounded search (--memory-limit), see
+// GPU-bounded.cuh.  The fValue range of the open list is split into the
+// bins, and g_pruned keeps the smallest fValue dropped flipped.
+
+#include "pathway/GPU-kernel.cuh"
+
+inline __device__ uint32_t pruneKey(const heap_t &heap)
+{
+    return flipFloat(heap.fValue);
+}
+
+inline __device__ uint32_t nodePrev(const node_t &node)
+{
+    return node.prev;
+}
+
+inline __device__ void relinkNode(node_t *node, uint32_t prev)
+{
+    node->prev = prev;
+}
+
+#include "GPU-bounded.cuh"
+
+// g_range[0] and g_range[1] are the flipped smallest and largest fValue
+template<int NT>
+__global__ void kHeapRange(
+    const heap_t g_openList[],
+    const int g_heapSize[],
+    int heapCapacity,
+    int numHeap,
+    uint32_t g_range[2]
+)
+{
+    int gid = GLOBAL_ID;
+    if (gid >= numHeap)
+        return;
+
+    uint32_t low = UINT32_MAX;
+    uint32_t high = 0;
+    const heap_t *heap = g_openList + (size_t)heapCapacity * gid;
+    for (int i = 0; i < g_heapSize[gid]; ++i) {
+        uint32_t f = flipFloat(heap[i].fValue);
+        low = min(low, f);
+        high = max(high, f);
+    }
+    if (low != UINT32_MAX) {
+        atomicMin(&g_range[0], low);
+        atomicMax(&g_range[1], high);
+    }
+}
+
+// Index the `nodeSize' compacted nodes, the hash slots of the old arena
+// must be cleared (kResetHash) already
+template<int NT>
+__global__ void kIndexNodes(
+    const node_t g_nodes[],
+    int nodeSize,
+    uint32_t g_hash[]
+)
+{
+    int gid = GLOBAL_ID;
+    if (gid < nodeSize)
+        g_hash[localCell(g_nodes[gid].nodeID)] = gid;
+}
+
+#endif /* end of include guard: __GPU_BOUNDED_KERNEL_CUH_Q8TZ4WLN */
@@ -0,0 +1,245 @@
+#ifndef __GPU_COMPACT_KERNEL_CUH_7RQX2M5C
+#define __GPU_COMPACT_KERNEL_CUH_7RQX2M5C
+
+// Kernels of the compact node layout (--node-layout compact).
+//
+// There is no node arena and no hash table.  Every cell owns one 64-bit word
+// `g_best[cell] = flipFloat(gValue) << 32 | prev cell', which is relaxed with
+// atomicMin right in the expansion, and heap items address cells directly.
+// The fValue is recomputed from the gValue and the heuristic, so an item is
+// stale once its fValue does not match its cell anymore.  The cells reached
+// are listed in `g_touched', in the order of g_nodeSize, so that the next
+// query only resets them.
+
+#include "pathway/GPU-kernel.cuh"
+
+inline __device__ float bestGValue(unsigned long long best)
+{
+    return reverseFlipFloat((uint32_t)(best >> 32));
+}
+
+__global__ void kCompactInitialize(
+    unsigned long long g_best[],
+    uint32_t g_touched[],
+    heap_t g_openList[],
+    int g_heapSize[],
+    int startX,
+    int startY
+)
+{
+    uint32_t startID = xyToID(startX, startY);
+
+    heap_t heap;
+    heap.fValue = computeHValue(startX, startY);
+    heap.addr = startID;
+
+    g_best[startID] = (unsigned long long)flipFloat(0) << 32 | UINT32_MAX;
+    g_touched[0] = startID;
+    g_openList[0] = heap;
+    g_heapSize[0] = 1;
+}
+
+// Clear the cells reached by the previous search
+template<int NT>
+__global__ void kCompactReset(
+    unsigned long long g_best[],
+    const uint32_t g_touched[],
+    int nodeSize
+)
+{
+    int gid = GLOBAL_ID;
+    if (gid < nodeSize)
+        g_best[g_touched[gid]] = ULLONG_MAX;
+}
+
+// NT: number of CUDA thread per CUDA block
+// VT: value handled per thread
+template<int NT, int VT>
+__global__ void kCompactExtractExpand(
+    unsigned long long g_best[],
+    // number of cells reached so far, and the cells
+    int *g_nodeSize,
+    uint32_t g_touched[],
+
+    uint8_t g_graph[],
+
+    // open list
+    heap_t g_openList[],
+    int g_heapSize[],
+    int heapCapacity,
+
+    // solution
+    uint32_t *g_optimalDistance,
+    unsigned long long *g_solution,
+    const int *g_status,
+
+    // output buffer
+    heap_t g_heapInsertList[],
+    int *g_heapInsertSize
+)
+{
+    __shared__ uint32_t s_optimalDistance;
+    __shared__ int s_heapInsertSize;
+    __shared__ int s_heapInsertBase;
+    __shared__ int s_nodeCount;
+    __shared__ int s_nodeBase;
+
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
+    int gid = GLOBAL_ID;
+    int tid = THREAD_ID;
+    if (tid == 0) {
+        s_optimalDistance = UINT32_MAX;
+        s_heapInsertSize = 0;
+        s_heapInsertBase = 0;
+        s_nodeCount = 0;
+    }
+
+    __syncthreads();
+
+    heap_t *heap = g_openList + (size_t)heapCapacity * gid - 1;
+
+    heap_t extracted[VT];
+    int popCount = 0;
+    int heapSize = g_heapSize[gid];
+
+#pragma unroll
+    for (int k = 0; k < VT; ++k) {
+        if (heapSize == 0 || heap[1].fValue > d_bandLimit[0])
+            break;
+
+        extracted[k] = heap[1];
+        popCount++;
+
+        heap_t nowValue = heap[heapSize--];
+
+        int now = 1;
+        int next;
+        while ((next = now*2) <= heapSize) {
+            heap_t nextValue = heap[next];
+            heap_t nextValue2 = heap[next+1];
+            bool inc = (next+1 <= heapSize) && (nextValue2 < nextValue);
+            if (inc) {
+                ++next;
+                nextValue = nextValue2;
+            }
+
+            if (nextValue < nowValue) {
+                heap[now] = nextValue;
+                now = next;
+            } else
+                break;
+        }
+        heap[now] = nowValue;
+    }
+    g_heapSize[gid] = heapSize;
+
+    int insertCount = 0;
+    int nodeCount = 0;
+    heap_t insertList[VT*8];
+    bool valid[VT*8];
+    // reached for the first time
+    bool fresh[VT*8];
+
+    const int DX[8] = { 1,  1, -1, -1,  1, -1,  0,  0 };
+    const int DY[8] = { 1, -1,  1, -1,  0,  0,  1, -1 };
+    const float COST[8] = { SQRT2, SQRT2, SQRT2, SQRT2, 1, 1, 1, 1 };
+
+#pragma unroll
+    for (int k = 0; k < VT; ++k) {
+#pragma unroll
+        for (int i = 0; i < 8; ++i)
+            valid[k*8 + i] = fresh[k*8 + i] = false;
+
+        if (k >= popCount)
+            continue;
+        atomicMin(&s_optimalDistance, flipFloat(extracted[k].fValue));
+
+        uint32_t cellID = extracted[k].addr;
+        int x, y;
+        idToXY(cellID, &x, &y);
+        unsigned long long best = g_best[cellID];
+        float gValue = bestGValue(best);
+        if (extracted[k].fValue != gValue + computeHValue(x, y))
+            continue;
+
+        if (cellID == d_targetID) {
+            unsigned long long solution = flipFloat(extracted[k].fValue);
+            atomicMin(g_solution, solution << 32 | cellID);
+            continue;
+        }
+
+        uint8_t mask = edgeMask(g_graph, cellID, x, y);
+        // the low word of the best value is the parent cell
+        if (d_jumpPruning && (uint32_t)best != UINT32_MAX) {
+            int px, py;
+            idToXY((uint32_t)best, &px, &py);
+            DeviceGraph graph = { g_graph };
+            mask = pruneMoves(graph, x, y, px, py, mask, DX, DY);
+        }
+#pragma unroll
+        for (int i = 0; i < 8; ++i) {
+            if (~mask & (1 << i))
+                continue;
+
+            int nx = x + DX[i];
+            int ny = y + DY[i];
+            int index = k*8 + i;
+            if (inrange(nx, ny)) {
+                uint32_t nodeID = xyToID(nx, ny);
+                float ngValue = gValue + COST[i];
+                unsigned long long value =
+                    (unsigned long long)flipFloat(ngValue) << 32 | cellID;
+                unsigned long long old = atomicMin(&g_best[nodeID], value);
+
+                // only a strictly better gValue is pushed again
+                if ((old >> 32) > (value >> 32)) {
+                    insertList[index].fValue =
+                        ngValue + computeHValue(nx, ny);
+                    insertList[index].addr = nodeID;
+                    valid[index] = true;
+                    ++insertCount;
+                    if (old == ULLONG_MAX) {
+                        fresh[index] = true;
+                        ++nodeCount;
+                    }
+                }
+            }
+        }
+    }
+
+    int heapInsertIndex = atomicAdd(&s_heapInsertSize, insertCount);
+    int nodeIndex = atomicAdd(&s_nodeCount, nodeCount);
+    __syncthreads();
+    if (tid == 0) {
+        s_heapInsertBase = atomicAdd(g_heapInsertSize, s_heapInsertSize);
+        s_nodeBase = atomicAdd(g_nodeSize, s_nodeCount);
+        atomicMin(g_optimalDistance, s_optimalDistance);
+    }
+    __syncthreads();
+    heapInsertIndex += s_heapInsertBase;
+    nodeIndex += s_nodeBase;
+
+#pragma unroll
+    for (int k = 0; k < VT*8; ++k) {
+        if (valid[k])
+            g_heapInsertList[heapInsertIndex++] = insertList[k];
+        if (fresh[k])
+            g_touched[nodeIndex++] = insertList[k].addr;
+    }
+}
+
+// The successors are pushed by the expansion itself, so the insert list is
+// only consumed after kHeapInsert.
+__global__ void kCompactAdvance(
+    int *g_heapBeginIndex,
+    int *g_heapInsertSize,
+    int numHeap
+)
+{
+    *g_heapBeginIndex = (*g_heapBeginIndex + *g_heapInsertSize) % numHeap;
+    *g_heapInsertSize = 0;
+}
+
+#endif /* end of include guard: __GPU_COMPACT_KERNEL_CUH_7RQX2M5C */
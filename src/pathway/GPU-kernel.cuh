@@ -4,10 +4,12 @@
 #include <cuda.h>
 #include <cuda_runtime.h>
 #include <cuda_profiler_api.h>
+#include <cfloat>
 
 #include <moderngpu.cuh>
 
 #include "utils.hpp"
+#include "pathway/pruning.hpp"
 
 // Suppose we only use x dimension
 #define THREAD_ID (threadIdx.x)
@@ -57,6 +59,10 @@ __host__ __device__ bool operator<(const sort_t &a, const sort_t &b)
     return a.gValue < b.gValue;
 }
 
+const int SEARCH_RUNNING = 0;
+const int SEARCH_SOLVED = 1;
+const int SEARCH_FAILED = 2;
+
 inline __host__ __device__ uint32_t flipFloat(float fl)
 {
     union {
@@ -82,7 +88,17 @@ __constant__ int d_width;
 __constant__ int d_targetX;
 __constant__ int d_targetY;
 __constant__ uint32_t d_targetID;
+// the open list is ordered by g + d_heuristicWeight * h, see anytime.hpp
+__constant__ float d_heuristicWeight;
 __constant__ uint32_t d_modules[10];
+// the graph is a tiled 1-bit passability map instead of one byte per cell
+__constant__ int d_graphBitmap;
+__constant__ int d_tilesPerRow;
+// first row of the graph and of the hash table held by this device, see
+// GPUShardedPathwaySolver
+__constant__ int d_rowBase;
+// --jump-pruning, see pruning.hpp
+__constant__ int d_jumpPruning;
 
 inline __device__ void idToXY(uint32_t nodeID, int *x, int *y)
 {
@@ -95,11 +111,17 @@ inline __device__ int xyToID(int x, int y)
     return x * d_width + y;
 }
 
+// index of a cell into the graph and the hash table of this device
+inline __device__ uint32_t localCell(uint32_t nodeID)
+{
+    return nodeID - (uint32_t)d_rowBase * d_width;
+}
+
 inline __device__ float computeHValue(int x, int y)
 {
     int dx = abs(d_targetX - x);
     int dy = abs(d_targetY - y);
-    return min(dx, dy)*SQRT2 + abs(dx-dy);
+    return d_heuristicWeight * (min(dx, dy)*SQRT2 + abs(dx-dy));
 }
 
 inline __device__ float computeHValue(uint32_t nodeID)
@@ -109,17 +131,48 @@ inline __device__ float computeHValue(uint32_t nodeID)
     return computeHValue(x, y);
 }
 
+// Direction bits of the cell (x, y) with ID `nodeID'.  A bitmap graph holds
+// 32x32 tiles of 32 words, word `x % 32' of a tile is a row of the tile, so
+// neighbouring cells share a cache line (see Pathway::edgeMask).
+inline __device__ uint8_t edgeMask(
+    const uint8_t g_graph[], uint32_t nodeID, int x, int y)
+{
+    if (!d_graphBitmap)
+        return g_graph[localCell(nodeID)];
+
+    // d_rowBase is a multiple of the tile size
+    const uint32_t *bitmap = reinterpret_cast<const uint32_t *>(g_graph);
+    uint32_t word = bitmap[
+        (((x - d_rowBase) >> 5) * d_tilesPerRow + (y >> 5)) * 32 + (x & 31)];
+    return (word >> (y & 31) & 1) ? 0xFF : 0;
+}
+
 inline __device__ float inrange(int x, int y)
 {
     return 0 <= x && x < d_height && 0 <= y && y < d_width;
 }
 
+// The moves of the graph for pruneMoves()
+struct DeviceGraph {
+    const uint8_t *graph;
+
+    __device__ bool canMove(int x, int y, int dx, int dy) const {
+        if (!inrange(x + dx, y + dy))
+            return false;
+        // the bit of (dx, dy) in the DX and DY of the kernels
+        int bit = dx && dy ? (dx < 0) * 2 + (dy < 0)
+                : dx ? 4 + (dx < 0) : 6 + (dy < 0);
+        return edgeMask(graph, xyToID(x, y), x, y) >> bit & 1;
+    }
+};
+
 inline cudaError_t initializeCUDAConstantMemory(
     int height,
     int width,
     int targetX,
     int targetY,
-    uint32_t targetID
+    uint32_t targetID,
+    float weight
 )
 {
     cudaError_t ret = cudaSuccess;
@@ -128,9 +181,27 @@ inline cudaError_t initializeCUDAConstantMemory(
     ret = cudaMemcpyToSymbol(d_targetX, &targetX, sizeof(int));
     ret = cudaMemcpyToSymbol(d_targetY, &targetY, sizeof(int));
     ret = cudaMemcpyToSymbol(d_targetID, &targetID, sizeof(uint32_t));
+    ret = cudaMemcpyToSymbol(d_heuristicWeight, &weight, sizeof(float));
+    return ret;
+}
+
+inline cudaError_t initializeGraphLayout(
+    bool bitmap, int tilesPerRow, int rowBase = 0)
+{
+    cudaError_t ret = cudaSuccess;
+    int graphBitmap = bitmap;
+    ret = cudaMemcpyToSymbol(d_graphBitmap, &graphBitmap, sizeof(int));
+    ret = cudaMemcpyToSymbol(d_tilesPerRow, &tilesPerRow, sizeof(int));
+    ret = cudaMemcpyToSymbol(d_rowBase, &rowBase, sizeof(int));
     return ret;
 }
 
+inline cudaError_t initializePruning(bool jumpPruning)
+{
+    int pruning = jumpPruning;
+    return cudaMemcpyToSymbol(d_jumpPruning, &pruning, sizeof(int));
+}
+
 inline cudaError_t updateModules(const vector<uint32_t> &mvec)
 {
     return cudaMemcpyToSymbol(
@@ -160,13 +231,70 @@ __global__ void kInitialize(
     g_nodes[0] = node;
     g_openList[0] = heap;
     g_heapSize[0] = 1;
-    g_hash[node.nodeID] = 0;
+    g_hash[localCell(node.nodeID)] = 0;
+}
+
+// Clear the hash slots owned by the nodes of the previous search
+template<int NT>
+__global__ void kResetHash(
+    node_t g_nodes[],
+    int nodeSize,
+    uint32_t g_hash[]
+)
+{
+    int gid = GLOBAL_ID;
+    if (gid < nodeSize)
+        g_hash[localCell(g_nodes[gid].nodeID)] = UINT32_MAX;
+}
+
+// --f-band: a heap whose top is more than the band above the smallest top of
+// the heaps of its direction sits the round out, so that the threads do not
+// expand nodes much worse than the frontier while a few heaps hold all the
+// good ones.  The smallest top is always extracted, so the termination test
+// of the round still sees the minimum of the open list.
+__device__ float d_bandLimit[2] = { FLT_MAX, FLT_MAX };
+
+// One block per direction, each of them owning `numHeap' contiguous heaps
+// NT: number of CUDA thread per CUDA block, a power of two
+template<int NT>
+__global__ void kBandLimit(
+    const heap_t g_openList[],
+    const int g_heapSize[],
+    int heapCapacity,
+    int numHeap,
+    float band,
+    const int *g_status
+)
+{
+    __shared__ float s_top[NT];
+
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
+    int tid = THREAD_ID;
+    int base = BLOCK_ID * numHeap;
+    float top = FLT_MAX;
+    for (int i = base + tid; i < base + numHeap; i += NT) {
+        if (g_heapSize[i] != 0)
+            top = fminf(top, g_openList[(size_t)heapCapacity * i].fValue);
+    }
+    s_top[tid] = top;
+    __syncthreads();
+
+    for (int stride = NT / 2; stride > 0; stride /= 2) {
+        if (tid < stride)
+            s_top[tid] = fminf(s_top[tid], s_top[tid + stride]);
+        __syncthreads();
+    }
+    if (tid == 0)
+        d_bandLimit[BLOCK_ID] = s_top[0] + band;
 }
 
-// NB: number of CUDA block
+// Every thread of the grid owns one heap, so the number of blocks is only
+// known at launch time.
 // NT: number of CUDA thread per CUDA block
 // VT: value handled per thread
-template<int NB, int NT, int VT, int HEAP_CAPACITY>
+template<int NT, int VT>
 __global__ void kExtractExpand(
     // global nodes
     node_t g_nodes[],
@@ -176,11 +304,12 @@ __global__ void kExtractExpand(
     // open list
     heap_t g_openList[],
     int g_heapSize[],
+    int heapCapacity,
 
     // solution
     uint32_t *g_optimalDistance,
-    heap_t g_optimalNodes[],
-    int *g_optimalNodesSize,
+    unsigned long long *g_solution,
+    const int *g_status,
 
     // output buffer
     sort_t g_sortList[],
@@ -196,6 +325,9 @@ __global__ void kExtractExpand(
     __shared__ int s_sortListSize;
     __shared__ int s_sortListBase;
 
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
     int gid = GLOBAL_ID;
     int tid = THREAD_ID;
     if (tid == 0) {
@@ -206,7 +338,7 @@ __global__ void kExtractExpand(
 
     __syncthreads();
 
-    heap_t *heap = g_openList + HEAP_CAPACITY * gid - 1;
+    heap_t *heap = g_openList + (size_t)heapCapacity * gid - 1;
 
     heap_t extracted[VT];
     int popCount = 0;
@@ -214,7 +346,7 @@ __global__ void kExtractExpand(
 
 #pragma unroll
     for (int k = 0; k < VT; ++k) {
-        if (heapSize == 0)
+        if (heapSize == 0 || heap[1].fValue > d_bandLimit[0])
             break;
 
         extracted[k] = heap[1];
@@ -274,8 +406,8 @@ __global__ void kExtractExpand(
             continue;
 
         if (node.nodeID == d_targetID) {
-            int index = atomicAdd(g_optimalNodesSize, 1);
-            g_optimalNodes[index] = extracted[k];
+            unsigned long long solution = flipFloat(extracted[k].fValue);
+            atomicMin(g_solution, solution << 32 | extracted[k].addr);
 #ifdef KERNEL_LOG
             printf("\t\t\t Saved answer {%.3f}\n", extracted[k].fValue);
 #endif
@@ -284,9 +416,16 @@ __global__ void kExtractExpand(
 
         int x, y;
         idToXY(node.nodeID, &x, &y);
+        uint8_t mask = edgeMask(g_graph, node.nodeID, x, y);
+        if (d_jumpPruning && node.prev != UINT32_MAX) {
+            int px, py;
+            idToXY(g_nodes[node.prev].nodeID, &px, &py);
+            DeviceGraph graph = { g_graph };
+            mask = pruneMoves(graph, x, y, px, py, mask, DX, DY);
+        }
 #pragma unroll
         for (int i = 0; i < 8; ++i) {
-            if (~g_graph[node.nodeID] & (1 << i))
+            if (~mask & (1 << i))
                 continue;
 
             int nx = x + DX[i];
@@ -329,23 +468,50 @@ __global__ void kExtractExpand(
     if (gid == 0) {
         int newHeapBeginIndex = *g_heapBeginIndex + *g_heapInsertSize;
 
-        *g_heapBeginIndex = newHeapBeginIndex % (NB*NT);
+        *g_heapBeginIndex = newHeapBeginIndex % (gridDim.x*NT);
         *g_heapInsertSize = 0;
     }
 }
 
+// Decide on the device whether the search is finished.  The best solution
+// is optimal once no node with a smaller fValue was extracted in this round,
+// and the search fails once nothing can be extracted at all.
+__global__ void kCheckTermination(
+    unsigned long long *g_solution,
+    uint32_t *g_optimalDistance,
+    int *g_status
+)
+{
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
+    unsigned long long solution = *g_solution;
+    uint32_t optimalDistance = *g_optimalDistance;
+    if (solution != ULLONG_MAX && (uint32_t)(solution >> 32) <= optimalDistance)
+        *g_status = SEARCH_SOLVED;
+    else if (optimalDistance == UINT32_MAX)
+        *g_status = SEARCH_FAILED;
+    *g_optimalDistance = UINT32_MAX;
+}
+
 // Assume g_sortList is sorted
 template<int NT>
 __global__ void kAssign(
     sort_t g_sortList[],
     uint32_t g_prevList[],
-    int sortListSize,
+    const int *g_sortListSize,
 
     sort_t g_sortList2[],
     uint32_t g_prevList2[],
-    int *g_sortListSize2
+    int *g_sortListSize2,
+
+    const int *g_status
 )
 {
+    if (*g_status != SEARCH_RUNNING)
+        return;
+    int sortListSize = *g_sortListSize;
+
     __shared__ uint32_t s_nodeIDList[NT+1];
     __shared__ uint32_t s_sortListCount2;
     __shared__ uint32_t s_sortListBase2;
@@ -397,6 +563,87 @@ __global__ void kAssign(
     }
 }
 
+// Alternative to MergesortPairs + kAssign: every successor atomically lowers
+// the (gValue, prev) word of its node in a scratch table.
+template<int NT>
+__global__ void kHashMark(
+    const sort_t g_sortList[],
+    const uint32_t g_prevList[],
+    const int *g_sortListSize,
+
+    unsigned long long g_dedupTable[],
+
+    const int *g_status
+)
+{
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
+    int gid = GLOBAL_ID;
+    if (gid < *g_sortListSize) {
+        sort_t sort = g_sortList[gid];
+        unsigned long long packed = flipFloat(sort.gValue);
+        atomicMin(&g_dedupTable[sort.nodeID], packed << 32 | g_prevList[gid]);
+    }
+}
+
+// Keep the successors whose word survived kHashMark.  Claiming the word
+// resets the slot, so the table is clean again for the next round.
+template<int NT>
+__global__ void kHashCollect(
+    const sort_t g_sortList[],
+    const uint32_t g_prevList[],
+    const int *g_sortListSize,
+
+    unsigned long long g_dedupTable[],
+
+    sort_t g_sortList2[],
+    uint32_t g_prevList2[],
+    int *g_sortListSize2,
+
+    const int *g_status
+)
+{
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
+    __shared__ int s_sortListCount2;
+    __shared__ int s_sortListBase2;
+
+    int tid = THREAD_ID;
+    int gid = GLOBAL_ID;
+
+    if (tid == 0)
+        s_sortListCount2 = 0;
+    __syncthreads();
+
+    bool working = false;
+    sort_t sort;
+    uint32_t prev;
+    int index;
+    if (gid < *g_sortListSize) {
+        sort = g_sortList[gid];
+        prev = g_prevList[gid];
+        unsigned long long packed = flipFloat(sort.gValue);
+        packed = packed << 32 | prev;
+        working = atomicCAS(&g_dedupTable[sort.nodeID], packed, ULLONG_MAX)
+            == packed;
+        if (working)
+            index = atomicAdd(&s_sortListCount2, 1);
+    }
+
+    __syncthreads();
+    if (tid == 0) {
+        s_sortListBase2 = atomicAdd(g_sortListSize2, s_sortListCount2);
+    }
+    __syncthreads();
+
+    if (working) {
+        g_sortList2[s_sortListBase2 + index] = sort;
+        g_prevList2[s_sortListBase2 + index] = prev;
+    }
+}
+
 template<int NT>
 __global__ void kDeduplicate(
     // global nodes
@@ -408,15 +655,20 @@ __global__ void kDeduplicate(
 
     sort_t g_sortList[],
     uint32_t g_prevList[],
-    int sortListSize,
+    const int *g_sortListSize,
 
     heap_t g_heapInsertList[],
-    int *g_heapInsertSize
+    int *g_heapInsertSize,
+
+    const int *g_status
 )
 {
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
     int tid = THREAD_ID;
     int gid = GLOBAL_ID;
-    bool working = gid < sortListSize;
+    bool working = gid < *g_sortListSize;
 
     __shared__ int s_nodeInsertCount;
     __shared__ int s_nodeInsertBase;
@@ -444,7 +696,7 @@ __global__ void kDeduplicate(
         node.fValue = node.gValue + computeHValue(node.nodeID);
 
         // cudaAssert((int)node.nodeID >= 0);
-        addr = g_hash[node.nodeID];
+        addr = g_hash[localCell(node.nodeID)];
         found = (addr != UINT32_MAX);
 
         if (found) {
@@ -477,7 +729,7 @@ __global__ void kDeduplicate(
         idToXY(node.nodeID, &x, &y);
         printf("\t\t\t[%d]: Store (%d, %d) to [%d]\n", gid, x, y, addr);
 #endif
-        g_hash[node.nodeID] = addr;
+        g_hash[localCell(node.nodeID)] = addr;
         g_nodes[addr] = node;
     }
     if (working && insert) {
@@ -487,11 +739,12 @@ __global__ void kDeduplicate(
     }
 }
 
-template<int NB, int NT, int HEAP_CAPACITY>
+template<int NT>
 __global__ void kHeapInsert(
     // open list
     heap_t g_openList[],
     int g_heapSize[],
+    int heapCapacity,
     int *g_heapBeginIndex,
 
     heap_t g_heapInsertList[],
@@ -500,21 +753,25 @@ __global__ void kHeapInsert(
     // cleanup variable
     int *sortListSize,
     int *sortListSize2,
-    uint32_t *optimalDistance,
-    int *optimalNodesSize
+
+    const int *g_status
 )
 {
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
     int gid = GLOBAL_ID;
+    int numHeap = gridDim.x * NT;
 
     int heapInsertSize = *g_heapInsertSize;
     int heapIndex = *g_heapBeginIndex + gid;
-    if (heapIndex >= NB*NT)
-        heapIndex -= NB*NT;
+    if (heapIndex >= numHeap)
+        heapIndex -= numHeap;
 
     int heapSize = g_heapSize[heapIndex];
-    heap_t *heap = g_openList + HEAP_CAPACITY * heapIndex - 1;
+    heap_t *heap = g_openList + (size_t)heapCapacity * heapIndex - 1;
 
-    for (int i = gid; i < heapInsertSize; i += NB*NT) {
+    for (int i = gid; i < heapInsertSize; i += numHeap) {
         heap_t value = g_heapInsertList[i];
         int now = ++heapSize;
 
@@ -538,34 +795,38 @@ __global__ void kHeapInsert(
     if (gid == 0) {
         *sortListSize = 0;
         *sortListSize2 = 0;
-        *optimalDistance = UINT32_MAX;
-        *optimalNodesSize = 0;
     }
 }
 
-__global__ void kFetchAnswer(
-    node_t *g_nodes,
-
-    uint32_t *lastAddr,
+// The fields of a node that the host walks a path over
+struct link_t {
+    uint32_t prev;
+    uint32_t nodeID;
+};
 
-    uint32_t answerList[],
-    int *g_answerSize
-)
+inline __device__ void gatherLink(const node_t &node, link_t *link)
 {
-    int count = 0;
-    int addr = *lastAddr;
+    link->prev = node.prev;
+    link->nodeID = node.nodeID;
+}
 
-    while (addr != UINT32_MAX) {
-#ifdef KERNEL_LOG
-        int x, y;
-        idToXY(g_nodes[addr].nodeID, &x, &y);
-        printf("\t\t\t Address: %d (%d, %d)\n", addr, x, y);
-#endif
-        answerList[count++] = g_nodes[addr].nodeID;
-        addr = g_nodes[addr].prev;
-    }
+// the compact layout, see GPU-compact-kernel.cuh: the cell is the index
+inline __device__ void gatherLink(unsigned long long best, uint32_t *prev)
+{
+    *prev = best & UINT32_MAX;
+}
 
-    *g_answerSize = count;
+// Copy the links of g_source[0, count) out of the rest of the nodes
+template<class T, class L, int NT>
+__global__ void kGatherLinks(
+    const T g_source[],
+    int count,
+    L g_links[]
+)
+{
+    int gid = GLOBAL_ID;
+    if (gid < count)
+        gatherLink(g_source[gid], &g_links[gid]);
 }
 
 #endif /* end of include guard: __GPU_KERNEL_CUH_IUGANILK */
@@ -0,0 +1,495 @@
+#ifndef __GPU_MULTI_KERNEL_CUH_P3KVZ8QE
+#define __GPU_MULTI_KERNEL_CUH_P3KVZ8QE
+
+// Kernels for solving several independent queries in one launch.
+//
+// Every query (search) owns a slice of `heapPerSearch' heaps and a copy of the
+// graph in the node ID space: the cell `id' of search `sid' is the node
+// `sid * size + id'.  As a result the sort/assign stage is shared verbatim
+// with the single search, and nodes of different searches never collide in
+// the hash table.
+//
+// The hash table is shared by all the searches and sized from the node
+// arena rather than from the node ID space, so that a search only pays for
+// the cells it reaches: open addressing of node addresses keyed by node ID.
+// The number of slots is a power of two, `hashMask' is that number minus
+// one, and an empty slot holds UINT32_MAX.
+
+#include "pathway/GPU-kernel.cuh"
+
+// per-query descriptor, replaces the __constant__ targets
+struct search_t {
+    // query
+    uint32_t startID;
+    int targetX;
+    int targetY;
+    uint32_t targetID;
+
+    // state of the current round
+    uint32_t optimalDistance;
+    int popCount;
+    int heapBeginIndex;
+    int heapInsertSize;
+    int status;
+
+    // best solution found so far: flipFloat(fValue) << 32 | addr
+    unsigned long long solution;
+};
+
+const int MULTI_MAX_PROBE = 64;
+
+inline __device__ uint32_t multiSlot(uint32_t nodeID)
+{
+    // murmur3 finalizer, the node IDs of a search are dense
+    nodeID ^= nodeID >> 16;
+    nodeID *= 0x85ebca6b;
+    nodeID ^= nodeID >> 13;
+    nodeID *= 0xc2b2ae35;
+    nodeID ^= nodeID >> 16;
+    return nodeID;
+}
+
+// Return the address of the node of `nodeID', or UINT32_MAX
+inline __device__ uint32_t multiFind(
+    const node_t g_nodes[],
+    const uint32_t g_hash[],
+    uint32_t hashMask,
+    uint32_t nodeID
+)
+{
+    uint32_t slot = multiSlot(nodeID);
+    for (int i = 0; i < MULTI_MAX_PROBE; ++i) {
+        uint32_t addr = g_hash[(slot + i) & hashMask];
+        if (addr == UINT32_MAX || g_nodes[addr].nodeID == nodeID)
+            return addr;
+    }
+    return UINT32_MAX;
+}
+
+// Index the node at `addr', which must be written and fenced already.  No
+// other thread inserts the same node ID at once: the sorted successors hold
+// every node ID once.  When the probes run out the node stays in `g_nodes'
+// without an index entry, and `g_hashFull' counts it so that the host
+// rebuilds a larger table.
+inline __device__ void multiInsert(
+    uint32_t g_hash[],
+    uint32_t hashMask,
+    uint32_t nodeID,
+    uint32_t addr,
+    int *g_hashFull
+)
+{
+    uint32_t slot = multiSlot(nodeID);
+    for (int i = 0; i < MULTI_MAX_PROBE; ++i)
+        if (atomicCAS(&g_hash[(slot + i) & hashMask],
+                      UINT32_MAX, addr) == UINT32_MAX)
+            return;
+    atomicAdd(g_hashFull, 1);
+}
+
+inline __device__ float computeHValue(const search_t &search, int x, int y)
+{
+    int dx = abs(search.targetX - x);
+    int dy = abs(search.targetY - y);
+    return d_heuristicWeight * (min(dx, dy)*SQRT2 + abs(dx-dy));
+}
+
+template<int NT>
+__global__ void kMultiInitialize(
+    node_t g_nodes[],
+    uint32_t g_hash[],
+    uint32_t hashMask,
+    int *g_hashFull,
+    heap_t g_openList[],
+    int g_heapSize[],
+    int heapCapacity,
+
+    search_t g_searches[],
+    int numSearch,
+    int heapPerSearch,
+    int size
+)
+{
+    int gid = GLOBAL_ID;
+    if (gid >= numSearch)
+        return;
+
+    search_t search = g_searches[gid];
+    int x, y;
+    idToXY(search.startID, &x, &y);
+
+    node_t node;
+    node.fValue = computeHValue(search, x, y);
+    node.gValue = 0;
+    node.prev = UINT32_MAX;
+    node.nodeID = (uint32_t)gid * size + search.startID;
+
+    heap_t heap;
+    heap.fValue = node.fValue;
+    heap.addr = gid;
+
+    int heapIndex = gid * heapPerSearch;
+    g_nodes[gid] = node;
+    g_openList[(size_t)heapCapacity * heapIndex] = heap;
+    g_heapSize[heapIndex] = 1;
+    __threadfence();
+    multiInsert(g_hash, hashMask, node.nodeID, gid, g_hashFull);
+}
+
+// Index the `nodeSize' nodes of the arena in a new table
+template<int NT>
+__global__ void kMultiRehash(
+    const node_t g_nodes[],
+    int nodeSize,
+    uint32_t g_hash[],
+    uint32_t hashMask,
+    int *g_hashFull
+)
+{
+    int gid = GLOBAL_ID;
+    if (gid < nodeSize)
+        multiInsert(g_hash, hashMask, g_nodes[gid].nodeID, gid, g_hashFull);
+}
+
+// NT: number of CUDA thread per CUDA block
+// VT: value handled per thread
+template<int NT, int VT>
+__global__ void kMultiExtractExpand(
+    // global nodes
+    node_t g_nodes[],
+
+    uint8_t g_graph[],
+
+    // open list
+    heap_t g_openList[],
+    int g_heapSize[],
+    int heapCapacity,
+
+    // searches
+    search_t g_searches[],
+    int numSearch,
+    int heapPerSearch,
+    int size,
+
+    // output buffer
+    sort_t g_sortList[],
+    uint32_t g_prevList[],
+    int *g_sortListSize
+)
+{
+    __shared__ int s_sortListSize;
+    __shared__ int s_sortListBase;
+
+    int gid = GLOBAL_ID;
+    int tid = THREAD_ID;
+    if (tid == 0) {
+        s_sortListSize = 0;
+        s_sortListBase = 0;
+    }
+
+    __syncthreads();
+
+    int sid = gid / heapPerSearch;
+    bool working = sid < numSearch &&
+        g_searches[sid].status == SEARCH_RUNNING;
+
+    heap_t extracted[VT];
+    int popCount = 0;
+
+    if (working) {
+        search_t &search = g_searches[sid];
+        if (gid == sid * heapPerSearch) {
+            search.heapBeginIndex =
+                (search.heapBeginIndex + search.heapInsertSize) % heapPerSearch;
+            search.heapInsertSize = 0;
+        }
+
+        heap_t *heap = g_openList + (size_t)heapCapacity * gid - 1;
+        int heapSize = g_heapSize[gid];
+
+#pragma unroll
+        for (int k = 0; k < VT; ++k) {
+            if (heapSize == 0)
+                break;
+
+            extracted[k] = heap[1];
+            popCount++;
+
+            heap_t nowValue = heap[heapSize--];
+
+            int now = 1;
+            int next;
+            while ((next = now*2) <= heapSize) {
+                heap_t nextValue = heap[next];
+                heap_t nextValue2 = heap[next+1];
+                bool inc = (next+1 <= heapSize) && (nextValue2 < nextValue);
+                if (inc) {
+                    ++next;
+                    nextValue = nextValue2;
+                }
+
+                if (nextValue < nowValue) {
+                    heap[now] = nextValue;
+                    now = next;
+                } else
+                    break;
+            }
+            heap[now] = nowValue;
+        }
+        g_heapSize[gid] = heapSize;
+
+        if (popCount)
+            atomicAdd(&search.popCount, popCount);
+    }
+
+    int sortListCount = 0;
+    sort_t sortList[VT*8];
+    int prevList[VT*8];
+    bool valid[VT*8];
+
+    const int DX[8] = { 1,  1, -1, -1,  1, -1,  0,  0 };
+    const int DY[8] = { 1, -1,  1, -1,  0,  0,  1, -1 };
+    const float COST[8] = { SQRT2, SQRT2, SQRT2, SQRT2, 1, 1, 1, 1 };
+
+    uint32_t base = (uint32_t)sid * size;
+
+#pragma unroll
+    for (int k = 0; k < VT; ++k) {
+#pragma unroll
+        for (int i = 0; i < 8; ++i)
+            valid[k*8 + i] = false;
+
+        if (k >= popCount)
+            continue;
+        search_t &search = g_searches[sid];
+        atomicMin(&search.optimalDistance, flipFloat(extracted[k].fValue));
+        node_t node = g_nodes[extracted[k].addr];
+        if (extracted[k].fValue != node.fValue)
+            continue;
+
+        uint32_t cellID = node.nodeID - base;
+        if (cellID == search.targetID) {
+            unsigned long long solution = flipFloat(extracted[k].fValue);
+            atomicMin(&search.solution, solution << 32 | extracted[k].addr);
+            continue;
+        }
+
+        int x, y;
+        idToXY(cellID, &x, &y);
+        uint8_t mask = edgeMask(g_graph, cellID, x, y);
+#pragma unroll
+        for (int i = 0; i < 8; ++i) {
+            if (~mask & (1 << i))
+                continue;
+
+            int nx = x + DX[i];
+            int ny = y + DY[i];
+            int index = k*8 + i;
+            if (inrange(nx, ny)) {
+                sortList[index].nodeID = base + xyToID(nx, ny);
+                sortList[index].gValue = node.gValue + COST[i];
+                prevList[index] = extracted[k].addr;
+                valid[index] = true;
+                ++sortListCount;
+            }
+        }
+    }
+
+    int sortListIndex = atomicAdd(&s_sortListSize, sortListCount);
+    __syncthreads();
+    if (tid == 0) {
+        s_sortListBase = atomicAdd(g_sortListSize, s_sortListSize);
+    }
+    __syncthreads();
+    sortListIndex += s_sortListBase;
+
+#pragma unroll
+    for (int k = 0; k < VT*8; ++k)
+        if (valid[k]) {
+            g_sortList[sortListIndex] = sortList[k];
+            g_prevList[sortListIndex] = prevList[k];
+            sortListIndex++;
+        }
+}
+
+// Decide which searches are finished after kMultiExtractExpand
+template<int NT>
+__global__ void kMultiCheck(
+    search_t g_searches[],
+    int numSearch,
+    int *g_numRunning
+)
+{
+    int gid = GLOBAL_ID;
+    if (gid >= numSearch)
+        return;
+
+    search_t &search = g_searches[gid];
+    if (search.status == SEARCH_RUNNING) {
+        uint32_t solution = search.solution >> 32;
+        if (search.solution != ULLONG_MAX &&
+            solution <= search.optimalDistance)
+            search.status = SEARCH_SOLVED;
+        else if (search.popCount == 0)
+            search.status = SEARCH_FAILED;
+        else
+            atomicAdd(g_numRunning, 1);
+    }
+    search.optimalDistance = UINT32_MAX;
+    search.popCount = 0;
+}
+
+template<int NT>
+__global__ void kMultiDeduplicate(
+    // global nodes
+    node_t g_nodes[],
+    int *g_nodeSize,
+
+    // hash table
+    uint32_t g_hash[],
+    uint32_t hashMask,
+    int *g_hashFull,
+
+    // searches
+    search_t g_searches[],
+    int size,
+
+    sort_t g_sortList[],
+    uint32_t g_prevList[],
+    int sortListSize,
+
+    // heapInsertCapacity entries for every search
+    heap_t g_heapInsertList[],
+    int heapInsertCapacity
+)
+{
+    int tid = THREAD_ID;
+    int gid = GLOBAL_ID;
+    bool working = gid < sortListSize;
+
+    __shared__ int s_nodeInsertCount;
+    __shared__ int s_nodeInsertBase;
+
+    if (tid == 0) {
+        s_nodeInsertCount = 0;
+    }
+    __syncthreads();
+
+    node_t node;
+    bool insert = true;
+    bool found = true;
+    uint32_t nodeIndex;
+    uint32_t addr;
+    int sid;
+
+    if (working) {
+        node.nodeID = g_sortList[gid].nodeID;
+        sid = node.nodeID / size;
+        // successors of a finished search are dropped
+        working = g_searches[sid].status == SEARCH_RUNNING;
+    }
+
+    if (working) {
+        int x, y;
+        idToXY(node.nodeID - (uint32_t)sid * size, &x, &y);
+        node.gValue = g_sortList[gid].gValue;
+        node.prev   = g_prevList[gid];
+        node.fValue = node.gValue + computeHValue(g_searches[sid], x, y);
+
+        addr = multiFind(g_nodes, g_hash, hashMask, node.nodeID);
+        found = (addr != UINT32_MAX);
+
+        if (found) {
+            if (node.fValue < g_nodes[addr].fValue) {
+                g_nodes[addr] = node;
+            } else {
+                insert = false;
+            }
+        }
+
+        if (!found) {
+            nodeIndex = atomicAdd(&s_nodeInsertCount, 1);
+        }
+    }
+
+    __syncthreads();
+    if (tid == 0) {
+        s_nodeInsertBase = atomicAdd(g_nodeSize, s_nodeInsertCount);
+    }
+    __syncthreads();
+
+    if (working && !found) {
+        addr = s_nodeInsertBase + nodeIndex;
+        g_nodes[addr] = node;
+        __threadfence();
+        multiInsert(g_hash, hashMask, node.nodeID, addr, g_hashFull);
+    }
+    if (working && insert) {
+        int index = atomicAdd(&g_searches[sid].heapInsertSize, 1);
+        heap_t &item = g_heapInsertList[heapInsertCapacity * sid + index];
+        item.fValue = node.fValue;
+        item.addr = addr;
+    }
+}
+
+template<int NT>
+__global__ void kMultiHeapInsert(
+    // open list
+    heap_t g_openList[],
+    int g_heapSize[],
+    int heapCapacity,
+
+    // searches
+    search_t g_searches[],
+    int numSearch,
+    int heapPerSearch,
+
+    heap_t g_heapInsertList[],
+    int heapInsertCapacity,
+
+    // cleanup variable
+    int *sortListSize,
+    int *sortListSize2
+)
+{
+    int gid = GLOBAL_ID;
+    if (gid == 0) {
+        *sortListSize = 0;
+        *sortListSize2 = 0;
+    }
+
+    int sid = gid / heapPerSearch;
+    if (sid >= numSearch)
+        return;
+
+    int local = gid - sid * heapPerSearch;
+    int heapInsertSize = g_searches[sid].heapInsertSize;
+    int heapIndex = g_searches[sid].heapBeginIndex + local;
+    if (heapIndex >= heapPerSearch)
+        heapIndex -= heapPerSearch;
+    heapIndex += sid * heapPerSearch;
+
+    int heapSize = g_heapSize[heapIndex];
+    heap_t *heap = g_openList + (size_t)heapCapacity * heapIndex - 1;
+    heap_t *insertList = g_heapInsertList + heapInsertCapacity * sid;
+
+    for (int i = local; i < heapInsertSize; i += heapPerSearch) {
+        heap_t value = insertList[i];
+        int now = ++heapSize;
+
+        while (now > 1) {
+            int next = now / 2;
+            heap_t nextValue = heap[next];
+            if (value < nextValue) {
+                heap[now] = nextValue;
+                now = next;
+            } else
+                break;
+        }
+        heap[now] = value;
+    }
+
+    g_heapSize[heapIndex] = heapSize;
+}
+
+#endif /* end of include guard: __GPU_MULTI_KERNEL_CUH_P3KVZ8QE */
@@ -0,0 +1,62 @@
+#ifndef __GPU_SHARD_KERNEL_CUH_M2WJ8ZRL
+#define __GPU_SHARD_KERNEL_CUH_M2WJ8ZRL
+
+// Kernels of a pathway search spread over several devices (see
+// GPU-shard.cuh).  A shard owns the cells of `rowsPerShard' consecutive rows,
+// its graph and hash table only hold those (see localCell()).  The extract
+// kernel and the deduplicate / insert pipeline are the ones of the single
+// device search: the successors are only routed to their owner in between.
+
+#include "GPU-shard.cuh"
+#include "pathway/GPU-kernel.cuh"
+
+// Move the successors of this round into the outbox of their owner, the
+// outbox of shard `k' starts at k * outCapacity.  The parents become
+// references to this shard.
+template<int NT>
+__global__ void kShardRoute(
+    const sort_t g_sortList[],
+    const uint32_t g_prevList[],
+    const int *g_sortListSize,
+
+    int shard,
+    int numShard,
+    int rowsPerShard,
+
+    sort_t g_outList[],
+    uint32_t g_outPrevList[],
+    int outCapacity,
+    int g_outSize[]
+)
+{
+    __shared__ int s_outCount[MAX_SHARD];
+    __shared__ int s_outBase[MAX_SHARD];
+
+    int tid = THREAD_ID;
+    int gid = GLOBAL_ID;
+    if (tid < numShard)
+        s_outCount[tid] = 0;
+    __syncthreads();
+
+    bool working = gid < *g_sortListSize;
+    sort_t sort;
+    int owner, index;
+    if (working) {
+        sort = g_sortList[gid];
+        owner = sort.nodeID / d_width / rowsPerShard;
+        index = atomicAdd(&s_outCount[owner], 1);
+    }
+    __syncthreads();
+
+    if (tid < numShard)
+        s_outBase[tid] = atomicAdd(&g_outSize[tid], s_outCount[tid]);
+    __syncthreads();
+
+    if (working) {
+        int i = owner * outCapacity + s_outBase[owner] + index;
+        g_outList[i] = sort;
+        g_outPrevList[i] = shardRef(shard, g_prevList[gid]);
+    }
+}
+
+#endif /* end of include guard: __GPU_SHARD_KERNEL_CUH_M2WJ8ZRL */
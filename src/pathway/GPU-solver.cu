@@ -1,11 +1,21 @@
 #define NO_CPP11
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <moderngpu.cuh>
-#include <queue>
 
+#include "GPU-memory.cuh"
+#include "GPU-metrics.cuh"
+#include "GPU-shard.cuh"
+#include "anytime.hpp"
 #include "pathway/GPU-solver.hpp"
 #include "pathway/GPU-kernel.cuh"
+#include "pathway/GPU-multi-kernel.cuh"
+#include "pathway/GPU-compact-kernel.cuh"
+#include "pathway/GPU-bounded-kernel.cuh"
+#include "pathway/GPU-bidirectional-kernel.cuh"
+#include "pathway/GPU-shard-kernel.cuh"
 
 using namespace mgpu;
 
@@ -28,6 +38,8 @@ struct DeviceData {
     MGPU_MEM(heap_t) openList;
     // store the size for each heap
     MGPU_MEM(int) heapSize;
+    // one per direction of the bidirectional search, as heapInsertSize and
+    // optimalDistance
     MGPU_MEM(int) heapBeginIndex;
 
     // element waiting to be sorted
@@ -41,26 +53,199 @@ struct DeviceData {
     MGPU_MEM(uint32_t) prevList2;
     MGPU_MEM(int) sortListSize2;
 
+    // scratch table for the hash based deduplication, one word per cell
+    MGPU_MEM(unsigned long long) dedupTable;
+
+    // flipFloat(gValue) << 32 | prev cell for every cell, replaces `nodes'
+    // and `hash' in the compact node layout, and the cells reached
+    MGPU_MEM(unsigned long long) best;
+    MGPU_MEM(uint32_t) touched;
+
     MGPU_MEM(heap_t) heapInsertList;
     MGPU_MEM(int) heapInsertSize;
 
     // current shortest distance (a float)
     MGPU_MEM(uint32_t) optimalDistance;
-    // store the result return by the GPU
-    MGPU_MEM(heap_t) optimalNodes;
-    // store the size for optimalNodes
-    MGPU_MEM(int) optimalNodesSize;
-
-    MGPU_MEM(uint32_t) lastAddr;
-    MGPU_MEM(uint32_t) answerList;
-    MGPU_MEM(int) answerSize;
+    // best solution found: flipFloat(fValue) << 32 | addr, or the meeting
+    // cell instead of addr in the bidirectional search
+    MGPU_MEM(unsigned long long) solution;
+    // SEARCH_RUNNING, SEARCH_SOLVED or SEARCH_FAILED
+    MGPU_MEM(int) status;
+
+    // memory bounded search: the smallest fValue pruned (flipped), a mark
+    // (then the new address) for every node, the fValue range and histogram
+    // of the open list
+    MGPU_MEM(uint32_t) pruned;
+    MGPU_MEM(uint32_t) mark;
+    MGPU_MEM(int) liveSize;
+    MGPU_MEM(uint32_t) range;
+    MGPU_MEM(int) histogram;
+
+    // successors bound to the other shards, one outbox per shard
+    MGPU_MEM(sort_t) outList;
+    MGPU_MEM(uint32_t) outPrevList;
+    MGPU_MEM(int) outSize;
+
+    // the status and the sort list size of the rounds, see search()
+    StatusPoll poll;
 
     ContextPtr context;
 };
 
+// Allocate the node arena and the `numHeap' heaps of the device data `d'
+// within `budget' bytes.  At most `maxNodes' nodes can ever be generated.
+// A `bounded' search never grows its buffers, so the open list takes all
+// that is left by the nodes at once, and a node also pays for the mark and
+// the copy it needs to be compacted.
+template<typename Data>
+void allocateLists(
+    Data *d, int64_t maxNodes, int numHeap, size_t budget, bool bounded,
+    int *nodeCapacity, int *heapCapacity)
+{
+    maxNodes = min<int64_t>(maxNodes, INT_MAX);
+
+    size_t nodeCost = sizeof(node_t);
+    if (bounded)
+        nodeCost += sizeof(uint32_t) + sizeof(node_t) / 2;
+    size_t nodeSize = bufferSize(
+        "node-list-size",
+        min<size_t>(maxNodes, budget / 2 / nodeCost),
+        nodeCost, budget);
+    budget -= nodeCost * nodeSize;
+
+    size_t openListSize = bufferSize(
+        "open-list-size",
+        bounded ? budget / sizeof(heap_t)
+                : min<size_t>(budget / sizeof(heap_t),
+                              max<size_t>(maxNodes,
+                                          numHeap * MIN_HEAP_CAPACITY)),
+        sizeof(heap_t), budget);
+    if (openListSize < numHeap) {
+        cout << "The open list needs at least " << numHeap
+             << " entries" << endl;
+        exit(1);
+    }
+
+    *nodeCapacity = (int)min<size_t>(min<size_t>(nodeSize, maxNodes), INT_MAX);
+    *heapCapacity = (int)min<size_t>(openListSize / numHeap, INT_MAX);
+    if (*nodeCapacity)
+        d->nodes = d->context->template Malloc<node_t>(*nodeCapacity);
+    d->openList = d->context->template Malloc<heap_t>(
+        (size_t)*heapCapacity * numHeap);
+    dout << "\t\tNode list: " << *nodeCapacity << ", heap capacity: "
+         << *heapCapacity << endl;
+}
+
+// Make sure the next round cannot overflow the node arena or any heap.  A
+// round generates at most numHeap * valuePerThread * 8 nodes and pushes at
+// most valuePerThread * 8 items into every heap, so the host keeps upper
+// bounds of both and only reads the real sizes back once a bound runs out.
+// The buffers are doubled when the real sizes do not leave room either.
+template<typename Data>
+void reserveRound(
+    Data *d, int64_t maxNodes, int numHeap, int valuePerThread,
+    int *nodeBound, int *nodeCapacity,
+    int *heapBound, int *heapCapacity)
+{
+    const int nodeGrowth = numHeap * valuePerThread * 8;
+    const int heapGrowth = valuePerThread * 8;
+
+    int64_t nextNodeBound = min<int64_t>(
+        (int64_t)*nodeBound + nodeGrowth, maxNodes);
+    if (nextNodeBound > *nodeCapacity) {
+        *nodeBound = d->nodeSize->Value();
+        nextNodeBound = min<int64_t>(
+            (int64_t)*nodeBound + nodeGrowth, maxNodes);
+    }
+    if (nextNodeBound > *nodeCapacity) {
+        int newCapacity = (int)min<int64_t>(
+            max<int64_t>(2 * (int64_t)*nodeCapacity, nextNodeBound),
+            min<int64_t>(maxNodes, INT_MAX));
+        if (!growBuffer(*d->context, d->nodes, *nodeBound, newCapacity))
+            outOfDeviceMemory("node list", *nodeCapacity);
+        dout << "\t\tNode list grows to " << newCapacity << endl;
+        *nodeCapacity = newCapacity;
+    }
+    *nodeBound = (int)nextNodeBound;
+
+    if (*heapBound + heapGrowth > *heapCapacity) {
+        vector<int> heapSize;
+        d->heapSize->ToHost(heapSize, numHeap);
+        *heapBound = *std::max_element(heapSize.begin(), heapSize.end());
+    }
+    if (*heapBound + heapGrowth > *heapCapacity) {
+        int newCapacity = max(2 * *heapCapacity, *heapBound + heapGrowth);
+        if (!growHeaps(*d->context, d->openList,
+                       numHeap, *heapCapacity, newCapacity))
+            outOfDeviceMemory(
+                "open list", (size_t)*heapCapacity * numHeap);
+        dout << "\t\tHeap capacity grows to " << newCapacity << endl;
+        *heapCapacity = newCapacity;
+    }
+    *heapBound += heapGrowth;
+}
+
+
+// The kernels whose launch geometry is tunable, instantiated for every
+// (NT, VT) pair of LAUNCH_CONFIGS.  The number of blocks is chosen at runtime.
+typedef void (*ExtractExpandKernel)(
+    node_t *, uint8_t *, heap_t *, int *, int,
+    uint32_t *, unsigned long long *, const int *,
+    sort_t *, uint32_t *, int *, int *, int *);
+typedef void (*HeapInsertKernel)(
+    heap_t *, int *, int, int *, heap_t *, int *, int *, int *, const int *);
+typedef void (*CompactExtractExpandKernel)(
+    unsigned long long *, int *, uint32_t *, uint8_t *, heap_t *, int *, int,
+    uint32_t *, unsigned long long *, const int *, heap_t *, int *);
+
+struct launch_config_t {
+    int numThread;
+    int valuePerThread;
+    ExtractExpandKernel extractExpand;
+    HeapInsertKernel heapInsert;
+    CompactExtractExpandKernel compactExtractExpand;
+    ExtractExpandKernel bidirectionalExtractExpand;
+};
+
+#define LAUNCH_CONFIG(NT, VT) \
+    { NT, VT, kExtractExpand<NT, VT>, kHeapInsert<NT>, \
+      kCompactExtractExpand<NT, VT>, kBidirectionalExtractExpand<NT, VT> }
+
+const launch_config_t LAUNCH_CONFIGS[] = {
+    LAUNCH_CONFIG(128, 1),
+    LAUNCH_CONFIG(192, 1),
+    LAUNCH_CONFIG(256, 1),
+    LAUNCH_CONFIG(128, 2),
+    LAUNCH_CONFIG(192, 2),
+    LAUNCH_CONFIG(256, 2),
+    LAUNCH_CONFIG(128, 4),
+};
+const int NUM_LAUNCH_CONFIG =
+    sizeof(LAUNCH_CONFIGS) / sizeof(LAUNCH_CONFIGS[0]);
+
+// blocks per multiprocessor tried by the autotuner
+const int TUNE_BLOCKS_PER_SM[] = { 2, 3, 4, 6 };
+// rounds searched for every candidate of the autotuner
+const int TUNE_ROUNDS = 100;
+// threads of kBandLimit, a power of two
+const int BAND_THREAD = 256;
+
+static int findLaunchConfig(int numThread, int valuePerThread)
+{
+    for (int i = 0; i < NUM_LAUNCH_CONFIG; ++i)
+        if (LAUNCH_CONFIGS[i].numThread == numThread &&
+            LAUNCH_CONFIGS[i].valuePerThread == valuePerThread)
+            return i;
+    return -1;
+}
 
 GPUPathwaySolver::GPUPathwaySolver(Pathway *pathway)
-    : p(pathway)
+    : p(pathway), m_nodeCapacity(0), m_heapCapacity(0),
+      m_launch(-1), m_numBlock(0), m_numHeap(0), m_numValue(0),
+      m_bidirectional(false), m_freeMemory(0), m_bounded(false),
+      m_numPrune(0), m_weight(1), m_fBand(-1), m_ordinal(0), m_shard(0),
+      m_numShard(1), m_shardRows(0), m_rowBegin(0), m_rowEnd(0),
+      m_receiveCapacity(0)
 {
     d = new DeviceData();
 }
@@ -88,83 +273,488 @@ GPUPathwaySolver::~GPUPathwaySolver()
 
 }
 
+// Rows owned by every shard of `numShard', whole tiles of a bitmap graph
+static int shardRows(const Pathway *p, int numShard)
+{
+    int rows = div_up(p->height(), numShard);
+    if (p->bitmapGraph())
+        rows = div_up(rows, GRAPH_TILE) * GRAPH_TILE;
+    return rows;
+}
+
+// Upload the rows [rowBegin, rowEnd) of the graph
+static MGPU_MEM(uint8_t) uploadGraphRows(
+    CudaContext &context, const Pathway *p, int rowBegin, int rowEnd)
+{
+    size_t begin = (size_t)rowBegin * p->width();
+    size_t end = (size_t)rowEnd * p->width();
+    if (p->bitmapGraph()) {
+        // a band of GRAPH_TILE rows is a row of tiles
+        size_t bandBytes =
+            sizeof(uint32_t) * p->tilesPerRow() * GRAPH_TILE;
+        begin = rowBegin / GRAPH_TILE * bandBytes;
+        end = min(p->graphBytes(), div_up(rowEnd, GRAPH_TILE) * bandBytes);
+    }
+    return uploadBuffer(context, p->graphData() + begin, end - begin);
+}
+
 void GPUPathwaySolver::initialize()
 {
+    initializeShard(vm_options["ordinal"].as<int>(), 0, 1);
+}
+
+void GPUPathwaySolver::initializeShard(int ordinal, int shard, int numShard)
+{
+    cudaSetDevice(ordinal);
     cudaDeviceSynchronize();
+    d->poll.release();
     cudaDeviceReset();
 
-    d->context = CreateCudaDevice(vm_options["ordinal"].as<int>());
+    m_ordinal = ordinal;
+    m_shard = shard;
+    m_numShard = numShard;
+    m_shardRows = shardRows(p, numShard);
+    m_rowBegin = min(p->height(), shard * m_shardRows);
+    m_rowEnd = min(p->height(), m_rowBegin + m_shardRows);
+    int64_t numCell = (int64_t)(m_rowEnd - m_rowBegin) * p->width();
+
+    d->context = CreateCudaDevice(ordinal);
+    countDeviceMemory(*d->context);
+    d->poll.create();
+    m_freeMemory = freeDeviceMemory();
+    m_bounded = memoryLimit() != 0;
+
+    initializeGraphLayout(p->bitmapGraph(), p->tilesPerRow(), m_rowBegin);
+    d->graph = uploadGraphRows(*d->context, p, m_rowBegin, m_rowEnd);
+
+    d->nodeSize = d->context->Fill<int>(1, 0);
+
+    m_compact = vm_options["node-layout"].as<string>() == "compact";
+    m_bidirectional = vm_options.count("bidirectional");
+    m_hashDedup = vm_options["dedup"].as<string>() == "hash";
+    // A deferred poll leaves the size of the sort list on the device.  The
+    // hash deduplication reads it there, the sort would have to sort the
+    // whole padded list every round instead.
+    if (vm_options["poll-interval"].as<int>() > 1 && !m_compact &&
+        numShard == 1 && !m_hashDedup) {
+        if (!vm_options["dedup"].defaulted()) {
+            cout << "--poll-interval needs --dedup hash" << endl;
+            exit(1);
+        }
+        m_hashDedup = true;
+    }
+    m_fBand = vm_options["f-band"].as<float>();
+    bool jumpPruning = vm_options.count("jump-pruning");
+    // the parents of the sharded and the backward searches are not cells
+    // of this graph
+    if (jumpPruning && (numShard > 1 || m_bidirectional)) {
+        cout << "--jump-pruning cannot be used with --devices or "
+             << "--bidirectional" << endl;
+        exit(1);
+    }
+    initializePruning(jumpPruning);
+    if (numShard > 1 &&
+        (m_compact || m_bidirectional || m_hashDedup || m_bounded ||
+         vm_options["launch"].as<string>() == "tune")) {
+        cout << "--devices needs the arena node layout, the sort "
+             << "deduplication, no --bidirectional, no --memory-limit and "
+             << "no --launch=tune" << endl;
+        exit(1);
+    }
+    if (numShard > 1 && m_rowBegin == m_rowEnd) {
+        cout << "The graph has too few rows for " << numShard << " devices"
+             << endl;
+        exit(1);
+    }
+    // the parent references keep SHARD_SHIFT bits for the address
+    if (numShard > 1 && numCell > SHARD_ADDR_MASK) {
+        cout << "The graph is too large for " << numShard << " devices, "
+             << "each of them owns at most " << SHARD_ADDR_MASK << " cells"
+             << endl;
+        exit(1);
+    }
+    if (m_bidirectional && (m_compact || m_bounded)) {
+        cout << "--bidirectional needs the arena node layout and no "
+             << "--memory-limit" << endl;
+        exit(1);
+    }
+    if (m_bidirectional && 2 * (int64_t)p->size() >= UINT32_MAX) {
+        cout << "The graph is too large for --bidirectional" << endl;
+        exit(1);
+    }
+    // the backward nodes have IDs of their own
+    size_t numNodeID = (size_t)numCell * (m_bidirectional ? 2 : 1);
+    if (m_compact) {
+        d->best = d->context->Fill<unsigned long long>(p->size(), ULLONG_MAX);
+        d->touched = d->context->Malloc<uint32_t>(p->size());
+    } else
+        d->hash = d->context->Fill<uint32_t>(numNodeID, UINT32_MAX);
 
-    initializeCUDAConstantMemory(
-        p->height(), p->width(), p->ex(), p->ey(),
-        (uint32_t)p->toID(p->ex(), p->ey()));
+    d->heapBeginIndex = d->context->Malloc<int>(2);
 
-    d->graph = d->context->Malloc<uint8_t>(p->graph(), p->size());
+    d->sortListSize = d->context->Malloc<int>(1);
+    d->sortListSize2 = d->context->Malloc<int>(1);
 
-    d->nodes = d->context->Malloc<node_t>(NODE_LIST_SIZE);
-    d->nodeSize = d->context->Fill<int>(1, 1);
+    if (m_hashDedup && !m_compact)
+        d->dedupTable = d->context->Fill<unsigned long long>(
+            numNodeID, ULLONG_MAX);
 
-    d->hash = d->context->Fill<uint32_t>(p->size(), UINT32_MAX);
+    d->heapInsertSize = d->context->Malloc<int>(2);
 
-    d->openList = d->context->Malloc<heap_t>(OPEN_LIST_SIZE);
-    d->heapSize = d->context->Fill<int>(NUM_TOTAL, 0);
-    d->heapBeginIndex = d->context->Fill<int>(1, 0);
+    d->optimalDistance = d->context->Malloc<uint32_t>(2);
+    d->solution = d->context->Malloc<unsigned long long>(1);
+    d->status = d->context->Malloc<int>(1);
 
-    d->sortList = d->context->Malloc<sort_t>(NUM_VALUE * 8);
-    d->prevList = d->context->Malloc<uint32_t>(NUM_VALUE * 8);
-    d->sortList2 = d->context->Malloc<sort_t>(NUM_VALUE * 8);
-    d->prevList2 = d->context->Malloc<uint32_t>(NUM_VALUE * 8);
-    d->sortListSize = d->context->Fill<int>(1, 0);
-    d->sortListSize2 = d->context->Fill<int>(1, 0);
 
-    d->heapInsertList = d->context->Malloc<heap_t>(NUM_VALUE * 8);
-    d->heapInsertSize = d->context->Fill<int>(1, 0);
+    d->pruned = d->context->Malloc<uint32_t>(1);
+    if (m_bounded) {
+        d->liveSize = d->context->Malloc<int>(1);
+        d->range = d->context->Malloc<uint32_t>(2);
+        d->histogram = d->context->Malloc<int>(PRUNE_BINS);
+    }
 
-    d->optimalDistance = d->context->Fill<uint32_t>(1, UINT32_MAX);
-    d->optimalNodes = d->context->Malloc<heap_t>(NUM_TOTAL);
-    d->optimalNodesSize = d->context->Fill<int>(1, 0);
+    int numSM;
+    cudaDeviceGetAttribute(&numSM, cudaDevAttrMultiProcessorCount, ordinal);
+    setLaunch(findLaunchConfig(NUM_THREAD, VALUE_PER_THREAD), 3 * numSM);
 
-    d->lastAddr = d->context->Malloc<uint32_t>(1);
-    d->answerList = d->context->Malloc<uint32_t>(ANSWER_LIST_SIZE);
-    d->answerSize = d->context->Fill<int>(1, 0);
+    // every cell owns at most one node per direction, and the compact
+    // layout none at all
+    allocateLists(d, m_compact ? 0 : numNodeID, m_numHeap,
+                  deviceMemoryBudget(m_freeMemory - freeDeviceMemory(),
+                                     m_bounded),
+                  m_bounded, &m_nodeCapacity, &m_heapCapacity);
+    if (m_bounded && m_nodeCapacity)
+        d->mark = d->context->Malloc<uint32_t>(m_nodeCapacity);
 
-    kInitialize<<<1, 1>>>(
-        *d->nodes,
-        *d->hash,
+    configureLaunch(numSM);
+
+    resetQuery();
+    dout << "\t\tGPU Initialization finishes" << endl;
+}
+
+// Pick the launch geometry from --launch:
+//     default    -- NUM_THREAD x VALUE_PER_THREAD with 3 blocks per SM
+//     tune       -- the cached choice for this device and problem size, or
+//                   the winner of a short tuning pass
+//     NB,NT,VT   -- an explicit geometry from LAUNCH_CONFIGS
+void GPUPathwaySolver::configureLaunch(int numSM)
+{
+    string launch = vm_options["launch"].as<string>();
+    if (launch == "default")
+        return;
+
+    int numBlock, numThread, valuePerThread;
+    if (launch == "tune") {
+        cudaDeviceProp prop;
+        cudaGetDeviceProperties(&prop, m_ordinal);
+        string device = prop.name;
+        // problems within a factor of two share their tuning result
+        int sizeClass = (int)log2((double)p->size());
+
+        if (!readLaunchCache(device, sizeClass,
+                             &numBlock, &numThread, &valuePerThread)) {
+            tune(numSM);
+            writeLaunchCache(device, sizeClass);
+            return;
+        }
+    } else if (sscanf(launch.c_str(), "%d,%d,%d",
+                      &numBlock, &numThread, &valuePerThread) != 3 ||
+               numBlock <= 0) {
+        cout << "Unknown launch geometry: " << launch << endl;
+        help();
+    }
+
+    int config = findLaunchConfig(numThread, valuePerThread);
+    if (config == -1) {
+        cout << "No kernel is instantiated for " << numThread
+             << " threads and " << valuePerThread << " values per thread"
+             << endl;
+        exit(1);
+    }
+    setLaunch(config, numBlock);
+}
+
+// Switch to the launch geometry `config' of LAUNCH_CONFIGS with `numBlock'
+// blocks, the heaps have to be reset afterward.
+void GPUPathwaySolver::setLaunch(int config, int numBlock)
+{
+    const launch_config_t &launch = LAUNCH_CONFIGS[config];
+    size_t openListSize = (size_t)m_heapCapacity * m_numHeap;
+    // each direction takes the heaps of half of the blocks
+    if (m_bidirectional)
+        numBlock += numBlock % 2;
+
+    m_launch = config;
+    m_numBlock = numBlock;
+    m_numHeap = numBlock * launch.numThread;
+    m_numValue = m_numHeap * launch.valuePerThread;
+    dout << "\t\tLaunch geometry: " << m_numBlock << " x "
+         << launch.numThread << " x " << launch.valuePerThread << endl;
+
+    d->heapSize = d->context->Malloc<int>(m_numHeap);
+    if (!m_compact) {
+        d->sortList = d->context->Malloc<sort_t>(m_numValue * 8);
+        d->prevList = d->context->Malloc<uint32_t>(m_numValue * 8);
+        d->sortList2 = d->context->Malloc<sort_t>(m_numValue * 8);
+        d->prevList2 = d->context->Malloc<uint32_t>(m_numValue * 8);
+    }
+    d->heapInsertList = d->context->Malloc<heap_t>(m_numValue * 8);
+
+    // spread the allocated open list over the new number of heaps
+    if (m_heapCapacity) {
+        m_heapCapacity = openListSize / m_numHeap;
+        if (m_heapCapacity < MIN_HEAP_CAPACITY) {
+            m_heapCapacity = MIN_HEAP_CAPACITY;
+            d->openList = d->context->Malloc<heap_t>(
+                (size_t)m_heapCapacity * m_numHeap);
+        }
+    }
+}
+
+// Search the current query for TUNE_ROUNDS rounds with every candidate
+// geometry and keep the one generating nodes at the highest rate.
+void GPUPathwaySolver::tune(int numSM)
+{
+    const int numBlocksPerSM =
+        sizeof(TUNE_BLOCKS_PER_SM) / sizeof(TUNE_BLOCKS_PER_SM[0]);
+
+    cudaEvent_t start, stop;
+    cudaEventCreate(&start);
+    cudaEventCreate(&stop);
+
+    int bestConfig = m_launch, bestBlock = m_numBlock;
+    float bestRate = 0;
+    for (int config = 0; config < NUM_LAUNCH_CONFIG; ++config)
+        for (int i = 0; i < numBlocksPerSM; ++i) {
+            int numBlock = TUNE_BLOCKS_PER_SM[i] * numSM;
+            setLaunch(config, numBlock);
+            resetQuery();
+
+            cudaEventRecord(start);
+            search(TUNE_ROUNDS);
+            cudaEventRecord(stop);
+            cudaEventSynchronize(stop);
+
+            float elapsed;
+            cudaEventElapsedTime(&elapsed, start, stop);
+            float rate = d->nodeSize->Value() / max(elapsed, 1e-3f);
+            dout << "\t\t\t" << rate << " nodes/ms" << endl;
+            if (rate > bestRate) {
+                bestRate = rate;
+                bestConfig = config;
+                bestBlock = numBlock;
+            }
+        }
+
+    cudaEventDestroy(start);
+    cudaEventDestroy(stop);
+    // clear the launch error of a candidate that does not fit on the device
+    cudaGetLastError();
+    setLaunch(bestConfig, bestBlock);
+}
+
+// The cache holds one "sizeClass NB NT VT device name" line per choice
+bool GPUPathwaySolver::readLaunchCache(
+    const string &device, int sizeClass,
+    int *numBlock, int *numThread, int *valuePerThread)
+{
+    std::ifstream fin(vm_options["launch-cache"].as<string>().c_str());
+    int cachedClass, nb, nt, vt;
+    string name;
+    while (fin >> cachedClass >> nb >> nt >> vt && getline(fin, name)) {
+        name.erase(0, name.find_first_not_of(' '));
+        if (cachedClass == sizeClass && name == device) {
+            *numBlock = nb;
+            *numThread = nt;
+            *valuePerThread = vt;
+            return true;
+        }
+    }
+    return false;
+}
+
+void GPUPathwaySolver::writeLaunchCache(const string &device, int sizeClass)
+{
+    std::ofstream fout(vm_options["launch-cache"].as<string>().c_str(),
+                       std::ios::app);
+    const launch_config_t &launch = LAUNCH_CONFIGS[m_launch];
+    fout << sizeClass << " " << m_numBlock << " " << launch.numThread << " "
+         << launch.valuePerThread << " " << device << endl;
+}
+
+void GPUPathwaySolver::resetQuery()
+{
+    cudaSetDevice(m_ordinal);
+    initializeCUDAConstantMemory(
+        p->height(), p->width(), p->ex(), p->ey(),
+        (uint32_t)p->toID(p->ex(), p->ey()), m_weight);
+    if (m_bidirectional)
+        initializeBidirectional(p->sx(), p->sy());
+
+    // Only the hash slots (or cells) touched by the previous search are
+    // cleared, every one of them is owned by a node in [0, nodeSize).
+    int nodeSize = d->nodeSize->Value();
+    if (m_compact && nodeSize) {
+        kCompactReset<NUM_THREAD><<<
+            div_up(nodeSize, NUM_THREAD), NUM_THREAD>>>(
+                *d->best,
+                *d->touched,
+                nodeSize
+            );
+    } else if (!m_compact && nodeSize) {
+        kResetHash<NUM_THREAD><<<div_up(nodeSize, NUM_THREAD), NUM_THREAD>>>(
+            *d->nodes,
+            nodeSize,
+            *d->hash
+        );
+    }
+
+    // only the owner of the start cell has a root
+    bool root = m_rowBegin <= p->sx() && p->sx() < m_rowEnd;
+    int numRoot = !root ? 0 : m_bidirectional ? 2 : 1;
+    d->nodeSize->FromHost(&numRoot, 1);
+    m_nodeBound = numRoot;
+    m_heapBound = 1;
+    cudaMemset(d->heapSize->get(), 0, sizeof(int) * m_numHeap);
+    cudaMemset(d->heapBeginIndex->get(), 0, 2 * sizeof(int));
+    cudaMemset(d->sortListSize->get(), 0, sizeof(int));
+    cudaMemset(d->sortListSize2->get(), 0, sizeof(int));
+    cudaMemset(d->heapInsertSize->get(), 0, 2 * sizeof(int));
+    cudaMemset(d->optimalDistance->get(), 0xFF, 2 * sizeof(uint32_t));
+    cudaMemset(d->solution->get(), 0xFF, sizeof(unsigned long long));
+    cudaMemset(d->status->get(), 0, sizeof(int));
+    cudaMemset(d->pruned->get(), 0xFF, sizeof(uint32_t));
+    m_numPrune = 0;
+
+    if (m_compact) {
+        kCompactInitialize<<<1, 1>>>(
+            *d->best,
+            *d->touched,
+            *d->openList,
+            *d->heapSize,
+            p->sx(),
+            p->sy()
+        );
+    } else if (m_bidirectional) {
+        kBidirectionalInitialize<<<1, 1>>>(
+            *d->nodes,
+            *d->hash,
+            *d->openList,
+            *d->heapSize,
+            m_heapCapacity,
+            m_numHeap,
+            p->sx(),
+            p->sy(),
+            p->ex(),
+            p->ey(),
+            *d->solution
+        );
+    } else if (root) {
+        kInitialize<<<1, 1>>>(
+            *d->nodes,
+            *d->hash,
+            *d->openList,
+            *d->heapSize,
+            p->sx(),
+            p->sy()
+        );
+    }
+#ifdef KERNEL_LOG
+    cudaDeviceSynchronize();
+#endif
+}
+
+bool GPUPathwaySolver::solve()
+{
+    search(INT_MAX);
+    recordDeviceMemory("gpu", *d->context);
+
+    if (d->status->Value() != SEARCH_SOLVED)
+        return false;
+
+    unsigned long long solution = d->solution->Value();
+    m_optimalNodeAddr = solution & UINT32_MAX;
+    m_optimalDistance = reverseFlipFloat((uint32_t)(solution >> 32));
+    printf("\t\t\t Number of nodes expanded: %d\n", d->nodeSize->Value());
+    metrics.counter("gpu", "expanded", d->nodeSize->Value());
+    dprintf("\t\t\t Optimal nodes address: %d\n", m_optimalNodeAddr);
+    return true;
+}
+
+void GPUPathwaySolver::limitBand(int numDirection)
+{
+    if (m_fBand < 0)
+        return;
+    kBandLimit<BAND_THREAD><<<numDirection, BAND_THREAD>>>(
         *d->openList,
         *d->heapSize,
-        p->sx(),
-        p->sy()
+        m_heapCapacity,
+        m_numHeap / numDirection,
+        m_fBand,
+        *d->status
     );
-    dout << "\t\tGPU Initialization finishes" << endl;
 }
 
-bool GPUPathwaySolver::solve()
+void GPUPathwaySolver::search(int maxRound)
 {
-    std::priority_queue< heap_t, vector<heap_t>, std::greater<heap_t> > pq;
+    if (m_compact) {
+        searchCompact(maxRound);
+        return;
+    }
 
-    for (int round = 0; ;++round) {
+    // With a poll interval larger than one, the host queues that many rounds
+    // without waiting for the device.  Every kernel reads its sizes from the
+    // device and becomes a no-op once the search is finished, which is why
+    // they go with the hash deduplication (see initializeShard()).  The
+    // status is copied on the side at every poll and only looked at one poll
+    // later, the device keeps running the next rounds meanwhile.  The memory
+    // bounded search has to stop right away, its pruning depends on the
+    // heaps left.
+    int pollInterval = max(vm_options["poll-interval"].as<int>(), 1);
+    bool deferred = pollInterval > 1;
+    int pollLag = deferred && !m_bounded ? 1 : 0;
+    const int sortListCapacity = m_numValue * 8;
+    int *statusWords[] = { d->status->get(), d->sortListSize->get() };
+    d->poll.reset();
+
+    const launch_config_t &launch = LAUNCH_CONFIGS[m_launch];
+    ExtractExpandKernel extractExpand = m_bidirectional
+        ? launch.bidirectionalExtractExpand : launch.extractExpand;
+    HeapInsertKernel heapInsert = launch.heapInsert;
+    const int64_t numNodeID = (int64_t)p->size() * (m_bidirectional ? 2 : 1);
+    RoundProbe probe("gpu");
+
+    for (int round = 0; round < maxRound; ++round) {
         if (DEBUG_CONDITION) {
             vector<int> heapSize;
-            d->heapSize->ToHost(heapSize, NUM_TOTAL);
-            printf("\t\t\t Heapsize: %d of %d\n", heapSize[0], HEAP_CAPACITY);
+            d->heapSize->ToHost(heapSize, m_numHeap);
+            printf("\t\t\t Heapsize: %d of %d\n", heapSize[0], m_heapCapacity);
         }
 
-        // printf("\t\tRound %d\n", round); fflush(stdout);
+        if (m_bounded) {
+            reserveBoundedRound(launch.valuePerThread);
+        } else {
+            reserveRound(d, numNodeID, m_numHeap, launch.valuePerThread,
+                         &m_nodeBound, &m_nodeCapacity,
+                         &m_heapBound, &m_heapCapacity);
+        }
+        probe.begin(round, d->heapSize->get(), m_numHeap, m_heapCapacity,
+                    launch.valuePerThread);
+
+        limitBand(m_bidirectional ? 2 : 1);
         dprintf("\t\tRound %d: kExtractExpand\n", round);
-        kExtractExpand<
-            NUM_BLOCK, NUM_THREAD, VALUE_PER_THREAD, HEAP_CAPACITY> <<<
-            NUM_BLOCK, NUM_THREAD>>>(
+        extractExpand<<<m_numBlock, launch.numThread>>>(
                 *d->nodes,
 
                 *d->graph,
 
                 *d->openList,
                 *d->heapSize,
+                m_heapCapacity,
 
                 *d->optimalDistance,
-                *d->optimalNodes,
-                *d->optimalNodesSize,
+                *d->solution,
+                *d->status,
 
                 *d->sortList,
                 *d->prevList,
@@ -178,99 +768,243 @@ bool GPUPathwaySolver::solve()
         cudaDeviceSynchronize();
 #endif
 
-        dprintf("\t\tRound %d: Fetch optimalNodesSize: ", round);
-        int optimalNodesSize = d->optimalNodesSize->Value();
-        dprintf("%d\n", optimalNodesSize);
+        if (m_bidirectional) {
+            kBidirectionalCheckTermination<<<1, 1>>>(
+                *d->solution,
+                *d->optimalDistance,
+                *d->status
+            );
+        } else {
+            kCheckTermination<<<1, 1>>>(
+                *d->solution,
+                *d->optimalDistance,
+                *d->status
+            );
+        }
+        probe.mark(RoundProbe::MARK_EXTRACT);
+
+        // the sizes on the device bound the grids below, the deduplicated
+        // list is no longer than the sort list
+        int sortListSize = sortListCapacity;
+        if (!deferred) {
+            dprintf("\t\tRound %d: Fetch status and sortListSize: ", round);
+            d->poll.issue(statusWords, 2);
+            const int *words = d->poll.wait(0);
+            dprintf("%d %d\n", words[0], words[1]);
+            if (words[0] != SEARCH_RUNNING)
+                break;
+            sortListSize = words[1];
+        }
 
-        if (optimalNodesSize) {
-            printf("\t\tRound %d: Found one solution\n", round);
-            vector<heap_t> optimalNodes;
-            d->optimalNodes->ToHost(optimalNodes, optimalNodesSize);
+        if (sortListSize && m_hashDedup) {
+            dprintf("\t\tRound %d: kHashMark\n", round);
+            kHashMark<NUM_THREAD><<<
+                div_up(sortListSize, NUM_THREAD), NUM_THREAD>>> (
+                    *d->sortList,
+                    *d->prevList,
+                    *d->sortListSize,
 
-            uint32_t optimalDistance = d->optimalDistance->Value();
-            dprintf("\t\tRound %d: Fetch optimalDistance: %.2f\n", round, reverseFlipFloat(optimalDistance));
+                    *d->dedupTable,
 
-            for (size_t i = 0; i != optimalNodes.size(); ++i) {
-                dprintf("\t\t\t optimalNodes[%d]: %.3f\n", (int)i, optimalNodes[i].fValue);
-                pq.push(optimalNodes[i]);
-            }
+                    *d->status
+                );
 
-            dprintf("\t\t\t pq.top(): %.3f\n", pq.top().fValue);
-            if (flipFloat(pq.top().fValue) <= optimalDistance) {
-                printf("\t\t\t Number of nodes expanded: %d\n", d->nodeSize->Value());
-                m_optimalNodeAddr = pq.top().addr;
-                m_optimalDistance = pq.top().fValue;
-                dprintf("\t\t\t Optimal nodes address: %d\n", m_optimalNodeAddr);
-                return true;
-            }
-        }
+            dprintf("\t\tRound %d: kHashCollect\n", round);
+            kHashCollect<NUM_THREAD><<<
+                div_up(sortListSize, NUM_THREAD), NUM_THREAD>>> (
+                    *d->sortList,
+                    *d->prevList,
+                    *d->sortListSize,
 
-        dprintf("\t\tRound %d: Fetch sortListSize: ", round);
-        int sortListSize = d->sortListSize->Value();
-        dprintf("%d\n", sortListSize);
-        // if (round % 2000 == 0) {
-        //     printf("\t\tRound %d: Fetch sortListSize: %d\n", round, sortListSize);
-        // }
-        if (sortListSize == 0)
-            return false;
+                    *d->dedupTable,
 
-        dprintf("\t\tRound %d: MergesortPairs\n", round);
-        MergesortPairs(
-            d->sortList->get(),
-            d->prevList->get(),
-            sortListSize,
-            *d->context
-        );
+                    *d->sortList2,
+                    *d->prevList2,
+                    *d->sortListSize2,
 
-        dprintf("\t\tRound %d: kAssign\n", round);
-        kAssign<NUM_THREAD><<<
-            div_up(sortListSize, NUM_THREAD), NUM_THREAD>>> (
-                *d->sortList,
-                *d->prevList,
+                    *d->status
+                );
+#ifdef KERNEL_LOG
+            cudaDeviceSynchronize();
+#endif
+        } else if (sortListSize) {
+            dprintf("\t\tRound %d: MergesortPairs\n", round);
+            MergesortPairs(
+                d->sortList->get(),
+                d->prevList->get(),
                 sortListSize,
-
-                *d->sortList2,
-                *d->prevList2,
-                *d->sortListSize2
+                *d->context
             );
+
+            dprintf("\t\tRound %d: kAssign\n", round);
+            kAssign<NUM_THREAD><<<
+                div_up(sortListSize, NUM_THREAD), NUM_THREAD>>> (
+                    *d->sortList,
+                    *d->prevList,
+                    *d->sortListSize,
+
+                    *d->sortList2,
+                    *d->prevList2,
+                    *d->sortListSize2,
+
+                    *d->status
+                );
+#ifdef KERNEL_LOG
+            cudaDeviceSynchronize();
+#endif
+        }
+
+        if (sortListSize) {
+            if (m_bidirectional) {
+                dprintf("\t\tRound %d: kBidirectionalDeduplicate\n", round);
+                kBidirectionalDeduplicate<NUM_THREAD> <<<
+                    div_up(sortListSize, NUM_THREAD), NUM_THREAD>>> (
+                        *d->nodes,
+                        *d->nodeSize,
+
+                        *d->hash,
+
+                        *d->sortList2,
+                        *d->prevList2,
+                        *d->sortListSize2,
+
+                        *d->heapInsertList,
+                        m_numValue * 4,
+                        *d->heapInsertSize,
+
+                        *d->solution,
+                        *d->status
+                    );
+            } else {
+                dprintf("\t\tRound %d: kDeduplicate\n", round);
+                kDeduplicate<NUM_THREAD> <<<
+                    div_up(sortListSize, NUM_THREAD), NUM_THREAD>>> (
+                        *d->nodes,
+                        *d->nodeSize,
+
+                        *d->hash,
+
+                        *d->sortList2,
+                        *d->prevList2,
+                        *d->sortListSize2,
+
+                        *d->heapInsertList,
+                        *d->heapInsertSize,
+
+                        *d->status
+                    );
+            }
+#ifdef KERNEL_LOG
+            cudaDeviceSynchronize();
+#endif
+        }
+
+        probe.mark(RoundProbe::MARK_DEDUP);
+        if (probe.active()) {
+            // kHeapInsert resets the sizes
+            round_metrics_t &r = probe.counters();
+            int heapInsertSize[2];
+            d->heapInsertSize->ToHost(heapInsertSize, 2);
+            r.successors = d->sortListSize->Value();
+            r.duplicates = r.successors - d->sortListSize2->Value();
+            r.inserted = heapInsertSize[0] + heapInsertSize[1];
+        }
+
+        // A direction has the heaps of half of the blocks, and a half of
+        // the insert list: it expands at most m_numValue / 2 nodes.
+        int numDirection = m_bidirectional ? 2 : 1;
+        int numBlock = m_numBlock / numDirection;
+        int numHeap = m_numHeap / numDirection;
+        for (int dir = 0; dir < numDirection; ++dir) {
+            dprintf("\t\tRound %d: kHeapInsert\n", round);
+            heapInsert<<<numBlock, launch.numThread>>> (
+                    d->openList->get() + (size_t)m_heapCapacity * numHeap * dir,
+                    d->heapSize->get() + numHeap * dir,
+                    m_heapCapacity,
+                    d->heapBeginIndex->get() + dir,
+
+                    d->heapInsertList->get() + m_numValue * 4 * dir,
+                    d->heapInsertSize->get() + dir,
+
+                    // reset them BTW
+                    *d->sortListSize,
+                    *d->sortListSize2,
+
+                    *d->status
+                );
+        }
 #ifdef KERNEL_LOG
         cudaDeviceSynchronize();
 #endif
+        probe.mark(RoundProbe::MARK_INSERT);
+        if (probe.active())
+            probe.end(d->nodeSize->Value(), m_nodeCapacity);
+        dprintf("\t\tRound %d: Finished\n\n", round);
 
-        dprintf("\t\tRound %d: Fetch sortListSize2: ", round);
-        int sortListSize2 = d->sortListSize2->Value();
-        dprintf("%d\n", sortListSize2);
-        // if (round % 2000 == 0) {
-        //     printf("\t\tRound %d: Fetch sortListSize2: %d\n", round, sortListSize2);
-        // }
-
-        dprintf("\t\tRound %d: kDeduplicate\n", round);
-        // printf("\t\tRound %d: nodeSize: %d\n", round, d->nodeSize->Value());
-        kDeduplicate<NUM_THREAD> <<<
-            div_up(sortListSize2, NUM_THREAD), NUM_THREAD>>> (
-                *d->nodes,
+        if (deferred && (round + 1) % pollInterval == 0) {
+            d->poll.issue(statusWords, 1);
+            const int *words = d->poll.wait(pollLag);
+            if (words && words[0] != SEARCH_RUNNING)
+                break;
+        }
+    }
+}
+
+// One round of the compact layout is extract and relax, then push: the
+// successors are deduplicated by the atomicMin on their cells.
+void GPUPathwaySolver::searchCompact(int maxRound)
+{
+    // polled as in search()
+    int pollInterval = max(vm_options["poll-interval"].as<int>(), 1);
+    int pollLag = pollInterval > 1 && !m_bounded ? 1 : 0;
+    int *statusWords[] = { d->status->get() };
+    d->poll.reset();
+
+    const launch_config_t &launch = LAUNCH_CONFIGS[m_launch];
+    CompactExtractExpandKernel extractExpand = launch.compactExtractExpand;
+    HeapInsertKernel heapInsert = launch.heapInsert;
+
+    for (int round = 0; round < maxRound; ++round) {
+        if (m_bounded) {
+            reserveBoundedRound(launch.valuePerThread);
+        } else {
+            reserveRound(d, 0, m_numHeap, launch.valuePerThread,
+                         &m_nodeBound, &m_nodeCapacity,
+                         &m_heapBound, &m_heapCapacity);
+        }
+
+        limitBand(1);
+        dprintf("\t\tRound %d: kCompactExtractExpand\n", round);
+        extractExpand<<<m_numBlock, launch.numThread>>>(
+                *d->best,
                 *d->nodeSize,
+                *d->touched,
 
-                *d->hash,
+                *d->graph,
 
-                *d->sortList2,
-                *d->prevList2,
-                sortListSize2,
+                *d->openList,
+                *d->heapSize,
+                m_heapCapacity,
+
+                *d->optimalDistance,
+                *d->solution,
+                *d->status,
 
                 *d->heapInsertList,
                 *d->heapInsertSize
             );
-        // printf("\t\tRound %d: nodeSize: %d\n", round, d->nodeSize->Value());
-#ifdef KERNEL_LOG
-        cudaDeviceSynchronize();
-#endif
+
+        kCheckTermination<<<1, 1>>>(
+            *d->solution,
+            *d->optimalDistance,
+            *d->status
+        );
 
         dprintf("\t\tRound %d: kHeapInsert\n", round);
-        kHeapInsert<
-            NUM_BLOCK, NUM_THREAD, HEAP_CAPACITY> <<<
-            NUM_BLOCK, NUM_THREAD>>> (
+        heapInsert<<<m_numBlock, launch.numThread>>> (
                 *d->openList,
                 *d->heapSize,
+                m_heapCapacity,
                 *d->heapBeginIndex,
 
                 *d->heapInsertList,
@@ -279,40 +1013,298 @@ bool GPUPathwaySolver::solve()
                 // reset them BTW
                 *d->sortListSize,
                 *d->sortListSize2,
-                *d->optimalDistance,
-                *d->optimalNodesSize
+
+                *d->status
             );
+        kCompactAdvance<<<1, 1>>>(
+            *d->heapBeginIndex,
+            *d->heapInsertSize,
+            m_numHeap
+        );
 #ifdef KERNEL_LOG
         cudaDeviceSynchronize();
 #endif
-        dprintf("\t\tRound %d: Finished\n\n", round);
+
+        if ((round + 1) % pollInterval == 0) {
+            d->poll.issue(statusWords, 1);
+            const int *words = d->poll.wait(pollLag);
+            if (words && words[0] != SEARCH_RUNNING)
+                break;
+        }
+    }
+}
+
+// links gathered on the device per copy, see downloadLinks()
+const int LINK_CHUNK = 1 << 20;
+
+// Copy the links (see kGatherLinks) of the `count' elements of `source' back
+// to `links'.  Only the fields that a path needs cross the bus, gathered
+// through a buffer of LINK_CHUNK links.
+template<class T, class L>
+static void downloadLinks(CudaContext &context, const T *source, size_t count,
+                          vector<L> *links)
+{
+    links->resize(count);
+    MGPU_MEM(L) chunk = context.Malloc<L>(max<size_t>(
+        min<size_t>(count, LINK_CHUNK), 1));
+    for (size_t begin = 0; begin < count; begin += LINK_CHUNK) {
+        int size = (int)min<size_t>(count - begin, LINK_CHUNK);
+        kGatherLinks<T, L, NUM_THREAD><<<
+            div_up(size, NUM_THREAD), NUM_THREAD>>>(
+                source + begin,
+                size,
+                *chunk
+            );
+        cudaMemcpy(&(*links)[begin], chunk->get(), sizeof(L) * size,
+                   cudaMemcpyDeviceToHost);
     }
 }
 
+// Append the cells on the path back from the node at `addr', the node IDs
+// start at `base'.  The paths are walked on the host over a copy of the
+// links: on the device, a single thread would chase the pointers one by one.
+static void walkPath(const vector<link_t> &links, uint32_t addr,
+                     uint32_t base, vector<int> *pathList)
+{
+    for (; addr != UINT32_MAX; addr = links[addr].prev)
+        pathList->push_back((int)(links[addr].nodeID - base));
+}
+
 void GPUPathwaySolver::getSolution(float *optimal, vector<int> *pathList)
 {
-    d->lastAddr->FromHost(&m_optimalNodeAddr, 1);
-    kFetchAnswer<<<1, 1>>>(
-        *d->nodes,
+    *optimal = m_optimalDistance;
+    pathList->clear();
 
-        *d->lastAddr,
+    if (m_compact) {
+        vector<uint32_t> prev;
+        downloadLinks(*d->context, d->best->get(), (size_t)p->size(), &prev);
+        for (uint32_t cell = m_optimalNodeAddr; cell != UINT32_MAX;
+             cell = prev[cell])
+            pathList->push_back((int)cell);
+        std::reverse(pathList->begin(), pathList->end());
+        return;
+    }
 
-        *d->answerList,
-        *d->answerSize
-    );
+    vector<link_t> links;
+    downloadLinks(*d->context, d->nodes->get(), (size_t)d->nodeSize->Value(),
+                  &links);
+    if (!m_bidirectional) {
+        walkPath(links, m_optimalNodeAddr, 0, pathList);
+        std::reverse(pathList->begin(), pathList->end());
+        return;
+    }
 
-    int answerSize = d->answerSize->Value();
+    // Both halves meet at the cell m_optimalNodeAddr: the forward one from
+    // the start to it, then the backward one from the next cell to the target
+    uint32_t cells = p->size();
+    uint32_t meeting[2];
+    cudaMemcpy(&meeting[0], d->hash->get() + m_optimalNodeAddr,
+               sizeof(uint32_t), cudaMemcpyDeviceToHost);
+    cudaMemcpy(&meeting[1], d->hash->get() + m_optimalNodeAddr + cells,
+               sizeof(uint32_t), cudaMemcpyDeviceToHost);
+    walkPath(links, meeting[0], 0, pathList);
+    std::reverse(pathList->begin(), pathList->end());
+    walkPath(links, links[meeting[1]].prev, cells, pathList);
+}
 
-    vector<uint32_t> answerList;
-    d->answerList->ToHost(answerList, answerSize);
+bool GPUPathwaySolver::lowerBound(float *bound)
+{
+    uint32_t pruned = d->pruned->Value();
+    if (m_numPrune)
+        printf("\t\t\t Open list pruned %d times, smallest fValue pruned: "
+               "%.3f\n", m_numPrune, reverseFlipFloat(pruned));
+    if (pruned == UINT32_MAX)
+        return false;
+    if (d->status->Value() == SEARCH_SOLVED &&
+        m_optimalDistance <= reverseFlipFloat(pruned))
+        return false;
+    // pruned under --weight, see anytime.hpp
+    *bound = reverseFlipFloat(pruned) / m_weight;
+    return true;
+}
 
-    *optimal = m_optimalDistance;
-    pathList->clear();
-    pathList->reserve(answerSize);
-    for (int i = answerSize-1; i >= 0; --i) {
-        pathList->push_back((int)answerList[i]);
+void GPUPathwaySolver::setWeight(float weight)
+{
+    m_weight = weight;
+}
+
+// Same bounds as reserveRound(), but the buffers are full for good once the
+// real sizes leave no room for a round.  Every cell owns at most one node,
+// so an arena of p->size() nodes is never pruned.
+void GPUPathwaySolver::reserveBoundedRound(int valuePerThread)
+{
+    const int nodeGrowth = m_numHeap * valuePerThread * 8;
+    const int heapGrowth = valuePerThread * 8;
+    bool full = false;
+
+    if (!m_compact &&
+        min<int64_t>((int64_t)m_nodeBound + nodeGrowth, p->size()) >
+        m_nodeCapacity) {
+        m_nodeBound = d->nodeSize->Value();
+        full = min<int64_t>((int64_t)m_nodeBound + nodeGrowth, p->size()) >
+            m_nodeCapacity;
+    }
+    if (m_heapBound + heapGrowth > m_heapCapacity) {
+        m_heapBound = maxHeapSize();
+        if (m_heapBound + heapGrowth > m_heapCapacity)
+            full = true;
     }
 
+    // reads both sizes back
+    if (full)
+        prune(valuePerThread);
+    m_nodeBound += nodeGrowth;
+    m_heapBound += heapGrowth;
+}
+
+int GPUPathwaySolver::maxHeapSize()
+{
+    vector<int> heapSize;
+    d->heapSize->ToHost(heapSize, m_numHeap);
+    return *std::max_element(heapSize.begin(), heapSize.end());
+}
+
+// Make room for the next round within --memory-limit.  The open list is
+// halved until the nodes it leads back to fit in half of the arena and every
+// heap has room for a round, then those nodes are compacted to the front of
+// the arena and indexed again.  The compact layout has no arena, but the
+// cells of the pruned items keep their gValue there, so they are only
+// searched again through a shorter path.
+void GPUPathwaySolver::prune(int valuePerThread)
+{
+    const int nodeGrowth = m_numHeap * valuePerThread * 8;
+    const int heapGrowth = valuePerThread * 8;
+    const int numBlock = div_up(m_numHeap, NUM_THREAD);
+    int nodeSize = m_compact ? 0 : d->nodeSize->Value();
+
+    int liveSize = 0;
+    for (;;) {
+        if (!pruneHeaps())
+            outOfDeviceMemory("open list (--memory-limit)",
+                              (size_t)m_heapCapacity * m_numHeap);
+        m_heapBound = maxHeapSize();
+        bool heapFits = m_heapBound + heapGrowth <= m_heapCapacity;
+        if (m_compact) {
+            if (heapFits)
+                break;
+            continue;
+        }
+
+        cudaMemset(d->mark->get(), 0, sizeof(uint32_t) * nodeSize);
+        cudaMemset(d->liveSize->get(), 0, sizeof(int));
+        kMarkLive<node_t, heap_t, NUM_THREAD><<<numBlock, NUM_THREAD>>>(
+            *d->nodes,
+            *d->openList,
+            *d->heapSize,
+            m_heapCapacity,
+            m_numHeap,
+            *d->solution,
+            *d->mark,
+            *d->liveSize
+        );
+        liveSize = d->liveSize->Value();
+        if (liveSize <= m_nodeCapacity / 2 &&
+            min<int64_t>((int64_t)liveSize + nodeGrowth, p->size()) <=
+            m_nodeCapacity && heapFits)
+            break;
+    }
+    ++m_numPrune;
+    if (m_compact) {
+        dout << "\t\tPruned the open list" << endl;
+        return;
+    }
+
+    cudaMemset(d->liveSize->get(), 0, sizeof(int));
+    kAssignLive<NUM_THREAD><<<div_up(nodeSize, NUM_THREAD), NUM_THREAD>>>(
+        *d->mark,
+        nodeSize,
+        *d->liveSize
+    );
+    kResetHash<NUM_THREAD><<<div_up(nodeSize, NUM_THREAD), NUM_THREAD>>>(
+        *d->nodes,
+        nodeSize,
+        *d->hash
+    );
+    MGPU_MEM(node_t) compacted = d->context->Malloc<node_t>(max(liveSize, 1));
+    kCompactNodes<node_t, NUM_THREAD><<<
+        div_up(nodeSize, NUM_THREAD), NUM_THREAD>>>(
+            *d->nodes,
+            nodeSize,
+            *d->mark,
+            *compacted
+        );
+    cudaMemcpy(d->nodes->get(), compacted->get(),
+               sizeof(node_t) * liveSize, cudaMemcpyDeviceToDevice);
+    compacted = MGPU_MEM(node_t)();
+    kIndexNodes<NUM_THREAD><<<
+        div_up(max(liveSize, 1), NUM_THREAD), NUM_THREAD>>>(
+            *d->nodes,
+            liveSize,
+            *d->hash
+        );
+    kRemapHeaps<heap_t, NUM_THREAD><<<numBlock, NUM_THREAD>>>(
+        *d->openList,
+        *d->heapSize,
+        m_heapCapacity,
+        m_numHeap,
+        *d->mark,
+        *d->solution
+    );
+
+    d->nodeSize->FromHost(&liveSize, 1);
+    m_nodeBound = liveSize;
+    dout << "\t\tPruned the open list, " << liveSize << " of "
+         << nodeSize << " nodes kept" << endl;
+}
+
+// Drop the worse half of the open list, return false if nothing can go
+bool GPUPathwaySolver::pruneHeaps()
+{
+    const int numBlock = div_up(m_numHeap, NUM_THREAD);
+
+    uint32_t range[2] = { UINT32_MAX, 0 };
+    d->range->FromHost(range, 2);
+    kHeapRange<NUM_THREAD><<<numBlock, NUM_THREAD>>>(
+        *d->openList,
+        *d->heapSize,
+        m_heapCapacity,
+        m_numHeap,
+        *d->range
+    );
+    d->range->ToHost(range, 2);
+    if (range[0] >= range[1])
+        return false;
+    float low = reverseFlipFloat(range[0]);
+    float scale = PRUNE_BINS / (reverseFlipFloat(range[1]) - low);
+
+    cudaMemset(d->histogram->get(), 0, sizeof(int) * PRUNE_BINS);
+    kHeapHistogram<heap_t, NUM_THREAD><<<numBlock, NUM_THREAD>>>(
+        *d->openList,
+        *d->heapSize,
+        m_heapCapacity,
+        m_numHeap,
+        low,
+        scale,
+        *d->histogram
+    );
+    vector<int> histogram;
+    d->histogram->ToHost(histogram, PRUNE_BINS);
+
+    int64_t dropped;
+    int cut = pruneCut(histogram, &dropped);
+    if (!dropped)
+        return false;
+    kPruneHeaps<heap_t, NUM_THREAD><<<numBlock, NUM_THREAD>>>(
+        *d->openList,
+        *d->heapSize,
+        m_heapCapacity,
+        m_numHeap,
+        low,
+        scale,
+        cut,
+        *d->pruned
+    );
+    return true;
 }
 
 bool GPUPathwaySolver::isPrime(uint32_t number)
@@ -347,3 +1339,610 @@ vector<uint32_t> GPUPathwaySolver::genRandomPrime(uint32_t maximum, int count)
 
     return result;
 }
+
+void GPUPathwaySolver::reserveShard(int receiveCapacity)
+{
+    cudaSetDevice(m_ordinal);
+    m_receiveCapacity = receiveCapacity;
+    d->sortList = d->context->Malloc<sort_t>(receiveCapacity);
+    d->prevList = d->context->Malloc<uint32_t>(receiveCapacity);
+    d->sortList2 = d->context->Malloc<sort_t>(receiveCapacity);
+    d->prevList2 = d->context->Malloc<uint32_t>(receiveCapacity);
+    d->heapInsertList = d->context->Malloc<heap_t>(receiveCapacity);
+
+    d->outList = d->context->Malloc<sort_t>(
+        (size_t)m_numValue * 8 * m_numShard);
+    d->outPrevList = d->context->Malloc<uint32_t>(
+        (size_t)m_numValue * 8 * m_numShard);
+    d->outSize = d->context->Fill<int>(m_numShard, 0);
+}
+
+void GPUPathwaySolver::shardExpand()
+{
+    cudaSetDevice(m_ordinal);
+    const launch_config_t &launch = LAUNCH_CONFIGS[m_launch];
+    const int64_t numCell = (int64_t)(m_rowEnd - m_rowBegin) * p->width();
+
+    // every successor of the round may be sent to this shard
+    reserveRound(d, numCell, m_numHeap,
+                 div_up(m_receiveCapacity, m_numHeap * 8),
+                 &m_nodeBound, &m_nodeCapacity,
+                 &m_heapBound, &m_heapCapacity);
+
+    limitBand(1);
+    launch.extractExpand<<<m_numBlock, launch.numThread>>>(
+            *d->nodes,
+
+            *d->graph,
+
+            *d->openList,
+            *d->heapSize,
+            m_heapCapacity,
+
+            *d->optimalDistance,
+            *d->solution,
+            *d->status,
+
+            *d->sortList,
+            *d->prevList,
+            *d->sortListSize,
+
+            // reset them BTW
+            *d->heapBeginIndex,
+            *d->heapInsertSize
+        );
+
+    kShardRoute<NUM_THREAD><<<
+        div_up(m_numValue * 8, NUM_THREAD), NUM_THREAD>>>(
+            *d->sortList,
+            *d->prevList,
+            *d->sortListSize,
+
+            m_shard,
+            m_numShard,
+            m_shardRows,
+
+            *d->outList,
+            *d->outPrevList,
+            m_numValue * 8,
+            *d->outSize
+        );
+}
+
+void GPUPathwaySolver::shardPoll(
+    uint32_t *optimalDistance, unsigned long long *solution,
+    vector<int> *outSize)
+{
+    cudaSetDevice(m_ordinal);
+    *optimalDistance = d->optimalDistance->Value();
+    *solution = d->solution->Value();
+    d->outSize->ToHost(*outSize, m_numShard);
+    cudaMemset(d->optimalDistance->get(), 0xFF, sizeof(uint32_t));
+    cudaMemset(d->outSize->get(), 0, sizeof(int) * m_numShard);
+}
+
+// The sort list was filled by the other shards.  kDeduplicate is launched
+// for all of it, so that the host does not wait for a device in the middle
+// of the round.
+void GPUPathwaySolver::shardInsert(int received)
+{
+    cudaSetDevice(m_ordinal);
+    const launch_config_t &launch = LAUNCH_CONFIGS[m_launch];
+
+    if (received) {
+        d->sortListSize->FromHost(&received, 1);
+        MergesortPairs(
+            d->sortList->get(),
+            d->prevList->get(),
+            received,
+            *d->context
+        );
+
+        kAssign<NUM_THREAD><<<div_up(received, NUM_THREAD), NUM_THREAD>>> (
+                *d->sortList,
+                *d->prevList,
+                *d->sortListSize,
+
+                *d->sortList2,
+                *d->prevList2,
+                *d->sortListSize2,
+
+                *d->status
+            );
+
+        kDeduplicate<NUM_THREAD><<<
+            div_up(received, NUM_THREAD), NUM_THREAD>>> (
+                *d->nodes,
+                *d->nodeSize,
+
+                *d->hash,
+
+                *d->sortList2,
+                *d->prevList2,
+                *d->sortListSize2,
+
+                *d->heapInsertList,
+                *d->heapInsertSize,
+
+                *d->status
+            );
+    }
+
+    launch.heapInsert<<<m_numBlock, launch.numThread>>> (
+            *d->openList,
+            *d->heapSize,
+            m_heapCapacity,
+            *d->heapBeginIndex,
+
+            *d->heapInsertList,
+            *d->heapInsertSize,
+
+            // reset them BTW
+            *d->sortListSize,
+            *d->sortListSize2,
+
+            *d->status
+        );
+}
+
+GPUShardedPathwaySolver::GPUShardedPathwaySolver(Pathway *pathway)
+    : p(pathway), m_ordinals(deviceOrdinals()), m_optimalShard(0),
+      m_optimalNodeAddr(0), m_optimalDistance(0)
+{
+}
+
+GPUShardedPathwaySolver::~GPUShardedPathwaySolver()
+{
+    for (int i = 0; i < (int)m_shards.size(); ++i)
+        delete m_shards[i];
+}
+
+int GPUShardedPathwaySolver::numShard() const
+{
+    return m_ordinals.size();
+}
+
+void GPUShardedPathwaySolver::initialize()
+{
+    int numShard = m_ordinals.size();
+    int receiveCapacity = 0;
+    for (int i = 0; i < numShard; ++i) {
+        m_shards.push_back(new GPUPathwaySolver(p));
+        m_shards[i]->initializeShard(m_ordinals[i], i, numShard);
+        receiveCapacity += m_shards[i]->m_numValue * 8;
+    }
+    for (int i = 0; i < numShard; ++i)
+        m_shards[i]->reserveShard(receiveCapacity);
+    enablePeerAccess(m_ordinals);
+    dout << "\t\tSharded over " << numShard << " devices, "
+         << m_shards[0]->m_shardRows << " rows each" << endl;
+}
+
+void GPUShardedPathwaySolver::resetQuery()
+{
+    for (int i = 0; i < (int)m_shards.size(); ++i)
+        m_shards[i]->resetQuery();
+}
+
+void GPUShardedPathwaySolver::setWeight(float weight)
+{
+    for (int i = 0; i < (int)m_shards.size(); ++i)
+        m_shards[i]->setWeight(weight);
+}
+
+// The host takes the place of kCheckTermination: the minimum fValue
+// extracted and the best solution are reduced over the shards every round,
+// before the outboxes are exchanged.
+bool GPUShardedPathwaySolver::solve()
+{
+    int numShard = m_shards.size();
+    vector< vector<int> > outSize(numShard);
+    unsigned long long best = ULLONG_MAX;
+
+    for (int round = 0; ; ++round) {
+        dprintf("\t\tRound %d: shardExpand\n", round);
+        for (int i = 0; i < numShard; ++i)
+            m_shards[i]->shardExpand();
+
+        uint32_t optimalDistance = UINT32_MAX;
+        for (int i = 0; i < numShard; ++i) {
+            uint32_t distance;
+            unsigned long long solution;
+            m_shards[i]->shardPoll(&distance, &solution, &outSize[i]);
+            optimalDistance = min(optimalDistance, distance);
+            if (solution < best) {
+                best = solution;
+                m_optimalShard = i;
+            }
+        }
+        if (best != ULLONG_MAX && (uint32_t)(best >> 32) <= optimalDistance)
+            break;
+        if (optimalDistance == UINT32_MAX)
+            return false;
+
+        dprintf("\t\tRound %d: exchange\n", round);
+        for (int i = 0; i < numShard; ++i) {
+            GPUPathwaySolver *to = m_shards[i];
+            int received = 0;
+            for (int j = 0; j < numShard; ++j) {
+                GPUPathwaySolver *from = m_shards[j];
+                size_t offset = (size_t)from->m_numValue * 8 * i;
+                int count = outSize[j][i];
+                peerCopy(to->d->sortList->get() + received, to->m_ordinal,
+                         from->d->outList->get() + offset, from->m_ordinal,
+                         count);
+                peerCopy(to->d->prevList->get() + received, to->m_ordinal,
+                         from->d->outPrevList->get() + offset,
+                         from->m_ordinal, count);
+                received += count;
+            }
+            to->shardInsert(received);
+        }
+    }
+
+    long long nodeSize = 0;
+    for (int i = 0; i < numShard; ++i) {
+        cudaSetDevice(m_ordinals[i]);
+        nodeSize += m_shards[i]->d->nodeSize->Value();
+        recordDeviceMemory("gpu", *m_shards[i]->d->context);
+    }
+    m_optimalNodeAddr = best & UINT32_MAX;
+    m_optimalDistance = reverseFlipFloat((uint32_t)(best >> 32));
+    printf("\t\t\t Number of nodes expanded: %lld\n", nodeSize);
+    metrics.counter("gpu", "expanded", nodeSize);
+    dprintf("\t\t\t Optimal nodes address: %d on shard %d\n",
+            m_optimalNodeAddr, m_optimalShard);
+    return true;
+}
+
+void GPUShardedPathwaySolver::getSolution(
+    float *optimal, vector<int> *pathList)
+{
+    // the path from the goal back to the start, the links of a shard are
+    // brought back the first time the path enters it
+    vector< vector<link_t> > links(m_shards.size());
+    *optimal = m_optimalDistance;
+    pathList->clear();
+    uint32_t ref = shardRef(m_optimalShard, m_optimalNodeAddr);
+    while (ref != UINT32_MAX) {
+        GPUPathwaySolver *shard = m_shards[refShard(ref)];
+        vector<link_t> &shardLinks = links[refShard(ref)];
+        if (shardLinks.empty()) {
+            cudaSetDevice(shard->m_ordinal);
+            downloadLinks(*shard->d->context, shard->d->nodes->get(),
+                          (size_t)shard->d->nodeSize->Value(), &shardLinks);
+        }
+        const link_t &link = shardLinks[refAddr(ref)];
+        pathList->push_back((int)link.nodeID);
+        ref = link.prev;
+    }
+    std::reverse(pathList->begin(), pathList->end());
+}
+
+struct MultiDeviceData {
+    MGPU_MEM(uint8_t) graph;
+
+    MGPU_MEM(search_t) searches;
+    MGPU_MEM(int) numRunning;
+    // always SEARCH_RUNNING, every search has its own status
+    MGPU_MEM(int) batchStatus;
+
+    MGPU_MEM(node_t) nodes;
+    MGPU_MEM(int) nodeSize;
+    // shared by the searches, see GPU-multi-kernel.cuh
+    MGPU_MEM(uint32_t) hash;
+    MGPU_MEM(int) hashFull;
+
+    MGPU_MEM(heap_t) openList;
+    MGPU_MEM(int) heapSize;
+
+    MGPU_MEM(sort_t) sortList;
+    MGPU_MEM(uint32_t) prevList;
+    MGPU_MEM(int) sortListSize;
+
+    MGPU_MEM(sort_t) sortList2;
+    MGPU_MEM(uint32_t) prevList2;
+    MGPU_MEM(int) sortListSize2;
+
+    // m_heapInsertCapacity entries for every search
+    MGPU_MEM(heap_t) heapInsertList;
+
+    // the links brought back for the paths, see getSolution()
+    vector<link_t> hostLinks;
+
+    ContextPtr context;
+};
+
+GPUMultiPathwaySolver::GPUMultiPathwaySolver(Pathway *pathway)
+    : p(pathway), m_numSearch(0), m_heapPerSearch(0),
+      m_heapInsertCapacity(0), m_count(0),
+      m_nodeCapacity(0), m_nodeBound(0), m_heapCapacity(0), m_heapBound(0),
+      m_hashMask(0), m_hashFull(0)
+{
+    d = new MultiDeviceData();
+}
+
+GPUMultiPathwaySolver::~GPUMultiPathwaySolver()
+{
+    delete d;
+}
+
+void GPUMultiPathwaySolver::initialize(int numSearch)
+{
+    // every search needs its own heaps and its own range of node IDs
+    numSearch = min(numSearch, NUM_TOTAL);
+    numSearch = min<int64_t>(numSearch, (UINT32_MAX - 1) / p->size());
+    m_numSearch = max(numSearch, 1);
+    m_heapPerSearch = NUM_TOTAL / m_numSearch;
+    // a search pops from its own heaps only, at most 8 successors each
+    m_heapInsertCapacity = m_heapPerSearch * VALUE_PER_THREAD * 8;
+    dout << "\t\t" << m_numSearch << " concurrent searches with "
+         << m_heapPerSearch << " heaps each" << endl;
+
+    cudaDeviceSynchronize();
+    cudaDeviceReset();
+
+    d->context = CreateCudaDevice(vm_options["ordinal"].as<int>());
+    countDeviceMemory(*d->context);
+
+    // the targets are stored in the search descriptors
+    initializeCUDAConstantMemory(p->height(), p->width(), 0, 0, UINT32_MAX,
+                                 searchWeight());
+
+    initializeGraphLayout(p->bitmapGraph(), p->tilesPerRow());
+    d->graph = uploadBuffer(*d->context, p->graphData(), p->graphBytes());
+
+    d->searches = d->context->Malloc<search_t>(m_numSearch);
+    d->numRunning = d->context->Malloc<int>(1);
+    d->batchStatus = d->context->Fill<int>(1, SEARCH_RUNNING);
+
+    d->nodeSize = d->context->Fill<int>(1, 0);
+    d->hashFull = d->context->Fill<int>(1, 0);
+
+    d->heapSize = d->context->Malloc<int>(NUM_TOTAL);
+
+    d->sortList = d->context->Malloc<sort_t>(NUM_VALUE * 8);
+    d->prevList = d->context->Malloc<uint32_t>(NUM_VALUE * 8);
+    d->sortList2 = d->context->Malloc<sort_t>(NUM_VALUE * 8);
+    d->prevList2 = d->context->Malloc<uint32_t>(NUM_VALUE * 8);
+    d->sortListSize = d->context->Malloc<int>(1);
+    d->sortListSize2 = d->context->Malloc<int>(1);
+
+    d->heapInsertList = d->context->Malloc<heap_t>(
+        m_heapInsertCapacity * m_numSearch);
+
+
+    // --memory-limit only bounds the single query search
+    allocateLists(d, (int64_t)p->size() * m_numSearch, NUM_TOTAL,
+                  deviceMemoryBudget(0, false),
+                  false, &m_nodeCapacity, &m_heapCapacity);
+    // at most half full while the arena does not grow
+    rebuildHash(0, 2 * (size_t)m_nodeCapacity);
+    dout << "\t\tGPU Initialization finishes" << endl;
+}
+
+// Index the `nodeSize' nodes of the arena in a table at least twice as large
+// and of at least `slots' slots
+void GPUMultiPathwaySolver::rebuildHash(int nodeSize, size_t slots)
+{
+    size_t hashSize = 2 * ((size_t)m_hashMask + 1);
+    while (hashSize < slots)
+        hashSize *= 2;
+    // drop the old table first, it is rebuilt from the arena anyway
+    d->hash = MGPU_MEM(uint32_t)();
+    if (sizeof(uint32_t) * hashSize > freeDeviceMemory())
+        outOfDeviceMemory("hash table", (size_t)m_hashMask + 1);
+    d->hash = d->context->Fill<uint32_t>(hashSize, UINT32_MAX);
+    m_hashMask = hashSize - 1;
+    dout << "\t\tHash table: " << hashSize << " slots" << endl;
+
+    if (nodeSize) {
+        kMultiRehash<NUM_THREAD><<<
+            div_up(nodeSize, NUM_THREAD), NUM_THREAD>>>(
+                *d->nodes,
+                nodeSize,
+                *d->hash,
+                m_hashMask,
+                *d->hashFull
+            );
+    }
+    m_hashFull = d->hashFull->Value();
+}
+
+int GPUMultiPathwaySolver::numSearch() const
+{
+    return m_numSearch;
+}
+
+void GPUMultiPathwaySolver::solve(const query_t queries[], int count)
+{
+    assert(count <= m_numSearch);
+    m_count = count;
+    vector<link_t>().swap(d->hostLinks);
+
+    // clear the hash table of the previous batch
+    cudaMemset(d->hash->get(), 0xFF,
+               sizeof(uint32_t) * ((size_t)m_hashMask + 1));
+    cudaMemset(d->hashFull->get(), 0, sizeof(int));
+    m_hashFull = 0;
+
+    vector<search_t> searches(count);
+    for (int i = 0; i < count; ++i) {
+        search_t &search = searches[i];
+        search.startID = p->toID(queries[i].sx, queries[i].sy);
+        search.targetX = queries[i].ex;
+        search.targetY = queries[i].ey;
+        search.targetID = p->toID(queries[i].ex, queries[i].ey);
+        search.optimalDistance = UINT32_MAX;
+        search.popCount = 0;
+        search.heapBeginIndex = 0;
+        search.heapInsertSize = 0;
+        search.status = SEARCH_RUNNING;
+        search.solution = ULLONG_MAX;
+    }
+    d->searches->FromHost(searches);
+
+    d->nodeSize->FromHost(&count, 1);
+    m_nodeBound = count;
+    m_heapBound = 1;
+    cudaMemset(d->heapSize->get(), 0, sizeof(int) * NUM_TOTAL);
+    cudaMemset(d->sortListSize->get(), 0, sizeof(int));
+    cudaMemset(d->sortListSize2->get(), 0, sizeof(int));
+
+    kMultiInitialize<NUM_THREAD><<<
+        div_up(count, NUM_THREAD), NUM_THREAD>>>(
+            *d->nodes,
+            *d->hash,
+            m_hashMask,
+            *d->hashFull,
+            *d->openList,
+            *d->heapSize,
+            m_heapCapacity,
+
+            *d->searches,
+            count,
+            m_heapPerSearch,
+            p->size()
+        );
+
+    for (int round = 0; ;++round) {
+        reserveRound(d, (int64_t)p->size() * count,
+                     NUM_TOTAL, VALUE_PER_THREAD,
+                     &m_nodeBound, &m_nodeCapacity,
+                     &m_heapBound, &m_heapCapacity);
+        if (2 * (size_t)m_nodeBound > (size_t)m_hashMask + 1)
+            rebuildHash(d->nodeSize->Value(), 2 * (size_t)m_nodeBound);
+
+        dprintf("\t\tRound %d: kMultiExtractExpand\n", round);
+        kMultiExtractExpand<NUM_THREAD, VALUE_PER_THREAD> <<<
+            NUM_BLOCK, NUM_THREAD>>>(
+                *d->nodes,
+
+                *d->graph,
+
+                *d->openList,
+                *d->heapSize,
+                m_heapCapacity,
+
+                *d->searches,
+                count,
+                m_heapPerSearch,
+                p->size(),
+
+                *d->sortList,
+                *d->prevList,
+                *d->sortListSize
+            );
+
+        cudaMemset(d->numRunning->get(), 0, sizeof(int));
+        kMultiCheck<NUM_THREAD><<<div_up(count, NUM_THREAD), NUM_THREAD>>>(
+            *d->searches,
+            count,
+            *d->numRunning
+        );
+        int numRunning = d->numRunning->Value();
+        dprintf("\t\tRound %d: %d searches running\n", round, numRunning);
+        if (numRunning == 0)
+            break;
+        // the probes of some nodes ran out last round, index them again
+        if (d->hashFull->Value() > m_hashFull)
+            rebuildHash(d->nodeSize->Value(), 0);
+
+        int sortListSize = d->sortListSize->Value();
+        if (sortListSize == 0)
+            continue;
+
+        MergesortPairs(
+            d->sortList->get(),
+            d->prevList->get(),
+            sortListSize,
+            *d->context
+        );
+
+        kAssign<NUM_THREAD><<<
+            div_up(sortListSize, NUM_THREAD), NUM_THREAD>>> (
+                *d->sortList,
+                *d->prevList,
+                *d->sortListSize,
+
+                *d->sortList2,
+                *d->prevList2,
+                *d->sortListSize2,
+
+                *d->batchStatus
+            );
+
+        int sortListSize2 = d->sortListSize2->Value();
+        kMultiDeduplicate<NUM_THREAD> <<<
+            div_up(sortListSize2, NUM_THREAD), NUM_THREAD>>> (
+                *d->nodes,
+                *d->nodeSize,
+
+                *d->hash,
+                m_hashMask,
+                *d->hashFull,
+
+                *d->searches,
+                p->size(),
+
+                *d->sortList2,
+                *d->prevList2,
+                sortListSize2,
+
+                *d->heapInsertList,
+                m_heapInsertCapacity
+            );
+
+        kMultiHeapInsert<NUM_THREAD> <<<
+            NUM_BLOCK, NUM_THREAD>>> (
+                *d->openList,
+                *d->heapSize,
+                m_heapCapacity,
+
+                *d->searches,
+                count,
+                m_heapPerSearch,
+
+                *d->heapInsertList,
+                m_heapInsertCapacity,
+
+                *d->sortListSize,
+                *d->sortListSize2
+            );
+    }
+
+    d->searches->ToHost(searches, count);
+    m_status.resize(count);
+    m_optimalNodeAddr.resize(count);
+    m_optimalDistance.resize(count);
+    for (int i = 0; i < count; ++i) {
+        m_status[i] = searches[i].status;
+        m_optimalNodeAddr[i] = searches[i].solution & UINT32_MAX;
+        m_optimalDistance[i] =
+            reverseFlipFloat((uint32_t)(searches[i].solution >> 32));
+    }
+    printf("\t\t\t Number of nodes expanded: %d\n", d->nodeSize->Value());
+    metrics.counter("gpu", "expanded", d->nodeSize->Value());
+    recordDeviceMemory("gpu", *d->context);
+}
+
+bool GPUMultiPathwaySolver::getSolution(
+    int index, float *optimal, vector<int> *pathList)
+{
+    if (m_status[index] != SEARCH_SOLVED)
+        return false;
+
+    // one copy of the links serves all the searches of the batch
+    if (d->hostLinks.empty()) {
+        downloadLinks(*d->context, d->nodes->get(),
+                      (size_t)d->nodeSize->Value(), &d->hostLinks);
+    }
+
+    // translate the node IDs of the search back to cells
+    uint32_t base = (uint32_t)index * p->size();
+    *optimal = m_optimalDistance[index];
+    pathList->clear();
+    walkPath(d->hostLinks, m_optimalNodeAddr[index], base, pathList);
+    std::reverse(pathList->begin(), pathList->end());
+    return true;
+}
@@ -3,10 +3,8 @@
 
 #include "pathway/pathway.hpp"
 
-const int OPEN_LIST_SIZE = 10000000;
-const int NODE_LIST_SIZE = 150000000;
-const int ANSWER_LIST_SIZE = 50000;
-
+// Default launch geometry, the single search picks its own at runtime (see
+// --launch).  NUM_BLOCK only sizes the concurrent searches.
 const int NUM_BLOCK  = 13 * 3;
 const int NUM_THREAD = 192;
 const int NUM_TOTAL = NUM_BLOCK * NUM_THREAD;
@@ -14,7 +12,10 @@ const int NUM_TOTAL = NUM_BLOCK * NUM_THREAD;
 const int VALUE_PER_THREAD = 1;
 const int NUM_VALUE = NUM_TOTAL * VALUE_PER_THREAD;
 
-const int HEAP_CAPACITY = OPEN_LIST_SIZE / NUM_TOTAL;
+// The node arena and the open list are sized at runtime (see GPU-memory.cuh),
+// an automatically sized open list starts with at least this many entries per
+// heap and is doubled whenever a round could overflow it.
+const int MIN_HEAP_CAPACITY = 64;
 
 class DeviceData;
 class GPUPathwaySolver {
@@ -22,17 +23,154 @@ public:
     GPUPathwaySolver(Pathway *pathway);
     ~GPUPathwaySolver();
     void initialize();
+    // Answer the next query of the pathway on the resident graph
+    void resetQuery();
+    // Order the open list by g + weight * h from the next resetQuery() on,
+    // see anytime.hpp
+    void setWeight(float weight);
     bool solve();
     void getSolution(float *optimal, vector<int> *pathList);
+    // Return whether the memory bounded search pruned a node that could lead
+    // to a shorter path, in which case the optimal distance is only known to
+    // be `bound' or more
+    bool lowerBound(float *bound);
 
 private:
+    friend class GPUShardedPathwaySolver;
+    // Bind to the device `ordinal' as the shard `shard' of `numShard', which
+    // owns the rows [m_rowBegin, m_rowEnd), see GPUShardedPathwaySolver
+    void initializeShard(int ordinal, int shard, int numShard);
+    // Make room for `receiveCapacity' successors sent by the shards a round
+    void reserveShard(int receiveCapacity);
+    // The phases of a round of the shard: extract, expand and fill the
+    // outboxes, read the minimum extracted, the best solution and the outbox
+    // sizes back, and deduplicate and insert the `received' successors
+    void shardExpand();
+    void shardPoll(uint32_t *optimalDistance, unsigned long long *solution,
+                   vector<int> *outSize);
+    void shardInsert(int received);
+    // Run at most `maxRound' rounds of the current query
+    void search(int maxRound);
+    void searchCompact(int maxRound);
+    // Find the band of the heaps extracted by the next round, see kBandLimit
+    void limitBand(int numDirection);
+    // reserveRound() of the memory bounded search, which prunes the open list
+    // instead of growing the buffers
+    void reserveBoundedRound(int valuePerThread);
+    void prune(int valuePerThread);
+    bool pruneHeaps();
+    int maxHeapSize();
+    void configureLaunch(int numSM);
+    void setLaunch(int config, int numBlock);
+    void tune(int numSM);
+    bool readLaunchCache(const string &device, int sizeClass,
+                         int *numBlock, int *numThread, int *valuePerThread);
+    void writeLaunchCache(const string &device, int sizeClass);
+
     bool isPrime(uint32_t number);
     vector<uint32_t> genRandomPrime(uint32_t maximum, int count);
     // Problem
     Pathway *p;
     DeviceData *d;
+    // address of the goal node, the meeting cell of a bidirectional search
+    uint32_t m_optimalNodeAddr;
+    float m_optimalDistance;
+    // allocated entries and host side upper bounds of the used ones
+    int m_nodeCapacity;
+    int m_nodeBound;
+    int m_heapCapacity;
+    int m_heapBound;
+    // launch geometry: an index into LAUNCH_CONFIGS, the number of blocks,
+    // of heaps (one per thread) and of values extracted per round
+    int m_launch;
+    int m_numBlock;
+    int m_numHeap;
+    int m_numValue;
+    // deduplicate the successors with kHashMark/kHashCollect instead of
+    // sorting them
+    bool m_hashDedup;
+    // keep one gValue/prev word per cell instead of a node arena and a hash
+    // table, see GPU-compact-kernel.cuh
+    bool m_compact;
+    // search from both ends, see GPU-bidirectional-kernel.cuh
+    bool m_bidirectional;
+    // free device memory before the first allocation
+    size_t m_freeMemory;
+    // --memory-limit is set, see GPU-bounded-kernel.cuh
+    bool m_bounded;
+    int m_numPrune;
+    float m_weight;
+    // --f-band, negative to extract every heap
+    float m_fBand;
+    // the device and the rows it owns, all of them without --devices
+    int m_ordinal;
+    int m_shard;
+    int m_numShard;
+    int m_shardRows;
+    int m_rowBegin;
+    int m_rowEnd;
+    // successors the shards may send to this one in a round
+    int m_receiveCapacity;
+};
+
+// Solve the query on all the devices of --devices at once, each of them
+// owning a band of rows of the grid (see GPU-shard.cuh)
+class GPUShardedPathwaySolver {
+public:
+    GPUShardedPathwaySolver(Pathway *pathway);
+    ~GPUShardedPathwaySolver();
+    int numShard() const;
+    void initialize();
+    void resetQuery();
+    void setWeight(float weight);
+    bool solve();
+    void getSolution(float *optimal, vector<int> *pathList);
+
+private:
+    Pathway *p;
+    vector<int> m_ordinals;
+    vector<GPUPathwaySolver *> m_shards;
+    // shard and address of the goal node
+    int m_optimalShard;
     uint32_t m_optimalNodeAddr;
     float m_optimalDistance;
 };
 
+// Solve several independent queries concurrently on one GPU.  Each query
+// owns a slice of the NUM_TOTAL heaps, so one launch of the extract, sort,
+// deduplicate and insert pipeline advances all of them.  The node arena and
+// the hash table are shared and grow with the cells the queries reach.
+class MultiDeviceData;
+class GPUMultiPathwaySolver {
+public:
+    GPUMultiPathwaySolver(Pathway *pathway);
+    ~GPUMultiPathwaySolver();
+    void initialize(int numSearch);
+    int numSearch() const;
+    // Solve `count' (at most numSearch()) queries
+    void solve(const query_t queries[], int count);
+    bool getSolution(int index, float *optimal, vector<int> *pathList);
+
+private:
+    void rebuildHash(int nodeSize, size_t slots);
+
+    Pathway *p;
+    MultiDeviceData *d;
+    int m_numSearch;
+    int m_heapPerSearch;
+    // the successors a search can generate in one round
+    int m_heapInsertCapacity;
+    int m_count;
+    int m_nodeCapacity;
+    int m_nodeBound;
+    int m_heapCapacity;
+    int m_heapBound;
+    uint32_t m_hashMask;
+    // the probes that ran out, as of the last rebuildHash()
+    int m_hashFull;
+    vector<int> m_status;
+    vector<uint32_t> m_optimalNodeAddr;
+    vector<float> m_optimalDistance;
+};
+
 #endif /* end of include guard: __GPU_SOLVER_HPP_1LYUPTGF */
@@ -0,0 +1,500 @@
+#include "pathway/hierarchy.hpp"
+#include "pathway/CPU-solver.hpp"
+#include "metrics.hpp"
+#include "boost/filesystem.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+const char HPA_MAGIC[4] = { 'U', 'H', 'P', 'A' };
+const uint32_t HPA_VERSION = 1;
+
+// the move opposite to the move i of DX and DY
+const int OPPOSITE[8] = { 1, 0, 3, 2, 7, 6, 5, 4, };
+
+// The index file: the header, then the int32 cells of the entrances, the
+// int64 edge offsets of every entrance and one more, and the edges
+struct hpa_header_t {
+    char magic[4];
+    uint32_t version;
+    int32_t height;
+    int32_t width;
+    int32_t cluster;
+    int32_t numNode;
+    int64_t numEdge;
+    // of the direction bits of the cells
+    uint64_t checksum;
+};
+
+HierarchicalPathwaySolver::HierarchicalPathwaySolver(Pathway *pathway)
+    : p(pathway), m_cluster(vm_options["hierarchy"].as<int>()),
+      m_clustersPerRow(0), m_numCluster(0), m_weight(1), m_startID(-1),
+      m_targetID(-1), m_abstract(false), m_optimal(0), m_numExpanded(0)
+{
+    if (m_cluster < 0) {
+        cout << "Please set your hierarchy parameter correctly." << endl
+            << "==============================================" << endl
+            << endl;
+        help();
+    }
+    m_fallback = new CPUPathwaySolver(pathway);
+}
+
+HierarchicalPathwaySolver::~HierarchicalPathwaySolver()
+{
+    delete m_fallback;
+}
+
+bool HierarchicalPathwaySolver::enabled() const
+{
+    return m_cluster > 0;
+}
+
+void HierarchicalPathwaySolver::initialize()
+{
+    m_clustersPerRow = (p->width() + m_cluster - 1) / m_cluster;
+    m_numCluster = m_clustersPerRow *
+        ((p->height() + m_cluster - 1) / m_cluster);
+
+    string filename = indexFile();
+    if (filename.empty() || !loadIndex(filename)) {
+        if (!filename.empty() && boost::filesystem::exists(filename))
+            cout << "\t" << filename << " is stale or not intact" << endl;
+        cout << "\tBuilding the hierarchy of " << m_numCluster
+             << " clusters" << endl;
+        buildIndex();
+        if (!filename.empty())
+            saveIndex(filename);
+    }
+    indexClusters();
+
+    int numNode = m_nodeCell.size();
+    m_g.assign(numNode + 1, numeric_limits<float>::infinity());
+    m_prev.assign(numNode + 1, -1);
+    m_closed.assign(numNode + 1, false);
+    m_touched.clear();
+    dout << "\t\t" << numNode << " entrances, " << m_edges.size()
+         << " abstract edges" << endl;
+}
+
+void HierarchicalPathwaySolver::resetQuery()
+{
+    m_startID = p->toID(p->sx(), p->sy());
+    m_targetID = p->toID(p->ex(), p->ey());
+    m_abstract = false;
+    m_pathList.clear();
+    m_numExpanded = 0;
+}
+
+void HierarchicalPathwaySolver::setWeight(float weight)
+{
+    m_weight = weight;
+}
+
+bool HierarchicalPathwaySolver::solve()
+{
+    int startCluster = clusterOf(m_startID);
+    int targetCluster = clusterOf(m_targetID);
+    m_numExpanded += searchCluster(startCluster, m_startID, false, -1,
+                                   &m_fromStart);
+    m_numExpanded += searchCluster(targetCluster, m_targetID, true, -1,
+                                   &m_toTarget);
+
+    for (int u : m_touched) {
+        m_g[u] = numeric_limits<float>::infinity();
+        m_prev[u] = -1;
+        m_closed[u] = false;
+    }
+    m_touched.clear();
+    m_openList.clear();
+
+    int target = m_nodeCell.size();
+    auto relax = [&](int v, float g, int prev) {
+        if (m_closed[v] || !(g < m_g[v]))
+            return;
+        if (m_g[v] == numeric_limits<float>::infinity())
+            m_touched.push_back(v);
+        m_g[v] = g;
+        m_prev[v] = prev;
+        float h = v == target ? 0 : octile(m_nodeCell[v]);
+        m_openList.update(v, g + m_weight * h);
+    };
+
+    // the start reaches the entrances of its cluster, or the target itself
+    if (startCluster == targetCluster) {
+        relax(target, m_fromStart.dist[localIndex(startCluster, m_targetID)],
+              -1);
+    }
+    for (int u = m_clusterBegin[startCluster];
+         u < m_clusterBegin[startCluster + 1]; ++u) {
+        relax(u, m_fromStart.dist[localIndex(startCluster, m_nodeCell[u])],
+              -1);
+    }
+
+    bool found = false;
+    while (!m_openList.empty()) {
+        int u = m_openList.pop();
+        m_closed[u] = true;
+        ++m_numExpanded;
+        if (u == target) {
+            found = true;
+            break;
+        }
+        if (clusterOf(m_nodeCell[u]) == targetCluster) {
+            relax(target, m_g[u] + m_toTarget.dist[
+                      localIndex(targetCluster, m_nodeCell[u])], u);
+        }
+        for (int64_t e = m_edgeBegin[u]; e < m_edgeBegin[u + 1]; ++e)
+            relax(m_edges[e].to, m_g[u] + m_edges[e].cost, u);
+    }
+
+    if (!found) {
+        m_fallback->setWeight(m_weight);
+        m_fallback->initialize();
+        return m_fallback->solve();
+    }
+
+    vector<int> route;
+    for (int u = m_prev[target]; u != -1; u = m_prev[u])
+        route.push_back(m_nodeCell[u]);
+    std::reverse(route.begin(), route.end());
+    route.push_back(m_targetID);
+
+    m_abstract = true;
+    m_optimal = 0;
+    m_pathList.assign(1, m_startID);
+    int from = m_startID;
+    for (int to : route) {
+        m_optimal += refine(from, to, &m_pathList);
+        from = to;
+    }
+    return true;
+}
+
+void HierarchicalPathwaySolver::getSolution(
+    float *optimal, vector<int> *pathList)
+{
+    if (!m_abstract) {
+        m_fallback->getSolution(optimal, pathList);
+        return;
+    }
+    printf("\t\t\tNumber of nodes expanded: %d\n", (int)m_numExpanded);
+    metrics.counter("cpu", "expanded", m_numExpanded);
+    *optimal = m_optimal;
+    *pathList = m_pathList;
+}
+
+bool HierarchicalPathwaySolver::lowerBound(float *bound)
+{
+    float h = octile(m_startID);
+    if (!m_abstract || float_equal(m_optimal, h))
+        return false;
+    *bound = h;
+    return true;
+}
+
+int HierarchicalPathwaySolver::clusterOf(int id) const
+{
+    int x, y;
+    p->toXY(id, &x, &y);
+    return x / m_cluster * m_clustersPerRow + y / m_cluster;
+}
+
+void HierarchicalPathwaySolver::clusterBounds(
+    int cluster, int *x0, int *y0, int *x1, int *y1) const
+{
+    *x0 = cluster / m_clustersPerRow * m_cluster;
+    *y0 = cluster % m_clustersPerRow * m_cluster;
+    *x1 = min(*x0 + m_cluster, p->height());
+    *y1 = min(*y0 + m_cluster, p->width());
+}
+
+int HierarchicalPathwaySolver::localIndex(int cluster, int id) const
+{
+    int x0, y0, x1, y1, x, y;
+    clusterBounds(cluster, &x0, &y0, &x1, &y1);
+    p->toXY(id, &x, &y);
+    return (x - x0) * (y1 - y0) + y - y0;
+}
+
+bool HierarchicalPathwaySolver::canStep(int id, int dir) const
+{
+    return p->edgeMask(id) & 1 << dir;
+}
+
+int HierarchicalPathwaySolver::searchCluster(
+    int cluster, int source, bool backward, int target,
+    local_t *local) const
+{
+    int x0, y0, x1, y1;
+    clusterBounds(cluster, &x0, &y0, &x1, &y1);
+    int width = y1 - y0;
+    local->dist.assign((x1 - x0) * width,
+                       numeric_limits<float>::infinity());
+    local->prev.assign((x1 - x0) * width, -1);
+    local->openList.clear();
+
+    int start = localIndex(cluster, source);
+    int stop = target == -1 ? -1 : localIndex(cluster, target);
+    local->dist[start] = 0;
+    local->openList.update(start, 0);
+
+    int numExpanded = 0;
+    while (!local->openList.empty()) {
+        int now = local->openList.pop();
+        ++numExpanded;
+        if (now == stop)
+            break;
+
+        int x = x0 + now / width;
+        int y = y0 + now % width;
+        int id = p->toID(x, y);
+        for (int i = 0; i < 8; ++i) {
+            int nx = x + DX[i];
+            int ny = y + DY[i];
+            if (nx < x0 || nx >= x1 || ny < y0 || ny >= y1)
+                continue;
+            // backward, the move goes from the neighbour to this cell
+            if (backward ? !canStep(p->toID(nx, ny), OPPOSITE[i])
+                         : !canStep(id, i))
+                continue;
+            int next = (nx - x0) * width + ny - y0;
+            float dist = local->dist[now] + COST[i];
+            if (dist < local->dist[next]) {
+                local->dist[next] = dist;
+                local->prev[next] = now;
+                local->openList.update(next, dist);
+            }
+        }
+    }
+    return numExpanded;
+}
+
+uint64_t HierarchicalPathwaySolver::checksum() const
+{
+    // FNV-1a, over the cells so that it does not depend on --graph-layout
+    uint64_t hash = 14695981039346656037ULL;
+    for (int id = 0; id < p->size(); ++id)
+        hash = (hash ^ p->edgeMask(id)) * 1099511628211ULL;
+    return hash;
+}
+
+string HierarchicalPathwaySolver::indexFile() const
+{
+    if (vm_options.count("hierarchy-file"))
+        return vm_options["hierarchy-file"].as<string>();
+    if (vm_options["input-module"].as<string>() == "map")
+        return vm_options["map-file"].as<string>() + ".hpa";
+    return "";
+}
+
+bool HierarchicalPathwaySolver::loadIndex(const string &filename)
+{
+    FILE *fin = fopen(filename.c_str(), "rb");
+    if (!fin)
+        return false;
+
+    hpa_header_t header;
+    bool valid = fread(&header, sizeof(header), 1, fin) == 1 &&
+        !memcmp(header.magic, HPA_MAGIC, sizeof(header.magic)) &&
+        header.version == HPA_VERSION &&
+        header.height == p->height() && header.width == p->width() &&
+        header.cluster == m_cluster && header.numNode >= 0 &&
+        header.numEdge >= 0 && header.checksum == checksum();
+    if (valid) {
+        m_nodeCell.resize(header.numNode);
+        m_edgeBegin.resize(header.numNode + 1);
+        m_edges.resize(header.numEdge);
+        valid = fread(m_nodeCell.data(), sizeof(int32_t), m_nodeCell.size(),
+                      fin) == m_nodeCell.size() &&
+            fread(m_edgeBegin.data(), sizeof(int64_t), m_edgeBegin.size(),
+                  fin) == m_edgeBegin.size() &&
+            fread(m_edges.data(), sizeof(edge_t), m_edges.size(),
+                  fin) == m_edges.size() &&
+            fgetc(fin) == EOF;
+    }
+    fclose(fin);
+
+    // the cells are grouped by cluster, and the edges stay within the index
+    for (int u = 0; valid && u < (int)m_nodeCell.size(); ++u) {
+        valid = m_nodeCell[u] >= 0 && m_nodeCell[u] < p->size() &&
+            (u == 0 || clusterOf(m_nodeCell[u - 1]) <=
+                       clusterOf(m_nodeCell[u])) &&
+            m_edgeBegin[u] <= m_edgeBegin[u + 1];
+    }
+    valid = valid && m_edgeBegin.front() == 0 &&
+        m_edgeBegin.back() == (int64_t)m_edges.size();
+    for (size_t e = 0; valid && e < m_edges.size(); ++e)
+        valid = m_edges[e].to >= 0 && m_edges[e].to < (int)m_nodeCell.size();
+
+    if (!valid) {
+        m_nodeCell.clear();
+        m_edgeBegin.clear();
+        m_edges.clear();
+        return false;
+    }
+    cout << "\tLoaded the hierarchy from " << filename << endl;
+    return true;
+}
+
+void HierarchicalPathwaySolver::saveIndex(const string &filename) const
+{
+    FILE *fout = fopen(filename.c_str(), "wb");
+    if (!fout) {
+        cout << "\tCannot write the hierarchy to " << filename << endl;
+        return;
+    }
+
+    hpa_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HPA_MAGIC, sizeof(header.magic));
+    header.version = HPA_VERSION;
+    header.height = p->height();
+    header.width = p->width();
+    header.cluster = m_cluster;
+    header.numNode = m_nodeCell.size();
+    header.numEdge = m_edges.size();
+    header.checksum = checksum();
+    fwrite(&header, sizeof(header), 1, fout);
+    fwrite(m_nodeCell.data(), sizeof(int32_t), m_nodeCell.size(), fout);
+    fwrite(m_edgeBegin.data(), sizeof(int64_t), m_edgeBegin.size(), fout);
+    fwrite(m_edges.data(), sizeof(edge_t), m_edges.size(), fout);
+    fclose(fout);
+    cout << "\tSaved the hierarchy to " << filename << endl;
+}
+
+void HierarchicalPathwaySolver::buildIndex()
+{
+    // the two cells of every entrance, found along the borders of every
+    // cluster with the one below it and the one right of it
+    vector<pair<int, int>> links;
+    // move 0 is down, 1 up, 2 right and 3 left
+    for (int x = m_cluster; x < p->height(); x += m_cluster)
+        for (int y0 = 0; y0 < p->width(); y0 += m_cluster) {
+            int length = min(m_cluster, p->width() - y0);
+            auto open = [&](int i) {
+                return canStep(p->toID(x - 1, y0 + i), 0) &&
+                       canStep(p->toID(x, y0 + i), 1);
+            };
+            for (int i : borderEntrances(length, open))
+                links.push_back(make_pair(p->toID(x - 1, y0 + i),
+                                          p->toID(x, y0 + i)));
+        }
+    for (int y = m_cluster; y < p->width(); y += m_cluster)
+        for (int x0 = 0; x0 < p->height(); x0 += m_cluster) {
+            int length = min(m_cluster, p->height() - x0);
+            auto open = [&](int i) {
+                return canStep(p->toID(x0 + i, y - 1), 2) &&
+                       canStep(p->toID(x0 + i, y), 3);
+            };
+            for (int i : borderEntrances(length, open))
+                links.push_back(make_pair(p->toID(x0 + i, y - 1),
+                                          p->toID(x0 + i, y)));
+        }
+
+    // the entrance cells, grouped by cluster
+    auto byCluster = [this](int a, int b) {
+        int ca = clusterOf(a), cb = clusterOf(b);
+        return ca != cb ? ca < cb : a < b;
+    };
+    m_nodeCell.clear();
+    for (const auto &link : links) {
+        m_nodeCell.push_back(link.first);
+        m_nodeCell.push_back(link.second);
+    }
+    std::sort(m_nodeCell.begin(), m_nodeCell.end(), byCluster);
+    m_nodeCell.erase(std::unique(m_nodeCell.begin(), m_nodeCell.end()),
+                     m_nodeCell.end());
+    auto nodeOf = [&](int id) {
+        return (int)(std::lower_bound(m_nodeCell.begin(), m_nodeCell.end(),
+                                      id, byCluster) - m_nodeCell.begin());
+    };
+    indexClusters();
+
+    int numNode = m_nodeCell.size();
+    vector<vector<edge_t>> adjacency(numNode);
+    for (const auto &link : links) {
+        int a = nodeOf(link.first);
+        int b = nodeOf(link.second);
+        adjacency[a].push_back(edge_t{b, 1});
+        adjacency[b].push_back(edge_t{a, 1});
+    }
+
+    // the distances within a cluster, a search from each of its entrances;
+    // every cluster only writes the edges out of its own entrances
+    int numThread = max(1u, std::thread::hardware_concurrency());
+    std::atomic<int> next(0);
+    vector<std::thread> threads;
+    for (int i = 0; i < numThread; ++i)
+        threads.emplace_back([&]() {
+            local_t local;
+            int cluster;
+            while ((cluster = next++) < m_numCluster) {
+                int begin = m_clusterBegin[cluster];
+                int end = m_clusterBegin[cluster + 1];
+                for (int u = begin; u < end; ++u) {
+                    searchCluster(cluster, m_nodeCell[u], false, -1, &local);
+                    for (int v = begin; v < end; ++v) {
+                        float dist = local.dist[
+                            localIndex(cluster, m_nodeCell[v])];
+                        if (v != u &&
+                            dist != numeric_limits<float>::infinity())
+                            adjacency[u].push_back(edge_t{v, dist});
+                    }
+                }
+            }
+        });
+    for (auto &thread : threads)
+        thread.join();
+
+    m_edgeBegin.assign(1, 0);
+    m_edges.clear();
+    for (int u = 0; u < numNode; ++u) {
+        m_edges.insert(m_edges.end(), adjacency[u].begin(),
+                       adjacency[u].end());
+        m_edgeBegin.push_back(m_edges.size());
+    }
+}
+
+void HierarchicalPathwaySolver::indexClusters()
+{
+    m_clusterBegin.assign(m_numCluster + 1, 0);
+    for (int id : m_nodeCell)
+        ++m_clusterBegin[clusterOf(id) + 1];
+    for (int c = 0; c < m_numCluster; ++c)
+        m_clusterBegin[c + 1] += m_clusterBegin[c];
+}
+
+float HierarchicalPathwaySolver::octile(int id) const
+{
+    int x, y;
+    p->toXY(id, &x, &y);
+    int dx = abs(x - p->ex());
+    int dy = abs(y - p->ey());
+    return min(dx, dy)*SQRT2 + abs(dx-dy);
+}
+
+float HierarchicalPathwaySolver::refine(int from, int to,
+                                        vector<int> *pathList)
+{
+    // the two cells of an entrance
+    int cluster = clusterOf(from);
+    if (cluster != clusterOf(to)) {
+        pathList->push_back(to);
+        return 1;
+    }
+    if (from == to)
+        return 0;
+
+    m_numExpanded += searchCluster(cluster, from, false, to, &m_refine);
+    int x0, y0, x1, y1;
+    clusterBounds(cluster, &x0, &y0, &x1, &y1);
+    int width = y1 - y0;
+    int end = localIndex(cluster, to);
+    size_t begin = pathList->size();
+    for (int i = end; i != localIndex(cluster, from); i = m_refine.prev[i])
+        pathList->push_back(p->toID(x0 + i / width, y0 + i % width));
+    std::reverse(pathList->begin() + begin, pathList->end());
+    return m_refine.dist[end];
+}
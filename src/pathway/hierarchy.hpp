@@ -0,0 +1,141 @@
+#ifndef __HIERARCHY_HPP_Q7DM3KXA
+#define __HIERARCHY_HPP_Q7DM3KXA
+
+// --hierarchy: HPA* (Botea, Mueller and Schaeffer) for many queries on the
+// same graph.  The graph is cut into square clusters, and the open runs of
+// the borders between two clusters give entrances: a pair of cells facing
+// each other across the border.  The abstract graph links the two cells of
+// an entrance, and every two entrance cells of a cluster by their distance
+// within the cluster.  It is built once per graph and saved to the
+// --hierarchy-file, by default next to the --map-file.
+//
+// A query links its start and target to the entrances of their clusters,
+// searches the abstract graph, and refines every abstract edge into cells
+// with a search within its cluster.  The paths stay within the clusters, so
+// the solution may cost more than the optimal one, which is at least the
+// octile distance.  When the abstract graph has no path (the clusters only
+// meet diagonally) the whole graph is searched instead.
+
+#include "pathway/pathway.hpp"
+#include "open-list.hpp"
+
+class CPUPathwaySolver;
+
+// An open run of a border gets an entrance in its middle, or one at each end
+// from this length on
+const int ENTRANCE_SPLIT = 6;
+
+// The entrances of a border of `length' pairs of facing cells, open(i)
+// telling whether the pair i connects the two clusters: the pairs that get
+// one, in order
+template<class Open>
+vector<int> borderEntrances(int length, Open open)
+{
+    vector<int> at;
+    int begin = -1;
+    for (int i = 0; i <= length; ++i) {
+        bool connected = i < length && open(i);
+        if (connected && begin == -1)
+            begin = i;
+        if (connected || begin == -1)
+            continue;
+        if (i - begin < ENTRANCE_SPLIT) {
+            at.push_back(begin + (i - begin - 1) / 2);
+        } else {
+            at.push_back(begin);
+            at.push_back(i - 1);
+        }
+        begin = -1;
+    }
+    return at;
+}
+
+class HierarchicalPathwaySolver {
+public:
+    HierarchicalPathwaySolver(Pathway *pathway);
+    ~HierarchicalPathwaySolver();
+    // whether --hierarchy is set
+    bool enabled() const;
+    // Load the index of the graph, or build and save it
+    void initialize();
+    // Start the current query of the pathway over
+    void resetQuery();
+    // g + weight * h orders the abstract search
+    void setWeight(float weight);
+    bool solve();
+    void getSolution(float *optimal, vector<int> *pathList);
+    // the optimal distance is at least `bound' when the solution went
+    // through the abstract graph, see anytime.hpp
+    bool lowerBound(float *bound);
+
+private:
+    struct edge_t {
+        int32_t to;
+        float cost;
+    };
+
+    // a search within a cluster, one entry per cell of the cluster
+    struct local_t {
+        vector<float> dist;
+        vector<int> prev;
+        DaryHeap<float> openList;
+    };
+
+    int clusterOf(int id) const;
+    void clusterBounds(int cluster, int *x0, int *y0, int *x1,
+                       int *y1) const;
+    // index of the cell `id' in `local'
+    int localIndex(int cluster, int id) const;
+    bool canStep(int id, int dir) const;
+    // Dijkstra from `source' within `cluster', along the reversed moves when
+    // `backward'.  Stops as soon as `target' (if not -1) is closed.
+    int searchCluster(int cluster, int source, bool backward, int target,
+                      local_t *local) const;
+
+    uint64_t checksum() const;
+    string indexFile() const;
+    bool loadIndex(const string &filename);
+    void saveIndex(const string &filename) const;
+    void buildIndex();
+    void indexClusters();
+
+    float octile(int id) const;
+    // Append the cells after `from' to `to' within their cluster
+    float refine(int from, int to, vector<int> *pathList);
+
+    Pathway *p;
+    int m_cluster;
+    int m_clustersPerRow;
+    int m_numCluster;
+    float m_weight;
+
+    // cells of the entrances grouped by cluster: the entrances of the
+    // cluster `c' are [m_clusterBegin[c], m_clusterBegin[c + 1])
+    vector<int32_t> m_nodeCell;
+    vector<int32_t> m_clusterBegin;
+    // edges out of the entrance `u': [m_edgeBegin[u], m_edgeBegin[u + 1])
+    vector<int64_t> m_edgeBegin;
+    vector<edge_t> m_edges;
+
+    // the abstract search, the target is the entrance m_nodeCell.size()
+    vector<float> m_g;
+    vector<int> m_prev;
+    vector<bool> m_closed;
+    vector<int> m_touched;
+    DaryHeap<float> m_openList;
+    local_t m_fromStart;
+    local_t m_toTarget;
+    local_t m_refine;
+
+    int m_startID;
+    int m_targetID;
+    // whether the solution went through the abstract graph
+    bool m_abstract;
+    float m_optimal;
+    vector<int> m_pathList;
+    size_t m_numExpanded;
+    // the whole graph search when the abstract graph has no path
+    CPUPathwaySolver *m_fallback;
+};
+
+#endif /* end of include guard: __HIERARCHY_HPP_Q7DM3KXA */
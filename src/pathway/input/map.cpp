@@ -0,0 +1,137 @@
+#include "pathway/input/map.hpp"
+#include "pathway/input/parallel-rows.hpp"
+
+#include <cctype>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MapPathwayInput::MapPathwayInput(const string &filename)
+    : m_filename(filename), m_base(NULL), m_length(0), m_offset(0),
+      m_format(0), m_maxValue(1), m_height(0), m_width(0)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        fail("cannot be read");
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        fail("cannot be read");
+    }
+    m_length = st.st_size;
+    void *base = mmap(NULL, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        fail("cannot be mapped");
+    m_base = (const uint8_t *)base;
+    // the pixels are read once, front to back
+    madvise(base, m_length, MADV_SEQUENTIAL);
+
+    // "P5 <width> <height> <maxval>" or "P4 <width> <height>", with
+    // comments, then a single whitespace before the pixels
+    if (m_length < 2 || m_base[0] != 'P' ||
+        (m_base[1] != '4' && m_base[1] != '5'))
+        fail("is neither a binary PGM (P5) nor a PBM (P4) image");
+    m_format = m_base[1];
+
+    size_t pos = 2;
+    int fields[3] = { 0, 0, 1 };
+    int numField = m_format == '5' ? 3 : 2;
+    for (int f = 0; f < numField; ++f) {
+        for (;;) {
+            while (pos < m_length && isspace(m_base[pos]))
+                ++pos;
+            if (pos < m_length && m_base[pos] == '#') {
+                while (pos < m_length && m_base[pos] != '\n')
+                    ++pos;
+            } else
+                break;
+        }
+        if (pos == m_length || !isdigit(m_base[pos]))
+            fail("has a broken header");
+        int64_t value = 0;
+        while (pos < m_length && isdigit(m_base[pos]) && value <= INT_MAX)
+            value = value * 10 + (m_base[pos++] - '0');
+        if (value <= 0 || value > INT_MAX)
+            fail("has a broken header");
+        fields[f] = (int)value;
+    }
+    if (pos == m_length || !isspace(m_base[pos]))
+        fail("has a broken header");
+    m_offset = pos + 1;
+
+    m_width = fields[0];
+    m_height = fields[1];
+    m_maxValue = fields[2];
+    if ((int64_t)m_width * m_height > INT_MAX)
+        fail("has more than 2^31 pixels");
+    if (m_maxValue > 65535)
+        fail("has a maximum gray value above 65535");
+
+    size_t rowBytes = m_format == '4' ? (m_width + 7) / 8
+        : (size_t)m_width * (m_maxValue > 255 ? 2 : 1);
+    if (m_length - m_offset < rowBytes * m_height)
+        fail("is truncated");
+
+    if (!parseEndpoints(&m_sx, &m_sy, &m_ex, &m_ey)) {
+        m_sx = 0;
+        m_sy = 0;
+        m_ex = m_height - 1;
+        m_ey = m_width - 1;
+    }
+}
+
+MapPathwayInput::~MapPathwayInput()
+{
+    if (m_base)
+        munmap((void *)m_base, m_length);
+}
+
+void MapPathwayInput::fail(const string &reason) const
+{
+    cout << "The map file " << m_filename << " " << reason << endl;
+    exit(1);
+}
+
+void MapPathwayInput::generate(uint8_t graph[])
+{
+    const uint8_t *pixels = m_base + m_offset;
+    int width = m_width;
+    char format = m_format;
+    int maxValue = m_maxValue;
+
+    parallelRows(m_height, [=](int row) {
+        uint8_t *buf = graph + (size_t)row * width;
+        if (format == '4') {
+            const uint8_t *bits = pixels + (size_t)row * ((width + 7) / 8);
+            for (int j = 0; j < width; ++j)
+                buf[j] = (bits[j >> 3] >> (7 - (j & 7)) & 1) ? 0 : 0xFF;
+        } else if (maxValue > 255) {
+            // two bytes per pixel, most significant first
+            const uint8_t *gray = pixels + (size_t)row * width * 2;
+            for (int j = 0; j < width; ++j) {
+                int value = gray[2*j] << 8 | gray[2*j + 1];
+                buf[j] = value * 2 > maxValue ? 0xFF : 0;
+            }
+        } else {
+            const uint8_t *gray = pixels + (size_t)row * width;
+            for (int j = 0; j < width; ++j)
+                buf[j] = gray[j] * 2 > maxValue ? 0xFF : 0;
+        }
+    });
+}
+
+void MapPathwayInput::getStartPoint(int *x, int *y)
+{
+    *x = m_sx;
+    *y = m_sy;
+}
+
+void MapPathwayInput::getEndPoint(int *x, int *y)
+{
+    *x = m_ex;
+    *y = m_ey;
+}
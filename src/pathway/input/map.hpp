@@ -0,0 +1,37 @@
+#ifndef __MAP_HPP_P8LC4VYD
+#define __MAP_HPP_P8LC4VYD
+
+#include "pathway/input.hpp"
+
+// A binary PGM (P5) or PBM (P4) image mapped from --map-file, one pixel per
+// cell and one image row per graph row.  A PGM pixel brighter than half of
+// the maximum gray value is open, a PBM pixel is open when its bit is 0
+// (white).  The size of the graph is the size of the image, and the start
+// and the end point come from --endpoints, the opposite corners by default.
+class MapPathwayInput : public PathwayInput {
+public:
+    explicit MapPathwayInput(const string &filename);
+    ~MapPathwayInput();
+    int height() const { return m_height; }
+    int width() const { return m_width; }
+    void generate(uint8_t graph[]) override;
+    void getStartPoint(int *x, int *y);
+    void getEndPoint(int *x, int *y);
+
+private:
+    void fail(const string &reason) const;
+
+    string m_filename;
+    const uint8_t *m_base;
+    size_t m_length;
+    // first byte of the pixels
+    size_t m_offset;
+    char m_format;
+    int m_maxValue;
+    int m_height;
+    int m_width;
+    int m_sx, m_sy;
+    int m_ex, m_ey;
+};
+
+#endif /* end of include guard: __MAP_HPP_P8LC4VYD */
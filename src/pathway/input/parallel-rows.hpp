@@ -0,0 +1,49 @@
+#ifndef __PARALLEL_ROWS_HPP_F3M8QZ1K
+#define __PARALLEL_ROWS_HPP_F3M8QZ1K
+
+// Fill the rows of a graph on all the cores.  This header needs C++11, keep
+// it out of the nvcc translation units.
+
+#include "utils.hpp"
+
+#include <atomic>
+#include <thread>
+
+// rows handed to a thread at once
+const int ROW_CHUNK = 64;
+
+// Run f(row) for every row in [0, height)
+template<typename F>
+void parallelRows(int height, F f)
+{
+    int numThread = max(1u, std::thread::hardware_concurrency());
+    std::atomic<int> next(0);
+    vector<std::thread> threads;
+    for (int i = 0; i < numThread; ++i)
+        threads.emplace_back([&]() {
+            int begin;
+            while ((begin = next.fetch_add(ROW_CHUNK)) < height)
+                for (int row = begin; row < min(begin + ROW_CHUNK, height);
+                     ++row)
+                    f(row);
+        });
+    for (auto &thread : threads)
+        thread.join();
+}
+
+// "sx,sy,ex,ey" of --endpoints, return false if the option is not set
+inline bool parseEndpoints(int *sx, int *sy, int *ex, int *ey)
+{
+    if (!vm_options.count("endpoints"))
+        return false;
+    string spec = vm_options["endpoints"].as<string>();
+    if (sscanf(spec.c_str(), "%d,%d,%d,%d", sx, sy, ex, ey) != 4) {
+        cout << "Please set your endpoints parameter as sx,sy,ex,ey." << endl
+             << "===================================================" << endl
+             << endl;
+        help();
+    }
+    return true;
+}
+
+#endif /* end of include guard: __PARALLEL_ROWS_HPP_F3M8QZ1K */
@@ -0,0 +1,72 @@
+#include "pathway/input/random.hpp"
+#include "pathway/input/parallel-rows.hpp"
+
+RandomPathwayInput::RandomPathwayInput(int height, int width)
+    : m_height(height), m_width(width)
+{
+    // pass
+}
+
+RandomPathwayInput::~RandomPathwayInput()
+{
+    // pass
+}
+
+// splitmix64, cheap enough to draw one word per cell
+static inline uint64_t nextRandom(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void RandomPathwayInput::generate(uint8_t graph[])
+{
+    if (!vm_options.count("block-rate") ||
+        vm_options["block-rate"].as<int>() < 1 ||
+        vm_options["block-rate"].as<int>() > 99) {
+        cout << "Please set your block-rate parameter (1-99)." << endl
+             << "============================================" << endl
+             << endl;
+        help();
+    }
+    int blockRate = vm_options["block-rate"].as<int>();
+
+    uint64_t seed = (uint64_t)random_engine() << 32 | random_engine();
+    if (!parseEndpoints(&m_sx, &m_sy, &m_ex, &m_ey)) {
+        boost::uniform_int<int> row(0, m_height - 1);
+        boost::uniform_int<int> column(0, m_width - 1);
+        m_sx = row(random_engine);
+        m_sy = column(random_engine);
+        m_ex = row(random_engine);
+        m_ey = column(random_engine);
+    }
+
+    // a cell is blocked when its word is below this share of 2^64
+    uint64_t threshold = (uint64_t)(blockRate / 100.0 * 18446744073709551616.0);
+    int width = m_width;
+    parallelRows(m_height, [=](int row) {
+        uint64_t state = seed ^ (uint64_t)row * 0xd1342543de82ef95ULL;
+        uint8_t *buf = graph + (size_t)row * width;
+        for (int j = 0; j < width; ++j)
+            buf[j] = nextRandom(&state) < threshold ? 0 : 0xFF;
+    });
+
+    if (0 <= m_sx && m_sx < m_height && 0 <= m_sy && m_sy < m_width)
+        graph[(size_t)m_sx * m_width + m_sy] = 0xFF;
+    if (0 <= m_ex && m_ex < m_height && 0 <= m_ey && m_ey < m_width)
+        graph[(size_t)m_ex * m_width + m_ey] = 0xFF;
+}
+
+void RandomPathwayInput::getStartPoint(int *x, int *y)
+{
+    *x = m_sx;
+    *y = m_sy;
+}
+
+void RandomPathwayInput::getEndPoint(int *x, int *y)
+{
+    *x = m_ex;
+    *y = m_ey;
+}
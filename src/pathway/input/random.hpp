@@ -0,0 +1,25 @@
+#ifndef __RANDOM_HPP_T6RW2BXN
+#define __RANDOM_HPP_T6RW2BXN
+
+#include "pathway/input.hpp"
+
+// Every cell is blocked with probability --block-rate percent.  The graph
+// only depends on --seed: every row draws from its own stream, so the rows
+// are generated in parallel.  The start and the end point are random cells
+// unless --endpoints is set, and are always open.
+class RandomPathwayInput : public PathwayInput {
+public:
+    RandomPathwayInput(int height, int width);
+    ~RandomPathwayInput();
+    void generate(uint8_t graph[]) override;
+    void getStartPoint(int *x, int *y);
+    void getEndPoint(int *x, int *y);
+
+protected:
+    int m_height;
+    int m_width;
+    int m_sx, m_sy;
+    int m_ex, m_ey;
+};
+
+#endif /* end of include guard: __RANDOM_HPP_T6RW2BXN */
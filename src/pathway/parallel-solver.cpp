@@ -0,0 +1,98 @@
+#include "pathway/parallel-solver.hpp"
+#include "hda-star.hpp"
+#include "metrics.hpp"
+
+namespace {
+
+struct PathwayDomain {
+    typedef int state_t;
+    typedef float cost_t;
+    typedef DaryHeap<float> openlist_t;
+
+    const Pathway *p;
+    int targetID;
+    float weight;
+
+    uint64_t hash(int id) const {
+        return id;
+    }
+
+    float heuristic(int id) const {
+        int x, y;
+        p->toXY(id, &x, &y);
+        int dx = abs(x - p->ex());
+        int dy = abs(y - p->ey());
+        return weight * (min(dx, dy)*SQRT2 + abs(dx-dy));
+    }
+
+    bool isGoal(int id) const {
+        return id == targetID;
+    }
+
+    template<class Visitor>
+    void expand(int id, Visitor visit) const {
+        int x, y;
+        p->toXY(id, &x, &y);
+        uint8_t mask = p->edgeMask(id);
+        for (int i = 0; i < 8; ++i) {
+            if (~mask & 1 << i)
+                continue;
+            int nx = x + DX[i];
+            int ny = y + DY[i];
+            if (p->inrange(nx, ny))
+                visit(p->toID(nx, ny), COST[i]);
+        }
+    }
+};
+
+}
+
+ParallelPathwaySolver::ParallelPathwaySolver(Pathway *pathway)
+    : p(pathway), m_numThread(0), m_weight(1), m_optimal(0),
+      m_numExpanded(0)
+{
+    // pass
+}
+
+void ParallelPathwaySolver::initialize()
+{
+    m_numThread = vm_options["threads"].as<int>();
+}
+
+void ParallelPathwaySolver::setWeight(float weight)
+{
+    m_weight = weight;
+}
+
+bool ParallelPathwaySolver::solve()
+{
+    PathwayDomain domain;
+    domain.p = p;
+    domain.targetID = p->toID(p->ex(), p->ey());
+    domain.weight = m_weight;
+
+    HDAStar<PathwayDomain> hda(domain, m_numThread);
+    bool found = hda.solve(p->toID(p->sx(), p->sy()));
+    m_numExpanded = hda.numExpanded();
+    if (found) {
+        // A reopened node keeps pointing to its best parent, so with a
+        // weighted heuristic the path may be shorter than the incumbent.
+        hda.getPath(&m_pathList);
+        m_optimal = 0;
+        for (int k = 1; k < (int)m_pathList.size(); ++k) {
+            int x0, y0, x1, y1;
+            p->toXY(m_pathList[k-1], &x0, &y0);
+            p->toXY(m_pathList[k], &x1, &y1);
+            m_optimal += x0 != x1 && y0 != y1 ? SQRT2 : 1;
+        }
+    }
+    return found;
+}
+
+void ParallelPathwaySolver::getSolution(float *optimal, vector<int> *pathList)
+{
+    printf("\t\t\tNumber of nodes expanded: %d\n", (int)m_numExpanded);
+    metrics.counter("parallel", "expanded", m_numExpanded);
+    *optimal = m_optimal;
+    *pathList = m_pathList;
+}
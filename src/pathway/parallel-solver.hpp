@@ -0,0 +1,26 @@
+#ifndef __PARALLEL_SOLVER_HPP_N8CZ4LDE
+#define __PARALLEL_SOLVER_HPP_N8CZ4LDE
+
+#include "pathway/pathway.hpp"
+
+// Hash distributed A* on --threads CPU threads, see hda-star.hpp
+class ParallelPathwaySolver {
+public:
+    ParallelPathwaySolver(Pathway *pathway);
+    void initialize();
+    // g + weight * h orders the open list of the next solve()
+    void setWeight(float weight);
+    bool solve();
+    void getSolution(float *optimal, vector<int> *pathList);
+
+private:
+    Pathway *p;
+    int m_numThread;
+    float m_weight;
+
+    float m_optimal;
+    vector<int> m_pathList;
+    size_t m_numExpanded;
+};
+
+#endif /* end of include guard: __PARALLEL_SOLVER_HPP_N8CZ4LDE */
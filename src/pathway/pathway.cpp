@@ -3,8 +3,23 @@
 #include "pathway/pathway.hpp"
 #include "pathway/input/custom.hpp"
 #include "pathway/input/zigzag.hpp"
+#include "pathway/input/random.hpp"
+#include "pathway/input/map.hpp"
 #include "pathway/CPU-solver.hpp"
 #include "pathway/GPU-solver.hpp"
+#include "pathway/parallel-solver.hpp"
+#include "pathway/hierarchy.hpp"
+#include "anytime.hpp"
+
+// Reject --`name' unless it is left at `value' with --concurrent
+static void rejectWithConcurrent(const string &name, const string &value)
+{
+    string line = "Please set your " + name + " parameter to " + value +
+        " with --concurrent.";
+    cout << line << endl << string(line.size(), '=') << endl
+        << endl;
+    help();
+}
 
 static void drawPixel(
     bitmap_image &image, int pixel_size,
@@ -17,29 +32,74 @@ static void drawPixel(
 
 Pathway::Pathway()
 {
-    if (!vm_options.count("width") || !vm_options.count("height")) {
+    m_inputModule = vm_options["input-module"].as<string>();
+    // the size of a map is the size of its image
+    if (m_inputModule != "map" &&
+        (!vm_options.count("width") || !vm_options.count("height"))) {
         cout << "Please set the width and height for your graph." << endl
             << "===============================================" << endl
             << endl;
         help();
     }
 
-    m_width = vm_options["width"].as<int>();
-    m_height = vm_options["height"].as<int>();
-    m_inputModule = vm_options["input-module"].as<string>();
+    m_width = vm_options.count("width") ? vm_options["width"].as<int>() : 0;
+    m_height = vm_options.count("height") ? vm_options["height"].as<int>() : 0;
     m_size = m_width * m_height;
+    m_concurrent = vm_options["concurrent"].as<int>();
+    m_bitmapGraph = false;
+    m_tilesPerRow = 0;
     cpuSolver = new CPUPathwaySolver(this);
     gpuSolver = new GPUPathwaySolver(this);
+    gpuMultiSolver = new GPUMultiPathwaySolver(this);
+    gpuShardedSolver = new GPUShardedPathwaySolver(this);
+    if (gpuShardedSolver->numShard() > 1 && m_concurrent > 1) {
+        cout << "--devices and --concurrent cannot be used together" << endl;
+        exit(1);
+    }
+    // the concurrent searches have a layout and launch of their own, and
+    // none of the options of the single query search
+    if (m_concurrent > 1) {
+        const char *fixed[][2] = {
+            { "dedup", "sort" },
+            { "node-layout", "arena" },
+            { "launch", "default" },
+        };
+        for (int i = 0; i < 3; ++i)
+            if (vm_options[fixed[i][0]].as<string>() != fixed[i][1])
+                rejectWithConcurrent(fixed[i][0], fixed[i][1]);
+        const char *flags[] = { "bidirectional", "jump-pruning" };
+        for (int i = 0; i < 2; ++i)
+            if (vm_options.count(flags[i]))
+                rejectWithConcurrent(flags[i], "unset");
+        if (vm_options["f-band"].as<float>() >= 0)
+            rejectWithConcurrent("f-band", "a negative value");
+        if (vm_options["memory-limit"].as<int>() != 0)
+            rejectWithConcurrent("memory-limit", "0");
+        if (vm_options["poll-interval"].as<int>() != 1)
+            rejectWithConcurrent("poll-interval", "1");
+    }
+    parallelSolver = new ParallelPathwaySolver(this);
+    hierarchySolver = new HierarchicalPathwaySolver(this);
+    string format = vm_options["solution-format"].as<string>();
+    if (format != "text" && format != "binary") {
+        cout << "Please set your solution-format parameter correctly." << endl
+            << "====================================================" << endl
+            << endl;
+        help();
+    }
     cpuSolved = false;
     gpuSolved = false;
-    cpuSuccessful = false;
-    gpuSuccessful = false;
+    parallelSolved = false;
 }
 
 Pathway::~Pathway()
 {
     delete cpuSolver;
     delete gpuSolver;
+    delete gpuMultiSolver;
+    delete gpuShardedSolver;
+    delete parallelSolver;
+    delete hierarchySolver;
 }
 
 string Pathway::problemName() const
@@ -49,84 +109,259 @@ string Pathway::problemName() const
 
 void Pathway::prepare()
 {
-    m_graph.resize(m_size);
     if (m_inputModule == "custom") {
         CustomPathwayInput input(m_height, m_width);
         generateGraph(input);
     } else if (m_inputModule == "zigzag") {
         ZigzagPathwayInput input(m_height, m_width);
         generateGraph(input);
+    } else if (m_inputModule == "random") {
+        RandomPathwayInput input(m_height, m_width);
+        generateGraph(input);
+    } else if (m_inputModule == "map") {
+        if (!vm_options.count("map-file")) {
+            cout << "Please set the map-file for the map input module." << endl
+                << "=================================================" << endl
+                << endl;
+            help();
+        }
+        MapPathwayInput input(vm_options["map-file"].as<string>());
+        m_height = input.height();
+        m_width = input.width();
+        m_size = m_width * m_height;
+        generateGraph(input);
     } else {
         cout << "Please set your input-module parameter correctly." << endl
             << "=================================================" << endl
             << endl;;
         help();
     }
+
+    string layout = vm_options["graph-layout"].as<string>();
+    if (layout == "bitmap") {
+        packGraph();
+    } else if (layout != "bytes") {
+        cout << "Please set your graph-layout parameter correctly." << endl
+            << "=================================================" << endl
+            << endl;;
+        help();
+    }
+
+    if (!inrange(m_sx, m_sy) || !inrange(m_ex, m_ey)) {
+        cout << "Query (" << m_sx << ", " << m_sy << ") -> (" << m_ex << ", "
+             << m_ey << ") is out of the graph" << endl;
+        exit(1);
+    }
+    m_queries.clear();
+    m_queries.push_back(query_t{m_sx, m_sy, m_ex, m_ey});
+    if (vm_options.count("query-file"))
+        loadQueries(vm_options["query-file"].as<string>());
+    selectQuery(0);
+}
+
+void Pathway::selectQuery(int index)
+{
+    const query_t &q = m_queries[index];
+    m_sx = q.sx;
+    m_sy = q.sy;
+    m_ex = q.ex;
+    m_ey = q.ey;
+}
+
+void Pathway::loadQueries(const string &filename)
+{
+    FILE *fin = fopen(filename.c_str(), "r");
+    if (!fin) {
+        cout << "Cannot read query file " << filename << endl;
+        exit(1);
+    }
+
+    query_t q;
+    while (fscanf(fin, "%d %d %d %d", &q.sx, &q.sy, &q.ex, &q.ey) == 4) {
+        if (!inrange(q.sx, q.sy) || !inrange(q.ex, q.ey)) {
+            cout << "Query (" << q.sx << ", " << q.sy << ") -> ("
+                 << q.ex << ", " << q.ey << ") is out of the graph" << endl;
+            exit(1);
+        }
+        m_queries.push_back(q);
+    }
+    fclose(fin);
+    dout << "\tLoaded " << m_queries.size() << " queries" << endl;
 }
 
 void Pathway::cpuInitialize()
 {
-    cpuSolver->initialize();
+    // the hierarchy is built (or loaded) once for all the queries
+    if (hierarchySolver->enabled())
+        hierarchySolver->initialize();
+    else
+        cpuSolver->initialize();
 }
 
 void Pathway::gpuInitialize()
 {
-    gpuSolver->initialize();
+    if (m_concurrent > 1)
+        gpuMultiSolver->initialize(min(m_concurrent, numQueries()));
+    else if (gpuShardedSolver->numShard() > 1)
+        gpuShardedSolver->initialize();
+    else
+        gpuSolver->initialize();
+}
+
+void Pathway::parallelInitialize()
+{
+    parallelSolver->initialize();
 }
 
 void Pathway::cpuSolve()
 {
-    cpuSuccessful = cpuSolver->solve();
+    cpuSolutions.resize(numQueries());
+    for (int i = 0; i < numQueries(); ++i) {
+        selectQuery(i);
+        if (hierarchySolver->enabled())
+            weightedSolve(hierarchySolver,
+                          &HierarchicalPathwaySolver::resetQuery,
+                          &HierarchicalPathwaySolver::lowerBound, false, "CPU",
+                          &cpuSolutions[i]);
+        else
+            weightedSolve(cpuSolver, &CPUPathwaySolver::initialize, false,
+                          "CPU", &cpuSolutions[i]);
+    }
     cpuSolved = true;
 }
 
 void Pathway::gpuSolve()
 {
-    gpuSuccessful = gpuSolver->solve();
+    // the graph and device buffers stay resident between the queries, only
+    // the search state is reset
+    gpuSolutions.resize(numQueries());
+    if (m_concurrent > 1) {
+        for (int i = 0; i < numQueries(); i += gpuMultiSolver->numSearch()) {
+            int count = min(gpuMultiSolver->numSearch(), numQueries() - i);
+            gpuMultiSolver->solve(m_queries.data() + i, count);
+            for (int j = 0; j < count; ++j) {
+                solution_t &s = gpuSolutions[i + j];
+                s.successful = gpuMultiSolver->getSolution(
+                    j, &s.optimal, &s.pathList);
+                // the concurrent searches run at --weight only
+                AnytimeSchedule schedule(false);
+                schedule.next(s.successful, s.optimal);
+                s.bounded = s.successful && !schedule.proven();
+                s.lowerBound = schedule.lowerBound();
+            }
+        }
+        gpuSolved = true;
+        return;
+    }
+
+    bool sharded = gpuShardedSolver->numShard() > 1;
+    for (int i = 0; i < numQueries(); ++i) {
+        selectQuery(i);
+        if (sharded)
+            weightedSolve(gpuShardedSolver,
+                          &GPUShardedPathwaySolver::resetQuery, false, "GPU",
+                          &gpuSolutions[i]);
+        else
+            weightedSolve(gpuSolver, &GPUPathwaySolver::resetQuery,
+                          &GPUPathwaySolver::lowerBound, false, "GPU",
+                          &gpuSolutions[i]);
+    }
     gpuSolved = true;
 }
 
+void Pathway::parallelSolve()
+{
+    parallelSolutions.resize(numQueries());
+    for (int i = 0; i < numQueries(); ++i) {
+        selectQuery(i);
+        weightedSolve(parallelSolver, &ParallelPathwaySolver::initialize,
+                      false, "CPU threads", &parallelSolutions[i]);
+    }
+    parallelSolved = true;
+}
+
 bool Pathway::output()
 {
-    if (cpuSolved && gpuSolved) {
-        if (cpuSuccessful != gpuSuccessful)
-            return false;
+    bool consistent = true;
+
+    for (int i = 1; i < numQueries(); ++i) {
+        const query_t &q = m_queries[i];
+        printf(" > Query %d (%d, %d) -> (%d, %d):", i, q.sx, q.sy, q.ex, q.ey);
+        if (cpuSolved)
+            printSummary(cpuSolutions[i], "CPU");
+        if (gpuSolved)
+            printSummary(gpuSolutions[i], "GPU");
+        if (parallelSolved)
+            printSummary(parallelSolutions[i], "threads");
+        printf("\n");
+
+        if (cpuSolved && gpuSolved) {
+            if (!matches(cpuSolutions[i], gpuSolutions[i]))
+                consistent = false;
+        }
+        if (cpuSolved && parallelSolved) {
+            if (!matches(cpuSolutions[i], parallelSolutions[i]))
+                consistent = false;
+        }
     }
 
+    // the first query is reported in detail
+    selectQuery(0);
+    solution_t cpu = cpuSolved ? cpuSolutions[0] : solution_t();
+    solution_t gpu = gpuSolved ? gpuSolutions[0] : solution_t();
+    solution_t threads = parallelSolved ? parallelSolutions[0] : solution_t();
+
     if (cpuSolved) {
-        if (cpuSuccessful) {
-            cpuSolver->getSolution(&cpuOptimal, &cpuSolution);
-            printSolution(cpuSolution, "solutionCPU.txt");
+        if (cpu.successful) {
+            printSolution(cpu.pathList, "solutionCPU");
         } else {
             cout << "No solution from CPU." << endl;
         }
     }
 
     if (gpuSolved) {
-        if (gpuSuccessful) {
-            gpuSolver->getSolution(&gpuOptimal, &gpuSolution);
-            printSolution(gpuSolution, "solutionGPU.txt");
+        if (gpu.successful) {
+            printSolution(gpu.pathList, "solutionGPU");
+        } else if (gpu.bounded) {
+            cout << "No solution from GPU within the memory limit." << endl;
         } else {
             cout << "No solution from GPU." << endl;
         }
     }
 
-    if (cpuSuccessful) {
-        printf(" > Optimal distance from CPU: %.3f\n", cpuOptimal);
-        plotSolution(cpuSolution, "pathwayCPU.bmp");
+    if (cpu.successful) {
+        printCost(cpu, "CPU");
+        plotSolution(cpu.pathList, "pathwayCPU.bmp");
     }
-    if (gpuSuccessful) {
-        printf(" > Optimal distance from GPU: %.3f\n", gpuOptimal);
-        plotSolution(gpuSolution, "pathwayGPU.bmp");
+    if (gpu.successful) {
+        printCost(gpu, "GPU");
+        plotSolution(gpu.pathList, "pathwayGPU.bmp");
+    }
+    if (threads.successful) {
+        printCost(threads, "CPU threads");
     }
     plotSolution(vector<int>(), "pathway.bmp");
 
     if (cpuSolved && gpuSolved) {
-        if (!float_equal(cpuOptimal, gpuOptimal))
+        if (!matches(cpu, gpu))
+            return false;
+    }
+    if (cpuSolved && parallelSolved) {
+        if (!matches(cpu, threads))
             return false;
     }
 
-    return true;
+    return consistent;
+}
+
+void Pathway::printSummary(const solution_t &s, const char *name)
+{
+    if (!s.successful)
+        printf(" %s none", name);
+    else if (s.bounded)
+        printf(" %s %.3f (>= %.3f)", name, s.optimal, s.lowerBound);
+    else
+        printf(" %s %.3f", name, s.optimal);
 }
 
 void Pathway::generateGraph(PathwayInput &input)
@@ -138,26 +373,55 @@ void Pathway::generateGraph(PathwayInput &input)
     input.getEndPoint(&m_ex, &m_ey);
 }
 
+// Convert the byte graph to the tiled bitmap and release it
+void Pathway::packGraph()
+{
+    m_tilesPerRow = (width() + GRAPH_TILE - 1) / GRAPH_TILE;
+    int tileRows = (height() + GRAPH_TILE - 1) / GRAPH_TILE;
+    m_bitmap.assign((size_t)tileRows * m_tilesPerRow * GRAPH_TILE, 0);
+
+    for (int x = 0; x < height(); ++x)
+        for (int y = 0; y < width(); ++y) {
+            uint8_t mask = m_graph[toID(x, y)];
+            assert(mask == 0 || mask == 0xFF);
+            if (mask) {
+                m_bitmap[((x / GRAPH_TILE) * m_tilesPerRow + y / GRAPH_TILE) *
+                         GRAPH_TILE + x % GRAPH_TILE] |= 1u << y % GRAPH_TILE;
+            }
+        }
+
+    vector<uint8_t>().swap(m_graph);
+    m_bitmapGraph = true;
+}
+
+// Write the path to `name'.txt, or with --solution-format=binary to
+// `name'.bin: the int32 height, width and length of the path, then the int32
+// cell IDs (x * width + y) from the start to the target.
 void Pathway::printSolution(const vector<int> &pathList,
-                            const string filename) const
+                            const string name) const
 {
-    FILE *fout = fopen(filename.c_str(), "w");
+    bool binary = vm_options["solution-format"].as<string>() == "binary";
+    string filename = name + (binary ? ".bin" : ".txt");
+    FILE *fout = fopen(filename.c_str(), binary ? "wb" : "w");
 
     if (!fout) {
         printf("ERROR: %s cannot be open for writting.", filename.c_str());
         return;
     }
+    // long paths are written in large blocks
+    setvbuf(fout, NULL, _IOFBF, 1 << 20);
+
+    if (binary) {
+        int32_t header[3] = { height(), width(), (int32_t)pathList.size() };
+        fwrite(header, sizeof(int32_t), 3, fout);
+        fwrite(pathList.data(), sizeof(int), pathList.size(), fout);
+    }
 
     int px, py;
     int count = 0;
     int count1 = 0;
     int count2 = 0;
     for (int v : pathList) {
-        if (count)
-            fprintf(fout, " -> ");
-        if (++count % 6 == 0) {
-            fprintf(fout, "\n\t");
-        }
         int x, y;
         toXY(v, &x, &y);
         if (abs(px-x) + abs(py-y) == 2)
@@ -166,6 +430,13 @@ void Pathway::printSolution(const vector<int> &pathList,
             count1++;
         px = x;
         py = y;
+        if (binary)
+            continue;
+        if (count)
+            fprintf(fout, " -> ");
+        if (++count % 6 == 0) {
+            fprintf(fout, "\n\t");
+        }
         fprintf(fout, "(%d %d)", x, y);
     }
 
@@ -185,18 +456,16 @@ void Pathway::plotSolution(const vector<int> &pathList,
     bitmap_image image(width() * 3 * pixel_size, height() * 3 * pixel_size);
 
     // draw the background
-    const uint8_t *buf = graph();
     for (int i = 0; i < height(); ++i)
         for (int j = 0; j < width(); ++j) {
             int x = 3 * i + 1;
             int y = 3 * j + 1;
+            uint8_t mask = edgeMask(toID(i, j));
             drawPixel(image, pixel_size, x, y, 255, 255, 255);
             for (int k = 0; k < 8; ++k) {
-                uint8_t col = (*buf & 1 << k) ? 255 : 128;
+                uint8_t col = (mask & 1 << k) ? 255 : 128;
                 drawPixel(image, pixel_size, x+DX[k], y+DY[k], col, col, col);
             }
-
-            ++buf;
         }
 
     // draw visited nodes
@@ -2,10 +2,24 @@
 #define __UASTAR_PATHWAY
 
 #include "problem.hpp"
+#include "anytime.hpp"
 #include "pathway/input.hpp"
 
+// side of the square tiles of a bitmap graph
+const int GRAPH_TILE = 32;
+
 class CPUPathwaySolver;
 class GPUPathwaySolver;
+class GPUMultiPathwaySolver;
+class GPUShardedPathwaySolver;
+class ParallelPathwaySolver;
+class HierarchicalPathwaySolver;
+
+// a single (sx, sy) -> (ex, ey) request against the loaded graph
+struct query_t {
+    int sx, sy;
+    int ex, ey;
+};
 
 class Pathway : public Problem {
 public:
@@ -15,8 +29,10 @@ public:
     void prepare();
     void cpuInitialize();
     void gpuInitialize();
+    void parallelInitialize();
     void cpuSolve();
     void gpuSolve();
+    void parallelSolve();
     bool output();
 
     int sx() const;
@@ -29,12 +45,31 @@ public:
     int toID(int x, int y) const;
     void toXY(int id, int *x, int *y) const;
     bool inrange(int x, int y) const;
-    const uint8_t *graph() const;
+    // direction bits of the cell `id'
+    uint8_t edgeMask(int id) const;
+
+    // The graph is either one byte of direction bits per cell or, with
+    // --graph-layout bitmap, a 1-bit passability map stored in tiles of
+    // GRAPH_TILE x GRAPH_TILE cells.  Every input module only generates
+    // fully open (0xFF) or blocked (0) cells, so the bitmap is lossless.
+    bool bitmapGraph() const;
+    int tilesPerRow() const;
+    const uint8_t *graphData() const;
+    size_t graphBytes() const;
+
+    int numQueries() const;
+    void selectQuery(int index);
 
 private:
+    typedef anytime_solution_t<float> solution_t;
+
+    static void printSummary(const solution_t &s, const char *name);
+
     void generateGraph(PathwayInput &input);
+    void packGraph();
+    void loadQueries(const string &filename);
     void printSolution(const vector<int> &pathList,
-                       const string filename) const;
+                       const string name) const;
     void plotSolution(const vector<int> &pathList,
                       const string filename) const;
 
@@ -47,18 +82,28 @@ private:
     int m_height;
     string m_inputModule;
     vector<uint8_t> m_graph;
+    bool m_bitmapGraph;
+    int m_tilesPerRow;
+    // word `x % GRAPH_TILE' of a tile holds the row x of the tile
+    vector<uint32_t> m_bitmap;
+    vector<query_t> m_queries;
+    int m_concurrent;
     CPUPathwaySolver *cpuSolver;
     GPUPathwaySolver *gpuSolver;
+    GPUMultiPathwaySolver *gpuMultiSolver;
+    GPUShardedPathwaySolver *gpuShardedSolver;
+    ParallelPathwaySolver *parallelSolver;
+    // answers the CPU queries instead of cpuSolver under --hierarchy
+    HierarchicalPathwaySolver *hierarchySolver;
 
     bool cpuSolved;
-    bool cpuSuccessful;
-    float cpuOptimal;
-    vector<int> cpuSolution;
+    vector<solution_t> cpuSolutions;
 
     bool gpuSolved;
-    bool gpuSuccessful;
-    float gpuOptimal;
-    vector<int> gpuSolution;
+    vector<solution_t> gpuSolutions;
+
+    bool parallelSolved;
+    vector<solution_t> parallelSolutions;
 };
 
 inline int Pathway::sx() const
@@ -113,9 +158,46 @@ inline bool Pathway::inrange(int x, int y) const
 }
     
 
-inline const uint8_t *Pathway::graph() const
+inline uint8_t Pathway::edgeMask(int id) const
+{
+    if (!m_bitmapGraph)
+        return m_graph[id];
+
+    int x, y;
+    toXY(id, &x, &y);
+    uint32_t word = m_bitmap[
+        ((x / GRAPH_TILE) * m_tilesPerRow + y / GRAPH_TILE) * GRAPH_TILE +
+        x % GRAPH_TILE];
+    return (word >> (y % GRAPH_TILE) & 1) ? 0xFF : 0;
+}
+
+inline bool Pathway::bitmapGraph() const
+{
+    return m_bitmapGraph;
+}
+
+inline int Pathway::tilesPerRow() const
+{
+    return m_tilesPerRow;
+}
+
+inline const uint8_t *Pathway::graphData() const
 {
+    if (m_bitmapGraph)
+        return reinterpret_cast<const uint8_t *>(m_bitmap.data());
     return m_graph.data();
 }
 
+inline size_t Pathway::graphBytes() const
+{
+    if (m_bitmapGraph)
+        return sizeof(uint32_t) * m_bitmap.size();
+    return m_graph.size();
+}
+
+inline int Pathway::numQueries() const
+{
+    return m_queries.size();
+}
+
 #endif
@@ -0,0 +1,77 @@
+#ifndef __PRUNING_HPP_W5HN2C7Y
+#define __PRUNING_HPP_W5HN2C7Y
+
+// --jump-pruning: the neighbour pruning of Jump Point Search (Harabor and
+// Grastien), shared by the CPU and the GPU searches.  The cell x reached
+// from its parent p skips the move to its neighbour n when n can be reached
+// from p without going through x, in at most two moves that cost strictly
+// less than p -> x -> n.  The moves left are the natural neighbours of the
+// move into x, and the forced ones where the detours are blocked: 3 of 8 on
+// an open grid.
+//
+// JPS also prunes the equal-cost detours after a straight move, which only
+// keeps one optimal path if every cell is expanded from its diagonal-first
+// parent.  The GPU deduplication keeps any parent of the best gValue, so the
+// ties are kept instead: a pruned move is then on no optimal path at all, and
+// the search stays optimal whichever parent a cell was expanded from.
+//
+// `Graph' answers canMove(x, y, dx, dy): whether the move (dx, dy) leaves the
+// cell (x, y) and stays on the graph.
+
+#include "utils.hpp"
+
+inline __cuda__ float moveCost(int dx, int dy)
+{
+    return dx && dy ? SQRT2 : 1;
+}
+
+// Whether (nx, ny) can be reached from (px, py) in at most two moves that
+// cost less than `limit', without going through (x, y)
+template<class Graph>
+__cuda__ bool hasDetour(const Graph &graph, int px, int py, int x, int y,
+                        int nx, int ny, float limit)
+{
+    int ex = nx - px;
+    int ey = ny - py;
+    if (ex == 0 && ey == 0)
+        return true;
+    if (abs(ex) <= 1 && abs(ey) <= 1 && moveCost(ex, ey) < limit &&
+        graph.canMove(px, py, ex, ey))
+        return true;
+
+    for (int ax = -1; ax <= 1; ++ax) {
+        for (int ay = -1; ay <= 1; ++ay) {
+            int cx = px + ax;
+            int cy = py + ay;
+            int bx = nx - cx;
+            int by = ny - cy;
+            if ((ax == 0 && ay == 0) || (cx == x && cy == y) ||
+                abs(bx) > 1 || abs(by) > 1 || (bx == 0 && by == 0))
+                continue;
+            if (moveCost(ax, ay) + moveCost(bx, by) < limit &&
+                graph.canMove(px, py, ax, ay) &&
+                graph.canMove(cx, cy, bx, by))
+                return true;
+        }
+    }
+    return false;
+}
+
+// Clear the bits of `mask' (bit i for the move (dx[i], dy[i])) that the cell
+// (x, y) reached from (px, py) does not need to take
+template<class Graph>
+__cuda__ uint8_t pruneMoves(const Graph &graph, int x, int y, int px, int py,
+                            uint8_t mask, const int dx[8], const int dy[8])
+{
+    float cost = moveCost(x - px, y - py);
+    for (int i = 0; i < 8; ++i) {
+        if (~mask & 1 << i)
+            continue;
+        if (hasDetour(graph, px, py, x, y, x + dx[i], y + dy[i],
+                      cost + moveCost(dx[i], dy[i])))
+            mask &= ~(1 << i);
+    }
+    return mask;
+}
+
+#endif /* end of include guard: __PRUNING_HPP_W5HN2C7Y */
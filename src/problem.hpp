@@ -14,12 +14,16 @@ public:
     virtual void cpuInitialize() = 0;
     // Initialize the environemnt for GPU execution
     virtual void gpuInitialize() = 0;
+    // Initialize the environemnt for multi-threaded CPU execution
+    virtual void parallelInitialize() = 0;
     // Solve the problem on CPU.  Return the used wall time .
     virtual void cpuSolve() = 0;
     // Solve the problem on GPU.  Return the used wall time .
     virtual void gpuSolve() = 0;
-    // Print the output.  Return whether the CPU's solution and the GPU's
-    // solution is consistent.
+    // Solve the problem on --threads CPU threads.
+    virtual void parallelSolve() = 0;
+    // Print the output.  Return whether the solutions of the CPU, the GPU
+    // and the CPU threads are consistent.
     virtual bool output() = 0;
 };
 
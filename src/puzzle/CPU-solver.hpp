@@ -3,144 +3,63 @@
 
 #include "puzzle/puzzle.cuh"
 #include "puzzle/storage.hpp"
-#include "puzzle/database.hpp"
+#include "puzzle/heuristic.hpp"
+#include "metrics.hpp"
+#include "anytime.hpp"
+#include "open-list.hpp"
 
-#include <queue>
 #include <boost/unordered_map.hpp>
 
 namespace cpusolver {
 
+// Nodes live in a pool and are addressed by their index, which is also
+// their handle in the open list.
 template<int N>
 struct node_t {
     PuzzleStorage<N> ps;
-    node_t<N> *prev;
+    int prev;
     int fValue;
     int gValue;
+    // the successors are evaluated from these
+    pdb_values_t hValues;
 };
 
-template<int N>
-struct heap_t {
-    int fValue;
-    node_t<N> *node;
-    bool operator<(const heap_t<N> &r) const {
-        return fValue < r.fValue;
-    }
-    bool operator>(const heap_t<N> &r) const {
-        return fValue > r.fValue;
-    }
-};
-
-template <int N>
+// OpenList: BucketQueue or DaryHeap, see open-list.hpp
+template <int N, class OpenList = BucketQueue<int> >
 class CPUPuzzleSolver {
 public:
-    CPUPuzzleSolver(Puzzle *puzzle) : p(puzzle) { }
-    ~CPUPuzzleSolver() {
-        for (typename boost::unordered_map<
-             PuzzleStorage<N>, node_t<N> * >::iterator
-             it = closeList.begin(); it != closeList.end(); ++it)
-            delete it->second;
-    }
+    CPUPuzzleSolver(Puzzle *puzzle)
+        : p(puzzle), m_weight(searchWeight()) { }
     void initialize() {
-        if (N == 3) {
-            dbCount = 1;
-            tracked.resize(dbCount);
-            database.resize(dbCount);
-            for (int i = 1; i <= 8; ++i)
-                tracked[0].push_back(i);
-        } else if (N == 4) {
-            dbCount = 2;
-            tracked.resize(dbCount);
-            database.resize(dbCount);
-
-            tracked[0].push_back(1);
-            tracked[0].push_back(2);
-            tracked[0].push_back(3);
-            tracked[0].push_back(4);
-            tracked[0].push_back(5);
-            tracked[0].push_back(6);
-            tracked[0].push_back(9);
-            tracked[0].push_back(13);
-
-            tracked[1].push_back(7);
-            tracked[1].push_back(8);
-            tracked[1].push_back(10);
-            tracked[1].push_back(11);
-            tracked[1].push_back(12);
-            tracked[1].push_back(14);
-            tracked[1].push_back(15);
-        } else if (N == 5) {
-            dbCount = 4;
-            tracked.resize(dbCount);
-            database.resize(dbCount);
-
-            tracked[0].push_back(3);
-            tracked[0].push_back(4);
-            tracked[0].push_back(5);
-            tracked[0].push_back(10);
-            tracked[0].push_back(15);
-            tracked[0].push_back(20);
-
-            tracked[1].push_back(2);
-            tracked[1].push_back(1);
-            tracked[1].push_back(6);
-            tracked[1].push_back(11);
-            tracked[1].push_back(16);
-            tracked[1].push_back(21);
-
-            tracked[2].push_back(7);
-            tracked[2].push_back(8);
-            tracked[2].push_back(9);
-            tracked[2].push_back(12);
-            tracked[2].push_back(17);
-            tracked[2].push_back(22);
-
-            tracked[3].push_back(13);
-            tracked[3].push_back(14);
-            tracked[3].push_back(18);
-            tracked[3].push_back(19);
-            tracked[3].push_back(23);
-            tracked[3].push_back(24);
-        } else
-            assert(false);
-
-        index.resize(dbCount);
-        multiple.resize(dbCount);
-        mapTracked.resize(N*N, make_pair(-1, -1));
-        for (int i = 0; i < dbCount; ++i) {
-            PatternDatabase pd(N, tracked[i]);
-            database[i].resize(pd.size());
-            pd.fetchDatabase(database[i].data());
-
-            index[i].resize(tracked[i].size());
-            multiple[i].reserve(tracked[i].size() + 1);
-
-            for (int j = 0; j < (int)tracked[i].size(); ++j) {
-                mapTracked[tracked[i][j]] = make_pair(i, j);
-                multiple[i].push_back(N*N - j);
-            }
-            multiple[i].push_back(1);
+        heuristic.initialize();
+        restart();
+    }
 
-            for (int j = tracked[i].size()-2; j >= 0; --j)
-                multiple[i][j] *= multiple[i][j+1];
-        }
+    // Order the open list by g + weight * h from the next restart() on,
+    // see anytime.hpp
+    void setWeight(float weight) {
+        m_weight = weight;
+    }
 
-        node_t<N> *node = new node_t<N>;
+    // Start the search over from the initial state
+    void restart() {
         vector<uint8_t> state;
         p->initialState(state);
 
-        node->ps = PuzzleStorage<N>(
-            *reinterpret_cast<uint8_t(*)[N][N]>(state.data()));
-        node->prev = 0;
-        node->fValue = computeHValue(
+        node_t<N> node;
+        node.ps = PuzzleStorage<N>(
             *reinterpret_cast<uint8_t(*)[N][N]>(state.data()));
-        node->gValue = 0;
-
-        heap_t<N> heapItem;
-        heapItem.fValue = node->fValue;
-        heapItem.node = node;
-
-        openList.push(heapItem);
-        closeList[node->ps] = node;
+        node.prev = -1;
+        node.fValue = weighted(heuristic.computeHValue(
+            *reinterpret_cast<uint8_t(*)[N][N]>(state.data()), &node.hValues));
+        node.gValue = 0;
+
+        nodes.clear();
+        nodes.push_back(node);
+        openList.clear();
+        openList.update(0, node.fValue);
+        closeList.clear();
+        closeList[node.ps] = 0;
 
         int count = 0;
         uint8_t _targetState[N][N];
@@ -158,29 +77,26 @@ public:
         int numDeduplicate = 0;
         while (!openList.empty()) {
             dprintf(" ======Round %d=======\n", round);
-            heap_t<N> now;
-            do {
-                now = openList.top();
-                openList.pop();
-            } while (closeList[now.node->ps]->fValue != now.fValue);
-
-            node_t<N> *node = now.node;
-            if (node->ps == targetState) {
+            int now = openList.pop();
+            // copied, the pool may move while the successors are added
+            node_t<N> node = nodes[now];
+            if (node.ps == targetState) {
                 printf("\t\tNumber of nodes deduplicated: %d\n", numDeduplicate);
-                printf("\t\tNumber of nodes expanded: %d\n", (int)closeList.size());
+                printf("\t\tNumber of nodes expanded: %d\n", (int)nodes.size());
+                metrics.counter("cpu", "expanded", nodes.size());
 
-                optimalNode = node;
+                optimalNode = now;
                 return true;
             }
 
             if (DEBUG_CONDITION) {
-                dout << "\tfValue: " << node->fValue << endl;
-                dout << "\tgValue: " << node->gValue << endl;
-                printStorage(node->ps, "\t");
+                dout << "\tfValue: " << node.fValue << endl;
+                dout << "\tgValue: " << node.gValue << endl;
+                printStorage(node.ps, "\t");
             }
 
             int x, y;
-            node->ps.decompose(conf);
+            node.ps.decompose(conf);
             getEmptyTile(conf, &x, &y);
 
             for (int i = 0; i < 4; ++i) {
@@ -191,9 +107,12 @@ public:
 
                     node_t<N> nnode;
                     nnode.ps = PuzzleStorage<N>(conf);
-                    nnode.gValue = node->gValue + 1;
-                    nnode.fValue = nnode.gValue + computeHValue(conf);
-                    nnode.prev = node;
+                    nnode.gValue = node.gValue + 1;
+                    nnode.hValues = node.hValues;
+                    nnode.fValue = nnode.gValue + weighted(
+                        heuristic.updateHValue(
+                            conf, conf[x][y], &nnode.hValues));
+                    nnode.prev = now;
 
                     if (DEBUG_CONDITION) {
                         dout << "\t\tfValue: " << nnode.fValue << endl;
@@ -202,25 +121,19 @@ public:
                         dout << endl;
                     }
 
-                    heap_t<N> heapItem;
-                    heapItem.fValue = nnode.fValue;
-
-                    if (closeList.count(nnode.ps) == 0) {
-                        node_t<N> *inode = new node_t<N>(nnode);
-                        closeList[nnode.ps] = inode;
-                        heapItem.node = inode;
-
-                        openList.push(heapItem);
-                    } else {
-                        node_t<N> *onode = closeList[nnode.ps];
-                        if (onode->fValue > nnode.fValue) {
-                            *onode = nnode;
-                            heapItem.node = onode;
-
-                            openList.push(heapItem);
-                        } else
-                            numDeduplicate++;
-                    }
+                    typename closelist_t::iterator it =
+                        closeList.find(nnode.ps);
+                    if (it == closeList.end()) {
+                        int handle = nodes.size();
+                        nodes.push_back(nnode);
+                        closeList[nnode.ps] = handle;
+                        openList.update(handle, nnode.fValue);
+                    } else if (nodes[it->second].fValue > nnode.fValue) {
+                        // lowers the key, or reopens a closed node
+                        nodes[it->second] = nnode;
+                        openList.update(it->second, nnode.fValue);
+                    } else
+                        numDeduplicate++;
                     std::swap(conf[x][y], conf[nx][ny]);
                 }
             }
@@ -231,18 +144,18 @@ public:
     }
 
     void getSolution(int *optimal, vector<int> *pathList) {
-        *optimal = optimalNode->fValue;
+        *optimal = nodes[optimalNode].fValue;
 
-        node_t<N> *curr = optimalNode;
-        node_t<N> *prev = curr->prev;
+        int curr = optimalNode;
+        int prev = nodes[curr].prev;
 
         uint8_t cconf[N][N];
         uint8_t pconf[N][N];
 
         pathList->clear();
-        while (prev) {
-            curr->ps.decompose(cconf);
-            prev->ps.decompose(pconf);
+        while (prev != -1) {
+            nodes[curr].ps.decompose(cconf);
+            nodes[prev].ps.decompose(pconf);
 
             int cx, cy;
             int px, py;
@@ -253,64 +166,31 @@ public:
                     pathList->push_back(i);
 
             curr = prev;
-            prev = curr->prev;
+            prev = nodes[curr].prev;
         }
 
         std::reverse(pathList->begin(), pathList->end());
     }
 
 private:
-    typedef typename std::priority_queue<
-        heap_t<N>,
-        vector< heap_t<N> >,
-        std::greater< heap_t<N> > > openlist_t;
-
     typedef typename boost::unordered_map<
-        PuzzleStorage<N>,
-        node_t<N> * > closelist_t;
+        PuzzleStorage<N>, int> closelist_t;
 
     Puzzle *p;
 
-    openlist_t openList;
+    vector< node_t<N> > nodes;
+    OpenList openList;
     closelist_t closeList;
 
     PuzzleStorage<N> targetState;
-    node_t<N> *optimalNode;
+    int optimalNode;
 
-    int dbCount;
-    vector< vector<uint8_t> > database;
-    vector< vector<int> > tracked;
-    vector< pair<int, int> > mapTracked;
-    vector< vector<int> > index;
-    vector< vector<int> > multiple;
-
-    int computeHValue(uint8_t conf[N][N]) {
-        for (int i = 0; i < N; ++i)
-            for (int j = 0; j < N; ++j)
-                if (conf[i][j]) {
-                    pair<int, int> p = mapTracked[conf[i][j]];
-                    index[p.first][p.second] = i*N + j;
-                }
-
-        int retn = 0;
-        for (int k = 0; k < dbCount; ++k) {
-            int oindex[20];
-            std::copy(index[k].begin(), index[k].end(), oindex);
-
-            for (int i = 0; i < (int)index[k].size(); ++i)
-                for (int j = i+1; j < (int)index[k].size(); ++j)
-                    if (oindex[i] < oindex[j])
-                        --index[k][j];
-            int code = 0;
-            for (int i = 0; i < (int)index[k].size(); ++i)
-                 code += index[k][i] * multiple[k][i+1];
-
-            // dout << "\t\t[" << code << "]" <<  (int)database[k][code] << " ";
-            retn += database[k][code];
-        }
-        // dout << endl;
+    PuzzleHeuristic<N> heuristic;
+    float m_weight;
 
-        return retn;
+    // truncated, the GPU solver computes the same values
+    int weighted(int hValue) const {
+        return (int)(m_weight * hValue);
     }
 
     void getEmptyTile(uint8_t conf[N][N], int *x, int *y) {
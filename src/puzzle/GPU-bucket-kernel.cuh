@@ -0,0 +1,294 @@
+#ifndef __GPU_BUCKET_KERNEL_CUH_T6QJ3M8E
+#define __GPU_BUCKET_KERNEL_CUH_T6QJ3M8E
+
+// --open-list buckets: the open list as one bucket per fValue instead of a
+// binary heap per thread.  A round works on whole batches, without any sift
+// loop: the best entries of all the buckets are staged as heaps of a single
+// entry for kExtractExpand, which leaves its successors in the heap insert
+// list, and those are scattered to their buckets with one atomic each.
+//
+// A bucket is a stack of chunks of BUCKET_CHUNK entries taken from a shared
+// pool: chunk `c' holds the entries [c, c + 1) * BUCKET_CHUNK of g_pool, and
+// g_chunkPrev[c] is the chunk below it in its bucket.  The chunks freed by
+// the staging are reused before new ones are taken from the pool.
+// g_bucketCount holds the chunks of the pool in use, the free chunks (listed
+// in g_freeChunks) and the entries staged for the next round.
+//
+// The fValues from NUM_BUCKET - 1 on share the last bucket, which is not
+// ordered: the solver refuses --weight, and the unweighted fValues of the
+// puzzles stay far below it.
+
+#include "puzzle/GPU-kernel.cuh"
+
+const int NUM_BUCKET = 256;
+const int BUCKET_CHUNK = 1024;
+
+struct bucket_t {
+    // entries, and the chunk holding the last of them
+    int size;
+    uint32_t top;
+    // entries inserted in this round, and the size and top chunk before; the
+    // new chunks of the bucket start at `firstChunk' in g_roundChunks
+    int add;
+    int base;
+    uint32_t baseTop;
+    int firstChunk;
+    // entries staged, after `takeBase' entries of the buckets before
+    int take;
+    int takeBase;
+};
+
+enum { BUCKET_CHUNK_USED, BUCKET_CHUNK_FREE, BUCKET_STAGED, NUM_BUCKET_COUNT };
+
+inline __device__ int bucketOf(uint32_t fValue)
+{
+    return min(fValue, (uint32_t)NUM_BUCKET - 1);
+}
+
+inline __device__ int bucketChunks(int size)
+{
+    return (size + BUCKET_CHUNK - 1) / BUCKET_CHUNK;
+}
+
+// Exclusive prefix sum of `value' over the NT threads of the block, the sum
+// of all of them goes to `total'
+template<int NT>
+__device__ int blockScan(int value, int s_scan[NT], int *total)
+{
+    int tid = THREAD_ID;
+    s_scan[tid] = value;
+    __syncthreads();
+    for (int offset = 1; offset < NT; offset *= 2) {
+        int other = tid >= offset ? s_scan[tid - offset] : 0;
+        __syncthreads();
+        s_scan[tid] += other;
+        __syncthreads();
+    }
+    *total = s_scan[NT - 1];
+    int exclusive = s_scan[tid] - value;
+    __syncthreads();
+    return exclusive;
+}
+
+__global__ void kBucketReset(
+    bucket_t g_buckets[],
+    int g_bucketCount[]
+)
+{
+    bucket_t bucket;
+    bucket.size = 0;
+    bucket.top = UINT32_MAX;
+    bucket.add = 0;
+    bucket.base = 0;
+    bucket.baseTop = UINT32_MAX;
+    bucket.firstChunk = 0;
+    bucket.take = 0;
+    bucket.takeBase = 0;
+    g_buckets[THREAD_ID] = bucket;
+    if (THREAD_ID < NUM_BUCKET_COUNT)
+        g_bucketCount[THREAD_ID] = 0;
+}
+
+// Number the entries of the heap insert list within their bucket
+template<int NT>
+__global__ void kBucketCount(
+    const heap_t g_heapInsertList[],
+    const int *g_heapInsertSize,
+    int g_insertPos[],
+    bucket_t g_buckets[],
+    const int *g_status
+)
+{
+    if (*g_status != SEARCH_RUNNING)
+        return;
+    int gid = GLOBAL_ID;
+    if (gid >= *g_heapInsertSize)
+        return;
+    int b = bucketOf(g_heapInsertList[gid].fValue);
+    g_insertPos[gid] = atomicAdd(&g_buckets[b].add, 1);
+}
+
+// Chain the chunks the inserted entries need on top of their buckets.  A
+// single block, a thread per bucket.
+__global__ void kBucketReserve(
+    bucket_t g_buckets[],
+    uint32_t g_chunkPrev[],
+    const uint32_t g_freeChunks[],
+    uint32_t g_roundChunks[],
+    int g_bucketCount[],
+    const int *g_status
+)
+{
+    __shared__ int s_scan[NUM_BUCKET];
+
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
+    int tid = THREAD_ID;
+    int numUsed = g_bucketCount[BUCKET_CHUNK_USED];
+    int numFree = g_bucketCount[BUCKET_CHUNK_FREE];
+    bucket_t bucket = g_buckets[tid];
+    int newChunks = bucketChunks(bucket.size + bucket.add)
+        - bucketChunks(bucket.size);
+
+    int total;
+    int first = blockScan<NUM_BUCKET>(newChunks, s_scan, &total);
+    // the free chunks go first
+    int fromFree = min(total, numFree);
+    uint32_t below = bucket.top;
+    for (int i = first; i < first + newChunks; ++i) {
+        uint32_t chunk = i < fromFree ? g_freeChunks[numFree - 1 - i]
+                                      : numUsed + i - fromFree;
+        g_chunkPrev[chunk] = below;
+        g_roundChunks[i] = chunk;
+        below = chunk;
+    }
+
+    bucket.base = bucket.size;
+    bucket.baseTop = bucket.top;
+    bucket.firstChunk = first;
+    bucket.size += bucket.add;
+    bucket.add = 0;
+    bucket.top = below;
+    g_buckets[tid] = bucket;
+
+    if (tid == 0) {
+        g_bucketCount[BUCKET_CHUNK_USED] = numUsed + total - fromFree;
+        g_bucketCount[BUCKET_CHUNK_FREE] = numFree - fromFree;
+    }
+}
+
+// Write the entries of the heap insert list to the places kBucketCount and
+// kBucketReserve gave them
+template<int NT>
+__global__ void kBucketScatter(
+    const heap_t g_heapInsertList[],
+    const int *g_heapInsertSize,
+    const int g_insertPos[],
+    const bucket_t g_buckets[],
+    const uint32_t g_roundChunks[],
+    heap_t g_pool[],
+    const int *g_status
+)
+{
+    if (*g_status != SEARCH_RUNNING)
+        return;
+    int gid = GLOBAL_ID;
+    if (gid >= *g_heapInsertSize)
+        return;
+
+    heap_t item = g_heapInsertList[gid];
+    const bucket_t &bucket = g_buckets[bucketOf(item.fValue)];
+    int pos = bucket.base + g_insertPos[gid];
+    int index = pos / BUCKET_CHUNK;
+    int baseChunks = bucketChunks(bucket.base);
+    uint32_t chunk = index < baseChunks ? bucket.baseTop
+        : g_roundChunks[bucket.firstChunk + index - baseChunks];
+    g_pool[(size_t)chunk * BUCKET_CHUNK + pos % BUCKET_CHUNK] = item;
+}
+
+// Pick the `numStage' best entries: all of the first buckets, and the top of
+// the last one.  A single block, a thread per bucket.
+__global__ void kBucketSelect(
+    bucket_t g_buckets[],
+    int numStage,
+    int g_bucketCount[],
+    const int *g_status
+)
+{
+    __shared__ int s_scan[NUM_BUCKET];
+
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
+    int tid = THREAD_ID;
+    int size = g_buckets[tid].size;
+    int total;
+    int before = blockScan<NUM_BUCKET>(size, s_scan, &total);
+    g_buckets[tid].take = max(0, min(size, numStage - before));
+    g_buckets[tid].takeBase = before;
+    if (tid == 0)
+        g_bucketCount[BUCKET_STAGED] = min(total, numStage);
+}
+
+// Stage the entries picked by kBucketSelect, one per heap, popping them from
+// the top of their bucket
+template<int NT>
+__global__ void kBucketStage(
+    const bucket_t g_buckets[],
+    const uint32_t g_chunkPrev[],
+    const heap_t g_pool[],
+    const int g_bucketCount[],
+    heap_t g_openList[],
+    int g_heapSize[],
+    const int *g_status
+)
+{
+    if (*g_status != SEARCH_RUNNING)
+        return;
+    int gid = GLOBAL_ID;
+    if (gid >= g_bucketCount[BUCKET_STAGED]) {
+        g_heapSize[gid] = 0;
+        return;
+    }
+
+    // the last bucket starting at or before `gid', the empty buckets on the
+    // way start at the same place as the next one
+    int lo = 0, hi = NUM_BUCKET - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (g_buckets[mid].takeBase <= gid)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    const bucket_t &bucket = g_buckets[lo];
+
+    int pos = bucket.size - 1 - (gid - bucket.takeBase);
+    int hops = (bucket.size - 1) / BUCKET_CHUNK - pos / BUCKET_CHUNK;
+    uint32_t chunk = bucket.top;
+    while (hops--)
+        chunk = g_chunkPrev[chunk];
+    g_openList[gid] = g_pool[(size_t)chunk * BUCKET_CHUNK + pos % BUCKET_CHUNK];
+    g_heapSize[gid] = 1;
+}
+
+// Drop the staged entries from their buckets and free the chunks left empty.
+// A single block, a thread per bucket.
+__global__ void kBucketRelease(
+    bucket_t g_buckets[],
+    const uint32_t g_chunkPrev[],
+    uint32_t g_freeChunks[],
+    int g_bucketCount[],
+    const int *g_status
+)
+{
+    __shared__ int s_scan[NUM_BUCKET];
+
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
+    int tid = THREAD_ID;
+    int numFree = g_bucketCount[BUCKET_CHUNK_FREE];
+    bucket_t bucket = g_buckets[tid];
+    int size = bucket.size - bucket.take;
+    int freed = bucketChunks(bucket.size) - bucketChunks(size);
+
+    int total;
+    int first = blockScan<NUM_BUCKET>(freed, s_scan, &total);
+    uint32_t chunk = bucket.top;
+    for (int i = 0; i < freed; ++i) {
+        g_freeChunks[numFree + first + i] = chunk;
+        chunk = g_chunkPrev[chunk];
+    }
+
+    bucket.size = size;
+    bucket.top = size ? chunk : UINT32_MAX;
+    bucket.take = 0;
+    g_buckets[tid] = bucket;
+
+    if (tid == 0)
+        g_bucketCount[BUCKET_CHUNK_FREE] = numFree + total;
+}
+
+#endif /* end of include guard: __GPU_BUCKET_KERNEL_CUH_T6QJ3M8E */
@@ -0,0 +1,166 @@
+#ifndef __GPU_IDA_KERNEL_CUH_M2XW8RVB
+#define __GPU_IDA_KERNEL_CUH_M2XW8RVB
+
+// --gpu-engine=ida: batched IDA* (iterative deepening A*, Korf) in a device
+// memory that does not grow with the search.  The host expands the initial
+// state breadth first into a frontier of subtree roots, then every iteration
+// searches all the subtrees depth first up to the same f threshold: a thread
+// takes the next root from a shared counter and keeps only the state, its
+// pattern values and a move per depth.  A move is undone by looking the
+// patterns of its tile up again, instead of keeping the values of every
+// depth.
+//
+// The roots are handed out in the order given by the host, the subtrees
+// that took the most work in the previous iteration first, so that the long
+// ones do not start last.  The first threshold is the smallest fValue of the
+// roots, the next one the smallest fValue above this one.
+
+#include "puzzle/GPU-kernel.cuh"
+
+// moves below a root a thread can keep
+const int IDA_MAX_DEPTH = 256;
+// expansions between two looks at whether another thread solved it
+const int IDA_POLL = 1024;
+// no move led to a root
+const int IDA_NO_MOVE = 4;
+
+template<int N>
+struct ida_root_t {
+    PuzzleStorage<N> ps;
+    uint16_t gValue;
+    // move that led to the root, it is not undone below
+    uint8_t lastMove;
+};
+
+struct ida_status_t {
+    // next root to hand out
+    uint32_t nextRoot;
+    // smallest fValue above the threshold
+    uint32_t nextThreshold;
+    unsigned long long expanded;
+    // the root of the solution, and the number of moves below it in g_path
+    int found;
+    uint32_t solutionRoot;
+    int solutionLength;
+    // a subtree went deeper than IDA_MAX_DEPTH
+    int overflow;
+};
+
+// Search the subtrees of g_roots (in the order of g_order) up to
+// `threshold', and count the expansions of every subtree in g_work
+template<int N, int NT>
+__global__ void kIDASearch(
+    uint8_t g_database[],
+
+    const ida_root_t<N> g_roots[],
+    const uint32_t g_order[],
+    uint32_t numRoot,
+    uint32_t threshold,
+
+    unsigned long long g_work[],
+    ida_status_t *g_status,
+    uint8_t g_path[]
+)
+{
+    __shared__ uint8_t s_conf[NT][N][N];
+    __shared__ uint8_t s_position[NT][2][N*N];
+
+    const int DX[4] = { 1, -1,  0,  0 };
+    const int DY[4] = { 0,  0,  1, -1 };
+
+    int tid = THREAD_ID;
+    uint8_t (&conf)[N][N] = s_conf[tid];
+    uint8_t (&position)[2][N*N] = s_position[tid];
+    uint8_t tried[IDA_MAX_DEPTH];
+    uint8_t moves[IDA_MAX_DEPTH];
+    volatile int *found = &g_status->found;
+
+    uint32_t nextThreshold = UINT32_MAX;
+    unsigned long long expanded = 0;
+
+    while (!*found) {
+        uint32_t index = atomicAdd(&g_status->nextRoot, 1);
+        if (index >= numRoot)
+            break;
+        uint32_t r = g_order[index];
+        ida_root_t<N> root = g_roots[r];
+
+        root.ps.decompose(conf);
+        int x, y;
+        getEmptyTile<N>(conf, &x, &y);
+        pdb_values_t values;
+        uint32_t fValue = root.gValue + weightedHValue(
+            computeHValue<N>(g_database, conf, position, &values));
+        unsigned long long work = 1;
+        if (fValue > threshold) {
+            nextThreshold = min(nextThreshold, fValue);
+            g_work[r] = work;
+            continue;
+        }
+
+        int depth = 0;
+        tried[0] = 0;
+        while (depth >= 0) {
+            if (tried[depth] == 4) {
+                // undo the move into this depth
+                if (--depth < 0)
+                    break;
+                int k = moves[depth] ^ 1;
+                int nx = x + DX[k];
+                int ny = y + DY[k];
+                swap(conf[x][y], conf[nx][ny]);
+                updateHValue<N>(
+                    g_database, conf, position, conf[x][y], &values);
+                x = nx;
+                y = ny;
+                continue;
+            }
+
+            int k = tried[depth]++;
+            int last = depth ? moves[depth - 1] : root.lastMove;
+            int nx = x + DX[k];
+            int ny = y + DY[k];
+            if (k == (last ^ 1) || !inrange<N>(nx, ny))
+                continue;
+
+            swap(conf[x][y], conf[nx][ny]);
+            int tile = conf[x][y];
+            int hValue =
+                updateHValue<N>(g_database, conf, position, tile, &values);
+            fValue = root.gValue + depth + 1 + weightedHValue(hValue);
+            if (fValue > threshold || depth + 1 == IDA_MAX_DEPTH) {
+                if (fValue > threshold)
+                    nextThreshold = min(nextThreshold, fValue);
+                else
+                    g_status->overflow = 1;
+                swap(conf[x][y], conf[nx][ny]);
+                updateHValue<N>(g_database, conf, position, tile, &values);
+                continue;
+            }
+
+            ++work;
+            moves[depth] = k;
+            x = nx;
+            y = ny;
+            if (hValue == 0 && checkSolution<N>(PuzzleStorage<N>(conf))) {
+                if (atomicCAS(&g_status->found, 0, 1) == 0) {
+                    for (int i = 0; i <= depth; ++i)
+                        g_path[i] = moves[i];
+                    g_status->solutionRoot = r;
+                    g_status->solutionLength = depth + 1;
+                }
+                break;
+            }
+            tried[++depth] = 0;
+            if (work % IDA_POLL == 0 && *found)
+                break;
+        }
+        g_work[r] = work;
+        expanded += work;
+    }
+
+    atomicMin(&g_status->nextThreshold, nextThreshold);
+    atomicAdd(&g_status->expanded, expanded);
+}
+
+#endif /* end of include guard: __GPU_IDA_KERNEL_CUH_M2XW8RVB */
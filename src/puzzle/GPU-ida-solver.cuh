@@ -0,0 +1,277 @@
+#ifndef __GPU_IDA_SOLVER_CUH_H5TN0QWC
+#define __GPU_IDA_SOLVER_CUH_H5TN0QWC
+
+#include <cstring>
+#include <functional>
+
+#include "puzzle/heuristic.hpp"
+#include "puzzle/GPU-solver.cuh"
+#include "puzzle/GPU-ida-kernel.cuh"
+
+namespace gpusolver {
+
+// subtree roots the frontier grows to, for every thread
+const int IDA_ROOTS_PER_THREAD = 4;
+
+// --gpu-engine=ida, see GPU-ida-kernel.cuh
+template<int N>
+class GPUIDAPuzzleSolver {
+public:
+    GPUIDAPuzzleSolver(Puzzle *puzzle)
+        : p(puzzle), m_weight(searchWeight()), m_frontierSolved(false),
+          m_optimalStep(0), m_numRoot(0) { }
+
+    void initialize() {
+        int ordinal = vm_options["ordinal"].as<int>();
+        cudaSetDevice(ordinal);
+        cudaDeviceSynchronize();
+        cudaDeviceReset();
+        m_context = CreateCudaDevice(ordinal);
+        countDeviceMemory(*m_context);
+        m_database = uploadDatabases<N>(*m_context);
+
+        expandFrontier();
+        if (!m_frontierSolved) {
+            vector< ida_root_t<N> > roots(m_numRoot);
+            const vector<frontier_t> &level = m_levels.back();
+            for (int i = 0; i < m_numRoot; ++i) {
+                roots[i].ps = level[i].ps;
+                roots[i].gValue = m_levels.size() - 1;
+                roots[i].lastMove = level[i].move;
+            }
+            m_roots = m_context->Malloc< ida_root_t<N> >(roots);
+            m_order = m_context->Malloc<uint32_t>(m_numRoot);
+            m_work = m_context->Malloc<unsigned long long>(m_numRoot);
+            // the databases are mapped once, see fetchDatabase()
+            m_heuristic.initialize();
+        }
+        m_status = m_context->Malloc<ida_status_t>(1);
+        m_path = m_context->Malloc<uint8_t>(IDA_MAX_DEPTH);
+        recordDeviceMemory("gpu", *m_context);
+        restart();
+        dout << "\t\tGPU Initialization finishes" << endl;
+    }
+
+    // Search with g + weight * h from the next restart() on, see anytime.hpp
+    void setWeight(float weight) {
+        m_weight = weight;
+    }
+
+    // Start over from the frontier, the subtrees are handed out in order
+    void restart() {
+        initializeCUDAWeight(m_weight);
+        if (m_frontierSolved)
+            return;
+        vector<uint32_t> order(m_numRoot);
+        for (int i = 0; i < m_numRoot; ++i)
+            order[i] = i;
+        m_order->FromHost(order);
+    }
+
+    bool solve() {
+        if (m_frontierSolved) {
+            m_optimalStep = m_pathList.size();
+            printf("\t\t\t Solved by the frontier of depth %d\n",
+                   m_optimalStep);
+            return true;
+        }
+
+        int depth = m_levels.size() - 1;
+        unsigned long long expanded = 0;
+        uint32_t threshold = rootThreshold();
+        ida_status_t status;
+        for (int iteration = 0; ; ++iteration) {
+            memset(&status, 0, sizeof(status));
+            status.nextThreshold = UINT32_MAX;
+            m_status->FromHost(&status, 1);
+            kIDASearch<N, NUM_THREAD><<<NUM_BLOCK, NUM_THREAD>>>(
+                *m_database,
+
+                *m_roots,
+                *m_order,
+                m_numRoot,
+                threshold,
+
+                *m_work,
+                *m_status,
+                *m_path
+            );
+            status = m_status->Value();
+            expanded += status.expanded;
+            dout << "\t\tIteration " << iteration << ": threshold "
+                 << threshold << ", " << status.expanded
+                 << " nodes expanded" << endl;
+
+            if (status.found || status.overflow ||
+                status.nextThreshold == UINT32_MAX)
+                break;
+            threshold = status.nextThreshold;
+            balance();
+        }
+        printf("\t\t\t Number of nodes expanded: %llu\n", expanded);
+        metrics.counter("gpu", "expanded", expanded);
+
+        if (!status.found) {
+            if (status.overflow)
+                cout << "\t\t\t A subtree is deeper than " << IDA_MAX_DEPTH
+                     << " moves" << endl;
+            return false;
+        }
+
+        // the moves to the root, then below it
+        m_pathList.clear();
+        uint32_t index = status.solutionRoot;
+        for (int d = depth; d > 0; --d) {
+            const frontier_t &node = m_levels[d][index];
+            m_pathList.push_back(node.move);
+            index = node.parent;
+        }
+        std::reverse(m_pathList.begin(), m_pathList.end());
+        vector<uint8_t> below;
+        m_path->ToHost(below, status.solutionLength);
+        m_pathList.insert(m_pathList.end(), below.begin(), below.end());
+        m_optimalStep = m_pathList.size();
+        return true;
+    }
+
+    void getSolution(int *optimal, vector<int> *pathList) {
+        *optimal = m_optimalStep;
+        *pathList = m_pathList;
+    }
+
+private:
+    // a state of the breadth first expansion, and the move from its parent
+    // in the level above
+    struct frontier_t {
+        PuzzleStorage<N> ps;
+        int parent;
+        uint8_t move;
+    };
+
+    // Expand the initial state level by level, without dropping the
+    // duplicates but never undoing the last move, until a level holds a root
+    // for IDA_ROOTS_PER_THREAD subtrees a thread.  A goal on the way is an
+    // optimal solution.
+    void expandFrontier() {
+        const int DX[4] = { 1, -1,  0,  0 };
+        const int DY[4] = { 0,  0,  1, -1 };
+
+        uint8_t target[N][N];
+        for (int i = 0; i < N; ++i)
+            for (int j = 0; j < N; ++j)
+                target[i][j] = i * N + j + 1;
+        target[N-1][N-1] = 0;
+        PuzzleStorage<N> targetState(target);
+
+        vector<uint8_t> state;
+        p->initialState(state);
+        frontier_t root;
+        root.ps = PuzzleStorage<N>(
+            *reinterpret_cast<uint8_t(*)[N][N]>(state.data()));
+        root.parent = -1;
+        root.move = IDA_NO_MOVE;
+        m_levels.assign(1, vector<frontier_t>(1, root));
+
+        for (;;) {
+            const vector<frontier_t> &level = m_levels.back();
+            for (int i = 0; i < (int)level.size(); ++i) {
+                if (level[i].ps == targetState) {
+                    solveByFrontier(i);
+                    return;
+                }
+            }
+            if ((int)level.size() >= IDA_ROOTS_PER_THREAD * NUM_TOTAL)
+                break;
+
+            vector<frontier_t> next;
+            for (int i = 0; i < (int)level.size(); ++i) {
+                uint8_t conf[N][N];
+                level[i].ps.decompose(conf);
+                int x = 0, y = 0;
+                getEmptyTile<N>(conf, &x, &y);
+                for (int k = 0; k < 4; ++k) {
+                    int nx = x + DX[k];
+                    int ny = y + DY[k];
+                    if (k == (level[i].move ^ 1) || !p->inrange(nx, ny))
+                        continue;
+                    std::swap(conf[x][y], conf[nx][ny]);
+                    frontier_t node;
+                    node.ps = PuzzleStorage<N>(conf);
+                    node.parent = i;
+                    node.move = k;
+                    next.push_back(node);
+                    std::swap(conf[x][y], conf[nx][ny]);
+                }
+            }
+            m_levels.push_back(next);
+        }
+        m_numRoot = m_levels.back().size();
+        dout << "\t\t" << m_numRoot << " subtrees at depth "
+             << m_levels.size() - 1 << endl;
+    }
+
+    // The state `index' of the last level is the goal
+    void solveByFrontier(int index) {
+        m_frontierSolved = true;
+        m_pathList.clear();
+        for (int d = m_levels.size() - 1; d > 0; --d) {
+            m_pathList.push_back(m_levels[d][index].move);
+            index = m_levels[d][index].parent;
+        }
+        std::reverse(m_pathList.begin(), m_pathList.end());
+    }
+
+    // The smallest fValue of the roots, so that the first iteration already
+    // expands some
+    uint32_t rootThreshold() const {
+        const vector<frontier_t> &level = m_levels.back();
+        uint32_t threshold = UINT32_MAX;
+        for (int i = 0; i < m_numRoot; ++i) {
+            uint8_t conf[N][N];
+            level[i].ps.decompose(conf);
+            // truncated like weightedHValue()
+            uint32_t fValue = m_levels.size() - 1 +
+                (int)(m_weight * m_heuristic.computeHValue(conf));
+            threshold = min(threshold, fValue);
+        }
+        return threshold;
+    }
+
+    // Hand out the subtrees by decreasing work of the last iteration
+    void balance() {
+        vector<unsigned long long> work;
+        m_work->ToHost(work, m_numRoot);
+        vector< pair<unsigned long long, uint32_t> > byWork(m_numRoot);
+        for (int i = 0; i < m_numRoot; ++i)
+            byWork[i] = make_pair(work[i], (uint32_t)i);
+        std::sort(byWork.begin(), byWork.end(),
+                  std::greater< pair<unsigned long long, uint32_t> >());
+        vector<uint32_t> order(m_numRoot);
+        for (int i = 0; i < m_numRoot; ++i)
+            order[i] = byWork[i].second;
+        m_order->FromHost(order);
+    }
+
+    Puzzle *p;
+    float m_weight;
+    cpusolver::PuzzleHeuristic<N> m_heuristic;
+    typename mgpu::ContextPtr m_context;
+    MGPU_MEM(uint8_t) m_database;
+
+    // the breadth first levels, the last one holds the roots
+    vector< vector<frontier_t> > m_levels;
+    bool m_frontierSolved;
+    int m_optimalStep;
+    vector<int> m_pathList;
+
+    int m_numRoot;
+    MGPU_MEM(ida_root_t<N>) m_roots;
+    MGPU_MEM(uint32_t) m_order;
+    MGPU_MEM(unsigned long long) m_work;
+    MGPU_MEM(ida_status_t) m_status;
+    MGPU_MEM(uint8_t) m_path;
+};
+
+}
+
+#endif /* end of include guard: __GPU_IDA_SOLVER_CUH_H5TN0QWC */
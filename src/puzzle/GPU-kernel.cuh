@@ -9,6 +9,8 @@
 
 #include "utils.hpp"
 #include "puzzle/storage.hpp"
+#include "puzzle/database.hpp"
+#include "puzzle/partition.hpp"
 
 // Suppose we only use x dimension
 #define THREAD_ID (threadIdx.x)
@@ -26,8 +28,13 @@
 
 using namespace mgpu;
 
+const int SEARCH_RUNNING = 0;
+const int SEARCH_SOLVED = 1;
+const int SEARCH_FAILED = 2;
+
+// an fValue weighted by --weight may not fit in a byte
 struct heap_t {
-    uint8_t fValue;
+    uint16_t fValue;
     uint32_t addr;
 };
 inline __host__ __device__ bool operator<(const heap_t &a, const heap_t &b) {
@@ -41,11 +48,53 @@ inline __host__ __device__ bool operator>(const heap_t &a, const heap_t &b) {
 template<int N>
 struct node_t {
     PuzzleStorage<N> ps;
-    uint32_t prev;
-    uint16_t fValue;
-    uint16_t gValue;
+    // the successors are evaluated from these
+    pdb_values_t hValues;
+    // gValue, fValue and prev, see packLink()
+    unsigned long long link;
 };
 
+// The copies of a state only differ in their link, and the fValue of a state
+// grows with its gValue, so that the best copy is the smallest link and wins
+// a single atomicMin on it.  A retired copy has NODE_DEAD.
+inline __host__ __device__ unsigned long long packLink(
+    uint32_t gValue, uint32_t fValue, uint32_t prev)
+{
+    return (unsigned long long)gValue << 48 |
+           (unsigned long long)fValue << 32 | prev;
+}
+inline __host__ __device__ uint32_t linkG(unsigned long long link)
+{
+    return link >> 48;
+}
+inline __host__ __device__ uint32_t linkF(unsigned long long link)
+{
+    return link >> 32 & 0xFFFF;
+}
+inline __host__ __device__ uint32_t linkPrev(unsigned long long link)
+{
+    return (uint32_t)link;
+}
+const unsigned long long NODE_DEAD = ULLONG_MAX;
+
+// Read the node at `addr' with its link in one load, other threads may
+// lower it meanwhile
+template<int N>
+inline __device__ node_t<N> loadNode(const node_t<N> g_nodes[], uint32_t addr)
+{
+    node_t<N> node = g_nodes[addr];
+    node.link = *(volatile const unsigned long long *)&g_nodes[addr].link;
+    return node;
+}
+
+// Lower `*link' to `value', return whether it lowered the g of the node.
+// A copy with the same g only takes over the parent, it is not reopened
+inline __device__ bool lowerLink(unsigned long long *link,
+                                 unsigned long long value)
+{
+    return linkG(atomicMin(link, value)) > linkG(value);
+}
+
 template<int N>
 struct sort_t {
     PuzzleStorage<N> ps;
@@ -57,10 +106,14 @@ struct sort_t {
     }
 };
 
-__constant__ int2 d_mapTracked[36];
+__constant__ pdb_layout_t d_pdb;
 __constant__ PuzzleStorage<3> d_target3;
 __constant__ PuzzleStorage<4> d_target4;
 __constant__ PuzzleStorage<5> d_target5;
+// PDB_BYTES or PDB_NIBBLES
+__constant__ int d_pdbFormat;
+// the open list is ordered by g + d_weight * h, see anytime.hpp
+__constant__ float d_weight;
 
 template<int N>
 inline __device__ float inrange(int x, int y)
@@ -68,74 +121,130 @@ inline __device__ float inrange(int x, int y)
     return 0 <= x && x < N && 0 <= y && y < N;
 }
 
+// `position' is the cell of every tile, and pattern `k' of d_pdb is looked
+// up in the concatenated databases
+template<int N>
 inline __device__ int computePatternHeuristic(
-    uint8_t database[], uint8_t index[], int indexCount, int offset, int mid)
+    const uint8_t database[], const uint8_t position[], int k)
 {
-    const int MULTIPLE[4][9] = {
-        { 362880, 40320, 5040, 720, 120, 24, 6, 2, 1 },
-        { 518918400, 32432400, 2162160, 154440, 11880, 990, 90, 9, 1 },
-        { 57657600, 3603600, 240240, 17160, 1320, 110, 10, 1, 0 },
-        { 127512000, 5100480, 212520, 9240, 420, 20, 1, 0, 0},
-    };
-
-    uint8_t oindex[10];
-#pragma unroll
-    for (int i = 0; i < indexCount; ++i)
-        oindex[i] = index[i];
-
-#pragma unroll
-    for (int i = 0; i < indexCount; ++i)
-#pragma unroll
-        for (int j = 0; j < indexCount; ++j)
-            if (j > i && oindex[i] < oindex[j])
-                --index[j];
-
+    const uint8_t *tile = d_pdb.tile[k];
     uint32_t code = 0;
-#pragma unroll
-    for (int i = 0; i < indexCount; ++i)
-        code += index[i] * MULTIPLE[mid][i+1];
+    int md = 0;
+    for (int i = 0; i < d_pdb.patternSize[k]; ++i) {
+        // rank of the position among the ones not taken yet
+        int index = position[tile[i]];
+        for (int j = 0; j < i; ++j)
+            if (position[tile[j]] < position[tile[i]])
+                --index;
+        code += index * d_pdb.multiple[k][i];
+        // the entries of a PDB_NIBBLES database are relative to it
+        md += abs(position[tile[i]] / N - (tile[i] - 1) / N) +
+              abs(position[tile[i]] % N - (tile[i] - 1) % N);
+    }
 
 #ifdef KERNEL_LOG
-    // printf("\t\t\t[%d]: Pattern database %d [%d] returns %d\n",
-    //        THREAD_ID, mid, code, database[offset + code]);
+    // printf("\t\t\t[%d]: Pattern database %d [%d]\n", THREAD_ID, k, code);
 #endif
 
-    return database[offset + code];
+    uint32_t entry = d_pdb.offset[k] + code;
+    if (d_pdbFormat == PDB_NIBBLES)
+        return md + 2 * pdbNibble(database, entry);
+    return database[entry];
 }
 
+// cell of every tile, in the state and in its reflection
 template<int N>
-inline __device__ int computeHValue(
-    uint8_t database[],
-    uint8_t conf[N][N],
-    uint8_t index[][N == 5 ? 6 : 8])
+inline __device__ void computePosition(
+    uint8_t conf[N][N], uint8_t position[2][N*N])
 {
 #pragma unroll
     for (int i = 0; i < N; ++i)
 #pragma unroll
-        for (int j = 0; j < N; ++j)
-            if (conf[i][j]) {
-                int2 p = d_mapTracked[conf[i][j]];
-                index[p.x][p.y] = i*N + j;
-            }
+        for (int j = 0; j < N; ++j) {
+            position[0][conf[i][j]] = i*N + j;
+            position[1][mirrorTile(N, conf[i][j])] = j*N + i;
+        }
+}
+
+// maximum over the partitions (and the reflection) of the sum of their
+// patterns, see partition.hpp.  `position' is a per-thread shared buffer,
+// local memory would be hit by every lookup.
+template<int N>
+inline __device__ int computeHValue(
+    uint8_t database[], uint8_t conf[N][N], uint8_t position[2][N*N])
+{
+    computePosition<N>(conf, position);
 
     int retn = 0;
-    if (N == 3) {
-        retn += computePatternHeuristic(database, index[0], 8, 0, 0);
-    } else if (N == 4) {
-        retn += computePatternHeuristic(database, index[0], 8, 0, 1);
-        retn += computePatternHeuristic(database, index[1], 7, 518918400, 2);
-    } else if (N == 5) {
-        retn += computePatternHeuristic(database, index[0], 6, 127512000*0, 3);
-        retn += computePatternHeuristic(database, index[1], 6, 127512000*1, 3);
-        retn += computePatternHeuristic(database, index[2], 6, 127512000*2, 3);
-        retn += computePatternHeuristic(database, index[3], 6, 127512000*3, 3);
-    }
+    for (int m = 0; m <= d_pdb.mirror; ++m)
+        for (int p = 0; p < d_pdb.numPartition; ++p) {
+            int sum = 0;
+            for (int k = d_pdb.partitionBegin[p];
+                 k < d_pdb.partitionBegin[p+1]; ++k)
+                sum += computePatternHeuristic<N>(database, position[m], k);
+            retn = max(retn, sum);
+        }
+
+    return retn;
+}
 
+inline __device__ int combinePatternValues(const pdb_values_t &values)
+{
+    int retn = 0;
+    for (int m = 0; m <= d_pdb.mirror; ++m)
+        for (int p = 0; p < d_pdb.numPartition; ++p) {
+            int sum = 0;
+            for (int k = d_pdb.partitionBegin[p];
+                 k < d_pdb.partitionBegin[p+1]; ++k)
+                sum += values.h[m * d_pdb.numPattern + k];
+            retn = max(retn, sum);
+        }
     return retn;
 }
 
+// Same, and keep the value of every pattern in `values'
+template<int N>
+inline __device__ int computeHValue(
+    uint8_t database[], uint8_t conf[N][N], uint8_t position[2][N*N],
+    pdb_values_t *values)
+{
+    if (!d_pdb.incremental)
+        return computeHValue<N>(database, conf, position);
+
+    computePosition<N>(conf, position);
+    for (int m = 0; m <= d_pdb.mirror; ++m)
+        for (int k = 0; k < d_pdb.numPattern; ++k)
+            values->h[m * d_pdb.numPattern + k] =
+                computePatternHeuristic<N>(database, position[m], k);
+    return combinePatternValues(*values);
+}
+
+// `conf' is a successor of the state of `values', reached by moving `tile',
+// so only the patterns tracking `tile' are looked up again
+template<int N>
+inline __device__ int updateHValue(
+    uint8_t database[], uint8_t conf[N][N], uint8_t position[2][N*N],
+    int tile, pdb_values_t *values)
+{
+    if (!d_pdb.incremental)
+        return computeHValue<N>(database, conf, position);
+
+    computePosition<N>(conf, position);
+    for (int m = 0; m <= d_pdb.mirror; ++m) {
+        int t = m ? mirrorTile(N, tile) : tile;
+        for (int p = 0; p < d_pdb.numPartition; ++p) {
+            int k = d_pdb.tilePattern[p][t];
+            if (k != -1)
+                values->h[m * d_pdb.numPattern + k] =
+                    computePatternHeuristic<N>(database, position[m], k);
+        }
+    }
+    return combinePatternValues(*values);
+}
+
 template<int N>
-inline __device__ void getEmptyTile(uint8_t conf[N][N], int *x, int *y)
+inline __host__ __device__ void getEmptyTile(
+    uint8_t conf[N][N], int *x, int *y)
 {
 #pragma unroll
     for (int i = 0; i < N; ++i)
@@ -149,48 +258,129 @@ inline __device__ void getEmptyTile(uint8_t conf[N][N], int *x, int *y)
 
 template<int N>
 inline cudaError_t initializeCUDAConstantMemory(
-    int2 mapTracked[],
+    const pdb_layout_t &layout,
     const PuzzleStorage<3> &target3,
     const PuzzleStorage<4> &target4,
-    const PuzzleStorage<5> &target5
+    const PuzzleStorage<5> &target5,
+    int pdbFormat
 )
 {
     cudaError_t ret = cudaSuccess;
-    ret = cudaMemcpyToSymbol(d_mapTracked, mapTracked, sizeof(int2) * N*N);
+    ret = cudaMemcpyToSymbol(d_pdb, &layout, sizeof(layout));
     ret = cudaMemcpyToSymbol(d_target3, &target3, sizeof(target3));
     ret = cudaMemcpyToSymbol(d_target4, &target4, sizeof(target4));
     ret = cudaMemcpyToSymbol(d_target5, &target5, sizeof(target5));
+    ret = cudaMemcpyToSymbol(d_pdbFormat, &pdbFormat, sizeof(pdbFormat));
     return ret;
 }
 
-template<int N, int M>
+inline cudaError_t initializeCUDAWeight(float weight)
+{
+    return cudaMemcpyToSymbol(d_weight, &weight, sizeof(weight));
+}
+
+// truncated like CPUPuzzleSolver::weighted()
+inline __device__ int weightedHValue(int hValue)
+{
+    return (int)(d_weight * hValue);
+}
+
+// The close list is an open addressing hash set of node addresses keyed by
+// PuzzleStorage<N>.  The number of slots is a power of two, `hashMask' is
+// that number minus one, and an empty slot holds UINT32_MAX.  The keys of 5x5
+// states do not fit in a CAS word, so slots are claimed by their node address
+// and keys are compared through `g_nodes'.
+const int HASH_MAX_PROBE = 64;
+
+inline __host__ __device__ uint32_t hashSlot(uint64_t key)
+{
+    // murmur3 finalizer, spreads the packed tiles over the low bits
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return (uint32_t)key;
+}
+
+// Return the address of the node holding `ps', or UINT32_MAX.
+template<int N>
+__device__ uint32_t hashFind(
+    const node_t<N> g_nodes[],
+    const uint32_t g_hash[],
+    uint32_t hashMask,
+    const PuzzleStorage<N> &ps,
+    uint32_t slot
+)
+{
+    for (int i = 0; i < HASH_MAX_PROBE; ++i) {
+        uint32_t addr = g_hash[(slot + i) & hashMask];
+        if (addr == UINT32_MAX)
+            break;
+        if (g_nodes[addr].ps == ps)
+            return addr;
+    }
+    return UINT32_MAX;
+}
+
+// Index the node at `addr', which must be written and fenced already.
+// Return the address of the node that holds `ps' afterward, which differs
+// from `addr' when another thread inserted the same state first, or
+// UINT32_MAX when the probes run out: the node stays in `g_nodes' without an
+// index entry, and `g_hashFull' counts it so that the host rebuilds a larger
+// table.
+template<int N>
+__device__ uint32_t hashInsert(
+    const node_t<N> g_nodes[],
+    uint32_t g_hash[],
+    uint32_t hashMask,
+    const PuzzleStorage<N> &ps,
+    uint32_t slot,
+    uint32_t addr,
+    int *g_hashFull
+)
+{
+    for (int i = 0; i < HASH_MAX_PROBE; ++i) {
+        uint32_t old = atomicCAS(
+            &g_hash[(slot + i) & hashMask], UINT32_MAX, addr);
+        if (old == UINT32_MAX)
+            return addr;
+        if (g_nodes[old].ps == ps)
+            return old;
+    }
+    atomicAdd(g_hashFull, 1);
+    return UINT32_MAX;
+}
+
+template<int N>
 __global__ void kInitialize(
     PuzzleStorage<N> ps,
     uint8_t g_database[],
     node_t<N> g_nodes[],
     uint32_t g_hash[],
+    uint32_t hashMask,
     heap_t g_openList[],
     int g_heapSize[]
 )
 {
-    __shared__ uint8_t s_index[N==5 ? 4 : (N==4 ? 2 : 1)][N==5 ? 6 : 8];
+    __shared__ uint8_t s_position[2][N*N];
     uint8_t conf[N][N];
 
     ps.decompose(conf);
 
     node_t<N> node;
-    node.fValue = computeHValue<N>(g_database, conf, s_index);
-    node.gValue = 0;
-    node.prev = UINT32_MAX;
+    uint32_t fValue = weightedHValue(
+        computeHValue<N>(g_database, conf, s_position, &node.hValues));
+    node.link = packLink(0, fValue, UINT32_MAX);
     node.ps = ps;
 
     heap_t heap;
-    heap.fValue = node.fValue;
+    heap.fValue = fValue;
     heap.addr = 0;
 
     g_nodes[0] = node;
     g_openList[0] = heap;
-    g_hash[ps.hashValue() % M] = 0;
+    g_hash[hashSlot(ps.hashValue()) & hashMask] = 0;
     g_heapSize[0] = 1;
 }
 
@@ -209,10 +399,67 @@ template<> __device__ bool checkSolution<5>(const PuzzleStorage<5> &ps)
 }
 
 
+// Index the live nodes [0, nodeSize) into a freshly cleared hash table
+// NT: number of CUDA thread per CUDA block
+template<int N, int NT>
+__global__ void kRehash(
+    const node_t<N> g_nodes[],
+    int nodeSize,
+    uint32_t g_hash[],
+    uint32_t hashMask,
+    int *g_hashFull
+)
+{
+    int gid = GLOBAL_ID;
+    if (gid >= nodeSize || g_nodes[gid].link == NODE_DEAD)
+        return;
+
+    PuzzleStorage<N> ps = g_nodes[gid].ps;
+    hashInsert<N>(g_nodes, g_hash, hashMask,
+                  ps, hashSlot(ps.hashValue()) & hashMask, gid, g_hashFull);
+}
+
+// --f-band: a heap whose top is more than the band above the smallest top of
+// all the heaps sits the round out, see the pathway kBandLimit.  The smallest
+// top is always extracted, kCheckTermination still sees the minimum.
+__device__ uint32_t d_stepLimit = UINT32_MAX;
+
+// A single block over the `numHeap' heaps
+// NT: number of CUDA thread per CUDA block, a power of two
+template<int NT>
+__global__ void kStepLimit(
+    const heap_t g_openList[],
+    const int g_heapSize[],
+    int heapCapacity,
+    int numHeap,
+    uint32_t band
+)
+{
+    __shared__ uint32_t s_top[NT];
+
+    int tid = THREAD_ID;
+    uint32_t top = UINT32_MAX;
+    for (int i = tid; i < numHeap; i += NT) {
+        if (g_heapSize[i] != 0) {
+            uint32_t fValue = g_openList[(size_t)heapCapacity * i].fValue;
+            top = min(top, fValue);
+        }
+    }
+    s_top[tid] = top;
+    __syncthreads();
+
+    for (int stride = NT / 2; stride > 0; stride /= 2) {
+        if (tid < stride)
+            s_top[tid] = min(s_top[tid], s_top[tid + stride]);
+        __syncthreads();
+    }
+    if (tid == 0)
+        d_stepLimit = s_top[0] == UINT32_MAX ? UINT32_MAX : s_top[0] + band;
+}
+
 // NB: number of CUDA block
 // NT: number of CUDA thread per CUDA block
-// VT: value handled per thread
-template<int N, int NB, int NT, int HEAP_CAPACITY, int M>
+template<int N, int NB, int NT>
 __global__ void kExtractExpand(
     uint8_t g_database[],
 
@@ -223,13 +470,16 @@ __global__ void kExtractExpand(
     // open list
     heap_t g_openList[],
     int g_heapSize[],
+    int heapCapacity,
 
     uint32_t g_hash[],
+    uint32_t hashMask,
+    int *g_hashFull,
 
     // solution
     uint32_t *g_optimalStep,
-    heap_t g_optimalNodes[],
-    int *g_optimalNodesSize,
+    unsigned long long *g_solution,
+    const int *g_status,
 
     // heap insert list
     heap_t *g_heapInsertList,
@@ -240,8 +490,8 @@ __global__ void kExtractExpand(
 )
 {
     __shared__ uint32_t s_optimalStep;
-    __shared__ uint8_t s_index[NT][N==5 ? 4 : (N==4 ? 2 : 1)][N==5 ? 6 : 8];
     __shared__ uint8_t s_conf[NT][N][N];
+    __shared__ uint8_t s_position[NT][2][N*N];
 
     __shared__ int s_nodeInsertCount;
     __shared__ int s_nodeInsertBase;
@@ -249,6 +499,9 @@ __global__ void kExtractExpand(
     __shared__ int s_heapInsertCount;
     __shared__ int s_heapInsertBase;
 
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
     int gid = GLOBAL_ID;
     int tid = THREAD_ID;
     if (tid == 0) {
@@ -259,11 +512,11 @@ __global__ void kExtractExpand(
 
     __syncthreads();
 
-    heap_t *heap = g_openList + HEAP_CAPACITY * gid - 1;
+    heap_t *heap = g_openList + (size_t)heapCapacity * gid - 1;
 
     heap_t topNode;
     int heapSize = g_heapSize[gid];
-    bool working = (heapSize != 0);
+    bool working = heapSize != 0 && heap[1].fValue <= d_stepLimit;
 
     node_t<N> node;
     uint8_t (&conf)[N][N] = s_conf[tid];
@@ -298,10 +551,13 @@ __global__ void kExtractExpand(
         g_heapSize[gid] = heapSize;
 
         // check solution
-        node = g_nodes[topNode.addr];
-        if (checkSolution<N>(node.ps)) {
-            int index = atomicAdd(g_optimalNodesSize, 1);
-            g_optimalNodes[index] = topNode;
+        // skip entries whose node was improved after they were pushed
+        node = loadNode<N>(g_nodes, topNode.addr);
+        if (topNode.fValue != linkF(node.link)) {
+            working = false;
+        } else if (checkSolution<N>(node.ps)) {
+            unsigned long long solution = topNode.fValue;
+            atomicMin(g_solution, solution << 32 | topNode.addr);
             working = false;
         }
     }
@@ -336,28 +592,24 @@ __global__ void kExtractExpand(
                 swap(conf[x][y], conf[nx][ny]);
 
                 PuzzleStorage<N> nps = PuzzleStorage<N>(conf);
-                hashValue[k] = nps.hashValue() % M;
-                addr[k] = g_hash[hashValue[k]];
+                hashValue[k] = hashSlot(nps.hashValue()) & hashMask;
+                addr[k] = hashFind<N>(
+                    g_nodes, g_hash, hashMask, nps, hashValue[k]);
                 nnode[k].ps = nps;
-                nnode[k].gValue = node.gValue + 1;
-                nnode[k].fValue = nnode[k].gValue +
-                    computeHValue<N>(g_database, conf, s_index[tid]);
-                nnode[k].prev = topNode.addr;
-
+                nnode[k].hValues = node.hValues;
+                uint32_t gValue = linkG(node.link) + 1;
+                uint32_t fValue = gValue + weightedHValue(
+                    updateHValue<N>(g_database, conf, s_position[tid],
+                                    conf[x][y], &nnode[k].hValues));
+                nnode[k].link = packLink(gValue, fValue, topNode.addr);
+
+                // only a copy with a lower g goes to the open list
                 if (addr[k] != UINT32_MAX) {
-                    node_t<N> onode = g_nodes[addr[k]];
-                    if (onode.ps == nps) {
-                        found[k] = true;
-                        if (nnode[k].gValue < onode.gValue) {
-                            g_nodes[addr[k]] = nnode[k];
-                        } else
-                            insert[k] = false;
-                    }
-                }
-                if (!found[k])
+                    found[k] = true;
+                    insert[k] = lowerLink(
+                        &g_nodes[addr[k]].link, nnode[k].link);
+                } else
                     ++nodeCount;
-                if (insert[k])
-                    ++heapCount;
 #ifdef KERNEL_LOG
                 printf("\t\t[%d] Gen node with hash %d (%d %d)\n",
                        gid, hashValue[k], found[k], insert[k]);
@@ -367,36 +619,55 @@ __global__ void kExtractExpand(
             }
         }
         nodeIndex = atomicAdd(&s_nodeInsertCount, nodeCount);
-        heapIndex = atomicAdd(&s_heapInsertCount, heapCount);
     }
 
     __syncthreads();
-    if (tid == 0) {
+    if (tid == 0)
         s_nodeInsertBase = atomicAdd(g_nodeSize, s_nodeInsertCount);
-        s_heapInsertBase = atomicAdd(g_heapInsertSize, s_heapInsertCount);
-    }
     __syncthreads();
 
+    // The new states are published by their hash slot alone: the copy that
+    // claims it is the node, any other copy of this round is retired and
+    // only races for the link of that one
     if (working) {
         nodeCount = 0;
-        heapCount = 0;
         for (int k = 0; k < 4; ++k) {
-            if (!work[k])
+            if (!work[k] || found[k])
                 continue;
-            if (!found[k]) {
-                addr[k] = s_nodeInsertBase + nodeIndex + nodeCount++;
-                g_nodes[addr[k]] = nnode[k];
-                __threadfence();
-                g_hash[hashValue[k]] = addr[k];
-            }
-            if (insert[k]) {
-                heap_t heapItem;
-                heapItem.fValue = nnode[k].fValue;
-                heapItem.addr = addr[k];
-                g_heapInsertList[
-                    s_heapInsertBase + heapIndex + heapCount++] = heapItem;
+            addr[k] = s_nodeInsertBase + nodeIndex + nodeCount++;
+            g_nodes[addr[k]] = nnode[k];
+            __threadfence();
+            uint32_t other = hashInsert<N>(
+                g_nodes, g_hash, hashMask,
+                nnode[k].ps, hashValue[k], addr[k], g_hashFull);
+            if (other != addr[k] && other != UINT32_MAX) {
+                g_nodes[addr[k]].link = NODE_DEAD;
+                insert[k] = lowerLink(&g_nodes[other].link, nnode[k].link);
+                addr[k] = other;
             }
         }
+        for (int k = 0; k < 4; ++k)
+            if (work[k] && insert[k])
+                ++heapCount;
+        heapIndex = atomicAdd(&s_heapInsertCount, heapCount);
+    }
+
+    __syncthreads();
+    if (tid == 0)
+        s_heapInsertBase = atomicAdd(g_heapInsertSize, s_heapInsertCount);
+    __syncthreads();
+
+    if (working) {
+        heapCount = 0;
+        for (int k = 0; k < 4; ++k) {
+            if (!work[k] || !insert[k])
+                continue;
+            heap_t heapItem;
+            heapItem.fValue = linkF(nnode[k].link);
+            heapItem.addr = addr[k];
+            g_heapInsertList[
+                s_heapInsertBase + heapIndex + heapCount++] = heapItem;
+        }
     }
 
     if (tid == 0)
@@ -407,21 +678,45 @@ __global__ void kExtractExpand(
     }
 }
 
-template<int N, int NB, int NT, int HEAP_CAPACITY>
+// The best solution is optimal once no node with a smaller fValue was
+// extracted in this round, and the search fails once nothing can be
+// extracted at all.
+template<int N>
+__global__ void kCheckTermination(
+    unsigned long long *g_solution,
+    uint32_t *g_optimalStep,
+    int *g_status
+)
+{
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
+    unsigned long long solution = *g_solution;
+    uint32_t optimalStep = *g_optimalStep;
+    if (solution != ULLONG_MAX && (uint32_t)(solution >> 32) <= optimalStep)
+        *g_status = SEARCH_SOLVED;
+    else if (optimalStep == UINT32_MAX)
+        *g_status = SEARCH_FAILED;
+    *g_optimalStep = UINT32_MAX;
+}
+
+template<int N, int NB, int NT>
 __global__ void kHeapInsert(
     // open list
     heap_t g_openList[],
     int g_heapSize[],
+    int heapCapacity,
     int *g_heapBeginIndex,
 
     heap_t g_heapInsertList[],
     int *g_heapInsertSize,
 
-    // cleanup variable
-    uint32_t *optimalStep,
-    int *optimalNodesSize
+    const int *g_status
 )
 {
+    if (*g_status != SEARCH_RUNNING)
+        return;
+
     int gid = GLOBAL_ID;
 
     int heapInsertSize = *g_heapInsertSize;
@@ -430,7 +725,7 @@ __global__ void kHeapInsert(
         heapIndex -= NB*NT;
 
     int heapSize = g_heapSize[heapIndex];
-    heap_t *heap = g_openList + HEAP_CAPACITY * heapIndex - 1;
+    heap_t *heap = g_openList + (size_t)heapCapacity * heapIndex - 1;
 
     for (int i = gid; i < heapInsertSize; i += NB*NT) {
         heap_t value = g_heapInsertList[i];
@@ -453,12 +748,30 @@ __global__ void kHeapInsert(
     }
 
     g_heapSize[heapIndex] = heapSize;
-    if (gid == 0) {
-        *optimalStep = UINT32_MAX;
-        *optimalNodesSize = 0;
-    }
 }
 
+// The puzzle side of the memory bounded search (--memory-limit), see
+// GPU-bounded.cuh.  The pruned arena is indexed again by kRehash.
+
+inline __device__ uint32_t pruneKey(const heap_t &heap)
+{
+    return heap.fValue;
+}
+
+template<int N>
+inline __device__ uint32_t nodePrev(const node_t<N> &node)
+{
+    return linkPrev(node.link);
+}
+
+template<int N>
+inline __device__ void relinkNode(node_t<N> *node, uint32_t prev)
+{
+    node->link = packLink(linkG(node->link), linkF(node->link), prev);
+}
+
+#include "GPU-bounded.cuh"
+
 template<int N>
 __global__ void kFetchAnswer(
     node_t<N> g_nodes[],
@@ -478,7 +791,7 @@ __global__ void kFetchAnswer(
     node_t<N> curr;
 
     curr = g_nodes[addr];
-    addr = curr.prev;
+    addr = linkPrev(curr.link);
     prev = g_nodes[addr];
 
     int cx, cy;
@@ -498,7 +811,7 @@ __global__ void kFetchAnswer(
             if (px + DX[i] == cx && py + DY[i] == cy)
                 g_answerList[count++] = i;
 
-        addr = prev.prev;
+        addr = linkPrev(prev.link);
         if (addr == UINT32_MAX)
             break;
         curr = prev;
@@ -0,0 +1,290 @@
+#ifndef __GPU_SHARD_KERNEL_CUH_7XKD0V4E
+#define __GPU_SHARD_KERNEL_CUH_7XKD0V4E
+
+// Kernels of a puzzle search spread over several devices (see
+// GPU-shard.cuh).  A state belongs to the shard picked by the high bits of
+// its hashSlot(), every shard keeps the nodes and the hash table of its own
+// states.  kExtractExpand is split in two: the sender computes the
+// successors and their heuristic, their owner looks them up in its table.
+
+#include "GPU-shard.cuh"
+#include "puzzle/GPU-kernel.cuh"
+
+// The low bits of the hash value index the table of the owner
+inline __host__ __device__ int shardOwner(uint32_t hashValue, int numShard)
+{
+    return (int)((uint64_t)hashValue * numShard >> 32);
+}
+
+// Extract and expand like kExtractExpand, but the successors go to the
+// outbox of their owner, the one of shard `k' starting at k * outCapacity.
+template<int N, int NB, int NT>
+__global__ void kShardExtractExpand(
+    uint8_t g_database[],
+
+    // global nodes
+    const node_t<N> g_nodes[],
+
+    // open list
+    heap_t g_openList[],
+    int g_heapSize[],
+    int heapCapacity,
+
+    // solution
+    uint32_t *g_optimalStep,
+    unsigned long long *g_solution,
+
+    int shard,
+    int numShard,
+
+    // outboxes
+    node_t<N> g_outList[],
+    int outCapacity,
+    int g_outSize[],
+
+    // cleanup
+    int *g_heapBeginIndex,
+    int *g_heapInsertSize
+)
+{
+    __shared__ uint32_t s_optimalStep;
+    __shared__ uint8_t s_conf[NT][N][N];
+    __shared__ uint8_t s_position[NT][2][N*N];
+
+    __shared__ int s_outCount[MAX_SHARD];
+    __shared__ int s_outBase[MAX_SHARD];
+
+    int gid = GLOBAL_ID;
+    int tid = THREAD_ID;
+    if (tid == 0)
+        s_optimalStep = UINT32_MAX;
+    if (tid < numShard)
+        s_outCount[tid] = 0;
+
+    __syncthreads();
+
+    heap_t *heap = g_openList + (size_t)heapCapacity * gid - 1;
+
+    heap_t topNode;
+    int heapSize = g_heapSize[gid];
+    bool working = heapSize != 0 && heap[1].fValue <= d_stepLimit;
+
+    node_t<N> node;
+    uint8_t (&conf)[N][N] = s_conf[tid];
+
+    if (working) {
+        topNode = heap[1];
+        heap_t nowValue = heap[heapSize--];
+
+        atomicMin(&s_optimalStep, topNode.fValue);
+
+        int now = 1;
+        int next;
+        while ((next = now*2) <= heapSize) {
+            heap_t nextValue = heap[next];
+            heap_t nextValue2 = heap[next+1];
+            bool inc = (next+1 <= heapSize) && (nextValue2 < nextValue);
+            if (inc) {
+                ++next;
+                nextValue = nextValue2;
+            }
+
+            if (nextValue < nowValue) {
+                heap[now] = nextValue;
+                now = next;
+            } else
+                break;
+        }
+        heap[now] = nowValue;
+        g_heapSize[gid] = heapSize;
+
+        // skip entries whose node was improved after they were pushed
+        node = loadNode<N>(g_nodes, topNode.addr);
+        if (topNode.fValue != linkF(node.link)) {
+            working = false;
+        } else if (checkSolution<N>(node.ps)) {
+            unsigned long long solution = topNode.fValue;
+            atomicMin(g_solution, solution << 32 | topNode.addr);
+            working = false;
+        }
+    }
+
+    node_t<N> nnode[4];
+    int owner[4], index[4];
+    bool work[4];
+
+    if (working) {
+        node.ps.decompose(conf);
+
+        int x, y;
+        getEmptyTile<N>(conf, &x, &y);
+
+        const int DX[4] = { 1, -1,  0,  0 };
+        const int DY[4] = { 0,  0,  1, -1 };
+#pragma unroll
+        for (int k = 0; k < 4; ++k) {
+            int nx = x + DX[k];
+            int ny = y + DY[k];
+
+            work[k] = inrange<N>(nx, ny);
+            if (!work[k])
+                continue;
+            swap(conf[x][y], conf[nx][ny]);
+
+            nnode[k].ps = PuzzleStorage<N>(conf);
+            nnode[k].hValues = node.hValues;
+            uint32_t gValue = linkG(node.link) + 1;
+            uint32_t fValue = gValue + weightedHValue(
+                updateHValue<N>(g_database, conf, s_position[tid],
+                                conf[x][y], &nnode[k].hValues));
+            nnode[k].link = packLink(
+                gValue, fValue, shardRef(shard, topNode.addr));
+            owner[k] = shardOwner(
+                hashSlot(nnode[k].ps.hashValue()), numShard);
+            index[k] = atomicAdd(&s_outCount[owner[k]], 1);
+
+            swap(conf[x][y], conf[nx][ny]);
+        }
+    }
+
+    __syncthreads();
+    if (tid < numShard)
+        s_outBase[tid] = atomicAdd(&g_outSize[tid], s_outCount[tid]);
+    __syncthreads();
+
+    if (working) {
+        for (int k = 0; k < 4; ++k)
+            if (work[k])
+                g_outList[owner[k] * outCapacity +
+                          s_outBase[owner[k]] + index[k]] = nnode[k];
+    }
+
+    if (tid == 0)
+        atomicMin(g_optimalStep, s_optimalStep);
+    if (gid == 0) {
+        int newHeapBeginIndex = *g_heapBeginIndex + *g_heapInsertSize;
+        *g_heapBeginIndex = newHeapBeginIndex % (NB*NT);
+        *g_heapInsertSize = 0;
+    }
+}
+
+// Merge the `inSize' successors sent to this shard into its nodes, the
+// second half of kExtractExpand
+template<int N, int NT>
+__global__ void kShardInsert(
+    // global nodes
+    node_t<N> g_nodes[],
+    int *g_nodeSize,
+
+    uint32_t g_hash[],
+    uint32_t hashMask,
+    int *g_hashFull,
+
+    const node_t<N> g_inList[],
+    int inSize,
+
+    // heap insert list
+    heap_t *g_heapInsertList,
+    int *g_heapInsertSize
+)
+{
+    __shared__ int s_nodeInsertCount;
+    __shared__ int s_nodeInsertBase;
+
+    __shared__ int s_heapInsertCount;
+    __shared__ int s_heapInsertBase;
+
+    int gid = GLOBAL_ID;
+    int tid = THREAD_ID;
+    if (tid == 0) {
+        s_nodeInsertCount = 0;
+        s_heapInsertCount = 0;
+    }
+    __syncthreads();
+
+    bool working = gid < inSize;
+    bool found = true, insert = true;
+    node_t<N> node;
+    uint32_t slot, addr;
+    int nodeIndex, heapIndex;
+
+    if (working) {
+        node = g_inList[gid];
+        slot = hashSlot(node.ps.hashValue()) & hashMask;
+        addr = hashFind<N>(g_nodes, g_hash, hashMask, node.ps, slot);
+        found = addr != UINT32_MAX;
+        // only a copy with a lower g goes to the open list, an equal g only
+        // takes over the parent
+        if (found)
+            insert = lowerLink(&g_nodes[addr].link, node.link);
+        else
+            nodeIndex = atomicAdd(&s_nodeInsertCount, 1);
+    }
+
+    __syncthreads();
+    if (tid == 0)
+        s_nodeInsertBase = atomicAdd(g_nodeSize, s_nodeInsertCount);
+    __syncthreads();
+
+    // published by the hash slot alone, as in kExtractExpand: a copy sent by
+    // another thread in this round that claimed it first is the node
+    if (working && !found) {
+        addr = s_nodeInsertBase + nodeIndex;
+        g_nodes[addr] = node;
+        __threadfence();
+        uint32_t other = hashInsert<N>(
+            g_nodes, g_hash, hashMask, node.ps, slot, addr, g_hashFull);
+        if (other != addr && other != UINT32_MAX) {
+            g_nodes[addr].link = NODE_DEAD;
+            insert = lowerLink(&g_nodes[other].link, node.link);
+            addr = other;
+        }
+    }
+    if (working && insert)
+        heapIndex = atomicAdd(&s_heapInsertCount, 1);
+
+    __syncthreads();
+    if (tid == 0)
+        s_heapInsertBase = atomicAdd(g_heapInsertSize, s_heapInsertCount);
+    __syncthreads();
+
+    if (working && insert) {
+        heap_t heapItem;
+        heapItem.fValue = linkF(node.link);
+        heapItem.addr = addr;
+        g_heapInsertList[s_heapInsertBase + heapIndex] = heapItem;
+    }
+}
+
+// Collect the states on the path back from the node at `addr' as long as
+// it stays on this shard.  g_next is the reference to the rest of the path,
+// UINT32_MAX when the initial state was reached.
+template<int N>
+__global__ void kShardFetchStates(
+    const node_t<N> g_nodes[],
+
+    uint32_t addr,
+    int shard,
+
+    PuzzleStorage<N> g_states[],
+    int *g_stateSize,
+    uint32_t *g_next
+)
+{
+    int count = 0;
+    uint32_t ref;
+
+    for (;;) {
+        node_t<N> node = g_nodes[addr];
+        g_states[count++] = node.ps;
+        ref = linkPrev(node.link);
+        if (ref == UINT32_MAX || refShard(ref) != shard)
+            break;
+        addr = refAddr(ref);
+    }
+
+    *g_stateSize = count;
+    *g_next = ref;
+}
+
+#endif /* end of include guard: __GPU_SHARD_KERNEL_CUH_7XKD0V4E */
@@ -3,21 +3,35 @@
 
 #include <moderngpu.cuh>
 
+#include "GPU-memory.cuh"
+#include "GPU-metrics.cuh"
+#include "anytime.hpp"
 #include "puzzle/puzzle.cuh"
+#include "puzzle/database.hpp"
 #include "puzzle/GPU-kernel.cuh"
+#include "puzzle/GPU-shard-kernel.cuh"
+#include "puzzle/GPU-bucket-kernel.cuh"
 
 namespace gpusolver {
 
-const int OPEN_LIST_SIZE = 1000000;
-const int NODE_LIST_SIZE = 15000000;
 const int ANSWER_LIST_SIZE = 50000;
-const int HASH_NUMBER = 90000089;
 
 const int NUM_BLOCK  = 13 * 3;
 const int NUM_THREAD = 192;
 const int NUM_TOTAL = NUM_BLOCK * NUM_THREAD;
+// threads of kStepLimit, a power of two
+const int BAND_THREAD = 256;
+// chunks a round may add to the buckets of --open-list=buckets: one per
+// BUCKET_CHUNK successors, and one more for every bucket they go to
+const int ROUND_CHUNKS = NUM_TOTAL * 4 / BUCKET_CHUNK + 1 + NUM_BUCKET;
 
-const int HEAP_CAPACITY = OPEN_LIST_SIZE / NUM_TOTAL;
+// The node arena and the open list are sized at runtime (see GPU-memory.cuh).
+// An automatically sized open list starts with this many entries per heap,
+// and the heaps are doubled whenever a round could overflow them.
+const int MIN_HEAP_CAPACITY = 128;
+// The open addressing hash keeps at least twice as many slots as the node
+// arena, so at most 2^30 nodes fit into the 32-bit slot indices.
+const int MAX_NODE_LIST_SIZE = 1 << 30;
 
 int div_up(int x, int y) { return (x-1) / y + 1; }
 
@@ -30,8 +44,9 @@ struct DeviceData {
     MGPU_MEM(node_t<N>) nodes;
     MGPU_MEM(int) nodeSize;
 
-    // hash table for `nodes'
+    // hash table for `nodes', and the probes that ran out (see hashInsert)
     MGPU_MEM(uint32_t) hash;
+    MGPU_MEM(int) hashFull;
 
     // store open list
     MGPU_MEM(heap_t) openList;
@@ -42,164 +57,286 @@ struct DeviceData {
     MGPU_MEM(heap_t) heapInsertList;
     MGPU_MEM(int) heapInsertSize;
 
+    // --open-list=buckets: the buckets, their pool of chunks and the
+    // allocator of the chunks (see GPU-bucket-kernel.cuh)
+    MGPU_MEM(bucket_t) buckets;
+    MGPU_MEM(heap_t) bucketPool;
+    MGPU_MEM(uint32_t) chunkPrev;
+    MGPU_MEM(uint32_t) freeChunks;
+    MGPU_MEM(uint32_t) roundChunks;
+    MGPU_MEM(int) insertPos;
+    MGPU_MEM(int) bucketCount;
+
     MGPU_MEM(uint32_t) optimalStep;
-    MGPU_MEM(heap_t) optimalNodes;
-    MGPU_MEM(int) optimalNodesSize;
+    // best solution found: fValue << 32 | addr
+    MGPU_MEM(unsigned long long) solution;
+    // SEARCH_RUNNING, SEARCH_SOLVED or SEARCH_FAILED
+    MGPU_MEM(int) status;
 
     MGPU_MEM(int) answerList;
     MGPU_MEM(int) answerSize;
 
+    // memory bounded search: the smallest fValue pruned, a mark (then the
+    // new address) for every node, and a histogram of the open list
+    MGPU_MEM(uint32_t) pruned;
+    MGPU_MEM(uint32_t) mark;
+    MGPU_MEM(int) liveSize;
+    MGPU_MEM(int) histogram;
+
+    // successors bound to the shards, one outbox per shard, and the ones
+    // received from them (see GPUShardedPuzzleSolver)
+    MGPU_MEM(node_t<N>) outList;
+    MGPU_MEM(int) outSize;
+    MGPU_MEM(node_t<N>) inList;
+    // a piece of the path of the solution and the reference to the rest
+    MGPU_MEM(PuzzleStorage<N>) pathStates;
+    MGPU_MEM(uint32_t) pathNext;
+
+    // the status of the rounds, see solve()
+    StatusPoll poll;
+
     typename mgpu::ContextPtr context;
 };
 
+// Upload the pattern databases of the layout straight from their mappings,
+// concatenated as d_pdb.offset expects, and set the constant memory of the
+// kernels: the layout, the format and the goal states
+template<int N>
+MGPU_MEM(uint8_t) uploadDatabases(CudaContext &context)
+{
+    pdb_layout_t layout;
+    vector< vector<int> > tracked;
+    initializeLayout(N, &layout, &tracked);
+
+    int dbCount = tracked.size();
+    vector<const uint8_t *> database(dbCount);
+    vector<size_t> databaseBytes(dbCount);
+    vector<size_t> databaseOffset(dbCount);
+    size_t totalBytes = 0;
+    int format = PDB_BYTES;
+    for (int i = 0; i < dbCount; ++i) {
+        PatternDatabase pd(N, tracked[i]);
+        database[i] = pd.fetchDatabase();
+        databaseBytes[i] = pd.bytes();
+        format = pd.format();
+    }
+    for (int k = 0; k < layout.numPattern; ++k) {
+        size_t entry = layout.offset[k];
+        databaseOffset[layout.database[k]] =
+            format == PDB_NIBBLES ? entry / 2 : entry;
+    }
+    for (int i = 0; i < dbCount; ++i)
+        totalBytes = max(totalBytes, databaseOffset[i] + databaseBytes[i]);
+
+    // 1 2 ... with the empty tile last, as the CPU solver
+    uint8_t s3[3][3], c3 = 0;
+    uint8_t s4[4][4], c4 = 0;
+    uint8_t s5[5][5], c5 = 0;
+    for (int i = 0; i < 5; ++i)
+        for (int j = 0; j < 5; ++j) {
+            if (i < 3 && j < 3)
+                s3[i][j] = ++c3;
+            if (i < 4 && j < 4)
+                s4[i][j] = ++c4;
+            s5[i][j] = ++c5;
+        }
+    s3[2][2] = s4[3][3] = s5[4][4] = 0;
+    PuzzleStorage<3> ps3(s3);
+    PuzzleStorage<4> ps4(s4);
+    PuzzleStorage<5> ps5(s5);
+    initializeCUDAConstantMemory<N>(layout, ps3, ps4, ps5, format);
+
+    MGPU_MEM(uint8_t) buffer = context.Malloc<uint8_t>(totalBytes);
+    for (int i = 0; i < dbCount; ++i)
+        cudaMemcpy(buffer->get() + databaseOffset[i], database[i],
+                   databaseBytes[i], cudaMemcpyHostToDevice);
+    return buffer;
+}
+
+template<int N> class GPUShardedPuzzleSolver;
+
 template<int N>
 class GPUPuzzleSolver {
 public:
-    GPUPuzzleSolver(Puzzle *puzzle) : p(puzzle) {
+    GPUPuzzleSolver(Puzzle *puzzle)
+        : p(puzzle), m_weight(searchWeight()), m_fBand(-1),
+          m_buckets(false), m_chunkCapacity(0), m_chunkBound(0),
+          m_ordinal(0), m_shard(0), m_numShard(1) {
         d = new DeviceData<N>();
     }
     ~GPUPuzzleSolver() {
         delete d;
     }
     void initialize() {
-        int dbCount;
-        vector< vector<int> > tracked;
-
-        if (N == 3) {
-            dbCount = 1;
-            tracked.resize(dbCount);
-            for (int i = 1; i <= 8; ++i)
-                tracked[0].push_back(i);
-        } else if (N == 4) {
-            dbCount = 2;
-            tracked.resize(dbCount);
-
-            tracked[0].push_back(1);
-            tracked[0].push_back(2);
-            tracked[0].push_back(3);
-            tracked[0].push_back(4);
-            tracked[0].push_back(5);
-            tracked[0].push_back(6);
-            tracked[0].push_back(9);
-            tracked[0].push_back(13);
-
-            tracked[1].push_back(7);
-            tracked[1].push_back(8);
-            tracked[1].push_back(10);
-            tracked[1].push_back(11);
-            tracked[1].push_back(12);
-            tracked[1].push_back(14);
-            tracked[1].push_back(15);
-        } else if (N == 5) {
-            dbCount = 4;
-            tracked.resize(dbCount);
-
-            tracked[0].push_back(3);
-            tracked[0].push_back(4);
-            tracked[0].push_back(5);
-            tracked[0].push_back(10);
-            tracked[0].push_back(15);
-            tracked[0].push_back(20);
-
-            tracked[1].push_back(2);
-            tracked[1].push_back(1);
-            tracked[1].push_back(6);
-            tracked[1].push_back(11);
-            tracked[1].push_back(16);
-            tracked[1].push_back(21);
-
-            tracked[2].push_back(7);
-            tracked[2].push_back(8);
-            tracked[2].push_back(9);
-            tracked[2].push_back(12);
-            tracked[2].push_back(17);
-            tracked[2].push_back(22);
-
-            tracked[3].push_back(13);
-            tracked[3].push_back(14);
-            tracked[3].push_back(18);
-            tracked[3].push_back(19);
-            tracked[3].push_back(23);
-            tracked[3].push_back(24);
-        } else
-            assert(false);
-
-        vector<int2> mapTracked;
-        vector<uint8_t> database;
-        mapTracked.resize(N*N, make_int2(-1, -1));
-        for (int i = 0; i < dbCount; ++i) {
-            PatternDatabase pd(N, tracked[i]);
-            int offset = database.size();
-            database.resize(offset + pd.size());
-            pd.fetchDatabase(database.data() + offset);
-            for (int j = 0; j < (int)tracked[i].size(); ++j) {
-                mapTracked[tracked[i][j]] = make_int2(i, j);
-            }
-        }
+        initializeShard(vm_options["ordinal"].as<int>(), 0, 1);
+    }
+
+    // Bind to the device `ordinal' as the shard `shard' of `numShard', see
+    // GPUShardedPuzzleSolver
+    void initializeShard(int ordinal, int shard, int numShard) {
+        m_ordinal = ordinal;
+        m_shard = shard;
+        m_numShard = numShard;
 
+        cudaSetDevice(ordinal);
         cudaDeviceSynchronize();
+        d->poll.release();
         cudaDeviceReset();
-        d->context = CreateCudaDevice(vm_options["ordinal"].as<int>());
-
-        uint8_t s3[3][3], c3 = 0;
-        uint8_t s4[4][4], c4 = 0;
-        uint8_t s5[5][5], c5 = 0;
-        for (int i = 0; i < 5; ++i)
-            for (int j = 0; j < 5; ++j) {
-                if (i < 3 && j < 3)
-                    s3[i][j] = ++c3;
-                if (i < 4 && j < 4)
-                    s4[i][j] = ++c4;
-                s5[i][j] = ++c5;
-            }
-        PuzzleStorage<3> ps3(s3);
-        PuzzleStorage<4> ps4(s4);
-        PuzzleStorage<5> ps5(s5);
-        initializeCUDAConstantMemory<N>(mapTracked.data(), ps3, ps4, ps5);
-
-        d->database = d->context->template Malloc<uint8_t>(database);
+        d->context = CreateCudaDevice(ordinal);
+        countDeviceMemory(*d->context);
+        d->poll.create();
+        m_freeMemory = freeDeviceMemory();
+        m_bounded = memoryLimit() != 0;
+        m_fBand = vm_options["f-band"].as<float>();
+        if (numShard > 1 && m_bounded) {
+            cout << "--devices cannot be used with --memory-limit" << endl;
+            exit(1);
+        }
+        string openList = vm_options["open-list"].as<string>();
+        if (openList != "heaps" && openList != "buckets") {
+            cout << "Please set your open-list parameter correctly." << endl
+                 << "==============================================" << endl
+                 << endl;
+            help();
+        }
+        m_buckets = openList == "buckets";
+        // the buckets are only ordered for the unweighted fValues, and the
+        // staged heaps hold a single entry
+        if (m_buckets && (numShard > 1 || m_bounded || m_fBand >= 0 ||
+                          vm_options["weight"].as<float>() != 1 ||
+                          vm_options.count("anytime"))) {
+            cout << "--open-list=buckets cannot be used with --devices, "
+                 << "--memory-limit, --f-band, --weight or --anytime" << endl;
+            exit(1);
+        }
 
-        d->nodes = d->context->template Malloc< node_t<N> >(NODE_LIST_SIZE);
-        d->nodeSize = d->context->template Fill<int>(1, 1);
+        d->database = uploadDatabases<N>(*d->context);
 
-        d->hash = d->context->template Fill<uint32_t>(HASH_NUMBER, UINT32_MAX);
+        d->nodeSize = d->context->template Malloc<int>(1);
+        d->hashFull = d->context->template Malloc<int>(1);
 
-        d->openList = d->context->template Malloc<heap_t>(OPEN_LIST_SIZE);
-        d->heapSize = d->context->template Fill<int>(NUM_TOTAL, 0);
-        d->heapBeginIndex = d->context->template Fill<int>(1, 0);
+        d->heapSize = d->context->template Malloc<int>(NUM_TOTAL);
+        d->heapBeginIndex = d->context->template Malloc<int>(1);
 
-        d->heapInsertList = d->context->template Malloc<heap_t>(NUM_TOTAL * 4);
-        d->heapInsertSize = d->context->template Fill<int>(1, 0);
+        // a shard may receive the successors of all the shards
+        d->heapInsertList = d->context->template Malloc<heap_t>(
+            NUM_TOTAL * 4 * numShard);
+        d->heapInsertSize = d->context->template Malloc<int>(1);
+        if (m_buckets) {
+            d->buckets = d->context->template Malloc<bucket_t>(NUM_BUCKET);
+            d->roundChunks = d->context->template Malloc<uint32_t>(
+                ROUND_CHUNKS);
+            d->insertPos = d->context->template Malloc<int>(NUM_TOTAL * 4);
+            d->bucketCount = d->context->template Malloc<int>(
+                NUM_BUCKET_COUNT);
+        }
 
-        d->optimalStep = d->context->template Fill<uint32_t>(1, UINT32_MAX);
-        d->optimalNodes = d->context->template Malloc<heap_t>(NUM_TOTAL);
-        d->optimalNodesSize = d->context->template Fill<int>(1, 0);
+        d->optimalStep = d->context->template Malloc<uint32_t>(1);
+        d->solution = d->context->template Malloc<unsigned long long>(1);
+        d->status = d->context->template Malloc<int>(1);
 
         d->answerList = d->context->template Malloc<int>(ANSWER_LIST_SIZE);
-        d->answerSize = d->context->template Fill<int>(1, 0);
+        d->answerSize = d->context->template Malloc<int>(1);
+
+        d->pruned = d->context->template Malloc<uint32_t>(1);
+        if (m_bounded) {
+            d->liveSize = d->context->template Malloc<int>(1);
+            d->histogram = d->context->template Malloc<int>(PRUNE_BINS);
+        }
+        if (numShard > 1) {
+            d->outList = d->context->template Malloc< node_t<N> >(
+                NUM_TOTAL * 4 * numShard);
+            d->outSize = d->context->template Fill<int>(numShard, 0);
+            d->inList = d->context->template Malloc< node_t<N> >(
+                NUM_TOTAL * 4 * numShard);
+            d->pathStates = d->context->template Malloc< PuzzleStorage<N> >(
+                ANSWER_LIST_SIZE);
+            d->pathNext = d->context->template Malloc<uint32_t>(1);
+        }
+
+        allocateLists();
+        restart();
+        dout << "\t\tGPU Initialization finishes" << endl;
+    }
+
+    // Order the open list by g + weight * h from the next restart() on,
+    // see anytime.hpp
+    void setWeight(float weight) {
+        m_weight = weight;
+    }
+
+    // Start the search over from the initial state, the buffers are kept
+    void restart() {
+        cudaSetDevice(m_ordinal);
+        initializeCUDAWeight(m_weight);
 
         vector<uint8_t> state;
         p->initialState(state);
-        kInitialize<N, HASH_NUMBER> <<<1, 1>>>(
-            PuzzleStorage<N>(*reinterpret_cast<uint8_t(*)[N][N]>(state.data())),
+        PuzzleStorage<N> ps(
+            *reinterpret_cast<uint8_t(*)[N][N]>(state.data()));
+        // only the owner of the initial state has a root
+        bool root =
+            shardOwner(hashSlot(ps.hashValue()), m_numShard) == m_shard;
+
+        int numRoot = root ? 1 : 0;
+        d->nodeSize->FromHost(&numRoot, 1);
+        m_nodeBound = numRoot;
+        m_heapBound = 1;
+        m_numPrune = 0;
+        cudaMemset(d->hash->get(), 0xFF,
+                   sizeof(uint32_t) * ((size_t)m_hashMask + 1));
+        cudaMemset(d->hashFull->get(), 0, sizeof(int));
+        m_hashFull = 0;
+        cudaMemset(d->heapSize->get(), 0, sizeof(int) * NUM_TOTAL);
+        cudaMemset(d->heapBeginIndex->get(), 0, sizeof(int));
+        cudaMemset(d->heapInsertSize->get(), 0, sizeof(int));
+        cudaMemset(d->optimalStep->get(), 0xFF, sizeof(uint32_t));
+        cudaMemset(d->solution->get(), 0xFF, sizeof(unsigned long long));
+        cudaMemset(d->status->get(), 0, sizeof(int));
+        cudaMemset(d->answerSize->get(), 0, sizeof(int));
+        cudaMemset(d->pruned->get(), 0xFF, sizeof(uint32_t));
+        if (m_buckets) {
+            kBucketReset<<<1, NUM_BUCKET>>>(*d->buckets, *d->bucketCount);
+            m_chunkBound = 0;
+        }
+
+        if (!root)
+            return;
+        kInitialize<N> <<<1, 1>>>(
+            ps,
             *d->database,
             *d->nodes,
             *d->hash,
+            m_hashMask,
             *d->openList,
             *d->heapSize
         );
 #ifdef KERNEL_LOG
             cudaDeviceSynchronize();
 #endif
-        dout << "\t\tGPU Initialization finishes" << endl;
     }
 
     bool solve() {
-        std::priority_queue< heap_t, vector<heap_t>, std::greater<heap_t> > pq;
+        // The host only looks at the status every `pollInterval' rounds, and
+        // at the one copied a poll earlier: the rounds queued meanwhile are
+        // no-ops once the search is over.  Polling every round, or under the
+        // memory bounded search (the pruning depends on the heaps left), it
+        // stops right away.
+        int pollInterval = max(vm_options["poll-interval"].as<int>(), 1);
+        int pollLag = pollInterval > 1 && !m_bounded ? 1 : 0;
+        int *statusWords[] = { d->status->get(), d->hashFull->get() };
+        d->poll.reset();
+        RoundProbe probe("gpu");
+
         for (int round = 0; ;++round) {
+            reserveRound();
+            probe.begin(round, d->heapSize->get(), NUM_TOTAL, m_heapCapacity,
+                        1);
+
+            limitBand();
             dprintf("\t\tRound %d: kExtractExpand\n", round);
             kExtractExpand<
-                N, NUM_BLOCK, NUM_THREAD, HEAP_CAPACITY, HASH_NUMBER> <<<
+                N, NUM_BLOCK, NUM_THREAD> <<<
                 NUM_BLOCK, NUM_THREAD>>>(
                     *d->database,
 
@@ -208,12 +345,15 @@ public:
 
                     *d->openList,
                     *d->heapSize,
+                    m_heapCapacity,
 
                     *d->hash,
+                    m_hashMask,
+                    *d->hashFull,
 
                     *d->optimalStep,
-                    *d->optimalNodes,
-                    *d->optimalNodesSize,
+                    *d->solution,
+                    *d->status,
 
                     *d->heapInsertList,
                     *d->heapInsertSize,
@@ -224,53 +364,88 @@ public:
 #ifdef KERNEL_LOG
             cudaDeviceSynchronize();
 #endif
-            dprintf("\t\tRound %d: Fetch optimalNodesSize: ", round);
-            int optimalNodesSize = d->optimalNodesSize->Value();
-            dprintf("%d\n", optimalNodesSize);
-
-            if (optimalNodesSize) {
-                printf("\t\tRound %d: Found one solution\n", round);
-                vector<heap_t> optimalNodes;
-                d->optimalNodes->ToHost(optimalNodes, optimalNodesSize);
-
-                for (size_t i = 0; i != optimalNodes.size(); ++i) {
-                    dprintf("\t\t\t optimalNodes's fValue: %d\n", (int)optimalNodes[i].fValue);
-                    pq.push(optimalNodes[i]);
-                }
-
-            }
+            kCheckTermination<N><<<1, 1>>>(
+                *d->solution,
+                *d->optimalStep,
+                *d->status
+            );
+            // the successors are deduplicated by kExtractExpand
+            probe.mark(RoundProbe::MARK_EXTRACT);
+            if (probe.active())
+                probe.counters().inserted = d->heapInsertSize->Value();
 
-            uint32_t optimalStep = d->optimalStep->Value();
-            dprintf("\t\t\t Global optimal step: %d\n", optimalStep);
-            if (!pq.empty() && pq.top().fValue <= optimalStep) {
-                printf("\t\t\t Number of nodes expanded: %d\n", d->nodeSize->Value());
-                m_optimalNodeAddr = pq.top().addr;
-                m_optimalStep = pq.top().fValue;
-                dprintf("\t\t\t Optimal nodes address: %d\n", m_optimalNodeAddr);
-                return true;
-            }
-
-            dprintf("\t\tRound %d: kHeapInsert\n", round);
-            kHeapInsert<
-                N, NUM_BLOCK, NUM_THREAD, HEAP_CAPACITY> <<<
-                NUM_BLOCK, NUM_THREAD>>> (
-                    *d->openList,
-                    *d->heapSize,
-                    *d->heapBeginIndex,
+            if (m_buckets) {
+                dprintf("\t\tRound %d: kBucketScatter\n", round);
+                insertBuckets();
+            } else {
+                dprintf("\t\tRound %d: kHeapInsert\n", round);
+                kHeapInsert<
+                    N, NUM_BLOCK, NUM_THREAD> <<<
+                    NUM_BLOCK, NUM_THREAD>>> (
+                        *d->openList,
+                        *d->heapSize,
+                        m_heapCapacity,
+                        *d->heapBeginIndex,
 
-                    *d->heapInsertList,
-                    *d->heapInsertSize,
+                        *d->heapInsertList,
+                        *d->heapInsertSize,
 
-                    // reset them BTW
-                    *d->optimalStep,
-                    *d->optimalNodesSize
-                );
+                        *d->status
+                    );
+            }
 #ifdef KERNEL_LOG
             cudaDeviceSynchronize();
 #endif
-            int value = 0;
-            d->heapInsertSize->FromHost(&value, 1);
+            cudaMemsetAsync(d->heapInsertSize->get(), 0, sizeof(int));
+            // the entries of the next round
+            if (m_buckets)
+                stageBuckets();
+            probe.mark(RoundProbe::MARK_INSERT);
+            if (probe.active())
+                probe.end(d->nodeSize->Value(), m_nodeCapacity);
+
+            if ((round + 1) % pollInterval == 0) {
+                d->poll.issue(statusWords, 2);
+                const int *words = d->poll.wait(pollLag);
+                if (words) {
+                    dprintf("\t\tRound %d: status %d\n", round, words[0]);
+                    if (words[0] != SEARCH_RUNNING)
+                        break;
+                    if (words[1] > m_hashFull)
+                        growHash();
+                }
+            }
         }
+        recordDeviceMemory("gpu", *d->context);
+
+        if (d->status->Value() != SEARCH_SOLVED)
+            return false;
+
+        unsigned long long solution = d->solution->Value();
+        printf("\t\t\t Number of nodes expanded: %d\n", d->nodeSize->Value());
+        metrics.counter("gpu", "expanded", d->nodeSize->Value());
+        m_optimalNodeAddr = solution & UINT32_MAX;
+        m_optimalStep = solution >> 32;
+        dprintf("\t\t\t Optimal nodes address: %d\n", m_optimalNodeAddr);
+        return true;
+    }
+
+    // Return whether the memory bounded search pruned a node that could
+    // lead to a better solution, in which case the optimal number of steps
+    // is only known to be `bound' or more.  Also true when the search failed
+    // after pruning.
+    bool lowerBound(int *bound) {
+        uint32_t pruned = d->pruned->Value();
+        if (m_numPrune)
+            printf("\t\t\t Open list pruned %d times, smallest fValue "
+                   "pruned: %d\n", m_numPrune, (int)pruned);
+        if (pruned == UINT32_MAX)
+            return false;
+        if (d->status->Value() == SEARCH_SOLVED && m_optimalStep <= pruned)
+            return false;
+        // pruned under --weight, see anytime.hpp
+        *bound = (int)ceil(pruned / m_weight - 1e-6);
+        return true;
     }
 
     void getSolution(int *optimal, vector<int> *pathList) {
@@ -287,10 +462,646 @@ public:
     }
 
 private:
+    // The node arena and its hash table share three quarters of the
+    // budget, the heaps start small and grow into the rest.
+    // Under --memory-limit the buffers take their whole share at once and
+    // never grow, the search prunes instead.
+    void allocateLists() {
+        size_t budget = deviceMemoryBudget(m_freeMemory - freeDeviceMemory(),
+                                           m_bounded);
+
+        size_t openListSize = bufferSize(
+            "open-list-size",
+            m_bounded ? budget / 4 / sizeof(heap_t)
+                      : (size_t)NUM_TOTAL * MIN_HEAP_CAPACITY,
+            sizeof(heap_t), budget / 4);
+        if (openListSize < NUM_TOTAL) {
+            cout << "The open list needs at least " << NUM_TOTAL
+                 << " entries" << endl;
+            exit(1);
+        }
+        m_heapCapacity = openListSize / NUM_TOTAL;
+        // the buckets take the open list, the heaps only stage a round
+        if (m_buckets) {
+            m_chunkCapacity = max(
+                (int)((openListSize + BUCKET_CHUNK - 1) / BUCKET_CHUNK),
+                2 * ROUND_CHUNKS);
+            m_heapCapacity = 1;
+        }
+
+        // A node costs its own entry and up to four hash slots.  Pruning
+        // also needs a mark per node, and compacts the surviving half of the
+        // arena through a copy.
+        size_t nodeCost = sizeof(node_t<N>) + 4 * sizeof(uint32_t);
+        if (m_bounded)
+            nodeCost += sizeof(uint32_t) + sizeof(node_t<N>) / 2;
+        size_t nodeCount = bufferSize(
+            "node-list-size", budget * 3 / 4 / nodeCost,
+            nodeCost, budget * 3 / 4);
+        m_nodeCapacity = (int)min<size_t>(nodeCount, maxNodeListSize());
+        if (m_bounded && m_nodeCapacity < 4 * NUM_TOTAL * 4) {
+            cout << "--memory-limit leaves room for " << m_nodeCapacity
+                 << " nodes, " << 4 * NUM_TOTAL * 4 << " at least are needed"
+                 << endl;
+            exit(1);
+        }
+
+        size_t hashSize = 1;
+        while (hashSize < 2 * (size_t)m_nodeCapacity)
+            hashSize <<= 1;
+        m_hashMask = hashSize - 1;
+
+        d->nodes = d->context->template Malloc< node_t<N> >(m_nodeCapacity);
+        d->hash = d->context->template Fill<uint32_t>(hashSize, UINT32_MAX);
+        d->openList = d->context->template Malloc<heap_t>(
+            (size_t)m_heapCapacity * NUM_TOTAL);
+        if (m_buckets) {
+            d->bucketPool = d->context->template Malloc<heap_t>(
+                (size_t)m_chunkCapacity * BUCKET_CHUNK);
+            d->chunkPrev = d->context->template Malloc<uint32_t>(
+                m_chunkCapacity);
+            d->freeChunks = d->context->template Malloc<uint32_t>(
+                m_chunkCapacity);
+        }
+        if (m_bounded)
+            d->mark = d->context->template Malloc<uint32_t>(m_nodeCapacity);
+        dout << "\t\tNode list: " << m_nodeCapacity << ", hash slots: "
+             << hashSize << ", heap capacity: " << m_heapCapacity << endl;
+    }
+
+    // Find the band of the heaps extracted by the next round, see kStepLimit
+    void limitBand() {
+        if (m_fBand < 0)
+            return;
+        kStepLimit<BAND_THREAD><<<1, BAND_THREAD>>>(
+            *d->openList,
+            *d->heapSize,
+            m_heapCapacity,
+            NUM_TOTAL,
+            (uint32_t)m_fBand
+        );
+    }
+
+    // A round generates at most NUM_TOTAL * 4 nodes and pushes at most 4
+    // items into every heap.  The host keeps upper bounds of both and only
+    // reads the real sizes back once a bound runs out; the node arena (with
+    // its hash table) or the heaps are doubled when they are really full, or
+    // pruned under --memory-limit.
+    void reserveRound() {
+        // a shard may receive the successors of all the shards
+        const int nodeGrowth = NUM_TOTAL * 4 * m_numShard;
+        const int heapGrowth = 4 * m_numShard;
+        bool full = false;
+
+        if ((int64_t)m_nodeBound + nodeGrowth > m_nodeCapacity) {
+            m_nodeBound = d->nodeSize->Value();
+            if ((int64_t)m_nodeBound + nodeGrowth > m_nodeCapacity) {
+                if (m_bounded)
+                    full = true;
+                else
+                    growNodes(m_nodeBound + nodeGrowth);
+            }
+        }
+
+        // the staged heaps of the buckets are emptied every round
+        if (m_buckets) {
+            reserveBuckets();
+        } else {
+            if (m_heapBound + heapGrowth > m_heapCapacity)
+                m_heapBound = maxHeapSize();
+            if (m_heapBound + heapGrowth > m_heapCapacity && m_bounded) {
+                full = true;
+            } else if (m_heapBound + heapGrowth > m_heapCapacity) {
+                int newCapacity =
+                    max(2 * m_heapCapacity, m_heapBound + heapGrowth);
+                if (!growHeaps(*d->context, d->openList,
+                               NUM_TOTAL, m_heapCapacity, newCapacity))
+                    outOfDeviceMemory(
+                        "open list", (size_t)m_heapCapacity * NUM_TOTAL);
+                dout << "\t\tHeap capacity grows to " << newCapacity
+                     << endl;
+                m_heapCapacity = newCapacity;
+            }
+        }
+
+        // reads both sizes back
+        if (full)
+            prune();
+        m_nodeBound += nodeGrowth;
+        m_heapBound += heapGrowth;
+    }
+
+    // The chunks of the pool in use only grow by ROUND_CHUNKS a round, the
+    // pool is doubled when it could run out
+    void reserveBuckets() {
+        if (m_chunkBound + ROUND_CHUNKS > m_chunkCapacity) {
+            vector<int> count;
+            d->bucketCount->ToHost(count, NUM_BUCKET_COUNT);
+            m_chunkBound = count[BUCKET_CHUNK_USED];
+        }
+        if (m_chunkBound + ROUND_CHUNKS > m_chunkCapacity) {
+            int newCapacity =
+                max(2 * m_chunkCapacity, m_chunkBound + ROUND_CHUNKS);
+            if (!growBuffer(*d->context, d->bucketPool,
+                            (size_t)m_chunkBound * BUCKET_CHUNK,
+                            (size_t)newCapacity * BUCKET_CHUNK) ||
+                !growBuffer(*d->context, d->chunkPrev,
+                            m_chunkBound, newCapacity) ||
+                !growBuffer(*d->context, d->freeChunks,
+                            m_chunkBound, newCapacity))
+                outOfDeviceMemory("open list",
+                                  (size_t)m_chunkCapacity * BUCKET_CHUNK);
+            dout << "\t\tBucket pool grows to " << newCapacity
+                 << " chunks" << endl;
+            m_chunkCapacity = newCapacity;
+        }
+        m_chunkBound += ROUND_CHUNKS;
+    }
+
+    // Move the heap insert list to the buckets
+    void insertBuckets() {
+        const int numInsert = NUM_TOTAL * 4;
+        kBucketCount<NUM_THREAD><<<
+            div_up(numInsert, NUM_THREAD), NUM_THREAD>>>(
+                *d->heapInsertList,
+                *d->heapInsertSize,
+                *d->insertPos,
+                *d->buckets,
+                *d->status
+            );
+        kBucketReserve<<<1, NUM_BUCKET>>>(
+            *d->buckets,
+            *d->chunkPrev,
+            *d->freeChunks,
+            *d->roundChunks,
+            *d->bucketCount,
+            *d->status
+        );
+        kBucketScatter<NUM_THREAD><<<
+            div_up(numInsert, NUM_THREAD), NUM_THREAD>>>(
+                *d->heapInsertList,
+                *d->heapInsertSize,
+                *d->insertPos,
+                *d->buckets,
+                *d->roundChunks,
+                *d->bucketPool,
+                *d->status
+            );
+    }
+
+    // Stage the NUM_TOTAL best entries of the buckets, one per heap
+    void stageBuckets() {
+        kBucketSelect<<<1, NUM_BUCKET>>>(
+            *d->buckets,
+            NUM_TOTAL,
+            *d->bucketCount,
+            *d->status
+        );
+        kBucketStage<NUM_THREAD><<<NUM_BLOCK, NUM_THREAD>>>(
+            *d->buckets,
+            *d->chunkPrev,
+            *d->bucketPool,
+            *d->bucketCount,
+            *d->openList,
+            *d->heapSize,
+            *d->status
+        );
+        kBucketRelease<<<1, NUM_BUCKET>>>(
+            *d->buckets,
+            *d->chunkPrev,
+            *d->freeChunks,
+            *d->bucketCount,
+            *d->status
+        );
+    }
+
+    int maxHeapSize() {
+        vector<int> heapSize;
+        d->heapSize->ToHost(heapSize, NUM_TOTAL);
+        return *std::max_element(heapSize.begin(), heapSize.end());
+    }
+
+    // Make room for the next round within --memory-limit.  The open list is
+    // halved until the nodes it leads back to fit in half of the arena and
+    // every heap has room for a round, then those nodes are compacted to the
+    // front of the arena and indexed again.
+    void prune() {
+        const int nodeGrowth = NUM_TOTAL * 4;
+        const int heapGrowth = 4;
+        int nodeSize = d->nodeSize->Value();
+
+        int liveSize;
+        for (;;) {
+            if (!pruneHeaps())
+                outOfDeviceMemory("node list (--memory-limit)",
+                                  m_nodeCapacity);
+            cudaMemset(d->mark->get(), 0, sizeof(uint32_t) * nodeSize);
+            cudaMemset(d->liveSize->get(), 0, sizeof(int));
+            kMarkLive<node_t<N>, heap_t, NUM_THREAD><<<NUM_BLOCK, NUM_THREAD>>>(
+                *d->nodes,
+                *d->openList,
+                *d->heapSize,
+                m_heapCapacity,
+                NUM_TOTAL,
+                *d->solution,
+                *d->mark,
+                *d->liveSize
+            );
+            liveSize = d->liveSize->Value();
+            m_heapBound = maxHeapSize();
+            if (liveSize <= m_nodeCapacity / 2 &&
+                liveSize + nodeGrowth <= m_nodeCapacity &&
+                m_heapBound + heapGrowth <= m_heapCapacity)
+                break;
+        }
+
+        cudaMemset(d->liveSize->get(), 0, sizeof(int));
+        kAssignLive<NUM_THREAD><<<
+            div_up(nodeSize, NUM_THREAD), NUM_THREAD>>>(
+                *d->mark,
+                nodeSize,
+                *d->liveSize
+            );
+        MGPU_MEM(node_t<N>) compacted =
+            d->context->template Malloc< node_t<N> >(max(liveSize, 1));
+        kCompactNodes<node_t<N>, NUM_THREAD><<<
+            div_up(nodeSize, NUM_THREAD), NUM_THREAD>>>(
+                *d->nodes,
+                nodeSize,
+                *d->mark,
+                *compacted
+            );
+        cudaMemcpy(d->nodes->get(), compacted->get(),
+                   sizeof(node_t<N>) * liveSize, cudaMemcpyDeviceToDevice);
+        compacted = MGPU_MEM(node_t<N>)();
+        kRemapHeaps<heap_t, NUM_THREAD><<<NUM_BLOCK, NUM_THREAD>>>(
+            *d->openList,
+            *d->heapSize,
+            m_heapCapacity,
+            NUM_TOTAL,
+            *d->mark,
+            *d->solution
+        );
+
+        cudaMemset(d->hash->get(), 0xFF,
+                   sizeof(uint32_t) * ((size_t)m_hashMask + 1));
+        kRehash<N, NUM_THREAD><<<
+            div_up(liveSize, NUM_THREAD), NUM_THREAD>>>(
+                *d->nodes,
+                liveSize,
+                *d->hash,
+                m_hashMask,
+                *d->hashFull
+            );
+        d->nodeSize->FromHost(&liveSize, 1);
+        m_nodeBound = liveSize;
+        ++m_numPrune;
+        dout << "\t\tPruned the open list, " << liveSize << " of "
+             << nodeSize << " nodes kept" << endl;
+    }
+
+    // Drop the worse half of the open list, return false if nothing can go
+    bool pruneHeaps() {
+        // the fValues are integers, so every one of them is its own bin and
+        // the ones past the last bin (with --weight) share it
+        const float low = 0, scale = 1;
+        cudaMemset(d->histogram->get(), 0, sizeof(int) * PRUNE_BINS);
+        kHeapHistogram<heap_t, NUM_THREAD><<<NUM_BLOCK, NUM_THREAD>>>(
+            *d->openList,
+            *d->heapSize,
+            m_heapCapacity,
+            NUM_TOTAL,
+            low,
+            scale,
+            *d->histogram
+        );
+        vector<int> histogram;
+        d->histogram->ToHost(histogram, PRUNE_BINS);
+
+        int64_t dropped;
+        int cut = pruneCut(histogram, &dropped);
+        if (!dropped)
+            return false;
+        kPruneHeaps<heap_t, NUM_THREAD><<<NUM_BLOCK, NUM_THREAD>>>(
+            *d->openList,
+            *d->heapSize,
+            m_heapCapacity,
+            NUM_TOTAL,
+            low,
+            scale,
+            cut,
+            *d->pruned
+        );
+        return true;
+    }
+
+    // Double the node arena and rebuild a hash table twice as large
+    void growNodes(int64_t required) {
+        int64_t newCapacity = 2 * (int64_t)m_nodeCapacity;
+        if (newCapacity < required || newCapacity > maxNodeListSize() ||
+            !growBuffer(*d->context, d->nodes, m_nodeBound, newCapacity))
+            outOfDeviceMemory("node list", m_nodeCapacity);
+        m_nodeCapacity = newCapacity;
+        rebuildHash(m_nodeBound);
+        dout << "\t\tNode list grows to " << m_nodeCapacity << endl;
+    }
+
+    // The probes of a state ran out, the nodes they left out of the table
+    // are indexed again in a table twice as large, or in the one of the
+    // pruned arena under --memory-limit
+    void growHash() {
+        if (m_bounded) {
+            prune();
+        } else {
+            rebuildHash(d->nodeSize->Value());
+            dout << "\t\tHash table grows to " << (size_t)m_hashMask + 1
+                 << " slots" << endl;
+        }
+        m_hashFull = d->hashFull->Value();
+    }
+
+    // Index the `nodeSize' nodes of the arena in a table twice as large
+    void rebuildHash(int nodeSize) {
+        size_t hashSize = 2 * ((size_t)m_hashMask + 1);
+        // drop the old table first, it is rebuilt from the arena anyway
+        d->hash = MGPU_MEM(uint32_t)();
+        if (sizeof(uint32_t) * hashSize > freeDeviceMemory())
+            outOfDeviceMemory("node list", m_nodeCapacity);
+        d->hash = d->context->template Fill<uint32_t>(hashSize, UINT32_MAX);
+        m_hashMask = hashSize - 1;
+
+        kRehash<N, NUM_THREAD><<<
+            div_up(nodeSize, NUM_THREAD), NUM_THREAD>>>(
+                *d->nodes,
+                nodeSize,
+                *d->hash,
+                m_hashMask,
+                *d->hashFull
+            );
+    }
+
+    // the parent references of a shard keep SHARD_SHIFT bits for the address
+    int maxNodeListSize() const {
+        return m_numShard > 1 ? (int)SHARD_ADDR_MASK : MAX_NODE_LIST_SIZE;
+    }
+
+    friend class GPUShardedPuzzleSolver<N>;
+
+    // The phases of a round of the shard: extract, expand and fill the
+    // outboxes, read the minimum extracted, the best solution and the outbox
+    // sizes back, and insert the `received' successors of the inbox
+    void shardExpand() {
+        cudaSetDevice(m_ordinal);
+        reserveRound();
+        limitBand();
+        kShardExtractExpand<
+            N, NUM_BLOCK, NUM_THREAD> <<<
+            NUM_BLOCK, NUM_THREAD>>>(
+                *d->database,
+
+                *d->nodes,
+
+                *d->openList,
+                *d->heapSize,
+                m_heapCapacity,
+
+                *d->optimalStep,
+                *d->solution,
+
+                m_shard,
+                m_numShard,
+
+                *d->outList,
+                NUM_TOTAL * 4,
+                *d->outSize,
+
+                // reset them BTW
+                *d->heapBeginIndex,
+                *d->heapInsertSize
+            );
+    }
+
+    void shardPoll(uint32_t *optimalStep, unsigned long long *solution,
+                   vector<int> *outSize) {
+        cudaSetDevice(m_ordinal);
+        *optimalStep = d->optimalStep->Value();
+        *solution = d->solution->Value();
+        d->outSize->ToHost(*outSize, m_numShard);
+        cudaMemset(d->optimalStep->get(), 0xFF, sizeof(uint32_t));
+        cudaMemset(d->outSize->get(), 0, sizeof(int) * m_numShard);
+        // the probes of the last kShardInsert that ran out
+        if (d->hashFull->Value() > m_hashFull)
+            growHash();
+    }
+
+    void shardInsert(int received) {
+        cudaSetDevice(m_ordinal);
+        if (received) {
+            kShardInsert<N, NUM_THREAD><<<
+                div_up(received, NUM_THREAD), NUM_THREAD>>>(
+                    *d->nodes,
+                    *d->nodeSize,
+
+                    *d->hash,
+                    m_hashMask,
+                    *d->hashFull,
+
+                    *d->inList,
+                    received,
+
+                    *d->heapInsertList,
+                    *d->heapInsertSize
+                );
+        }
+        kHeapInsert<
+            N, NUM_BLOCK, NUM_THREAD> <<<
+            NUM_BLOCK, NUM_THREAD>>> (
+                *d->openList,
+                *d->heapSize,
+                m_heapCapacity,
+                *d->heapBeginIndex,
+
+                *d->heapInsertList,
+                *d->heapInsertSize,
+
+                *d->status
+            );
+    }
+
+    // Append the states on the path back from the node at `addr' as long as
+    // it stays on this shard, return the reference to the rest of it
+    uint32_t shardFetch(uint32_t addr, vector< PuzzleStorage<N> > *path) {
+        cudaSetDevice(m_ordinal);
+        kShardFetchStates<N><<<1, 1>>>(
+            *d->nodes,
+            addr,
+            m_shard,
+            *d->pathStates,
+            *d->answerSize,
+            *d->pathNext
+        );
+        vector< PuzzleStorage<N> > states;
+        d->pathStates->ToHost(states, d->answerSize->Value());
+        path->insert(path->end(), states.begin(), states.end());
+        return d->pathNext->Value();
+    }
+
     Puzzle *p;
     DeviceData<N> *d;
     uint32_t m_optimalNodeAddr;
     uint32_t m_optimalStep;
+    // allocated entries and host side upper bounds of the used ones
+    int m_nodeCapacity;
+    int m_nodeBound;
+    int m_heapCapacity;
+    int m_heapBound;
+    uint32_t m_hashMask;
+    // the probes that ran out, as of the last growHash()
+    int m_hashFull;
+    // free device memory before the first allocation
+    size_t m_freeMemory;
+    // --memory-limit is set, prune instead of growing the buffers
+    bool m_bounded;
+    int m_numPrune;
+    float m_weight;
+    // --f-band, negative to extract every heap
+    float m_fBand;
+    // --open-list=buckets, with the chunks of the pool allocated and a host
+    // side upper bound of the ones in use
+    bool m_buckets;
+    int m_chunkCapacity;
+    int m_chunkBound;
+    // the device, and the share of the states it owns, see GPU-shard.cuh
+    int m_ordinal;
+    int m_shard;
+    int m_numShard;
+};
+
+// Solve the puzzle on all the devices of --devices at once, each of them
+// owning the states of a range of hash values (see GPU-shard.cuh)
+template<int N>
+class GPUShardedPuzzleSolver {
+public:
+    GPUShardedPuzzleSolver(Puzzle *puzzle)
+        : p(puzzle), m_ordinals(deviceOrdinals()), m_optimalShard(0) { }
+    ~GPUShardedPuzzleSolver() {
+        for (int i = 0; i < (int)m_shards.size(); ++i)
+            delete m_shards[i];
+    }
+
+    int numShard() const {
+        return m_ordinals.size();
+    }
+
+    void initialize() {
+        int numShard = m_ordinals.size();
+        for (int i = 0; i < numShard; ++i) {
+            m_shards.push_back(new GPUPuzzleSolver<N>(p));
+            m_shards[i]->initializeShard(m_ordinals[i], i, numShard);
+        }
+        enablePeerAccess(m_ordinals);
+        dout << "\t\tSharded over " << numShard << " devices" << endl;
+    }
+
+    void setWeight(float weight) {
+        for (int i = 0; i < (int)m_shards.size(); ++i)
+            m_shards[i]->setWeight(weight);
+    }
+
+    void restart() {
+        for (int i = 0; i < (int)m_shards.size(); ++i)
+            m_shards[i]->restart();
+    }
+
+    // The host takes the place of kCheckTermination: the minimum fValue
+    // extracted and the best solution are reduced over the shards every
+    // round, before the outboxes are exchanged.
+    bool solve() {
+        int numShard = m_shards.size();
+        vector< vector<int> > outSize(numShard);
+        unsigned long long best = ULLONG_MAX;
+
+        for (int round = 0; ; ++round) {
+            dprintf("\t\tRound %d: shardExpand\n", round);
+            for (int i = 0; i < numShard; ++i)
+                m_shards[i]->shardExpand();
+
+            uint32_t optimalStep = UINT32_MAX;
+            for (int i = 0; i < numShard; ++i) {
+                uint32_t step;
+                unsigned long long solution;
+                m_shards[i]->shardPoll(&step, &solution, &outSize[i]);
+                optimalStep = min(optimalStep, step);
+                if (solution < best) {
+                    best = solution;
+                    m_optimalShard = i;
+                }
+            }
+            if (best != ULLONG_MAX && (uint32_t)(best >> 32) <= optimalStep)
+                break;
+            if (optimalStep == UINT32_MAX)
+                return false;
+
+            dprintf("\t\tRound %d: exchange\n", round);
+            for (int i = 0; i < numShard; ++i) {
+                GPUPuzzleSolver<N> *to = m_shards[i];
+                int received = 0;
+                for (int j = 0; j < numShard; ++j) {
+                    GPUPuzzleSolver<N> *from = m_shards[j];
+                    peerCopy(to->d->inList->get() + received, to->m_ordinal,
+                             from->d->outList->get() + NUM_TOTAL * 4 * i,
+                             from->m_ordinal, outSize[j][i]);
+                    received += outSize[j][i];
+                }
+                to->shardInsert(received);
+            }
+        }
+
+        long long nodeSize = 0;
+        for (int i = 0; i < numShard; ++i) {
+            cudaSetDevice(m_ordinals[i]);
+            nodeSize += m_shards[i]->d->nodeSize->Value();
+            recordDeviceMemory("gpu", *m_shards[i]->d->context);
+        }
+        printf("\t\t\t Number of nodes expanded: %lld\n", nodeSize);
+        metrics.counter("gpu", "expanded", nodeSize);
+        m_optimalNodeAddr = best & UINT32_MAX;
+        m_optimalStep = best >> 32;
+        dprintf("\t\t\t Optimal nodes address: %d on shard %d\n",
+                m_optimalNodeAddr, m_optimalShard);
+        return true;
+    }
+
+    void getSolution(int *optimal, vector<int> *pathList) {
+        // the states from the solution back to the initial one
+        vector< PuzzleStorage<N> > states;
+        uint32_t ref = shardRef(m_optimalShard, m_optimalNodeAddr);
+        while (ref != UINT32_MAX)
+            ref = m_shards[refShard(ref)]->shardFetch(refAddr(ref), &states);
+
+        *optimal = m_optimalStep;
+        pathList->clear();
+        for (int k = (int)states.size() - 1; k > 0; --k) {
+            uint8_t conf[N][N];
+            int px, py, cx, cy;
+            states[k].decompose(conf);
+            getEmptyTile<N>(conf, &px, &py);
+            states[k-1].decompose(conf);
+            getEmptyTile<N>(conf, &cx, &cy);
+            for (int i = 0; i < 4; ++i)
+                if (px + DX[i] == cx && py + DY[i] == cy)
+                    pathList->push_back(i);
+        }
+    }
+
+private:
+    Puzzle *p;
+    vector<int> m_ordinals;
+    vector< GPUPuzzleSolver<N> * > m_shards;
+    // shard and address of the solution
+    int m_optimalShard;
+    uint32_t m_optimalNodeAddr;
+    uint32_t m_optimalStep;
 };
 
 }
@@ -1,13 +1,63 @@
 #include "puzzle/database.hpp"
-#include "boost/dynamic_bitset.hpp"
 #include "boost/filesystem.hpp"
 
-#include <queue>
-#include <bitset>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char PDB_MAGIC[4] = { 'U', 'P', 'D', 'B' };
+const uint32_t PDB_VERSION = 1;
+
+// The breadth first search keeps 2 bits per state in 64-bit words
+enum {
+    STATE_UNVISITED = 0,
+    STATE_CLOSED = 1,
+    STATE_FRONTIER = 2,
+    STATE_NEXT = 3,
+};
+const uint64_t LOW_BITS = 0x5555555555555555ULL;
+const int STATES_PER_WORD = 32;
+// words handed to a thread at once
+const size_t CHUNK_WORDS = 4096;
+
+// Run f(begin, end) over [0, count) in chunks, on all the cores
+template<typename F>
+static void parallelFor(size_t count, F f)
+{
+    int numThread = max(1u, std::thread::hardware_concurrency());
+    std::atomic<size_t> next(0);
+    vector<std::thread> threads;
+    for (int i = 0; i < numThread; ++i)
+        threads.emplace_back([&]() {
+            size_t begin;
+            while ((begin = next.fetch_add(CHUNK_WORDS)) < count)
+                f(begin, min(begin + CHUNK_WORDS, count));
+        });
+    for (auto &thread : threads)
+        thread.join();
+}
 
 PatternDatabase::PatternDatabase(int n, const vector<int> &tracked)
     : n(n), m_tracked(tracked)
 {
+    string format = vm_options["pdb-format"].as<string>();
+    if (format == "nibbles") {
+        m_format = PDB_NIBBLES;
+    } else if (format == "bytes") {
+        m_format = PDB_BYTES;
+    } else {
+        cout << "Please set your pdb-format parameter correctly." << endl
+            << "===============================================" << endl
+            << endl;
+        help();
+    }
+
     m_size = 1;
     m_map.resize(n*n);
     m_multiple.reserve(tracked.size()+1);
@@ -34,117 +84,334 @@ size_t PatternDatabase::size()
     return m_size;
 }
 
+size_t PatternDatabase::bytes()
+{
+    return m_format == PDB_NIBBLES ? (m_size + 1) / 2 : m_size;
+}
+
+int PatternDatabase::format() const
+{
+    return m_format;
+}
+
+const vector<uint32_t> &PatternDatabase::multiple() const
+{
+    return m_multiple;
+}
+
+// manhattan distance of the tracked tiles of `conf' to their goal
+static int manhattan(int n, const uint8_t conf[])
+{
+    int md = 0;
+    for (int i = 0; i < n*n; ++i)
+        if (conf[i])
+            md += abs(i / n - (conf[i] - 1) / n) +
+                  abs(i % n - (conf[i] - 1) % n);
+    return md;
+}
+
+// Move every tracked tile of `conf' to the neighbouring free cells, and add
+// the unvisited results to the next frontier.  Return how many were added.
+// With `residual', (depth - manhattan distance) / 2 is stored instead of the
+// depth, `md' being the distance of `conf'.
+static size_t expand(
+    const PatternDatabase &pd, int n, uint8_t conf[], int md, bool residual,
+    std::atomic<uint64_t> mark[], uint8_t out[], int depth)
+{
+    size_t found = 0;
+    for (int x = 0; x < n; ++x)
+        for (int y = 0; y < n; ++y) {
+            int id = x * n + y;
+            if (!conf[id])
+                continue;
+            for (int k = 0; k < 4; ++k) {
+                int nx = x + DX[k];
+                int ny = y + DY[k];
+                int nid = nx * n + ny;
+                if (nx < 0 || nx >= n || ny < 0 || ny >= n || conf[nid] != 0)
+                    continue;
+                int gx = (conf[id] - 1) / n;
+                int gy = (conf[id] - 1) % n;
+                int nmd = md + abs(nx - gx) + abs(ny - gy)
+                    - abs(x - gx) - abs(y - gy);
+
+                std::swap(conf[id], conf[nid]);
+                uint32_t ncode = pd.encoding(conf);
+                std::swap(conf[id], conf[nid]);
+
+                std::atomic<uint64_t> &word = mark[ncode / STATES_PER_WORD];
+                int shift = ncode % STATES_PER_WORD * 2;
+                uint64_t old = word.load(std::memory_order_relaxed);
+                while ((old >> shift & 3) == STATE_UNVISITED) {
+                    if (word.compare_exchange_weak(
+                            old, old | (uint64_t)STATE_NEXT << shift,
+                            std::memory_order_relaxed)) {
+                        out[ncode] = residual ? (depth - nmd) / 2 : depth;
+                        ++found;
+                        break;
+                    }
+                }
+            }
+        }
+    return found;
+}
+
+// Level synchronous BFS.  A state is unvisited, closed, in the frontier or
+// in the next frontier.  All the threads expand the frontier of a level at
+// once, and a state joins the next frontier through a CAS on its word, so
+// its distance in `out' has a single writer.
 void PatternDatabase::genDatabase(uint8_t out[])
 {
-    uint8_t conf[MAX_CONF];
-    std::queue<uint32_t> q;
-    boost::dynamic_bitset<> visited(size());
+    generate(out, false);
+}
 
-    memset(conf, 0, sizeof(conf));
-    memset(out, 0xFF, m_size);
+void PatternDatabase::generate(uint8_t out[], bool residual)
+{
+    size_t numWord = (m_size + STATES_PER_WORD - 1) / STATES_PER_WORD;
+    std::unique_ptr<std::atomic<uint64_t>[]> mark(
+        new std::atomic<uint64_t>[numWord]);
+    parallelFor(numWord, [&](size_t begin, size_t end) {
+        for (size_t w = begin; w < end; ++w)
+            mark[w].store(0, std::memory_order_relaxed);
+        memset(out + begin * STATES_PER_WORD, 0xFF,
+               min(end * STATES_PER_WORD, m_size) - begin * STATES_PER_WORD);
+    });
 
+    uint8_t conf[MAX_CONF];
+    memset(conf, 0, sizeof(conf));
     for (int v : m_tracked)
         conf[v-1] = v;
     uint32_t code = encoding(conf);
-    q.push(code);
     out[code] = 0;
-    visited[code] = 1;
-
-    int count = 1;
-    while (!q.empty()) {
-        uint32_t code = q.front(); q.pop();
-        decoding(code, conf);
-        for (int x = 0; x < n; ++x)
-            for (int y = 0; y < n; ++y) {
-                int id = tileID(x, y);
-                if (conf[id]) {
-                    for (int k = 0; k < 4; ++k) {
-                        int nx = x + DX[k];
-                        int ny = y + DY[k];
-                        int nid = tileID(nx, ny);
-                        if (inrange(nx, ny) && conf[nid] == 0) {
-                            std::swap(conf[id], conf[nid]);
-                            uint32_t ncode = encoding(conf);
-                            if (!visited[ncode]) {
-                                visited[ncode] = 1;
-                                q.push(ncode);
-                                out[ncode] = out[code] + 1;
-                                ++count;
-                                if (count % 10000000 == 0)
-                                    cout << "\t"
-                                         << count/1024/1024 << "M/"
-                                         << m_size/1024/1024 << "M" << endl;
-                            }
-                            std::swap(conf[id], conf[nid]);
-                        }
-                    }
+    mark[code / STATES_PER_WORD] =
+        (uint64_t)STATE_FRONTIER << code % STATES_PER_WORD * 2;
+
+    size_t count = 1;
+    size_t found;
+    for (int depth = 0; ; ++depth) {
+        std::atomic<size_t> numFound(0);
+        parallelFor(numWord, [&](size_t begin, size_t end) {
+            uint8_t conf[MAX_CONF];
+            size_t localFound = 0;
+            for (size_t w = begin; w < end; ++w) {
+                // only STATE_NEXT is written during a level, so the frontier
+                // lanes of the word do not move
+                uint64_t word = mark[w].load(std::memory_order_relaxed);
+                uint64_t frontier = word & ~(word << 1) & (LOW_BITS << 1);
+                while (frontier) {
+                    int lane = __builtin_ctzll(frontier) / 2;
+                    frontier &= frontier - 1;
+                    uint32_t code = w * STATES_PER_WORD + lane;
+                    decoding(code, conf);
+                    int md = residual ? manhattan(n, conf) : 0;
+                    localFound += expand(*this, n, conf, md, residual,
+                                         mark.get(), out, depth + 1);
                 }
             }
+            numFound += localFound;
+        });
+        found = numFound;
+        if (found == 0)
+            break;
+        count += found;
+        if (m_size >= 10000000)
+            cout << "\t" << count/1024/1024 << "M/"
+                 << m_size/1024/1024 << "M" << endl;
+
+        // closed <- frontier <- next frontier
+        parallelFor(numWord, [&](size_t begin, size_t end) {
+            for (size_t w = begin; w < end; ++w) {
+                uint64_t word = mark[w].load(std::memory_order_relaxed);
+                uint64_t high = word >> 1 & LOW_BITS;
+                uint64_t low = word & LOW_BITS;
+                mark[w].store((high & low) << 1 | (high ^ low),
+                              std::memory_order_relaxed);
+            }
+        });
+    }
+}
+
+static uint64_t checksum(const uint8_t data[], size_t bytes)
+{
+    // FNV-1a over 64-bit words, then over the tail bytes
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 1099511628211ULL;
     }
+    for (; i < bytes; ++i)
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    return hash;
 }
 
-void PatternDatabase::fetchDatabase(uint8_t out[])
+size_t packNibbles(const uint8_t values[], size_t count, uint8_t out[])
+{
+    memset(out, 0, (count + 1) / 2);
+    size_t saturated = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t v = values[i] == 0xFF ? 0 : values[i];
+        if (v > 15) {
+            v = 15;
+            ++saturated;
+        }
+        out[i / 2] |= v << (i % 2 * 4);
+    }
+    return saturated;
+}
+
+// A mapped database file, kept until the process exits
+struct mapping_t {
+    const uint8_t *base;
+    size_t length;
+};
+
+static std::mutex registryMutex;
+static std::map<string, mapping_t> registry;
+
+// Map `filename' and check its header, return NULL if it does not match
+static const uint8_t *mapDatabase(
+    const string &filename, const pdb_header_t &expected, size_t bytes)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    size_t length = sizeof(pdb_header_t) + bytes;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != length) {
+        close(fd);
+        return NULL;
+    }
+    void *base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    pdb_header_t header;
+    memcpy(&header, base, sizeof(header));
+    const uint8_t *payload = (const uint8_t *)base + sizeof(header);
+    if (memcmp(header.magic, expected.magic, sizeof(header.magic)) ||
+        header.version != expected.version ||
+        header.n != expected.n ||
+        header.format != expected.format ||
+        header.numTracked != expected.numTracked ||
+        memcmp(header.tracked, expected.tracked, sizeof(header.tracked)) ||
+        header.size != expected.size ||
+        header.checksum != checksum(payload, bytes)) {
+        munmap(base, length);
+        return NULL;
+    }
+
+    registry[filename] = mapping_t{(const uint8_t *)base, length};
+    return payload;
+}
+
+const uint8_t *PatternDatabase::fetchDatabase()
 {
     string filename = "database_" + std::to_string(n);
     for (int i = 0; i < (int)m_tracked.size(); ++i)
         filename += "_" + std::to_string(m_tracked[i]);
-    filename += ".bin";
+    filename += m_format == PDB_NIBBLES ? ".nib.pdb" : ".pdb";
 
-    if (boost::filesystem::exists(filename)) {
-        FILE *fin = fopen(filename.c_str(), "rb");
-        if (!fin) {
-            cout << "Cannot read file " << filename << endl;
-            exit(1);
-        }
-        size_t read = fread(out, 1, m_size, fin);
-        if (read != m_size) {
-            boost::filesystem::remove(filename);
-            cout << filename << "is not intact" << endl;
-            exit(1);
-        }
-        fclose(fin);
-    } else {
+    pdb_header_t expected;
+    memset(&expected, 0, sizeof(expected));
+    memcpy(expected.magic, PDB_MAGIC, sizeof(expected.magic));
+    expected.version = PDB_VERSION;
+    expected.n = n;
+    expected.format = m_format;
+    expected.numTracked = m_tracked.size();
+    for (int i = 0; i < (int)m_tracked.size(); ++i)
+        expected.tracked[i] = m_tracked[i];
+    expected.size = m_size;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = registry.find(filename);
+    if (it != registry.end())
+        return it->second.base + sizeof(pdb_header_t);
+
+    const uint8_t *payload = mapDatabase(filename, expected, bytes());
+    if (!payload) {
+        if (boost::filesystem::exists(filename))
+            cout << "\t" << filename << " is stale or not intact" << endl;
         cout << "\tGenerating pattern databse" << endl;
-        genDatabase(out);
-        FILE *fout = fopen(filename.c_str(), "wb");
-        if (!fout) {
-            cout << "Cannot write to file " << filename << endl;
-            exit(1);
-        }
-        size_t write = fwrite(out, 1, m_size, fout);
-        if (write != m_size) {
-            boost::filesystem::remove(filename);
-            cout << filename << "cannot be written (disk is full?)" << endl;
-            exit(1);
-        }
-        fclose(fout);
+        writeDatabase(filename);
+        payload = mapDatabase(filename, expected, bytes());
+    }
+    if (!payload) {
+        cout << "Cannot map file " << filename << endl;
+        exit(1);
+    }
+    return payload;
+}
+
+// Generate the database and write it through a temporary file, so that a
+// concurrent process never maps half of it
+void PatternDatabase::writeDatabase(const string &filename)
+{
+    vector<uint8_t> out(m_size);
+    generate(out.data(), m_format == PDB_NIBBLES);
+
+    vector<uint8_t> payload;
+    if (m_format == PDB_NIBBLES) {
+        payload.resize(bytes());
+        size_t saturated = packNibbles(out.data(), m_size, payload.data());
+        dout << "\t" << saturated << " states saturated" << endl;
+        vector<uint8_t>().swap(out);
+    } else {
+        payload.swap(out);
+    }
+
+    pdb_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PDB_MAGIC, sizeof(header.magic));
+    header.version = PDB_VERSION;
+    header.n = n;
+    header.format = m_format;
+    header.numTracked = m_tracked.size();
+    for (int i = 0; i < (int)m_tracked.size(); ++i)
+        header.tracked[i] = m_tracked[i];
+    header.size = m_size;
+    header.checksum = checksum(payload.data(), payload.size());
+
+    string temporary = filename + "." + std::to_string(getpid()) + ".tmp";
+    FILE *fout = fopen(temporary.c_str(), "wb");
+    if (!fout) {
+        cout << "Cannot write to file " << temporary << endl;
+        exit(1);
+    }
+    if (fwrite(&header, sizeof(header), 1, fout) != 1 ||
+        fwrite(payload.data(), 1, payload.size(), fout) != payload.size() ||
+        fclose(fout) != 0) {
+        boost::filesystem::remove(temporary);
+        cout << filename << " cannot be written (disk is full?)" << endl;
+        exit(1);
     }
+    boost::filesystem::rename(temporary, filename);
 }
 
-bool PatternDatabase::inrange(int x, int y)
+bool PatternDatabase::inrange(int x, int y) const
 {
     return 0 <= x && x < n && 0 <= y && y < n;
 }
 
-int PatternDatabase::tileID(int x, int y)
+int PatternDatabase::tileID(int x, int y) const
 {
     return x * n + y;
 }
 
-void PatternDatabase::tileXY(int id, int *x, int *y)
+void PatternDatabase::tileXY(int id, int *x, int *y) const
 {
     *x = id / n;
     *y = id % n;
 }
 
-uint32_t PatternDatabase::encoding(const uint8_t in[])
+uint32_t PatternDatabase::encoding(const uint8_t in[]) const
 {
-    static vector<uint8_t> index, vrank;
-
-    if (index.size() != m_tracked.size()) {
-        index.resize(m_tracked.size());
-        vrank.resize(m_tracked.size());
-    }
+    int size = m_tracked.size();
+    uint8_t index[MAX_CONF];
+    uint8_t vrank[MAX_CONF];
 
     uint32_t retn = 0;
     int nn = n*n;
@@ -152,34 +419,30 @@ uint32_t PatternDatabase::encoding(const uint8_t in[])
         if (in[i]) {
             index[m_map[in[i]]] = i;
         }
-    copy(index.begin(), index.end(), vrank.begin());
-    for (int i = 0; i < (int)index.size(); ++i)
-        for (int j = i+1; j < (int)index.size(); ++j)
+    std::copy(index, index + size, vrank);
+    for (int i = 0; i < size; ++i)
+        for (int j = i+1; j < size; ++j)
             if (index[i] < index[j])
                 --vrank[j];
-    for (int i = 0; i < (int)vrank.size(); ++i)
+    for (int i = 0; i < size; ++i)
         retn += vrank[i] * m_multiple[i+1];
     return retn;
 }
 
-void PatternDatabase::decoding(uint32_t code, uint8_t out[])
+void PatternDatabase::decoding(uint32_t code, uint8_t out[]) const
 {
-    static vector<uint8_t> value;
-    static vector<bool> used;
-
-    if (value.size() != m_tracked.size())
-        value.resize(m_tracked.size());
-    if ((int)used.size() != n*n)
-        used.resize(n*n);
+    int size = m_tracked.size();
+    uint8_t value[MAX_CONF];
+    bool used[MAX_CONF];
 
-    used.assign(n*n, false);
+    std::fill(used, used + n*n, false);
 
-    for (int i = 0; i < (int)m_tracked.size(); ++i) {
+    for (int i = 0; i < size; ++i) {
         value[i] = code / m_multiple[i+1];
         code %= m_multiple[i+1];
     }
 
-    for (int i = 0; i < (int)m_tracked.size(); ++i) {
+    for (int i = 0; i < size; ++i) {
         int cnt = 0;
         while (used[cnt])
             ++cnt;
@@ -193,7 +456,7 @@ void PatternDatabase::decoding(uint32_t code, uint8_t out[])
     }
 
     memset(out, 0, n*n);
-    for (int i = 0; i < (int)value.size(); ++i) {
+    for (int i = 0; i < size; ++i) {
         out[value[i]] = m_tracked[i];
     }
 }
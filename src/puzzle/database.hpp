@@ -5,25 +5,75 @@
 
 const int MAX_CONF = 5*5+1;
 
+// Storage formats of a database, chosen by --pdb-format
+enum {
+    // one byte per state
+    PDB_BYTES = 0,
+    // Two states per byte, the low nibble first.  A nibble holds
+    // (value - manhattan distance of the tracked tiles) / 2, which is exact
+    // since every move changes the manhattan distance by one, and saturates
+    // at 15, which keeps the heuristic admissible.
+    PDB_NIBBLES = 1,
+};
+
+// Pack the PDB_NIBBLES values of `count' states (0xFF for the unreachable
+// ones, never looked up) into the (count + 1) / 2 bytes of `out', return how
+// many of them saturated
+size_t packNibbles(const uint8_t values[], size_t count, uint8_t out[]);
+
+// entry `code' of a PDB_NIBBLES payload
+inline __cuda__ int pdbNibble(const uint8_t payload[], uint32_t code)
+{
+    return payload[code >> 1] >> (code & 1) * 4 & 15;
+}
+
+// Header of a database file, followed by the payload
+struct pdb_header_t {
+    char magic[4];
+    uint32_t version;
+    uint32_t n;
+    uint32_t format;
+    uint32_t numTracked;
+    uint8_t tracked[28];
+    uint64_t size;
+    uint64_t checksum;
+};
+
 // Disjoint pattern databse generator
 class PatternDatabase {
 public:
     PatternDatabase(int n, const vector<int> &tracked);
     virtual ~PatternDatabase();
 
+    // number of states
     size_t size();
+    // number of bytes of the payload in format()
+    size_t bytes();
+    int format() const;
+    // code = sum of the rank of tracked tile i times multiple()[i+1]
+    const vector<uint32_t> &multiple() const;
+
+    // parallel breadth first search on all the cores
     void genDatabase(uint8_t out[]);
-    void fetchDatabase(uint8_t out[]);
+    // Map the database file read-only and return its payload, generating
+    // the file first when it is missing or does not match its header.  The
+    // mapping is shared by every database of the process and lives until the
+    // process exits, while the page cache is shared between processes.
+    const uint8_t *fetchDatabase();
 
-    uint32_t encoding(const uint8_t in[]);
-    void decoding(uint32_t code, uint8_t out[]);
+    // thread-safe
+    uint32_t encoding(const uint8_t in[]) const;
+    void decoding(uint32_t code, uint8_t out[]) const;
 
 private:
-    bool inrange(int x, int y);
-    int tileID(int x, int y);
-    void tileXY(int id, int *x, int *y);
+    void generate(uint8_t out[], bool residual);
+    void writeDatabase(const string &filename);
+    bool inrange(int x, int y) const;
+    int tileID(int x, int y) const;
+    void tileXY(int id, int *x, int *y) const;
 
     int n;
+    int m_format;
     size_t m_size;
     vector<int> m_tracked;
     vector<int> m_map;  // from number to position in m_tracked
@@ -0,0 +1,131 @@
+#ifndef __HEURISTIC_HPP_T5MW3QJA
+#define __HEURISTIC_HPP_T5MW3QJA
+
+#include "puzzle/database.hpp"
+#include "puzzle/partition.hpp"
+
+namespace cpusolver {
+
+// Pattern database heuristic of the CPU solvers, see partition.hpp.
+// computeHValue() only reads the databases, so one instance is shared by all
+// the threads.
+template<int N>
+class PuzzleHeuristic {
+public:
+    void initialize() {
+        vector< vector<int> > tracked;
+        initializeLayout(N, &layout, &tracked);
+
+        database.resize(tracked.size());
+        for (int i = 0; i < (int)tracked.size(); ++i) {
+            PatternDatabase pd(N, tracked[i]);
+            database[i] = pd.fetchDatabase();
+            format = pd.format();
+        }
+    }
+
+    int computeHValue(const uint8_t conf[N][N]) const {
+        int position[2][N*N];
+        computePosition(conf, position);
+
+        int retn = 0;
+        for (int m = 0; m <= layout.mirror; ++m)
+            for (int p = 0; p < layout.numPartition; ++p) {
+                int sum = 0;
+                for (int k = layout.partitionBegin[p];
+                     k < layout.partitionBegin[p+1]; ++k)
+                    sum += computePatternHeuristic(position[m], k);
+                retn = max(retn, sum);
+            }
+
+        return retn;
+    }
+
+    // Same, and keep the value of every pattern in `values'
+    int computeHValue(const uint8_t conf[N][N], pdb_values_t *values) const {
+        if (!layout.incremental)
+            return computeHValue(conf);
+
+        int position[2][N*N];
+        computePosition(conf, position);
+        for (int m = 0; m <= layout.mirror; ++m)
+            for (int k = 0; k < layout.numPattern; ++k)
+                values->h[m * layout.numPattern + k] =
+                    computePatternHeuristic(position[m], k);
+        return combine(*values);
+    }
+
+    // `conf' is a successor of the state of `values', reached by moving
+    // `tile', so only the patterns tracking `tile' are looked up again
+    int updateHValue(
+        const uint8_t conf[N][N], int tile, pdb_values_t *values) const {
+        if (!layout.incremental)
+            return computeHValue(conf);
+
+        int position[2][N*N];
+        computePosition(conf, position);
+        for (int m = 0; m <= layout.mirror; ++m) {
+            int t = m ? mirrorTile(N, tile) : tile;
+            for (int p = 0; p < layout.numPartition; ++p) {
+                int k = layout.tilePattern[p][t];
+                if (k != -1)
+                    values->h[m * layout.numPattern + k] =
+                        computePatternHeuristic(position[m], k);
+            }
+        }
+        return combine(*values);
+    }
+
+private:
+    // cell of every tile, in the state and in its reflection
+    void computePosition(const uint8_t conf[N][N], int position[2][N*N]) const {
+        for (int i = 0; i < N; ++i)
+            for (int j = 0; j < N; ++j) {
+                position[0][conf[i][j]] = i*N + j;
+                position[1][mirrorTile(N, conf[i][j])] = j*N + i;
+            }
+    }
+
+    int combine(const pdb_values_t &values) const {
+        int retn = 0;
+        for (int m = 0; m <= layout.mirror; ++m)
+            for (int p = 0; p < layout.numPartition; ++p) {
+                int sum = 0;
+                for (int k = layout.partitionBegin[p];
+                     k < layout.partitionBegin[p+1]; ++k)
+                    sum += values.h[m * layout.numPattern + k];
+                retn = max(retn, sum);
+            }
+        return retn;
+    }
+
+    int computePatternHeuristic(const int position[], int k) const {
+        const uint8_t *t = layout.tile[k];
+        int code = 0;
+        int md = 0;
+        for (int i = 0; i < layout.patternSize[k]; ++i) {
+            // rank of the position among the ones not taken yet
+            int index = position[t[i]];
+            for (int j = 0; j < i; ++j)
+                if (position[t[j]] < position[t[i]])
+                    --index;
+            code += index * layout.multiple[k][i];
+            md += abs(position[t[i]] / N - (t[i] - 1) / N) +
+                  abs(position[t[i]] % N - (t[i] - 1) % N);
+        }
+
+        const uint8_t *db = database[layout.database[k]];
+        if (format == PDB_NIBBLES)
+            return md + 2 * pdbNibble(db, code);
+        return db[code];
+    }
+
+    pdb_layout_t layout;
+    int format;
+    // mapped by PatternDatabase::fetchDatabase(), one per tracked tile set
+    vector<const uint8_t *> database;
+};
+
+}
+
+#endif /* end of include guard: __HEURISTIC_HPP_T5MW3QJA */
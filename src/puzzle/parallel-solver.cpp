@@ -0,0 +1,196 @@
+#include "puzzle/parallel-solver.hpp"
+#include "puzzle/storage.hpp"
+#include "puzzle/heuristic.hpp"
+#include "hda-star.hpp"
+#include "metrics.hpp"
+
+namespace {
+
+// (-1, -1) when there is no empty tile
+template<int N>
+void getEmptyTile(const uint8_t conf[N][N], int *x, int *y)
+{
+    *x = *y = -1;
+    for (int i = 0; i < N; ++i)
+        for (int j = 0; j < N; ++j)
+            if (conf[i][j] == 0) {
+                *x = i;
+                *y = j;
+                return;
+            }
+}
+
+template<int N>
+struct PuzzleDomain {
+    typedef PuzzleStorage<N> state_t;
+    typedef int cost_t;
+    typedef BucketQueue<int> openlist_t;
+
+    const cpusolver::PuzzleHeuristic<N> *pdb;
+    PuzzleStorage<N> targetState;
+    float weight;
+
+    uint64_t hash(const PuzzleStorage<N> &ps) const {
+        return ps.hashValue();
+    }
+
+    int heuristic(const PuzzleStorage<N> &ps) const {
+        uint8_t conf[N][N];
+        ps.decompose(conf);
+        // truncated like the other solvers
+        return (int)(weight * pdb->computeHValue(conf));
+    }
+
+    bool isGoal(const PuzzleStorage<N> &ps) const {
+        return ps == targetState;
+    }
+
+    template<class Visitor>
+    void expand(const PuzzleStorage<N> &ps, Visitor visit) const {
+        uint8_t conf[N][N];
+        ps.decompose(conf);
+        int x, y;
+        getEmptyTile<N>(conf, &x, &y);
+        for (int i = 0; i < 4; ++i) {
+            int nx = x + DX[i];
+            int ny = y + DY[i];
+            if (0 <= nx && nx < N && 0 <= ny && ny < N) {
+                std::swap(conf[x][y], conf[nx][ny]);
+                visit(PuzzleStorage<N>(conf), 1);
+                std::swap(conf[x][y], conf[nx][ny]);
+            }
+        }
+    }
+};
+
+}
+
+class ParallelPuzzleSolverPrivate {
+public:
+    virtual ~ParallelPuzzleSolverPrivate() { }
+    virtual void initialize() = 0;
+    virtual void setWeight(float weight) = 0;
+    virtual bool solve() = 0;
+    virtual void getSolution(int *optimal, vector<int> *pathList) = 0;
+};
+
+namespace {
+
+template<int N>
+class ParallelPuzzleSolverImpl : public ParallelPuzzleSolverPrivate {
+public:
+    ParallelPuzzleSolverImpl(Puzzle *puzzle) : p(puzzle) { }
+
+    void initialize() {
+        m_numThread = vm_options["threads"].as<int>();
+        heuristic.initialize();
+
+        int count = 0;
+        uint8_t targetState[N][N];
+        for (int i = 0; i < N; ++i)
+            for (int j = 0; j < N; ++j)
+                targetState[i][j] = ++count;
+        targetState[N-1][N-1] = 0;
+
+        domain.pdb = &heuristic;
+        domain.targetState = PuzzleStorage<N>(targetState);
+        domain.weight = 1;
+    }
+
+    void setWeight(float weight) {
+        domain.weight = weight;
+    }
+
+    bool solve() {
+        vector<uint8_t> state;
+        p->initialState(state);
+        PuzzleStorage<N> start(
+            *reinterpret_cast<uint8_t(*)[N][N]>(state.data()));
+
+        HDAStar< PuzzleDomain<N> > hda(domain, m_numThread);
+        bool found = hda.solve(start);
+        printf("\t\tNumber of nodes expanded: %d\n", (int)hda.numExpanded());
+        metrics.counter("parallel", "expanded", hda.numExpanded());
+        if (found) {
+            // A reopened node keeps pointing to its best parent, so with a
+            // weighted heuristic the path may be shorter than the incumbent.
+            hda.getPath(&m_path);
+            m_optimal = m_path.size() - 1;
+        }
+        return found;
+    }
+
+    void getSolution(int *optimal, vector<int> *pathList) {
+        *optimal = m_optimal;
+
+        uint8_t cconf[N][N];
+        uint8_t pconf[N][N];
+
+        pathList->clear();
+        for (int k = 1; k < (int)m_path.size(); ++k) {
+            m_path[k].decompose(cconf);
+            m_path[k-1].decompose(pconf);
+
+            int cx, cy;
+            int px, py;
+            getEmptyTile<N>(cconf, &cx, &cy);
+            getEmptyTile<N>(pconf, &px, &py);
+            for (int i = 0; i < 4; ++i)
+                if (px + DX[i] == cx && py + DY[i] == cy)
+                    pathList->push_back(i);
+        }
+    }
+
+private:
+    Puzzle *p;
+    int m_numThread;
+    cpusolver::PuzzleHeuristic<N> heuristic;
+    PuzzleDomain<N> domain;
+
+    int m_optimal;
+    vector< PuzzleStorage<N> > m_path;
+};
+
+}
+
+ParallelPuzzleSolver::ParallelPuzzleSolver(Puzzle *puzzle)
+{
+    switch (puzzle->length()) {
+    case 3:
+        d = new ParallelPuzzleSolverImpl<3>(puzzle);
+        break;
+    case 4:
+        d = new ParallelPuzzleSolverImpl<4>(puzzle);
+        break;
+    case 5:
+        d = new ParallelPuzzleSolverImpl<5>(puzzle);
+        break;
+    default:
+        assert(false);
+    }
+}
+
+ParallelPuzzleSolver::~ParallelPuzzleSolver()
+{
+    delete d;
+}
+
+void ParallelPuzzleSolver::initialize()
+{
+    d->initialize();
+}
+
+void ParallelPuzzleSolver::setWeight(float weight)
+{
+    d->setWeight(weight);
+}
+
+bool ParallelPuzzleSolver::solve()
+{
+    return d->solve();
+}
+
+void ParallelPuzzleSolver::getSolution(int *optimal, vector<int> *pathList)
+{
+    d->getSolution(optimal, pathList);
+}
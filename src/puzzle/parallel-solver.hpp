@@ -0,0 +1,24 @@
+#ifndef __PARALLEL_SOLVER_HPP_B6QH1TUW
+#define __PARALLEL_SOLVER_HPP_B6QH1TUW
+
+#include "puzzle/puzzle.cuh"
+
+// Hash distributed A* on --threads CPU threads, see hda-star.hpp.  The
+// engine needs C++11, so it is built in parallel-solver.cpp and hidden from
+// the nvcc translation units behind this class.
+class ParallelPuzzleSolverPrivate;
+class ParallelPuzzleSolver {
+public:
+    ParallelPuzzleSolver(Puzzle *puzzle);
+    ~ParallelPuzzleSolver();
+    void initialize();
+    // g + weight * h orders the open list of the next solve()
+    void setWeight(float weight);
+    bool solve();
+    void getSolution(int *optimal, vector<int> *pathList);
+
+private:
+    ParallelPuzzleSolverPrivate *d;
+};
+
+#endif /* end of include guard: __PARALLEL_SOLVER_HPP_B6QH1TUW */
@@ -0,0 +1,121 @@
+#include "puzzle/partition.hpp"
+#include "puzzle/database.hpp"
+
+#include <cstring>
+#include <map>
+#include <sstream>
+
+// Korf and Felner's partitions, in the --pdb-partition syntax
+static const char *DEFAULT_PARTITION[6] = {
+    "", "", "",
+    "1,2,3,4,5,6,7,8",
+    "1,2,3,4,5,6,9,13/7,8,10,11,12,14,15",
+    "3,4,5,10,15,20/2,1,6,11,16,21/7,8,9,12,17,22/13,14,18,19,23,24",
+};
+
+static void badPartition(const string &reason)
+{
+    cout << "Please set your pdb-partition parameter correctly: " << reason
+         << endl
+         << "===============================================" << endl
+         << endl;
+    help();
+}
+
+static vector<string> split(const string &s, char delim)
+{
+    vector<string> parts;
+    std::istringstream in(s);
+    string part;
+    while (std::getline(in, part, delim))
+        parts.push_back(part);
+    return parts;
+}
+
+void initializeLayout(int n, pdb_layout_t *layout,
+                      vector< vector<int> > *tracked)
+{
+    assert(3 <= n && n <= 5);
+    string spec = vm_options["pdb-partition"].as<string>();
+    if (spec.empty())
+        spec = DEFAULT_PARTITION[n];
+
+    *layout = pdb_layout_t();
+    layout->mirror = vm_options.count("pdb-mirror") ? 1 : 0;
+    tracked->clear();
+
+    std::map<vector<int>, int> databases;
+    uint64_t entries = 0;
+    int numPattern = 0;
+    vector<string> partitions = split(spec, ';');
+    if (partitions.empty() || (int)partitions.size() > MAX_PARTITION)
+        badPartition("between 1 and " + std::to_string(MAX_PARTITION) +
+                     " partitions are supported");
+
+    memset(layout->tilePattern, -1, sizeof(layout->tilePattern));
+    for (int p = 0; p < (int)partitions.size(); ++p) {
+        layout->partitionBegin[p] = numPattern;
+        vector<bool> used(n*n, false);
+        vector<string> patterns = split(partitions[p], '/');
+        if (patterns.empty())
+            badPartition("empty partition");
+
+        for (int k = 0; k < (int)patterns.size(); ++k) {
+            vector<int> tiles;
+            vector<string> tokens = split(patterns[k], ',');
+            for (int i = 0; i < (int)tokens.size(); ++i) {
+                int tile = 0;
+                try {
+                    tile = boost::lexical_cast<int>(tokens[i]);
+                } catch (boost::bad_lexical_cast &) {
+                    badPartition("`" + tokens[i] + "' is not a tile");
+                }
+                if (tile <= 0 || tile >= n*n)
+                    badPartition("tile " + tokens[i] + " is out of range");
+                if (used[tile])
+                    badPartition("tile " + tokens[i] +
+                                 " is tracked twice by a partition");
+                used[tile] = true;
+                tiles.push_back(tile);
+            }
+            if (tiles.empty() || (int)tiles.size() > MAX_PATTERN_SIZE)
+                badPartition("patterns track between 1 and " +
+                             std::to_string(MAX_PATTERN_SIZE) + " tiles");
+            if (numPattern == MAX_PATTERN)
+                badPartition("at most " + std::to_string(MAX_PATTERN) +
+                             " patterns are supported");
+
+            int id = numPattern++;
+            layout->patternSize[id] = tiles.size();
+            for (int i = 0; i < (int)tiles.size(); ++i) {
+                layout->tile[id][i] = tiles[i];
+                layout->tilePattern[p][tiles[i]] = id;
+            }
+
+            PatternDatabase pd(n, tiles);
+            const vector<uint32_t> &multiple = pd.multiple();
+            for (int i = 0; i < (int)tiles.size(); ++i)
+                layout->multiple[id][i] = multiple[i+1];
+
+            auto it = databases.find(tiles);
+            if (it == databases.end()) {
+                it = databases.emplace(tiles, tracked->size()).first;
+                tracked->push_back(tiles);
+                layout->offset[id] = entries;
+                // even, so that nibbles of two databases never share a byte
+                entries += (pd.size() + 1) / 2 * 2;
+                if (entries > UINT32_MAX)
+                    badPartition("the databases have more than 2^32 states");
+            } else {
+                for (int j = 0; j < id; ++j)
+                    if (layout->database[j] == it->second)
+                        layout->offset[id] = layout->offset[j];
+            }
+            layout->database[id] = it->second;
+        }
+    }
+    layout->numPartition = partitions.size();
+    layout->numPattern = numPattern;
+    layout->partitionBegin[layout->numPartition] = numPattern;
+    layout->incremental = numPattern * (1 + layout->mirror) <= PDB_SLOTS;
+}
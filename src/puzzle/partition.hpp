@@ -0,0 +1,64 @@
+#ifndef __PARTITION_HPP_H6QZ3VNC
+#define __PARTITION_HPP_H6QZ3VNC
+
+// Patterns of the puzzle heuristic, shared by the CPU and the GPU solvers.
+//
+// A partition is a list of disjoint patterns, so their databases add up, and
+// the heuristic is the maximum over the partitions.  With `mirror' it is also
+// the maximum over the reflection of the state about the main diagonal.  The
+// goal is symmetric about that diagonal, so the reflected state is looked up
+// in the same databases, tile (r, c) being renamed to tile (c, r).
+//
+// The partitions come from --pdb-partition, or default to the ones of Korf
+// and Felner for the 15 and the 24 puzzles.
+
+#include "utils.hpp"
+
+const int MAX_PARTITION = 8;
+const int MAX_PATTERN = 16;
+const int MAX_PATTERN_SIZE = 8;
+
+// Values of the patterns a node carries, so that a successor only looks up
+// the patterns of the tile that moved.  Slot m * numPattern + k holds pattern
+// k of the state (m = 0) or of its reflection (m = 1).
+const int PDB_SLOTS = 8;
+struct pdb_values_t {
+    uint8_t h[PDB_SLOTS];
+};
+
+// Flat enough to be copied to the GPU constant memory as is
+struct pdb_layout_t {
+    int numPartition;
+    int numPattern;
+    int mirror;
+    // the patterns of partition p are [partitionBegin[p], partitionBegin[p+1])
+    int partitionBegin[MAX_PARTITION + 1];
+
+    int patternSize[MAX_PATTERN];
+    uint8_t tile[MAX_PATTERN][MAX_PATTERN_SIZE];
+    // Patterns tracking the same tiles share a database.  The databases are
+    // concatenated in the order of their index, and `offset' is the first
+    // entry of the database of a pattern.
+    int database[MAX_PATTERN];
+    uint32_t offset[MAX_PATTERN];
+    // code = sum of the rank of tile i times multiple[i]
+    uint32_t multiple[MAX_PATTERN][MAX_PATTERN_SIZE];
+
+    // pattern of partition p tracking a tile, -1 if none
+    int8_t tilePattern[MAX_PARTITION][5*5];
+    // whether all the values fit in pdb_values_t
+    int incremental;
+};
+
+// Fill `layout' for the n x n puzzle from --pdb-partition and --pdb-mirror,
+// and return the tiles of every database in `tracked'.
+void initializeLayout(int n, pdb_layout_t *layout,
+                      vector< vector<int> > *tracked);
+
+// tile at (c, r) of the goal for the tile at (r, c), 0 for the empty tile
+inline __cuda__ int mirrorTile(int n, int tile)
+{
+    return tile ? (tile - 1) % n * n + (tile - 1) / n + 1 : 0;
+}
+
+#endif /* end of include guard: __PARTITION_HPP_H6QZ3VNC */
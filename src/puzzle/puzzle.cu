@@ -4,18 +4,21 @@
 
 #include "puzzle/CPU-solver.hpp"
 #include "puzzle/GPU-solver.cuh"
+#include "puzzle/GPU-ida-solver.cuh"
+#include "puzzle/parallel-solver.hpp"
+#include "anytime.hpp"
+
+struct solution_t : anytime_solution_t<int> {
+    bool solved;
+
+    solution_t() : solved(false) {}
+};
 
 class PuzzlePrivate {
 public:
-    bool cpuSolved;
-    bool cpuSuccessful;
-    int cpuOptimal;
-    vector<int> cpuSolution;
-
-    bool gpuSolved;
-    bool gpuSuccessful;
-    int gpuOptimal;
-    vector<int> gpuSolution;
+    solution_t cpu;
+    solution_t gpu;
+    solution_t parallel;
 
     cpusolver::CPUPuzzleSolver<3> *c3;
     cpusolver::CPUPuzzleSolver<4> *c4;
@@ -25,7 +28,21 @@ public:
     gpusolver::GPUPuzzleSolver<4> *g4;
     gpusolver::GPUPuzzleSolver<5> *g5;
 
-    PuzzlePrivate() : c3(0), c4(0), c5(0), g3(0), g4(0), g5(0) {}
+    // instead of g3, g4 or g5 under --devices
+    gpusolver::GPUShardedPuzzleSolver<3> *s3;
+    gpusolver::GPUShardedPuzzleSolver<4> *s4;
+    gpusolver::GPUShardedPuzzleSolver<5> *s5;
+
+    // instead of both under --gpu-engine=ida
+    gpusolver::GPUIDAPuzzleSolver<3> *i3;
+    gpusolver::GPUIDAPuzzleSolver<4> *i4;
+    gpusolver::GPUIDAPuzzleSolver<5> *i5;
+
+    ParallelPuzzleSolver *parallelSolver;
+
+    PuzzlePrivate()
+        : c3(0), c4(0), c5(0), g3(0), g4(0), g5(0), s3(0), s4(0), s5(0),
+          i3(0), i4(0), i5(0), parallelSolver(0) {}
     ~PuzzlePrivate() {
         if (c3) delete c3;
         if (c4) delete c4;
@@ -33,6 +50,13 @@ public:
         if (g3) delete g3;
         if (g4) delete g4;
         if (g5) delete g5;
+        if (s3) delete s3;
+        if (s4) delete s4;
+        if (s5) delete s5;
+        if (i3) delete i3;
+        if (i4) delete i4;
+        if (i5) delete i5;
+        if (parallelSolver) delete parallelSolver;
     }
 };
 
@@ -56,18 +80,50 @@ Puzzle::Puzzle()
     }
 
     d = new PuzzlePrivate();
+    bool sharded = deviceOrdinals().size() > 1;
+    string engine = vm_options["gpu-engine"].as<string>();
+    if (engine != "astar" && engine != "ida") {
+        cout << "Please set your gpu-engine parameter correctly." << endl
+            << "==============================================" << endl
+            << endl;
+        help();
+    }
+    bool ida = engine == "ida";
+    // IDA* keeps no open list to bound, spread or order
+    if (ida && (sharded || vm_options["memory-limit"].as<int>() != 0 ||
+                vm_options["open-list"].as<string>() != "heaps" ||
+                vm_options["f-band"].as<float>() >= 0)) {
+        cout << "--gpu-engine=ida cannot be used with --devices, "
+             << "--memory-limit, --open-list or --f-band" << endl;
+        exit(1);
+    }
     switch (n) {
     case 3:
         d->c3 = new cpusolver::CPUPuzzleSolver<3>(this);
-        d->g3 = new gpusolver::GPUPuzzleSolver<3>(this);
+        if (ida)
+            d->i3 = new gpusolver::GPUIDAPuzzleSolver<3>(this);
+        else if (sharded)
+            d->s3 = new gpusolver::GPUShardedPuzzleSolver<3>(this);
+        else
+            d->g3 = new gpusolver::GPUPuzzleSolver<3>(this);
         break;
     case 4:
         d->c4 = new cpusolver::CPUPuzzleSolver<4>(this);
-        d->g4 = new gpusolver::GPUPuzzleSolver<4>(this);
+        if (ida)
+            d->i4 = new gpusolver::GPUIDAPuzzleSolver<4>(this);
+        else if (sharded)
+            d->s4 = new gpusolver::GPUShardedPuzzleSolver<4>(this);
+        else
+            d->g4 = new gpusolver::GPUPuzzleSolver<4>(this);
         break;
     case 5:
         d->c5 = new cpusolver::CPUPuzzleSolver<5>(this);
-        d->g5 = new gpusolver::GPUPuzzleSolver<5>(this);
+        if (ida)
+            d->i5 = new gpusolver::GPUIDAPuzzleSolver<5>(this);
+        else if (sharded)
+            d->s5 = new gpusolver::GPUShardedPuzzleSolver<5>(this);
+        else
+            d->g5 = new gpusolver::GPUPuzzleSolver<5>(this);
         break;
     default:
         cout << "Currently we can only solve N=3~5 puzzle problem" << endl
@@ -75,6 +131,7 @@ Puzzle::Puzzle()
              << endl;
         help();
     }
+    d->parallelSolver = new ParallelPuzzleSolver(this);
 }
 
 Puzzle::~Puzzle()
@@ -116,103 +173,146 @@ void Puzzle::gpuInitialize()
 {
     switch (n) {
     case 3:
-        d->g3->initialize();
+        if (d->i3)
+            d->i3->initialize();
+        else if (d->s3)
+            d->s3->initialize();
+        else
+            d->g3->initialize();
         break;
     case 4:
-        d->g4->initialize();
+        if (d->i4)
+            d->i4->initialize();
+        else if (d->s4)
+            d->s4->initialize();
+        else
+            d->g4->initialize();
         break;
     case 5:
-        d->g5->initialize();
+        if (d->i5)
+            d->i5->initialize();
+        else if (d->s5)
+            d->s5->initialize();
+        else
+            d->g5->initialize();
         break;
     };
 }
 
+void Puzzle::parallelInitialize()
+{
+    d->parallelSolver->initialize();
+}
+
 void Puzzle::cpuSolve()
 {
     switch (n) {
     case 3:
-        d->cpuSuccessful = d->c3->solve();
+        weightedSolve(d->c3, &cpusolver::CPUPuzzleSolver<3>::restart,
+                      true, "CPU", &d->cpu);
         break;
     case 4:
-        d->cpuSuccessful = d->c4->solve();
+        weightedSolve(d->c4, &cpusolver::CPUPuzzleSolver<4>::restart,
+                      true, "CPU", &d->cpu);
         break;
     case 5:
-        d->cpuSuccessful = d->c5->solve();
+        weightedSolve(d->c5, &cpusolver::CPUPuzzleSolver<5>::restart,
+                      true, "CPU", &d->cpu);
         break;
     };
-    d->cpuSolved = true;
+    d->cpu.solved = true;
 }
 
 void Puzzle::gpuSolve()
 {
     switch (n) {
     case 3:
-        d->gpuSuccessful = d->g3->solve();
+        if (d->i3)
+            weightedSolve(d->i3, &gpusolver::GPUIDAPuzzleSolver<3>::restart,
+                          true, "GPU", &d->gpu);
+        else if (d->s3)
+            weightedSolve(d->s3, &gpusolver::GPUShardedPuzzleSolver<3>::restart,
+                          true, "GPU", &d->gpu);
+        else
+            weightedSolve(d->g3, &gpusolver::GPUPuzzleSolver<3>::restart,
+                          &gpusolver::GPUPuzzleSolver<3>::lowerBound,
+                          true, "GPU", &d->gpu);
         break;
     case 4:
-        d->gpuSuccessful = d->g4->solve();
+        if (d->i4)
+            weightedSolve(d->i4, &gpusolver::GPUIDAPuzzleSolver<4>::restart,
+                          true, "GPU", &d->gpu);
+        else if (d->s4)
+            weightedSolve(d->s4, &gpusolver::GPUShardedPuzzleSolver<4>::restart,
+                          true, "GPU", &d->gpu);
+        else
+            weightedSolve(d->g4, &gpusolver::GPUPuzzleSolver<4>::restart,
+                          &gpusolver::GPUPuzzleSolver<4>::lowerBound,
+                          true, "GPU", &d->gpu);
         break;
     case 5:
-        d->gpuSuccessful = d->g5->solve();
+        if (d->i5)
+            weightedSolve(d->i5, &gpusolver::GPUIDAPuzzleSolver<5>::restart,
+                          true, "GPU", &d->gpu);
+        else if (d->s5)
+            weightedSolve(d->s5, &gpusolver::GPUShardedPuzzleSolver<5>::restart,
+                          true, "GPU", &d->gpu);
+        else
+            weightedSolve(d->g5, &gpusolver::GPUPuzzleSolver<5>::restart,
+                          &gpusolver::GPUPuzzleSolver<5>::lowerBound,
+                          true, "GPU", &d->gpu);
         break;
     };
-    d->gpuSolved = true;
+    d->gpu.solved = true;
 }
 
-bool Puzzle::output()
+void Puzzle::parallelSolve()
 {
-    if (d->cpuSolved && d->gpuSolved) {
-        if (d->cpuSuccessful != d->gpuSuccessful)
-            return false;
-    }
+    // solve() always starts over
+    void (ParallelPuzzleSolver::*restart)() = NULL;
+    weightedSolve(d->parallelSolver, restart, false, "CPU threads",
+                  &d->parallel);
+    d->parallel.solved = true;
+}
 
-    if (d->cpuSolved) {
-        if (d->cpuSuccessful) {
-            switch (n) {
-            case 3:
-                d->c3->getSolution(&d->cpuOptimal, &d->cpuSolution);
-                break;
-            case 4:
-                d->c4->getSolution(&d->cpuOptimal, &d->cpuSolution);
-                break;
-            case 5:
-                d->c5->getSolution(&d->cpuOptimal, &d->cpuSolution);
-                break;
-            }
-            printSolution(d->cpuSolution, "solutionCPU.txt");
-        } else {
+bool Puzzle::output()
+{
+    if (d->cpu.solved) {
+        if (d->cpu.successful)
+            printSolution(d->cpu.pathList, "solutionCPU.txt");
+        else
             cout << "No solution from CPU." << endl;
-        }
     }
 
-    if (d->gpuSolved) {
-        if (d->gpuSuccessful) {
-            switch (n) {
-            case 3:
-                d->g3->getSolution(&d->gpuOptimal, &d->gpuSolution);
-                break;
-            case 4:
-                d->g4->getSolution(&d->gpuOptimal, &d->gpuSolution);
-                break;
-            case 5:
-                d->g5->getSolution(&d->gpuOptimal, &d->gpuSolution);
-                break;
-            }
-            printSolution(d->gpuSolution, "solutionGPU.txt");
-        } else {
+    if (d->gpu.solved) {
+        if (d->gpu.successful)
+            printSolution(d->gpu.pathList, "solutionGPU.txt");
+        else if (d->gpu.bounded)
+            cout << "No solution from GPU within the memory limit." << endl;
+        else
             cout << "No solution from GPU." << endl;
-        }
     }
 
-    if (d->cpuSuccessful) {
-        printf(" > Optimal steps from CPU: %d\n", d->cpuOptimal);
-    }
-    if (d->gpuSuccessful) {
-        printf(" > Optimal steps from GPU: %d\n", d->gpuOptimal);
+    if (d->parallel.solved) {
+        if (d->parallel.successful)
+            printSolution(d->parallel.pathList, "solutionThreads.txt");
+        else
+            cout << "No solution from CPU threads." << endl;
     }
 
-    if (d->cpuSolved && d->gpuSolved) {
-        if (d->cpuOptimal != d->gpuOptimal)
+    if (d->cpu.successful)
+        printCost(d->cpu, "CPU");
+    if (d->gpu.successful)
+        printCost(d->gpu, "GPU");
+    if (d->parallel.successful)
+        printCost(d->parallel, "CPU threads");
+
+    if (d->cpu.solved && d->gpu.solved) {
+        if (!matches(d->cpu, d->gpu))
+            return false;
+    }
+    if (d->cpu.solved && d->parallel.solved) {
+        if (!matches(d->cpu, d->parallel))
             return false;
     }
 
@@ -12,8 +12,10 @@ public:
     void prepare();
     void cpuInitialize();
     void gpuInitialize();
+    void parallelInitialize();
     void cpuSolve();
     void gpuSolve();
+    void parallelSolve();
     bool output();
 
     bool inrange(int x, int y) {
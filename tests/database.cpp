@@ -0,0 +1,92 @@
+#include <boost/test/unit_test.hpp>
+
+#include "puzzle/database.hpp"
+#include "tests/options.hpp"
+
+BOOST_AUTO_TEST_SUITE(database)
+
+BOOST_AUTO_TEST_CASE(nibbles_roundtrip)
+{
+    uint8_t values[5] = {0, 7, 15, 3, 9};
+    uint8_t packed[3];
+    BOOST_CHECK_EQUAL(packNibbles(values, 5, packed), 0u);
+    BOOST_CHECK_EQUAL(packed[0], 0x70);
+    BOOST_CHECK_EQUAL(packed[2], 0x09);
+    for (int i = 0; i < 5; ++i)
+        BOOST_CHECK_EQUAL(pdbNibble(packed, i), values[i]);
+}
+
+BOOST_AUTO_TEST_CASE(nibbles_saturate)
+{
+    uint8_t values[4] = {16, 0xFF, 200, 15};
+    uint8_t packed[2];
+    BOOST_CHECK_EQUAL(packNibbles(values, 4, packed), 2u);
+    BOOST_CHECK_EQUAL(pdbNibble(packed, 0), 15);
+    BOOST_CHECK_EQUAL(pdbNibble(packed, 1), 0);
+    BOOST_CHECK_EQUAL(pdbNibble(packed, 2), 15);
+    BOOST_CHECK_EQUAL(pdbNibble(packed, 3), 15);
+}
+
+BOOST_AUTO_TEST_CASE(encoding_roundtrip)
+{
+    setOptions();
+    vector<int> tracked = {1, 2, 5};
+    PatternDatabase pd(3, tracked);
+    BOOST_CHECK_EQUAL(pd.size(), 9u * 8 * 7);
+    BOOST_CHECK_EQUAL(pd.format(), PDB_BYTES);
+
+    vector<bool> seen(pd.size(), false);
+    uint8_t state[MAX_CONF];
+    for (uint32_t code = 0; code < pd.size(); ++code) {
+        pd.decoding(code, state);
+        uint32_t again = pd.encoding(state);
+        BOOST_REQUIRE_EQUAL(again, code);
+        seen[again] = true;
+    }
+    BOOST_CHECK(std::find(seen.begin(), seen.end(), false) == seen.end());
+}
+
+BOOST_AUTO_TEST_CASE(multiple)
+{
+    setOptions();
+    vector<int> tracked = {3, 4, 8};
+    PatternDatabase pd(4, tracked);
+    const vector<uint32_t> &multiple = pd.multiple();
+    BOOST_REQUIRE_EQUAL(multiple.size(), 4u);
+    BOOST_CHECK_EQUAL(multiple[0], 16u * 15 * 14);
+    BOOST_CHECK_EQUAL(multiple[1], 15u * 14);
+    BOOST_CHECK_EQUAL(multiple[2], 14u);
+    BOOST_CHECK_EQUAL(multiple[3], 1u);
+}
+
+BOOST_AUTO_TEST_CASE(eight_puzzle)
+{
+    // the full pattern of the 8 puzzle: half of the states are reachable, the
+    // farthest ones in 31 moves
+    setOptions();
+    vector<int> tracked = {1, 2, 3, 4, 5, 6, 7, 8};
+    PatternDatabase pd(3, tracked);
+    vector<uint8_t> out(pd.size());
+    pd.genDatabase(out.data());
+
+    uint8_t goal[MAX_CONF] = {1, 2, 3, 4, 5, 6, 7, 8, 0};
+    BOOST_CHECK_EQUAL(out[pd.encoding(goal)], 0);
+    size_t reachable = 0;
+    int farthest = 0;
+    for (uint8_t v : out)
+        if (v != 0xFF) {
+            ++reachable;
+            farthest = max(farthest, (int)v);
+        }
+    BOOST_CHECK_EQUAL(reachable, pd.size() / 2);
+    BOOST_CHECK_EQUAL(farthest, 31);
+}
+
+BOOST_AUTO_TEST_CASE(bad_format)
+{
+    setOptions({"--pdb-format", "words"});
+    vector<int> tracked = {1};
+    BOOST_CHECK_THROW(PatternDatabase(3, tracked), runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,46 @@
+#include <boost/test/unit_test.hpp>
+
+#include "pathway/hierarchy.hpp"
+
+namespace {
+
+// entrances of a border given as a string, '1' for an open pair
+vector<int> entrances(const string &border)
+{
+    return borderEntrances(border.size(), [&](int i) {
+        return border[i] == '1';
+    });
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(hierarchy)
+
+BOOST_AUTO_TEST_CASE(closed)
+{
+    BOOST_CHECK(entrances("").empty());
+    BOOST_CHECK(entrances("0000").empty());
+}
+
+BOOST_AUTO_TEST_CASE(short_runs)
+{
+    // one entrance in the middle, the lower one for an even run
+    BOOST_CHECK(entrances("1") == vector<int>({0}));
+    BOOST_CHECK(entrances("0110") == vector<int>({1}));
+    BOOST_CHECK(entrances("0111110") == vector<int>({3}));
+}
+
+BOOST_AUTO_TEST_CASE(long_runs)
+{
+    // one at each end from ENTRANCE_SPLIT on, up to the end of the border
+    BOOST_CHECK(entrances(string(ENTRANCE_SPLIT, '1')) ==
+                vector<int>({0, ENTRANCE_SPLIT - 1}));
+    BOOST_CHECK(entrances("0011111111") == vector<int>({2, 9}));
+}
+
+BOOST_AUTO_TEST_CASE(several_runs)
+{
+    BOOST_CHECK(entrances("1101100111111") == vector<int>({0, 3, 7, 12}));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,31 @@
+// Host unit tests of the pure helpers, built without CUDA
+
+#define BOOST_TEST_MODULE uastar
+#include <boost/test/included/unit_test.hpp>
+
+#include "tests/options.hpp"
+
+#include <boost/program_options.hpp>
+
+boost::program_options::variables_map vm_options;
+boost::mt19937 random_engine;
+bool debug;
+
+// The options are rejected by throwing instead of exiting
+void help()
+{
+    throw runtime_error("help");
+}
+
+void setOptions(const vector<string> &args)
+{
+    namespace po = boost::program_options;
+    po::options_description desc;
+    desc.add_options()
+        ("pdb-format", po::value<string>()->default_value("bytes"), "")
+        ("pdb-partition", po::value<string>()->default_value(""), "")
+        ("pdb-mirror", "");
+    vm_options.clear();
+    po::store(po::command_line_parser(args).options(desc).run(), vm_options);
+    po::notify(vm_options);
+}
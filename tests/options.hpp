@@ -0,0 +1,9 @@
+#ifndef __OPTIONS_HPP_T2KD8WQE
+#define __OPTIONS_HPP_T2KD8WQE
+
+#include "utils.hpp"
+
+// Parse `args' into vm_options from the options the tested code reads
+void setOptions(const vector<string> &args = vector<string>());
+
+#endif /* end of include guard: __OPTIONS_HPP_T2KD8WQE */
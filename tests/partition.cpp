@@ -0,0 +1,82 @@
+#include <boost/test/unit_test.hpp>
+
+#include "puzzle/partition.hpp"
+#include "tests/options.hpp"
+
+BOOST_AUTO_TEST_SUITE(partition)
+
+BOOST_AUTO_TEST_CASE(default_15_puzzle)
+{
+    setOptions();
+    pdb_layout_t layout;
+    vector< vector<int> > tracked;
+    initializeLayout(4, &layout, &tracked);
+    BOOST_CHECK_EQUAL(layout.numPartition, 1);
+    BOOST_CHECK_EQUAL(layout.numPattern, 2);
+    BOOST_CHECK_EQUAL(layout.mirror, 0);
+    BOOST_CHECK_EQUAL(layout.patternSize[0], 8);
+    BOOST_CHECK_EQUAL(layout.patternSize[1], 7);
+    BOOST_REQUIRE_EQUAL(tracked.size(), 2u);
+    BOOST_CHECK_EQUAL(layout.offset[0], 0u);
+    // 16! / 8! states, even already
+    BOOST_CHECK_EQUAL(layout.offset[1], 518918400u);
+    BOOST_CHECK_EQUAL(layout.tilePattern[0][1], 0);
+    BOOST_CHECK_EQUAL(layout.tilePattern[0][7], 1);
+    BOOST_CHECK_EQUAL(layout.tilePattern[0][0], -1);
+    BOOST_CHECK_EQUAL(layout.multiple[0][7], 1u);
+    BOOST_CHECK(layout.incremental);
+}
+
+BOOST_AUTO_TEST_CASE(default_24_puzzle_mirror)
+{
+    setOptions({"--pdb-mirror"});
+    pdb_layout_t layout;
+    vector< vector<int> > tracked;
+    initializeLayout(5, &layout, &tracked);
+    BOOST_CHECK_EQUAL(layout.numPattern, 4);
+    BOOST_CHECK_EQUAL(layout.mirror, 1);
+    BOOST_CHECK_EQUAL(tracked.size(), 4u);
+    // 4 patterns of the state and 4 of its reflection
+    BOOST_CHECK(layout.incremental);
+}
+
+BOOST_AUTO_TEST_CASE(shared_database)
+{
+    setOptions({"--pdb-partition", "1,2/3;1,2"});
+    pdb_layout_t layout;
+    vector< vector<int> > tracked;
+    initializeLayout(3, &layout, &tracked);
+    BOOST_CHECK_EQUAL(layout.numPartition, 2);
+    BOOST_CHECK_EQUAL(layout.numPattern, 3);
+    BOOST_CHECK_EQUAL(layout.partitionBegin[1], 2);
+    BOOST_REQUIRE_EQUAL(tracked.size(), 2u);
+    BOOST_CHECK_EQUAL(layout.database[2], layout.database[0]);
+    BOOST_CHECK_EQUAL(layout.offset[2], layout.offset[0]);
+    BOOST_CHECK_EQUAL(layout.offset[1], 9u * 8);
+    BOOST_CHECK_EQUAL(layout.tilePattern[1][3], -1);
+}
+
+BOOST_AUTO_TEST_CASE(bad_partition)
+{
+    const char *specs[] = {"1,1", "9", "0", "a", "1//2", "1;;2"};
+    pdb_layout_t layout;
+    vector< vector<int> > tracked;
+    for (const char *spec : specs) {
+        setOptions({"--pdb-partition", spec});
+        BOOST_CHECK_THROW(initializeLayout(3, &layout, &tracked),
+                          runtime_error);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mirror_tile)
+{
+    BOOST_CHECK_EQUAL(mirrorTile(4, 0), 0);
+    BOOST_CHECK_EQUAL(mirrorTile(4, 2), 5);
+    BOOST_CHECK_EQUAL(mirrorTile(4, 6), 6);
+    BOOST_CHECK_EQUAL(mirrorTile(5, 5), 21);
+    for (int n = 3; n <= 5; ++n)
+        for (int tile = 0; tile < n*n; ++tile)
+            BOOST_CHECK_EQUAL(mirrorTile(n, mirrorTile(n, tile)), tile);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,95 @@
+#include <boost/test/unit_test.hpp>
+
+#include "pathway/pruning.hpp"
+
+#include <set>
+
+namespace {
+
+const int DX[8] = {1, -1, 0, 0, 1, 1, -1, -1};
+const int DY[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+
+// 5 x 5 grid with blocked cells
+struct grid_t {
+    std::set< pair<int, int> > blocked;
+
+    bool canMove(int x, int y, int dx, int dy) const
+    {
+        int nx = x + dx;
+        int ny = y + dy;
+        return 0 <= nx && nx < 5 && 0 <= ny && ny < 5 &&
+               !blocked.count(make_pair(nx, ny));
+    }
+
+    uint8_t prune(int x, int y, int px, int py) const
+    {
+        uint8_t mask = 0;
+        for (int i = 0; i < 8; ++i)
+            if (canMove(x, y, DX[i], DY[i]))
+                mask |= 1 << i;
+        return pruneMoves(*this, x, y, px, py, mask, DX, DY);
+    }
+};
+
+// mask of the moves to the cells of `to'
+uint8_t moves(int x, int y, std::initializer_list< pair<int, int> > to)
+{
+    uint8_t mask = 0;
+    for (auto n : to)
+        for (int i = 0; i < 8; ++i)
+            if (x + DX[i] == n.first && y + DY[i] == n.second)
+                mask |= 1 << i;
+    return mask;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(pruning)
+
+BOOST_AUTO_TEST_CASE(move_cost)
+{
+    BOOST_CHECK_EQUAL(moveCost(1, 0), 1);
+    BOOST_CHECK_EQUAL(moveCost(0, -1), 1);
+    BOOST_CHECK_EQUAL(moveCost(-1, 1), SQRT2);
+}
+
+BOOST_AUTO_TEST_CASE(open_straight)
+{
+    // the natural neighbour and its two diagonals tie with their detours
+    grid_t grid;
+    BOOST_CHECK_EQUAL(grid.prune(2, 2, 1, 2),
+                      moves(2, 2, {{3, 1}, {3, 2}, {3, 3}}));
+}
+
+BOOST_AUTO_TEST_CASE(open_diagonal)
+{
+    grid_t grid;
+    BOOST_CHECK_EQUAL(grid.prune(2, 2, 1, 1),
+                      moves(2, 2, {{3, 3}, {3, 2}, {2, 3}}));
+}
+
+BOOST_AUTO_TEST_CASE(forced)
+{
+    // the detour to (3, 1) through (2, 1) is blocked
+    grid_t grid;
+    grid.blocked.insert(make_pair(2, 1));
+    BOOST_CHECK_EQUAL(grid.prune(2, 2, 1, 1),
+                      moves(2, 2, {{3, 3}, {3, 2}, {2, 3}, {3, 1}}));
+}
+
+BOOST_AUTO_TEST_CASE(detour)
+{
+    grid_t grid;
+    // back to the parent
+    BOOST_CHECK(hasDetour(grid, 1, 2, 2, 2, 1, 2, 0));
+    // (1, 2) -> (1, 3) costs 1 < 2
+    BOOST_CHECK(hasDetour(grid, 1, 2, 2, 2, 1, 3, 2));
+    BOOST_CHECK(!hasDetour(grid, 1, 2, 2, 2, 1, 3, 1));
+    // (1, 2) -> (2, 3) -> (3, 3) costs 1 + sqrt(2), not less
+    BOOST_CHECK(!hasDetour(grid, 1, 2, 2, 2, 3, 3, 1 + SQRT2));
+    BOOST_CHECK(hasDetour(grid, 1, 2, 2, 2, 3, 3, 1 + SQRT2 + 0.01f));
+    grid.blocked.insert(make_pair(2, 3));
+    BOOST_CHECK(!hasDetour(grid, 1, 2, 2, 2, 3, 3, 1 + SQRT2 + 0.01f));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,285 @@
+#!/bin/env python3
+
+"""Benchmark uastar over a fixed corpus and compare it with a baseline.
+
+Every case of the corpus (zigzag maps, seeded random maps, 15-puzzle and
+24-puzzle instances) is solved by every backend, one uastar run each, and
+the --metrics dump of the run gives the time to the first solution, the
+total time, the expansion rate, the peak device memory and the cost found.
+A solution is optimal when its cost meets its lower bound and agrees with
+the other backends.
+
+The results are compared with the stored baseline: a slower solve, a lower
+expansion rate or a different cost is a regression, and the exit status is
+1.  A missing baseline is an error too.  --update-baseline stores the
+results of this run as the new baseline.
+
+The puzzle instances are in bench/puzzle15.txt and bench/puzzle24.txt, one
+state per line (0 is the blank, the goal is 1 2 ... 0).  The 15-puzzle set
+is the 100 instances of Korf (1985), turned by 180 degrees and with the
+tiles t numbered 16 - t, since his goal has the blank first.  The 24-puzzle
+set is generated, --generate writes it again from its fixed seed.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+CORPUS_DIR = os.path.join(HERE, 'bench')
+
+# seed and size of the generated puzzle instances
+PUZZLE24_SEED, PUZZLE24_COUNT, PUZZLE24_WALK = 24, 20, 60
+
+# name -> (problem, extra options, metrics solver)
+BACKENDS = {
+    'cpu': ('any', ['--no-gpu'], 'cpu'),
+    'gpu': ('any', ['--no-cpu'], 'gpu'),
+    'gpu-hash': ('pathway', ['--no-cpu', '--dedup', 'hash'], 'gpu'),
+    'gpu-compact': ('pathway', ['--no-cpu', '--node-layout', 'compact'],
+                    'gpu'),
+    'gpu-bidirectional': ('pathway', ['--no-cpu', '--bidirectional'], 'gpu'),
+    'gpu-jump-pruning': ('pathway', ['--no-cpu', '--jump-pruning'], 'gpu'),
+    'gpu-band': ('any', ['--no-cpu', '--f-band', '2'], 'gpu'),
+    'gpu-poll': ('any', ['--no-cpu', '--poll-interval', '8'], 'gpu'),
+    'gpu-buckets': ('puzzle', ['--no-cpu', '--open-list', 'buckets'], 'gpu'),
+    'gpu-ida': ('puzzle', ['--no-cpu', '--gpu-engine', 'ida'], 'gpu'),
+    'threads': ('any', ['--no-cpu', '--no-gpu', '--threads',
+                        str(os.cpu_count() or 1)], 'parallel'),
+}
+
+
+class Random:
+    """xorshift64*, so that the corpus does not depend on the Python version"""
+
+    def __init__(self, seed):
+        self.state = (seed * 0x9E3779B97F4A7C15 + 1) & (2**64 - 1)
+
+    def below(self, n):
+        x = self.state
+        x ^= x >> 12
+        x ^= (x << 25) & (2**64 - 1)
+        x ^= x >> 27
+        self.state = x
+        return ((x * 0x2545F4914F6CDD1D) & (2**64 - 1)) % n
+
+
+def goal_state(n):
+    return list(range(1, n * n)) + [0]
+
+
+def walked_states(n, count, walk, seed):
+    """States `walk' random moves away from the goal, never undoing a move"""
+    rng = Random(seed)
+    states = []
+    for _ in range(count):
+        state = goal_state(n)
+        blank, last = n * n - 1, None
+        for _ in range(walk):
+            x, y = divmod(blank, n)
+            moves = [(x + dx, y + dy) for dx, dy in
+                     ((1, 0), (-1, 0), (0, 1), (0, -1))
+                     if 0 <= x + dx < n and 0 <= y + dy < n and
+                     (x + dx) * n + y + dy != last]
+            nx, ny = moves[rng.below(len(moves))]
+            last, blank = blank, nx * n + ny
+            state[last], state[blank] = state[blank], state[last]
+        states.append(state)
+    return states
+
+
+def corpus_file(name):
+    return os.path.join(CORPUS_DIR, name)
+
+
+def generate():
+    os.makedirs(CORPUS_DIR, exist_ok=True)
+    states = walked_states(5, PUZZLE24_COUNT, PUZZLE24_WALK, PUZZLE24_SEED)
+    with open(corpus_file('puzzle24.txt'), 'w') as f:
+        for state in states:
+            f.write(' '.join(map(str, state)) + '\n')
+
+
+def read_states(name):
+    with open(corpus_file(name)) as f:
+        return [line.split() for line in f if line.strip()]
+
+
+def corpus(suite):
+    """[(name, problem, options, stdin)]"""
+    quick = suite == 'quick'
+    cases = []
+    for size in ((500, 1000) if quick else (500, 1000, 2000, 4000)):
+        cases.append(('zigzag-%d' % size, 'pathway',
+                      ['--pathway', '-H', str(size), '-W', str(size),
+                       '--input-module', 'zigzag'], ''))
+    for size in ((1000,) if quick else (1000, 4000)):
+        for rate in (20, 30):
+            for seed in ((1,) if quick else (1, 2, 3)):
+                cases.append(('random-%d-b%d-s%d' % (size, rate, seed),
+                              'pathway',
+                              ['--pathway', '-H', str(size), '-W', str(size),
+                               '--input-module', 'random',
+                               '--block-rate', str(rate),
+                               '--seed', str(seed)], ''))
+    for name, n, count in (('puzzle15', 4, 10), ('puzzle24', 5, 5)):
+        states = read_states(name + '.txt')
+        for i, state in enumerate(states[:count] if quick else states):
+            cases.append(('%s-%03d' % (name, i + 1), 'puzzle',
+                          ['--puzzle', '-W', str(n)], ' '.join(state) + '\n'))
+    return cases
+
+
+def run(uastar, options, stdin, solver, timeout):
+    with tempfile.TemporaryDirectory() as tmp:
+        dump = os.path.join(tmp, 'metrics.json')
+        start = time.time()
+        try:
+            proc = subprocess.run([uastar] + options + ['--metrics', dump],
+                                  input=stdin, capture_output=True,
+                                  text=True, timeout=timeout)
+        except subprocess.TimeoutExpired:
+            return {'status': 'timeout'}
+        wall = (time.time() - start) * 1000
+        if proc.returncode != 0 or not os.path.exists(dump):
+            return {'status': 'failed'}
+        with open(dump) as f:
+            metrics = json.load(f)
+
+    counters = {c['name']: c['value'] for c in metrics['counters']
+                if c['solver'] == solver}
+    phases = {p['name']: p['ms'] for p in metrics['phases']}
+    result = {
+        'status': 'solved' if counters.get('solved') else 'unsolved',
+        'total_ms': sum(phases.values()),
+        'wall_ms': wall,
+        'solve_ms': phases.get(solver + '_solve'),
+    }
+    for name in ('first_solution_ms', 'expanded', 'expand_rate',
+                 'device_memory_mb', 'cost', 'lower_bound'):
+        if name in counters:
+            result[name] = counters[name]
+    if 'cost' in result:
+        result['optimal'] = \
+            result['cost'] <= result['lower_bound'] * (1 + 1e-6) + 1e-6
+    return result
+
+
+def regressions(result, base, tolerance):
+    """What got worse than the baseline `base'"""
+    found = []
+    if base.get('status') == 'solved' and result['status'] != 'solved':
+        found.append(result['status'])
+    if result['status'] != 'solved' or base.get('status') != 'solved':
+        return found
+    # below 50 ms the times are mostly noise
+    if result['solve_ms'] > max(base['solve_ms'] * (1 + tolerance),
+                                base['solve_ms'] + 50):
+        found.append('solve %.0f ms > %.0f ms' %
+                     (result['solve_ms'], base['solve_ms']))
+    if 'expand_rate' in base and \
+            result.get('expand_rate', 0) < base['expand_rate'] * \
+            (1 - tolerance):
+        found.append('rate %.3g < %.3g' %
+                     (result.get('expand_rate', 0), base['expand_rate']))
+    cost = result.get('cost')
+    if 'cost' in base and \
+            (cost is None or
+             abs(cost - base['cost']) > 1e-3 * max(1, base['cost'])):
+        found.append('cost %s != %g' % (cell(cost, '%g'), base['cost']))
+    return found
+
+
+def cell(value, fmt):
+    return '-' if value is None else fmt % value
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--uastar', default='./uastar',
+                        help='the uastar binary')
+    parser.add_argument('--baseline', default=corpus_file('baseline.json'))
+    parser.add_argument('--update-baseline', action='store_true')
+    parser.add_argument('--suite', choices=('quick', 'full'),
+                        default='quick')
+    parser.add_argument('--backends', default=','.join(BACKENDS),
+                        help='comma separated, among ' + ', '.join(BACKENDS))
+    parser.add_argument('--tolerance', type=float, default=0.25,
+                        help='relative slowdown reported as a regression')
+    parser.add_argument('--timeout', type=float, default=600,
+                        help='seconds for one run')
+    parser.add_argument('--generate', action='store_true',
+                        help='write the 24-puzzle instances again and exit')
+    args = parser.parse_args()
+
+    if args.generate:
+        generate()
+        return 0
+
+    backends = args.backends.split(',')
+    for backend in backends:
+        if backend not in BACKENDS:
+            parser.error('unknown backend ' + backend)
+
+    baseline = {}
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    elif not args.update_baseline:
+        print('No baseline %s, write one with --update-baseline' %
+              args.baseline)
+        return 1
+
+    results = {}
+    failures = 0
+    print('%-22s %-18s %-8s %10s %10s %10s %10s %8s %10s %s' % (
+        'case', 'backend', 'status', 'first ms', 'solve ms', 'total ms',
+        'rate/s', 'dev MB', 'cost', 'notes'))
+    for name, problem, options, stdin in corpus(args.suite):
+        costs = []
+        for backend in backends:
+            kind, extra, solver = BACKENDS[backend]
+            if kind not in ('any', problem):
+                continue
+            key = name + '/' + backend
+            result = run(args.uastar, options + extra, stdin, solver,
+                         args.timeout)
+            results[key] = result
+
+            notes = regressions(result, baseline.get(key, {}),
+                                args.tolerance)
+            if result.get('optimal') is False:
+                notes.append('not optimal')
+            if 'cost' in result:
+                costs.append(result['cost'])
+                if abs(result['cost'] - costs[0]) > 1e-3 * max(1, costs[0]):
+                    notes.append('disagrees with the other backends')
+            failures += bool(notes)
+            print('%-22s %-18s %-8s %10s %10s %10s %10s %8s %10s %s' % (
+                name, backend, result['status'],
+                cell(result.get('first_solution_ms'), '%.1f'),
+                cell(result.get('solve_ms'), '%.1f'),
+                cell(result.get('total_ms'), '%.1f'),
+                cell(result.get('expand_rate'), '%.3g'),
+                cell(result.get('device_memory_mb'), '%.0f'),
+                cell(result.get('cost'), '%g'),
+                '; '.join(notes)))
+            sys.stdout.flush()
+
+    if args.update_baseline:
+        with open(args.baseline, 'w') as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+        print('Baseline written to %s' % args.baseline)
+        return 0
+    if failures:
+        print('%d runs regressed' % failures)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())